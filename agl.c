@@ -44,6 +44,7 @@
 #include "dpxutil.h"
 
 #include "dpxfile.h"
+#include "dpxthread.h"
 
 #include "unicode.h"
 
@@ -359,7 +360,12 @@ agl_normalized_name (char *glyphname)
   return agln;
 }
 
+/* Loaded once and shared by all open documents */
 static struct ht_table aglmap;
+static int             aglmap_users = 0;
+static dpx_rwlock      aglmap_lock  = DPX_RWLOCK_INITIALIZER;
+
+static int load_listfile (const char *filename, int is_predef);
 
 static void CDECL
 hval_free (void *hval)
@@ -370,26 +376,46 @@ hval_free (void *hval)
 void
 agl_init_map (void)
 {
-  texpdf_ht_init_table(&aglmap, hval_free);
-  agl_load_listfile(AGL_EXTRA_LISTFILE, 0);
-  if (agl_load_listfile(AGL_PREDEF_LISTFILE, 1) < 0) {
-    WARN("Failed to load AGL file \"%s\"...", AGL_PREDEF_LISTFILE);
-  }
-  if (agl_load_listfile(AGL_DEFAULT_LISTFILE, 0) < 0) {
-    WARN("Failed to load AGL file \"%s\"...", AGL_DEFAULT_LISTFILE);
+  dpx_write_lock(&aglmap_lock);
+  if (aglmap_users++ == 0) {
+    texpdf_ht_init_table(&aglmap, hval_free);
+    load_listfile(AGL_EXTRA_LISTFILE, 0);
+    if (load_listfile(AGL_PREDEF_LISTFILE, 1) < 0) {
+      WARN("Failed to load AGL file \"%s\"...", AGL_PREDEF_LISTFILE);
+    }
+    if (load_listfile(AGL_DEFAULT_LISTFILE, 0) < 0) {
+      WARN("Failed to load AGL file \"%s\"...", AGL_DEFAULT_LISTFILE);
+    }
   }
+  dpx_unlock(&aglmap_lock);
 }
 
 void
 agl_close_map (void)
 {
-  texpdf_ht_clear_table(&aglmap);
+  dpx_write_lock(&aglmap_lock);
+  if (aglmap_users > 0 && --aglmap_users == 0)
+    texpdf_ht_clear_table(&aglmap);
+  dpx_unlock(&aglmap_lock);
 }
 
 #define WBUF_SIZE 1024
 
 int
 agl_load_listfile (const char *filename, int is_predef)
+{
+  int count;
+
+  dpx_write_lock(&aglmap_lock);
+  count = load_listfile(filename, is_predef);
+  dpx_unlock(&aglmap_lock);
+
+  return count;
+}
+
+/* Called with the write lock held. */
+static int
+load_listfile (const char *filename, int is_predef)
 {
   int   count = 0;
   const char *p, *endptr;
@@ -509,7 +535,9 @@ agl_lookup_list (const char *glyphname)
   if (!glyphname)
     return NULL;
 
+  dpx_read_lock(&aglmap_lock);
   agln = texpdf_ht_lookup_table(&aglmap, glyphname, strlen(glyphname));
+  dpx_unlock(&aglmap_lock);
 
   return agln;
 }
@@ -28,6 +28,7 @@
 #include "mem.h"
 #include "error.h"
 #include "mfileio.h"
+#include "fontcache.h"
 
 #include "cff_limits.h"
 #include "cff_types.h"
@@ -64,6 +65,7 @@ cff_font *cff_open(FILE *stream, long offset, int n)
   cff->fontname = NULL;
   cff->index    = n;
   cff->stream   = stream;
+  cff->file     = font_cache_open(stream);
   cff->offset   = offset;
   cff->filter   = 0;      /* not used */
   cff->flag     = 0;
@@ -220,6 +222,7 @@ cff_close (cff_font *cff)
     }
     if (cff->_string)
       cff_release_index(cff->_string);
+    font_cache_release(cff->file);
 
     RELEASE(cff);
   }
@@ -284,12 +287,38 @@ cff_put_header (cff_font *cff, card8 *dest, long destlen)
   return 4;
 }
 
-/* Only read header part but not body */
+static void
+index_free (void *idx)
+{
+  cff_release_index(idx);
+}
+
+/* Only read header part but not body
+ *
+ * The offsets are kept in the font cache with the font file, so that
+ * the CharStrings INDEX of a font used by many documents is read once.
+ */
 cff_index *
 cff_get_index_header (cff_font *cff)
 {
-  cff_index *idx;
+  cff_index *idx, *cached;
   card16     i, count;
+  long       pos;
+
+  pos    = tell_position(cff->stream);
+  cached = font_cache_find_table(cff->file, "CFFi", pos, 0);
+  if (cached) {
+    idx = NEW(1, cff_index);
+    idx->count   = cached->count;
+    idx->offsize = cached->offsize;
+    idx->offset  = NEW(cached->count + 1, l_offset);
+    memcpy(idx->offset, cached->offset, (cached->count + 1) * sizeof(l_offset));
+    idx->data    = NULL;
+    seek_absolute(cff->stream,
+                  pos + 3 + (cached->count + 1) * cached->offsize);
+    font_cache_release(cff->file);
+    return idx;
+  }
 
   idx = NEW(1, cff_index);
 
@@ -312,6 +341,18 @@ cff_get_index_header (cff_font *cff)
       ERROR("cff_get_index(): invalid index data");
 
     idx->data = NULL;
+    if (cff->file) {
+      cached = NEW(1, cff_index);
+      cached->count   = count;
+      cached->offsize = idx->offsize;
+      cached->offset  = NEW(count + 1, l_offset);
+      memcpy(cached->offset, idx->offset, (count + 1) * sizeof(l_offset));
+      cached->data    = NULL;
+      font_cache_add_table(cff->file, "CFFi", pos, 0, cached,
+                           sizeof(cff_index) + (count + 1) * sizeof(l_offset),
+                           index_free);
+      font_cache_release(cff->file);
+    }
   } else {
     idx->offsize = 0;
     idx->offset = NULL;
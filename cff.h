@@ -72,6 +72,7 @@ typedef struct
   cff_index  *_string;
 
   FILE         *stream;
+  struct font_file *file; /* in the font cache, or NULL */
 
   int           filter;   /* not used, ASCII Hex filter if needed */
 
@@ -35,6 +35,7 @@
 
 #include "error.h"
 #include "mem.h"
+#include "dpxthread.h"
 
 #ifndef CFF_DEBUG_STR
 #define CFF_DEBUG_STR "CFF"
@@ -100,8 +101,8 @@ void cff_release_dict (cff_dict *dict)
  */
 
 #define CFF_DICT_STACK_LIMIT 64
-static int    stack_top = 0;
-static double arg_stack[CFF_DICT_STACK_LIMIT];
+static DPX_THREAD_LOCAL int    stack_top = 0;
+static DPX_THREAD_LOCAL double arg_stack[CFF_DICT_STACK_LIMIT];
 
 /*
  * CFF DICT encoding:
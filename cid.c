@@ -33,6 +33,7 @@
 #include "mem.h"
 #include "error.h"
 #include "dpxutil.h"
+#include "dpxthread.h"
 
 #include "pdfobj.h"
 
@@ -40,6 +41,7 @@
 #include "cidtype2.h"
 #include "cid_p.h"
 #include "cid.h"
+#include "pdffont.h"
 
 #include "cff.h"
 
@@ -211,6 +213,15 @@ CIDFont_get_ident (CIDFont *font)
   return font->ident;
 }
 
+/* Maps glyph indexes to CIDs for CFF-based fonts, or NULL */
+void *
+CIDFont_get_cff_charsets (CIDFont *font)
+{
+  ASSERT(font);
+
+  return font->options ? font->options->cff_charsets : NULL;
+}
+
 int
 CIDFont_get_opt_index (CIDFont *font)
 {
@@ -512,7 +523,10 @@ struct FontCache {
   CIDFont **fonts;
 };
 
-static struct FontCache *__cache   = NULL;
+/* CIDFonts of the document selected on this thread, made along with its
+ * Type0 fonts, see Type0Font_cache_init()
+ */
+static DPX_THREAD_LOCAL struct FontCache *__cache = NULL;
 
 #define CHECK_ID(n) do {\
                         if (! __cache)\
@@ -521,17 +535,23 @@ static struct FontCache *__cache   = NULL;
                            ERROR("%s: Invalid ID %d", CIDFONT_DEBUG_STR, (n));\
                     } while (0)
 
-void
+struct FontCache *
 CIDFont_cache_init (void)
 {
-  if (__cache)
-    ERROR("%s: Already initialized.", CIDFONT_DEBUG_STR);
+  struct FontCache *cache = NEW(1, struct FontCache);
 
-  __cache = NEW(1, struct FontCache);
+  cache->max  = CACHE_ALLOC_SIZE;
+  cache->fonts = NEW(cache->max, struct CIDFont *);
+  cache->num  = 0;
+  CIDFont_cache_select(cache);
 
-  __cache->max  = CACHE_ALLOC_SIZE;
-  __cache->fonts = NEW(__cache->max, struct CIDFont *);
-  __cache->num  = 0;
+  return cache;
+}
+
+void
+CIDFont_cache_select (struct FontCache *cache)
+{
+  __cache = cache;
 }
 
 CIDFont *
@@ -553,7 +573,7 @@ CIDFont_cache_find (const char *map_name,
   cid_opt *opt     = NULL;
 
   if (!__cache)
-    CIDFont_cache_init();
+    ERROR("%s: CIDFont cache not initialized.", CIDFONT_DEBUG_STR);
 
   opt  = NEW(1, cid_opt);
   opt->style = fmap_opt->style;
@@ -642,8 +662,6 @@ CIDFont_cache_find (const char *map_name,
       font->options = opt;
       __cache->fonts[font_id] = font;
       (__cache->num)++;
-
-      fmap_opt->cff_charsets = opt->cff_charsets;
     }
   } else if (opt) {
     release_opt(opt);
@@ -652,12 +670,32 @@ CIDFont_cache_find (const char *map_name,
   return font_id;
 }
 
+static void
+CIDFont_dofont_job (void *font)
+{
+  CIDFont_dofont(font);
+}
+
+static void
+CIDFont_close (CIDFont *font)
+{
+  CIDFont_flush  (font);
+  CIDFont_release(font);
+
+  RELEASE(font);
+}
+
+/* Fonts are subset on worker threads if there are any, see
+ * texpdf_close_fonts().
+ */
 void
 CIDFont_cache_close (void)
 {
   int  font_id;
+  pdf_font_job **jobs;
 
   if (__cache) {
+    jobs = __cache->num > 0 ? NEW(__cache->num, pdf_font_job *) : NULL;
     for (font_id = 0;
 	 font_id < __cache->num; font_id++) {
       CIDFont *font;
@@ -667,15 +705,22 @@ CIDFont_cache_close (void)
       if (__verbose)
 	MESG("(CID");
 
-      CIDFont_dofont (font);
-      CIDFont_flush  (font);
-      CIDFont_release(font);
-
-      RELEASE(font);
+      jobs[font_id] = pdf_font_job_start(CIDFont_dofont_job, font);
+      if (!jobs[font_id])
+        CIDFont_close(font);
 
       if (__verbose)
 	MESG(")");
     }
+    for (font_id = 0;
+	 font_id < __cache->num; font_id++) {
+      if (jobs[font_id]) {
+        pdf_font_job_finish(jobs[font_id]);
+        CIDFont_close(__cache->fonts[font_id]);
+      }
+    }
+    if (jobs)
+      RELEASE(jobs);
     RELEASE(__cache->fonts);
     RELEASE(__cache);
     __cache = NULL;
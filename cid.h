@@ -73,6 +73,7 @@ extern char       *CIDFont_get_fontname   (CIDFont *font);
 
 extern char       *CIDFont_get_ident      (CIDFont *font); /* FIXME */
 extern int         CIDFont_get_opt_index  (CIDFont *font); /* FIXME */
+extern void       *CIDFont_get_cff_charsets (CIDFont *font);
 
 extern int         CIDFont_get_flag       (CIDFont *font, int mask);
 
@@ -89,7 +90,8 @@ extern int      CIDFont_is_ACCFont  (CIDFont *font);
 extern int      CIDFont_is_UCSFont  (CIDFont *font);
 
 #include "fontmap.h"
-extern void     CIDFont_cache_init  (void);
+extern struct FontCache *CIDFont_cache_init (void);
+extern void     CIDFont_cache_select (struct FontCache *cache);
 extern int      CIDFont_cache_find  (const char *map_name, CIDSysInfo *cmap_csi, fontmap_opt *fmap_opt);
 extern CIDFont *CIDFont_cache_get   (int fnt_id);
 extern void     CIDFont_cache_close (void);
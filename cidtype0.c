@@ -286,8 +286,7 @@ add_CIDVMetrics (sfnt *sfont, pdf_obj *fontdict,
     RELEASE(vorg->vertOriginYMetrics);
   RELEASE(vorg);
 
-  if (vmtx)
-    RELEASE(vmtx);
+  tt_release_table(sfont, vmtx);
   if (vhea)
     RELEASE(vhea);
 
@@ -321,7 +320,7 @@ add_CIDMetrics (sfnt *sfont, pdf_obj *fontdict,
   if (need_vmetrics)
     add_CIDVMetrics(sfont, fontdict, CIDToGIDMap, last_cid, maxp, head, hmtx);
 
-  RELEASE(hmtx);
+  tt_release_table(sfont, hmtx);
   RELEASE(hhea);
   RELEASE(maxp);
   RELEASE(head);
@@ -45,11 +45,14 @@
 #include "error.h"
 #include "dpxutil.h"
 
+#include "dpxthread.h"
+
 #include "cmap_p.h"
 #include "cmap.h"
+#include "cmap_bin.h"
 
 static int __verbose = 0;
-static int __silent  = 0;
+static DPX_THREAD_LOCAL int __silent  = 0;
 
 void
 CMap_set_verbose (void)
@@ -111,6 +114,10 @@ CMap_new (void)
   cmap->reverseMap = NEW(65536, int);
   memset(cmap->reverseMap, 0, 65536 * sizeof(int));
 
+  cmap->image.data   = NULL;
+  cmap->image.length = 0;
+  cmap->image.mapped = 0;
+
   return cmap;
 }
 
@@ -129,6 +136,8 @@ CMap_release (CMap *cmap)
   }
   if (cmap->codespace.ranges)
     RELEASE(cmap->codespace.ranges);
+  if (cmap->image.data)
+    CMap_unload_compiled(cmap);
   if (cmap->mapTbl)
     mapDef_release(cmap->mapTbl);
   {
@@ -867,9 +876,13 @@ struct CMap_cache {
   int    num;
   int    max;
   CMap **cmaps;
+  struct ht_table names; /* CMapName to the first ID with that name */
 };
 
+/* Shared by all open documents; CMaps are never changed once cached. */
 static struct CMap_cache *__cache = NULL;
+static int                __cache_users = 0;
+static dpx_rwlock         __cache_lock  = DPX_RWLOCK_INITIALIZER;
 
 #define CHECK_ID(n) do {\
                         if (! __cache)\
@@ -880,44 +893,105 @@ static struct CMap_cache *__cache = NULL;
 
 #include "dpxfile.h"
 
-void
-CMap_cache_init (void)
+static void
+hval_free (void *hval)
+{
+  RELEASE(hval);
+}
+
+static int cache_append (CMap *cmap);
+
+static void
+cache_create (void)
 {
   static unsigned char range_min[2] = {0x00, 0x00};
   static unsigned char range_max[2] = {0xff, 0xff};
-
-  if (__cache)
-    ERROR("%s: Already initialized.", CMAP_DEBUG_STR);
+  CMap *cmap;
 
   __cache = NEW(1, struct CMap_cache);
 
   __cache->max   = CMAP_CACHE_ALLOC_SIZE;
   __cache->cmaps = NEW(__cache->max, CMap *);
   __cache->num   = 0;
+  texpdf_ht_init_table(&__cache->names, hval_free);
 
   /* Create Identity mapping */
-  __cache->cmaps[0] = CMap_new();
-  CMap_set_name (__cache->cmaps[0], "Identity-H");
-  CMap_set_type (__cache->cmaps[0], CMAP_TYPE_IDENTITY);
-  CMap_set_wmode(__cache->cmaps[0], 0);
-  CMap_set_CIDSysInfo(__cache->cmaps[0], &CSI_IDENTITY);
-  CMap_add_codespacerange(__cache->cmaps[0], range_min, range_max, 2);
-
-  __cache->cmaps[1] = CMap_new();
-  CMap_set_name (__cache->cmaps[1], "Identity-V");
-  CMap_set_type (__cache->cmaps[1], CMAP_TYPE_IDENTITY);
-  CMap_set_wmode(__cache->cmaps[1], 1);
-  CMap_set_CIDSysInfo(__cache->cmaps[1], &CSI_IDENTITY);
-  CMap_add_codespacerange(__cache->cmaps[1], range_min, range_max, 2);
+  cmap = CMap_new();
+  CMap_set_name (cmap, "Identity-H");
+  CMap_set_type (cmap, CMAP_TYPE_IDENTITY);
+  CMap_set_wmode(cmap, 0);
+  CMap_set_CIDSysInfo(cmap, &CSI_IDENTITY);
+  CMap_add_codespacerange(cmap, range_min, range_max, 2);
+  cache_append(cmap);
+
+  cmap = CMap_new();
+  CMap_set_name (cmap, "Identity-V");
+  CMap_set_type (cmap, CMAP_TYPE_IDENTITY);
+  CMap_set_wmode(cmap, 1);
+  CMap_set_CIDSysInfo(cmap, &CSI_IDENTITY);
+  CMap_add_codespacerange(cmap, range_min, range_max, 2);
+  cache_append(cmap);
+}
 
-  __cache->num += 2;
+/* Each open document holds the cache once. */
+void
+CMap_cache_init (void)
+{
+  dpx_write_lock(&__cache_lock);
+  if (!__cache)
+    cache_create();
+  __cache_users++;
+  dpx_unlock(&__cache_lock);
 }
 
 CMap *
 texpdf_CMap_cache_get (int id)
 {
+  CMap *cmap;
+
+  dpx_read_lock(&__cache_lock);
   CHECK_ID(id);
-  return __cache->cmaps[id];
+  cmap = __cache->cmaps[id];
+  dpx_unlock(&__cache_lock);
+
+  return cmap;
+}
+
+/* Called with the lock held. */
+static int
+cache_lookup (const char *cmap_name)
+{
+  int *id;
+
+  id = texpdf_ht_lookup_table(&__cache->names, cmap_name, strlen(cmap_name));
+
+  return id ? *id : -1;
+}
+
+/* Called with the write lock held. */
+static int
+cache_append (CMap *cmap)
+{
+  int   id;
+  char *name;
+
+  if (__cache->num >= __cache->max) {
+    __cache->max   += CMAP_CACHE_ALLOC_SIZE;
+    __cache->cmaps = RENEW(__cache->cmaps, __cache->max, CMap *);
+  }
+  id = __cache->num;
+  (__cache->num)++;
+  __cache->cmaps[id] = cmap;
+
+  /* CMapName may be undefined when processing usecmap. */
+  name = CMap_get_name(cmap);
+  if (name && cache_lookup(name) < 0) {
+    int *idp = NEW(1, int);
+    *idp = id;
+    texpdf_ht_append_table(&__cache->names, name, strlen(name), idp);
+  }
+
+  return id;
 }
 
 int
@@ -925,19 +999,13 @@ texpdf_CMap_cache_find (const char *cmap_name)
 {
   int   id = 0;
   FILE *fp = NULL;
+  CMap *cmap;
 
-  if (!__cache)
-    CMap_cache_init();
-  ASSERT(__cache);
-
-  for (id = 0; id < __cache->num; id++) {
-    char *name = NULL;
-    /* CMapName may be undefined when processing usecmap. */
-    name = CMap_get_name(__cache->cmaps[id]);
-    if (name && strcmp(cmap_name, name) == 0) {
-      return id;
-    }
-  }
+  dpx_read_lock(&__cache_lock);
+  id = __cache ? cache_lookup(cmap_name) : -1;
+  dpx_unlock(&__cache_lock);
+  if (id >= 0)
+    return id;
 
   fp = DPXFOPEN(cmap_name, DPX_RES_TYPE_CMAP);
   if (!fp)
@@ -951,19 +1019,29 @@ texpdf_CMap_cache_find (const char *cmap_name)
   if (__verbose)
     MESG("(CMap:%s", cmap_name);
 
-  if (__cache->num >= __cache->max) {
-    __cache->max   += CMAP_CACHE_ALLOC_SIZE;
-    __cache->cmaps = RENEW(__cache->cmaps, __cache->max, CMap *);
+  /* Read without the lock: usecmap looks up other CMaps. */
+  cmap = CMap_load_compiled(cmap_name, fp);
+  if (!cmap) {
+    cmap = CMap_new();
+    if (CMap_parse(cmap, fp) < 0)
+      ERROR("%s: Parsing CMap file failed.", CMAP_DEBUG_STR);
+    CMap_save_compiled(cmap, cmap_name, fp);
   }
-  id = __cache->num;
-  (__cache->num)++;
-  __cache->cmaps[id] = CMap_new();
-
-  if (CMap_parse(__cache->cmaps[id], fp) < 0)
-    ERROR("%s: Parsing CMap file failed.", CMAP_DEBUG_STR);
 
   DPXFCLOSE(fp);
 
+  dpx_write_lock(&__cache_lock);
+  if (!__cache)
+    cache_create();
+  id = cache_lookup(cmap_name);
+  if (id < 0)
+    id = cache_append(cmap);
+  else {
+    /* Another thread got there first. */
+    CMap_release(cmap);
+  }
+  dpx_unlock(&__cache_lock);
+
   if (__verbose)
     MESG(")");
 
@@ -974,28 +1052,22 @@ int
 CMap_cache_add (CMap *cmap)
 {
   int   id;
-  char *cmap_name0, *cmap_name1;
 
   if (!CMap_is_valid(cmap))
     ERROR("%s: Invalid CMap.", CMAP_DEBUG_STR);
 
-  for (id = 0; id < __cache->num; id++) {
-    cmap_name0 = CMap_get_name(cmap);
-    cmap_name1 = CMap_get_name(__cache->cmaps[id]);
-    if (!strcmp(cmap_name0, cmap_name1)) {
-      ERROR("%s: CMap \"%s\" already defined.",
-	    CMAP_DEBUG_STR, cmap_name0);
-      return -1;
-    }
-  }
-
-  if (__cache->num >= __cache->max) {
-    __cache->max   += CMAP_CACHE_ALLOC_SIZE;
-    __cache->cmaps = RENEW(__cache->cmaps, __cache->max, CMap *);
+  dpx_write_lock(&__cache_lock);
+  id = cache_lookup(CMap_get_name(cmap));
+  if (id >= 0) {
+    /* Built by another document at the same time. The copy is kept,
+     * as it may already be another CMap's usecmap, but the first one
+     * is shared.
+     */
+    cache_append(cmap);
+  } else {
+    id = cache_append(cmap);
   }
-  id = __cache->num;
-  (__cache->num)++;
-  __cache->cmaps[id] = cmap;
+  dpx_unlock(&__cache_lock);
 
   return id;
 }
@@ -1003,13 +1075,18 @@ CMap_cache_add (CMap *cmap)
 void
 CMap_cache_close (void)
 {
-  if (__cache) {
+  dpx_write_lock(&__cache_lock);
+  if (__cache_users > 0)
+    __cache_users--;
+  if (__cache && __cache_users == 0) {
     int id;
     for (id = 0; id < __cache->num; id++) {
       CMap_release(__cache->cmaps[id]);
     }
     RELEASE(__cache->cmaps);
+    texpdf_ht_clear_table(&__cache->names);
     RELEASE(__cache);
     __cache = NULL;
   }
+  dpx_unlock(&__cache_lock);
 }
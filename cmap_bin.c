@@ -0,0 +1,542 @@
+/* This is libtexpdf, a PDF output library derived from dvipdfmx,
+   an eXtended version of dvipdfm by Mark A. Wicks.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+#include "libtexpdf.h"
+
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#define CMAP_BIN_MMAP 1
+#endif
+
+#include "cmap_p.h"
+#include "cmap_bin.h"
+
+/*
+ * Layout of a compiled CMap, in host byte order:
+ *
+ *   header
+ *   BIN_FIXED words describing the CMap (see below)
+ *   BIN_RANGE_WORDS per codespace range: dim, codeLo, codeHi
+ *   BIN_ENTRY_WORDS per entry of each 256-entry lookup table, mapTbl
+ *     first, then the tables below it depth first: flag, len, next, code
+ *   65536 words of reverse map
+ *   pool of codes and NUL-terminated strings, padded to a word
+ *
+ * Strings and codes are given as offsets into the pool and next as the
+ * number of a table, always greater than that of the table it is in;
+ * CMAP_BIN_NONE stands for none. The checksum covers all but the header.
+ */
+
+#define CMAP_BIN_VERSION    1
+#define CMAP_BIN_BYTE_ORDER 0x01020304u
+#define CMAP_BIN_SUFFIX     ".bcmap"
+#define CMAP_BIN_NONE       0xffffffffu
+
+struct bin_header {
+  char     magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t length;       /* Bytes following the header */
+  uint32_t checksum;
+  int64_t  source_size;  /* Of the CMap file compiled */
+  int64_t  source_mtime;
+};
+
+static const char bin_magic[8] = "CMapBin";
+
+enum {
+  BIN_TYPE, BIN_WMODE, BIN_FLAGS,
+  BIN_MIN_BYTES_IN, BIN_MAX_BYTES_IN, BIN_MIN_BYTES_OUT, BIN_MAX_BYTES_OUT,
+  BIN_NAME, BIN_USECMAP, BIN_REGISTRY, BIN_ORDERING, BIN_SUPPLEMENT,
+  BIN_NUM_RANGES, BIN_NUM_TABLES, BIN_POOL_SIZE,
+  BIN_FIXED
+};
+
+#define BIN_RANGE_WORDS  3
+#define BIN_ENTRY_WORDS  4
+#define BIN_TABLE_WORDS  (256 * BIN_ENTRY_WORDS)
+#define BIN_REVERSE_SIZE 65536
+
+static char *cache_dir = NULL;
+
+void
+texpdf_set_cmap_cache_dir (const char *dir)
+{
+  if (cache_dir)
+    RELEASE(cache_dir);
+  cache_dir = NULL;
+  if (dir) {
+    cache_dir = NEW(strlen(dir) + 1, char);
+    strcpy(cache_dir, dir);
+  }
+}
+
+static char *
+compiled_path (const char *cmap_name)
+{
+  char *path;
+
+  if (!cache_dir || !cmap_name || !*cmap_name ||
+      strchr(cmap_name, '/') || strchr(cmap_name, '\\'))
+    return NULL;
+
+  path = NEW(strlen(cache_dir) + strlen(cmap_name) +
+             strlen(CMAP_BIN_SUFFIX) + 2, char);
+  sprintf(path, "%s/%s%s", cache_dir, cmap_name, CMAP_BIN_SUFFIX);
+
+  return path;
+}
+
+/* FNV-1a over words, in four interleaved lanes so that the multiplies
+ * do not wait on each other. */
+static uint32_t
+bin_checksum (const uint32_t *w, size_t n)
+{
+  uint32_t h0 = 2166136261u, h1 = h0 + 1, h2 = h0 + 2, h3 = h0 + 3;
+  size_t   i;
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    h0 = (h0 ^ w[i])   * 16777619u;
+    h1 = (h1 ^ w[i+1]) * 16777619u;
+    h2 = (h2 ^ w[i+2]) * 16777619u;
+    h3 = (h3 ^ w[i+3]) * 16777619u;
+  }
+  for (; i < n; i++)
+    h0 = (h0 ^ w[i]) * 16777619u;
+
+  return ((h0 * 16777619u ^ h1) * 16777619u ^ h2) * 16777619u ^ h3;
+}
+
+/************************** Writing **************************/
+
+struct bin_pool {
+  unsigned char *data;
+  size_t         length;
+  size_t         max;
+};
+
+static uint32_t
+pool_put (struct bin_pool *pool, const void *data, size_t length)
+{
+  size_t pos = pool->length;
+
+  if (pool->length + length > pool->max) {
+    pool->max  = MAX(2 * pool->max, pool->length + length + 1024);
+    pool->data = RENEW(pool->data, pool->max, unsigned char);
+  }
+  memcpy(pool->data + pos, data, length);
+  pool->length += length;
+
+  return pos;
+}
+
+static uint32_t
+pool_put_string (struct bin_pool *pool, const char *s)
+{
+  return s ? pool_put(pool, s, strlen(s) + 1) : CMAP_BIN_NONE;
+}
+
+static uint32_t
+count_tables (mapDef *t)
+{
+  uint32_t n = 1;
+  int      c;
+
+  for (c = 0; c < 256; c++) {
+    if (LOOKUP_CONTINUE(t[c].flag))
+      n += count_tables(t[c].next);
+  }
+
+  return n;
+}
+
+/* Writes t into slot *next of tables, and the tables below it into the
+ * slots that follow; returns the slot of t.
+ */
+static uint32_t
+put_table (mapDef *t, uint32_t *tables, uint32_t *next, struct bin_pool *pool)
+{
+  uint32_t  slot = (*next)++;
+  uint32_t *e    = tables + (size_t) slot * BIN_TABLE_WORDS;
+  int       c;
+
+  for (c = 0; c < 256; c++, e += BIN_ENTRY_WORDS) {
+    int defined = MAP_DEFINED(t[c].flag) && t[c].code;
+
+    e[0] = t[c].flag;
+    e[1] = defined ? t[c].len : 0;
+    e[2] = LOOKUP_CONTINUE(t[c].flag) ?
+      put_table(t[c].next, tables, next, pool) : CMAP_BIN_NONE;
+    e[3] = defined ? pool_put(pool, t[c].code, t[c].len) : CMAP_BIN_NONE;
+  }
+
+  return slot;
+}
+
+void
+CMap_save_compiled (CMap *cmap, const char *cmap_name, FILE *source)
+{
+#ifdef HAVE_MKSTEMP
+  static const unsigned char padding[4] = { 0, 0, 0, 0 };
+  struct bin_header hdr;
+  struct bin_pool   pool = { NULL, 0, 0 };
+  struct stat       st;
+  uint32_t         *words, *w, num_tables, next = 0;
+  size_t            num_words;
+  char             *path, *tmp;
+  FILE             *fp;
+  int               i, fd, error;
+
+  ASSERT(cmap);
+
+  if (sizeof(int) != sizeof(uint32_t) || !cmap->name || !cmap->reverseMap ||
+      (cmap->useCMap && !CMap_get_name(cmap->useCMap)))
+    return;
+  if (!source || fstat(fileno(source), &st) < 0 || !S_ISREG(st.st_mode))
+    return;
+  path = compiled_path(cmap_name);
+  if (!path)
+    return;
+
+  num_tables = cmap->mapTbl ? count_tables(cmap->mapTbl) : 0;
+  num_words  = BIN_FIXED + (size_t) cmap->codespace.num * BIN_RANGE_WORDS +
+    (size_t) num_tables * BIN_TABLE_WORDS + BIN_REVERSE_SIZE;
+  words = NEW(num_words, uint32_t);
+
+  words[BIN_TYPE]          = cmap->type;
+  words[BIN_WMODE]         = cmap->wmode;
+  words[BIN_FLAGS]         = cmap->flags;
+  words[BIN_MIN_BYTES_IN]  = cmap->profile.minBytesIn;
+  words[BIN_MAX_BYTES_IN]  = cmap->profile.maxBytesIn;
+  words[BIN_MIN_BYTES_OUT] = cmap->profile.minBytesOut;
+  words[BIN_MAX_BYTES_OUT] = cmap->profile.maxBytesOut;
+  words[BIN_NAME]     = pool_put_string(&pool, cmap->name);
+  words[BIN_USECMAP]  = pool_put_string(&pool, cmap->useCMap ?
+                                        CMap_get_name(cmap->useCMap) : NULL);
+  if (cmap->CSI && cmap->CSI->registry && cmap->CSI->ordering) {
+    words[BIN_REGISTRY]   = pool_put_string(&pool, cmap->CSI->registry);
+    words[BIN_ORDERING]   = pool_put_string(&pool, cmap->CSI->ordering);
+    words[BIN_SUPPLEMENT] = cmap->CSI->supplement;
+  } else {
+    words[BIN_REGISTRY]   = CMAP_BIN_NONE;
+    words[BIN_ORDERING]   = CMAP_BIN_NONE;
+    words[BIN_SUPPLEMENT] = 0;
+  }
+  words[BIN_NUM_RANGES] = cmap->codespace.num;
+  words[BIN_NUM_TABLES] = num_tables;
+
+  w = words + BIN_FIXED;
+  for (i = 0; i < cmap->codespace.num; i++, w += BIN_RANGE_WORDS) {
+    rangeDef *csr = cmap->codespace.ranges + i;
+    w[0] = csr->dim;
+    w[1] = pool_put(&pool, csr->codeLo, csr->dim);
+    w[2] = pool_put(&pool, csr->codeHi, csr->dim);
+  }
+  if (num_tables > 0)
+    put_table(cmap->mapTbl, w, &next, &pool);
+  w += (size_t) num_tables * BIN_TABLE_WORDS;
+  memcpy(w, cmap->reverseMap, BIN_REVERSE_SIZE * sizeof(uint32_t));
+
+  pool_put(&pool, padding, (4 - pool.length % 4) % 4);
+  words[BIN_POOL_SIZE] = pool.length;
+  words = RENEW(words, num_words + pool.length / 4, uint32_t);
+  memcpy(words + num_words, pool.data, pool.length);
+  num_words += pool.length / 4;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, bin_magic, sizeof(hdr.magic));
+  hdr.version      = CMAP_BIN_VERSION;
+  hdr.byte_order   = CMAP_BIN_BYTE_ORDER;
+  hdr.length       = num_words * sizeof(uint32_t);
+  hdr.checksum     = bin_checksum(words, num_words);
+  hdr.source_size  = st.st_size;
+  hdr.source_mtime = st.st_mtime;
+
+  /* Written under a temporary name and renamed, so that other processes
+   * never see a partial file. */
+  tmp = NEW(strlen(path) + 8, char);
+  sprintf(tmp, "%s.XXXXXX", path);
+  fd = mkstemp(tmp);
+  if (fd >= 0) {
+    fp = fdopen(fd, FOPEN_WBIN_MODE);
+    if (fp) {
+      error = fwrite(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        fwrite(words, sizeof(uint32_t), num_words, fp) != num_words;
+      error |= fclose(fp) != 0;
+    } else {
+      close(fd);
+      error = 1;
+    }
+    if (error || rename(tmp, path) < 0) {
+      WARN("Could not write compiled CMap: %s", path);
+      remove(tmp);
+    }
+  }
+
+  RELEASE(tmp);
+  RELEASE(path);
+  RELEASE(words);
+  if (pool.data)
+    RELEASE(pool.data);
+#endif /* HAVE_MKSTEMP */
+}
+
+/************************** Reading **************************/
+
+static int
+check_string (const unsigned char *pool, uint32_t pool_size, uint32_t offset)
+{
+  return offset < pool_size &&
+    memchr(pool + offset, 0, pool_size - offset) != NULL;
+}
+
+/* Returns 0 if data holds a well-formed compiled CMap made from a source
+ * file as described by src. Checked before anything is built from it.
+ */
+static int
+check_compiled (const unsigned char *data, size_t length, const struct stat *src)
+{
+  const struct bin_header *hdr = (const struct bin_header *) data;
+  const uint32_t          *words, *w;
+  const unsigned char     *pool;
+  uint32_t                 num_ranges, num_tables, pool_size, i;
+  uint64_t                 num_words;
+  int                      c;
+
+  if (length < sizeof(struct bin_header) ||
+      memcmp(hdr->magic, bin_magic, sizeof(hdr->magic)) ||
+      hdr->version != CMAP_BIN_VERSION ||
+      hdr->byte_order != CMAP_BIN_BYTE_ORDER ||
+      hdr->length != length - sizeof(struct bin_header) ||
+      hdr->length % 4 != 0 || hdr->length < BIN_FIXED * sizeof(uint32_t) ||
+      hdr->source_size != (int64_t) src->st_size ||
+      hdr->source_mtime != (int64_t) src->st_mtime)
+    return -1;
+
+  words      = (const uint32_t *) (data + sizeof(struct bin_header));
+  num_ranges = words[BIN_NUM_RANGES];
+  num_tables = words[BIN_NUM_TABLES];
+  pool_size  = words[BIN_POOL_SIZE];
+  num_words  = BIN_FIXED + (uint64_t) num_ranges * BIN_RANGE_WORDS +
+    (uint64_t) num_tables * BIN_TABLE_WORDS + BIN_REVERSE_SIZE;
+  if (num_words * sizeof(uint32_t) + pool_size != hdr->length)
+    return -1;
+  if (bin_checksum(words, hdr->length / 4) != hdr->checksum)
+    return -1;
+
+  pool = (const unsigned char *) (words + num_words);
+  if (!check_string(pool, pool_size, words[BIN_NAME]))
+    return -1;
+  if (words[BIN_USECMAP] != CMAP_BIN_NONE &&
+      !check_string(pool, pool_size, words[BIN_USECMAP]))
+    return -1;
+  if ((words[BIN_REGISTRY] != CMAP_BIN_NONE ||
+       words[BIN_ORDERING] != CMAP_BIN_NONE) &&
+      (!check_string(pool, pool_size, words[BIN_REGISTRY]) ||
+       !check_string(pool, pool_size, words[BIN_ORDERING])))
+    return -1;
+
+  w = words + BIN_FIXED;
+  for (i = 0; i < num_ranges; i++, w += BIN_RANGE_WORDS) {
+    if (w[0] < 1 || w[0] > pool_size ||
+        w[1] > pool_size - w[0] || w[2] > pool_size - w[0])
+      return -1;
+  }
+  for (i = 0; i < num_tables; i++) {
+    for (c = 0; c < 256; c++, w += BIN_ENTRY_WORDS) {
+      if (LOOKUP_CONTINUE(w[0]) ?
+          w[2] <= i || w[2] >= num_tables : w[2] != CMAP_BIN_NONE)
+        return -1;
+      if (w[3] == CMAP_BIN_NONE ? MAP_DEFINED(w[0]) :
+          w[1] > pool_size || w[3] > pool_size - w[1])
+        return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* Builds the CMap from a checked image, which it then owns. */
+static CMap *
+build_compiled (unsigned char *data, size_t length, int mapped, CMap *ucmap)
+{
+  CMap          *cmap;
+  CIDSysInfo     csi;
+  mapDef        *tables = NULL;
+  uint32_t      *words, *w, num_tables, i;
+  unsigned char *pool;
+
+  words      = (uint32_t *) (data + sizeof(struct bin_header));
+  num_tables = words[BIN_NUM_TABLES];
+  w          = words + BIN_FIXED +
+    (size_t) words[BIN_NUM_RANGES] * BIN_RANGE_WORDS;
+  pool       = (unsigned char *) (w + (size_t) num_tables * BIN_TABLE_WORDS +
+                                  BIN_REVERSE_SIZE);
+
+  cmap = CMap_new();
+  CMap_set_name (cmap, (char *) pool + words[BIN_NAME]);
+  CMap_set_type (cmap, words[BIN_TYPE]);
+  CMap_set_wmode(cmap, words[BIN_WMODE]);
+  if (words[BIN_REGISTRY] != CMAP_BIN_NONE) {
+    csi.registry   = (char *) pool + words[BIN_REGISTRY];
+    csi.ordering   = (char *) pool + words[BIN_ORDERING];
+    csi.supplement = words[BIN_SUPPLEMENT];
+    CMap_set_CIDSysInfo(cmap, &csi);
+  }
+  cmap->flags               = words[BIN_FLAGS];
+  cmap->profile.minBytesIn  = words[BIN_MIN_BYTES_IN];
+  cmap->profile.maxBytesIn  = words[BIN_MAX_BYTES_IN];
+  cmap->profile.minBytesOut = words[BIN_MIN_BYTES_OUT];
+  cmap->profile.maxBytesOut = words[BIN_MAX_BYTES_OUT];
+
+  /* Already includes those of ucmap, so it is not set with CMap_set_usecmap(). */
+  for (i = 0; i < words[BIN_NUM_RANGES]; i++) {
+    uint32_t *r = words + BIN_FIXED + (size_t) i * BIN_RANGE_WORDS;
+    CMap_add_codespacerange(cmap, pool + r[1], pool + r[2], r[0]);
+  }
+  cmap->useCMap = ucmap;
+
+  /* The tables are laid out in one block; codes stay in the image. */
+  if (num_tables > 0) {
+    mapDef *t;
+
+    tables = NEW((size_t) num_tables * 256, mapDef);
+    for (t = tables, i = 0; i < num_tables * 256; i++, t++, w += BIN_ENTRY_WORDS) {
+      t->flag = w[0];
+      t->len  = w[1];
+      t->next = w[2] != CMAP_BIN_NONE ? tables + (size_t) w[2] * 256 : NULL;
+      t->code = w[3] != CMAP_BIN_NONE ? pool + w[3] : NULL;
+    }
+  }
+  cmap->mapTbl = tables;
+
+  RELEASE(cmap->reverseMap);
+  cmap->reverseMap = (int *) w;
+
+  cmap->image.data   = data;
+  cmap->image.length = length;
+  cmap->image.mapped = mapped;
+
+  return cmap;
+}
+
+static void
+release_image (unsigned char *data, size_t length, int mapped)
+{
+#ifdef CMAP_BIN_MMAP
+  if (mapped)
+    munmap(data, length);
+  else
+#endif
+    RELEASE(data);
+}
+
+CMap *
+CMap_load_compiled (const char *cmap_name, FILE *source)
+{
+  struct stat    st, src;
+  unsigned char *data = NULL;
+  size_t         length;
+  int            mapped = 0;
+  char          *path;
+  FILE          *fp;
+  CMap          *ucmap = NULL;
+
+  if (sizeof(int) != sizeof(uint32_t) || !source ||
+      fstat(fileno(source), &src) < 0)
+    return NULL;
+  path = compiled_path(cmap_name);
+  if (!path)
+    return NULL;
+  fp = fopen(path, FOPEN_RBIN_MODE);
+  RELEASE(path);
+  if (!fp)
+    return NULL;
+
+  if (fstat(fileno(fp), &st) < 0 || !S_ISREG(st.st_mode) ||
+      st.st_size < (off_t) sizeof(struct bin_header) ||
+      (size_t) st.st_size != st.st_size) {
+    fclose(fp);
+    return NULL;
+  }
+  length = st.st_size;
+#ifdef CMAP_BIN_MMAP
+  data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+  if (data != MAP_FAILED)
+    mapped = 1;
+  else
+    data = NULL;
+#endif
+  if (!data) {
+    data = NEW(length, unsigned char);
+    if (fread(data, 1, length, fp) != length) {
+      RELEASE(data);
+      data = NULL;
+    }
+  }
+  fclose(fp);
+  if (!data)
+    return NULL;
+
+  if (check_compiled(data, length, &src) < 0) {
+    release_image(data, length, mapped);
+    return NULL;
+  }
+
+  {
+    const uint32_t *words = (const uint32_t *) (data + sizeof(struct bin_header));
+
+    if (words[BIN_USECMAP] != CMAP_BIN_NONE) {
+      const char *name = (const char *) data + length -
+        words[BIN_POOL_SIZE] + words[BIN_USECMAP];
+      int id = -1;
+
+      if (strcmp(name, cmap_name) != 0)
+        id = texpdf_CMap_cache_find(name);
+      if (id < 0) {
+        release_image(data, length, mapped);
+        return NULL;
+      }
+      ucmap = texpdf_CMap_cache_get(id);
+    }
+  }
+
+  return build_compiled(data, length, mapped, ucmap);
+}
+
+void
+CMap_unload_compiled (CMap *cmap)
+{
+  ASSERT(cmap);
+
+  if (!cmap->image.data)
+    return;
+
+  if (cmap->mapTbl)
+    RELEASE(cmap->mapTbl);
+  cmap->mapTbl     = NULL;
+  cmap->reverseMap = NULL;
+  release_image(cmap->image.data, cmap->image.length, cmap->image.mapped);
+  cmap->image.data = NULL;
+}
@@ -0,0 +1,53 @@
+/* This is libtexpdf, a PDF output library derived from dvipdfmx,
+   an eXtended version of dvipdfm by Mark A. Wicks.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+#ifndef _CMAP_BIN_H_
+#define _CMAP_BIN_H_
+
+#include <stdio.h>
+#include "cmap.h"
+
+/* Compiled CMaps.
+ *
+ * A CMap parsed from a PostScript CMap file can be saved as a flat table
+ * of lookup nodes, codes and the reverse map, and later mapped back into
+ * memory instead of being parsed again. A compiled file records the size
+ * and modification time of the CMap file it was made from and is checked
+ * by version, byte order and checksum; files that do not match are
+ * ignored and written afresh.
+ */
+
+/* Returns the compiled form of the CMap `cmap_name`, whose source file is
+ * open as `source`, or NULL if there is no valid one.
+ */
+extern CMap *CMap_load_compiled   (const char *cmap_name, FILE *source);
+extern void  CMap_save_compiled   (CMap *cmap, const char *cmap_name, FILE *source);
+/* Frees what CMap_load_compiled() attached to cmap; for CMap_release(). */
+extern void  CMap_unload_compiled (CMap *cmap);
+
+/** Keep compiled CMaps in a directory
+
+CMaps read from CMap files are saved in `dir` the first time they are
+parsed and loaded from there afterwards, which is much faster. Pass NULL
+to stop using compiled CMaps (the default). Must be called before
+`texpdf_open_document`.
+
+*/
+extern void  texpdf_set_cmap_cache_dir (const char *dir);
+
+#endif /* _CMAP_BIN_H_ */
@@ -98,6 +98,14 @@ struct CMap {
   } profile;
 
   int *reverseMap;
+
+  /* Compiled file this CMap was loaded from, if any: mapTbl is then one
+   * block of tables, and their codes and reverseMap point into it. */
+  struct {
+    unsigned char *data;
+    size_t         length;
+    int            mapped;
+  } image;
 };
 
 #endif /* _CMAP_P_H_ */
@@ -60,22 +60,22 @@
 #define CS_SUBR_RETURN   2
 #define CS_CHAR_END      3
 
-static int status = CS_PARSE_ERROR;
+static DPX_THREAD_LOCAL int status = CS_PARSE_ERROR;
 
 #define DST_NEED(a,b) {if ((a) < (b)) { status = CS_BUFFER_ERROR ; return ; }}
 #define SRC_NEED(a,b) {if ((a) < (b)) { status = CS_PARSE_ERROR  ; return ; }}
 #define NEED(a,b)     {if ((a) < (b)) { status = CS_STACK_ERROR  ; return ; }}
 
 /* hintmask and cntrmask need number of stem zones */
-static int num_stems = 0;
-static int phase     = 0;
+static DPX_THREAD_LOCAL int num_stems = 0;
+static DPX_THREAD_LOCAL int phase     = 0;
 
 /* subroutine nesting */
-static int nest      = 0;
+static DPX_THREAD_LOCAL int nest      = 0;
 
 /* advance width */
-static int    have_width = 0;
-static double width      = 0.0;
+static DPX_THREAD_LOCAL int    have_width = 0;
+static DPX_THREAD_LOCAL double width      = 0.0;
 
 /*
  * Standard Encoding Accented Characters:
@@ -84,13 +84,13 @@ static double width      = 0.0;
  */
 #if 0
 /* adx ady bchar achar endchar */
-static double seac[4] = {0.0, 0.0, 0.0, 0.0};
+static DPX_THREAD_LOCAL double seac[4] = {0.0, 0.0, 0.0, 0.0};
 #endif
 
 /* Operand stack and Transient array */
-static int    stack_top = 0;
-static double arg_stack[CS_ARG_STACK_MAX];
-static double trn_array[CS_TRANS_ARRAY_MAX];
+static DPX_THREAD_LOCAL int    stack_top = 0;
+static DPX_THREAD_LOCAL double arg_stack[CS_ARG_STACK_MAX];
+static DPX_THREAD_LOCAL double trn_array[CS_TRANS_ARRAY_MAX];
 
 /*
  * Type 2 CharString encoding
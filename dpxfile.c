@@ -154,7 +154,7 @@ miktex_find_psheader_file (const char *filename, char *buf)
 #ifndef PATH_SEP_CHR
 #  define PATH_SEP_CHR '\\'
 #endif
-static char  _tmpbuf[_MAX_PATH+1];
+static DPX_THREAD_LOCAL char  _tmpbuf[_MAX_PATH+1];
 #endif /* MIKTEX */
 
 static int exec_spawn (char *cmd)
@@ -415,6 +415,7 @@ dpx_create_fix_temp_file (const char *filename)
 #define PREFIX "dvipdfm-x."
   static const char *dir = NULL;
   static char *cwd = NULL;
+  static dpx_mutex dir_lock = DPX_MUTEX_INITIALIZER;
   char *ret, *s;
   int i;
   MD5_CONTEXT state;
@@ -423,12 +424,14 @@ dpx_create_fix_temp_file (const char *filename)
   char *p;
 #endif
 
+  dpx_mutex_lock(&dir_lock);
   if (!dir) {
       char wd[PATH_MAX];
       dir = dpx_get_tmpdir();
       getcwd(wd, PATH_MAX);
       cwd = strdup(wd);
   }
+  dpx_mutex_unlock(&dir_lock);
 
   texpdf_MD5_init(&state);
   texpdf_MD5_write(&state, (unsigned char *)cwd,      strlen(cwd));
@@ -616,7 +619,7 @@ if ((l) + (n) >= (m)) { \
   return  error;
 }
 
-static char _sbuf[128];
+static DPX_THREAD_LOCAL char _sbuf[128];
 /*
  * SFNT type sigs:
  *  `true' (0x74727565): TrueType (Mac)
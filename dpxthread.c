@@ -0,0 +1,215 @@
+/* This is libtexpdf, a PDF output library derived from dvipdfmx,
+   an eXtended version of dvipdfm by Mark A. Wicks.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+#include "libtexpdf.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "dpxthread.h"
+
+#define WORKERS_MAX 64
+
+#ifdef HAVE_PTHREAD
+static struct {
+  int              users;  /* documents using the pool */
+  int              num_threads;
+  int              shutdown;
+  pthread_t        threads[WORKERS_MAX];
+  pthread_mutex_t  lock;
+  pthread_cond_t   work;  /* signalled when a task is queued  */
+  pthread_cond_t   done;  /* broadcast when a task is finished */
+  dpx_task        *head, *tail;
+} pool = { 0 };
+
+/* Serializes starting and stopping the pool */
+static pthread_mutex_t pool_setup = PTHREAD_MUTEX_INITIALIZER;
+
+static void *
+worker_main (void *arg)
+{
+  dpx_task *task;
+
+  pthread_mutex_lock(&pool.lock);
+  for (;;) {
+    while (!pool.head && !pool.shutdown)
+      pthread_cond_wait(&pool.work, &pool.lock);
+    if (!pool.head)
+      break;
+    task = pool.head;
+    pool.head = task->next;
+    if (!pool.head)
+      pool.tail = NULL;
+    pthread_mutex_unlock(&pool.lock);
+
+    task->run(task);
+
+    pthread_mutex_lock(&pool.lock);
+    task->done = 1;
+    pthread_cond_broadcast(&pool.done);
+  }
+  pthread_mutex_unlock(&pool.lock);
+
+  return NULL;
+}
+#endif /* HAVE_PTHREAD */
+
+/* Takes a reference to the pool, starting it if it is not running yet,
+ * and returns its number of threads. If that is 0 no reference is taken.
+ */
+int
+dpx_workers_init (int num_threads)
+{
+#ifdef HAVE_PTHREAD
+  pthread_mutex_lock(&pool_setup);
+  if (pool.num_threads > 0) {
+    pool.users++;
+    pthread_mutex_unlock(&pool_setup);
+    return pool.num_threads;
+  }
+  if (num_threads > WORKERS_MAX)
+    num_threads = WORKERS_MAX;
+
+  pthread_mutex_init(&pool.lock, NULL);
+  pthread_cond_init (&pool.work, NULL);
+  pthread_cond_init (&pool.done, NULL);
+  pool.head = pool.tail = NULL;
+  pool.shutdown = 0;
+
+  while (pool.num_threads < num_threads) {
+    if (pthread_create(&pool.threads[pool.num_threads], NULL, worker_main, NULL)) {
+      WARN("Could not start worker thread; using %d.", pool.num_threads);
+      break;
+    }
+    pool.num_threads++;
+  }
+  if (pool.num_threads == 0) {
+    pthread_cond_destroy (&pool.done);
+    pthread_cond_destroy (&pool.work);
+    pthread_mutex_destroy(&pool.lock);
+  } else {
+    pool.users = 1;
+  }
+  pthread_mutex_unlock(&pool_setup);
+
+  return pool.num_threads;
+#else
+  if (num_threads > 0)
+    WARN("Worker threads not supported; compressing serially.");
+  return 0;
+#endif
+}
+
+/* Drops a reference taken by dpx_workers_init(). The last one finishes
+ * all queued tasks, then stops the threads.
+ */
+void
+dpx_workers_close (void)
+{
+#ifdef HAVE_PTHREAD
+  int i;
+
+  pthread_mutex_lock(&pool_setup);
+  if (pool.num_threads == 0 || --pool.users > 0) {
+    pthread_mutex_unlock(&pool_setup);
+    return;
+  }
+
+  pthread_mutex_lock(&pool.lock);
+  pool.shutdown = 1;
+  pthread_cond_broadcast(&pool.work);
+  pthread_mutex_unlock(&pool.lock);
+
+  for (i = 0; i < pool.num_threads; i++)
+    pthread_join(pool.threads[i], NULL);
+  pool.num_threads = 0;
+
+  pthread_cond_destroy (&pool.done);
+  pthread_cond_destroy (&pool.work);
+  pthread_mutex_destroy(&pool.lock);
+  pthread_mutex_unlock(&pool_setup);
+#endif
+}
+
+int
+dpx_workers_active (void)
+{
+#ifdef HAVE_PTHREAD
+  return pool.num_threads;
+#else
+  return 0;
+#endif
+}
+
+void
+dpx_workers_submit (dpx_task *task)
+{
+  ASSERT(task && task->run);
+
+  task->done = 0;
+  task->next = NULL;
+#ifdef HAVE_PTHREAD
+  if (pool.num_threads > 0) {
+    pthread_mutex_lock(&pool.lock);
+    if (pool.tail)
+      pool.tail->next = task;
+    else
+      pool.head = task;
+    pool.tail = task;
+    pthread_cond_signal(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+    return;
+  }
+#endif
+  task->run(task);
+  task->done = 1;
+}
+
+int
+dpx_workers_poll (dpx_task *task)
+{
+  int done;
+
+#ifdef HAVE_PTHREAD
+  if (pool.num_threads > 0) {
+    pthread_mutex_lock(&pool.lock);
+    done = task->done;
+    pthread_mutex_unlock(&pool.lock);
+    return done;
+  }
+#endif
+  done = task->done;
+
+  return done;
+}
+
+void
+dpx_workers_wait (dpx_task *task)
+{
+#ifdef HAVE_PTHREAD
+  if (pool.num_threads > 0) {
+    pthread_mutex_lock(&pool.lock);
+    while (!task->done)
+      pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+    return;
+  }
+#endif
+  ASSERT(task->done);
+}
@@ -0,0 +1,110 @@
+/* This is libtexpdf, a PDF output library derived from dvipdfmx,
+   an eXtended version of dvipdfm by Mark A. Wicks.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+#ifndef _DPXTHREAD_H_
+#define _DPXTHREAD_H_
+
+/* A small pool of worker threads for CPU-bound jobs (mainly zlib).
+ *
+ * A task is embedded at the start of the caller's own job structure;
+ * run() must not touch any pdf_obj or other shared library state, unless
+ * it sets an object log first (see pdf_obj_log_set()).
+ * Without POSIX threads, or before dpx_workers_init(), tasks are run
+ * immediately by dpx_workers_submit(). The pool is shared by every open
+ * document: each dpx_workers_init() returning non-zero is matched by one
+ * dpx_workers_close().
+ */
+typedef struct dpx_task dpx_task;
+
+struct dpx_task
+{
+  void      (*run) (dpx_task *task);
+  int         done;
+  dpx_task   *next;
+};
+
+extern int   dpx_workers_init   (int num_threads);
+extern void  dpx_workers_close  (void);
+extern int   dpx_workers_active (void);
+
+extern void  dpx_workers_submit (dpx_task *task);
+extern int   dpx_workers_poll   (dpx_task *task);
+extern void  dpx_workers_wait   (dpx_task *task);
+
+/* Locks for the caches shared by every document (CMaps, the glyph list,
+ * fontmaps and font files): any number of readers or a single writer.
+ * A dpx_mutex is for short sections that always write. Without POSIX
+ * threads they do nothing.
+ */
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+
+typedef pthread_rwlock_t dpx_rwlock;
+
+#define DPX_RWLOCK_INITIALIZER PTHREAD_RWLOCK_INITIALIZER
+#define dpx_read_lock(l)  pthread_rwlock_rdlock(l)
+#define dpx_write_lock(l) pthread_rwlock_wrlock(l)
+#define dpx_unlock(l)     pthread_rwlock_unlock(l)
+
+typedef pthread_mutex_t dpx_mutex;
+
+#define DPX_MUTEX_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#define dpx_mutex_lock(m)   pthread_mutex_lock(m)
+#define dpx_mutex_unlock(m) pthread_mutex_unlock(m)
+
+/* Atomic operations on an int or a pointer, for reference counts and
+ * lists that other threads push onto without a lock. dpx_atomic_cas()
+ * stores DESIRED if *P equals *OLD and returns non-zero; otherwise it
+ * sets *OLD to the current value and returns 0.
+ */
+#define dpx_atomic_load(p)    __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define dpx_atomic_add(p, n)  __atomic_add_fetch(p, n, __ATOMIC_ACQ_REL)
+#define dpx_atomic_cas(p, old, desired) \
+  __atomic_compare_exchange_n(p, old, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#else
+typedef int dpx_rwlock;
+
+#define DPX_RWLOCK_INITIALIZER 0
+#define dpx_read_lock(l)  ((void) (l))
+#define dpx_write_lock(l) ((void) (l))
+#define dpx_unlock(l)     ((void) (l))
+
+typedef int dpx_mutex;
+
+#define DPX_MUTEX_INITIALIZER 0
+#define dpx_mutex_lock(m)   ((void) (m))
+#define dpx_mutex_unlock(m) ((void) (m))
+
+#define dpx_atomic_load(p)    (*(p))
+#define dpx_atomic_add(p, n)  (*(p) += (n))
+#define dpx_atomic_cas(p, old, desired) \
+  (*(p) == *(old) ? (*(p) = (desired), 1) : (*(old) = *(p), 0))
+#endif
+
+/* Storage class of variables that each thread has its own copy of */
+#if !defined(HAVE_PTHREAD)
+#define DPX_THREAD_LOCAL
+#elif defined(__GNUC__)
+#define DPX_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define DPX_THREAD_LOCAL __declspec(thread)
+#else
+#define DPX_THREAD_LOCAL _Thread_local
+#endif
+
+#endif /* _DPXTHREAD_H_ */
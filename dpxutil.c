@@ -164,13 +164,10 @@ texpdf_skip_white_spaces (unsigned char **s, unsigned char *endptr)
 void
 texpdf_ht_init_table (struct ht_table *ht, hval_free_func hval_free_fn)
 {
-  int  i;
-
   ASSERT(ht);
 
-  for (i = 0; i < HASH_TABLE_SIZE; i++) {
-    ht->table[i] = NULL;
-  }
+  ht->table = NULL;
+  ht->size  = 0;
   ht->count = 0;
   ht->hval_free_fn = hval_free_fn;
 }
@@ -178,11 +175,11 @@ texpdf_ht_init_table (struct ht_table *ht, hval_free_func hval_free_fn)
 void
 texpdf_ht_clear_table (struct ht_table *ht)
 {
-  int   i;
+  long  i;
 
   ASSERT(ht);
 
-  for (i = 0; i < HASH_TABLE_SIZE; i++) {
+  for (i = 0; i < ht->size; i++) {
     struct ht_entry *hent, *next;
 
     hent = ht->table[i];
@@ -190,17 +187,15 @@ texpdf_ht_clear_table (struct ht_table *ht)
       if (hent->value && ht->hval_free_fn) {
 	ht->hval_free_fn(hent->value);
       }
-      hent->value  = NULL;
-      if (hent->key) {
-	RELEASE(hent->key);
-      }
-      hent->key = NULL;
       next = hent->next;
       RELEASE(hent);
       hent = next;
     }
-    ht->table[i] = NULL;
   }
+  if (ht->table)
+    RELEASE(ht->table);
+  ht->table = NULL;
+  ht->size  = 0;
   ht->count = 0;
   ht->hval_free_fn = NULL;
 }
@@ -212,75 +207,144 @@ long ht_table_size (struct ht_table *ht)
   return ht->count;
 }
 
+/* FNV-1a, then a final mix so that the low bits picking the bucket
+ * depend on every byte of the key. */
 static unsigned int
 get_hash (const void *key, int keylen)
 {
-  unsigned int hkey = 0;
+  const unsigned char *p = key;
+  unsigned int hkey = 2166136261u;
   int      i;
 
   for (i = 0; i < keylen; i++) {
-    hkey = (hkey << 5) + hkey + ((const char *)key)[i];
+    hkey = (hkey ^ p[i]) * 16777619u;
   }
+  hkey ^= hkey >> 16;
+  hkey *= 0x85ebca6bu;
+  hkey ^= hkey >> 13;
+  hkey *= 0xc2b2ae35u;
+  hkey ^= hkey >> 16;
 
-  return (hkey % HASH_TABLE_SIZE);
+  return hkey;
 }
 
-void *
-texpdf_ht_lookup_table (struct ht_table *ht, const void *key, int keylen)
+#define HT_BUCKET(ht,h) ((ht)->table + ((h) & ((ht)->size - 1)))
+
+static struct ht_entry *
+ht_find (struct ht_table *ht, const void *key, int keylen, unsigned int hkey)
 {
   struct ht_entry *hent;
-  unsigned int     hkey;
 
-  ASSERT(ht && key);
+  if (ht->size == 0)
+    return NULL;
 
-  hkey = get_hash(key, keylen);
-  hent = ht->table[hkey];
-  while (hent) {
-    if (hent->keylen == keylen &&
+  for (hent = *HT_BUCKET(ht, hkey); hent; hent = hent->next) {
+    if (hent->hkey == hkey && hent->keylen == keylen &&
 	!memcmp(hent->key, key, keylen)) {
-      return hent->value;
+      return hent;
     }
-    hent = hent->next;
   }
 
   return NULL;
 }
 
+/* Doubles the number of buckets. Entries of bucket i go to i or i + size,
+ * keeping their order, so that the first of several entries with the
+ * same key is still the one found. */
+static void
+ht_grow (struct ht_table *ht)
+{
+  struct ht_entry **table;
+  long   size, i;
+
+  size  = ht->size ? 2 * ht->size : HASH_TABLE_SIZE;
+  table = NEW(size, struct ht_entry *);
+  for (i = 0; i < size; i++)
+    table[i] = NULL;
+
+  for (i = 0; i < ht->size; i++) {
+    struct ht_entry *hent, *next, **tail[2];
+
+    tail[0] = &table[i];
+    tail[1] = &table[i + ht->size];
+    for (hent = ht->table[i]; hent; hent = next) {
+      int half = (hent->hkey & ht->size) ? 1 : 0;
+
+      next = hent->next;
+      hent->next  = NULL;
+      *tail[half] = hent;
+      tail[half]  = &hent->next;
+    }
+  }
+
+  if (ht->table)
+    RELEASE(ht->table);
+  ht->table = table;
+  ht->size  = size;
+}
+
+/* Adds a new entry at the end of its bucket. */
+static void
+ht_add (struct ht_table *ht,
+	const void *key, int keylen, unsigned int hkey, void *value)
+{
+  struct ht_entry *hent, **last;
+
+  if (ht->count >= ht->size)
+    ht_grow(ht);
+
+  hent = (struct ht_entry *) new(sizeof(struct ht_entry) + keylen);
+  hent->key    = (char *) (hent + 1);
+  memcpy(hent->key, key, keylen);
+  hent->keylen = keylen;
+  hent->hkey   = hkey;
+  hent->value  = value;
+  hent->next   = NULL;
+
+  for (last = HT_BUCKET(ht, hkey); *last; last = &(*last)->next)
+    ;
+  *last = hent;
+
+  ht->count++;
+}
+
+void *
+texpdf_ht_lookup_table (struct ht_table *ht, const void *key, int keylen)
+{
+  struct ht_entry *hent;
+
+  ASSERT(ht && key);
+
+  hent = ht_find(ht, key, keylen, get_hash(key, keylen));
+
+  return hent ? hent->value : NULL;
+}
+
 int
 ht_remove_table (struct ht_table *ht,
 		 const void *key, int keylen)
 /* returns 1 if the element was found and removed and 0 otherwise */
 {
-  struct ht_entry *hent, *prev;
+  struct ht_entry *hent, **prev;
   unsigned int     hkey;
 
   ASSERT(ht && key);
 
+  if (ht->size == 0)
+    return 0;
+
   hkey = get_hash(key, keylen);
-  hent = ht->table[hkey];
-  prev = NULL;
-  while (hent) {
-    if (hent->keylen == keylen &&
+  for (prev = HT_BUCKET(ht, hkey); (hent = *prev) != NULL; prev = &hent->next) {
+    if (hent->hkey == hkey && hent->keylen == keylen &&
 	!memcmp(hent->key, key, keylen)) {
       break;
     }
-    prev = hent;
-    hent = hent->next;
   }
   if (hent) {
-    if (hent->key)
-      RELEASE(hent->key);
-    hent->key    = NULL;
-    hent->keylen = 0;
     if (hent->value && ht->hval_free_fn) {
       ht->hval_free_fn(hent->value);
     }
-    hent->value  = NULL;
-    if (prev) {
-      prev->next = hent->next;
-    } else {
-      ht->table[hkey] = hent->next;
-    }
+    *prev = hent->next;
     RELEASE(hent);
     ht->count--;
     return 1;
@@ -293,39 +357,19 @@ void
 ht_insert_table (struct ht_table *ht,
 		 const void *key, int keylen, void *value)
 {
-  struct ht_entry *hent, *prev;
+  struct ht_entry *hent;
   unsigned int     hkey;
 
   ASSERT(ht && key);
 
   hkey = get_hash(key, keylen);
-  hent = ht->table[hkey];
-  prev = NULL;
-  while (hent) {
-    if (hent->keylen == keylen &&
-	!memcmp(hent->key, key, keylen)) {
-      break;
-    }
-    prev = hent;
-    hent = hent->next;
-  }
+  hent = ht_find(ht, key, keylen, hkey);
   if (hent) {
-      if (hent->value && ht->hval_free_fn)
-	ht->hval_free_fn(hent->value);
-      hent->value  = value;
-  } else {
-    hent = NEW(1, struct ht_entry);
-    hent->key = NEW(keylen, char);
-    memcpy(hent->key, key, keylen);
-    hent->keylen = keylen;
+    if (hent->value && ht->hval_free_fn)
+      ht->hval_free_fn(hent->value);
     hent->value  = value;
-    hent->next   = NULL;
-    if (prev) {
-      prev->next      = hent;
-    } else {
-      ht->table[hkey] = hent;
-    }
-    ht->count++;
+  } else {
+    ht_add(ht, key, keylen, hkey, value);
   }
 }
 
@@ -333,39 +377,19 @@ void
 texpdf_ht_append_table (struct ht_table *ht,
 		 const void *key, int keylen, void *value) 
 {
-  struct ht_entry *hent, *last;
-  unsigned int hkey;
-
-  hkey = get_hash(key, keylen);
-  hent = ht->table[hkey];
-  if (!hent) {
-    hent = NEW(1, struct ht_entry);
-    ht->table[hkey] = hent;
-  } else {
-    while (hent) {
-      last = hent;
-      hent = hent->next;
-    }
-    hent = NEW(1, struct ht_entry);
-    last->next = hent;
-  }
-  hent->key = NEW(keylen, char);
-  memcpy(hent->key, key, keylen);
-  hent->keylen = keylen;
-  hent->value  = value;
-  hent->next   = NULL;
+  ASSERT(ht && key);
 
-  ht->count++;
+  ht_add(ht, key, keylen, get_hash(key, keylen), value);
 }
 
 int
 ht_set_iter (struct ht_table *ht, struct ht_iter *iter)
 {
-  int    i;
+  long   i;
 
-  ASSERT(ht && ht->table && iter);
+  ASSERT(ht && iter);
 
-  for (i = 0; i < HASH_TABLE_SIZE; i++) {
+  for (i = 0; i < ht->size; i++) {
     if (ht->table[i]) {
       iter->index = i;
       iter->curr  = ht->table[i];
@@ -381,7 +405,7 @@ void
 ht_clear_iter (struct ht_iter *iter)
 {
   if (iter) {
-    iter->index = HASH_TABLE_SIZE;
+    iter->index = iter->hash ? iter->hash->size : 0;
     iter->curr  = NULL;
     iter->hash  = NULL;
   }
@@ -427,7 +451,7 @@ ht_iter_next (struct ht_iter *iter)
   hent = (struct ht_entry *) iter->curr;
   hent = hent->next;
   while (!hent &&
-         ++iter->index < HASH_TABLE_SIZE) {
+         ++iter->index < ht->size) {
     hent = ht->table[iter->index];
   }
   iter->curr = hent;
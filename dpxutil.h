@@ -54,11 +54,16 @@ extern unsigned char ostrtouc (unsigned char **inbuf,
 extern unsigned char esctouc  (unsigned char **inbuf,
 			       unsigned char *inbufend, unsigned char *valid);
 
-#define HASH_TABLE_SIZE 503
+/* Buckets are allocated on the first insertion, HASH_TABLE_SIZE of them,
+ * and doubled whenever there would be more entries than buckets. Lookups
+ * never change the table.
+ */
+#define HASH_TABLE_SIZE 64
 
 struct ht_entry {
-  char  *key;
+  char  *key;    /* Stored in the same block as the entry */
   int    keylen;
+  unsigned int hkey;
 
   void  *value;
 
@@ -70,7 +75,8 @@ typedef void (*hval_free_func) (void *);
 struct ht_table {
   long   count;
   hval_free_func hval_free_fn;
-  struct ht_entry *table[HASH_TABLE_SIZE];
+  long   size;   /* Number of buckets, a power of two, or 0 */
+  struct ht_entry **table;
 };
 
 extern void  texpdf_ht_init_table   (struct ht_table *ht,
@@ -31,6 +31,9 @@
 
 #include "libtexpdf.h"
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 static int  rect_equal       (pdf_obj *rect1, pdf_obj *rect2);
 #if 0
 #if HAVE_ZLIB
@@ -149,135 +152,70 @@ texpdf_get_page_obj (pdf_file *pf, long page_no,
       texpdf_release_obj(markinfo);
     }
 
-    page_tree = pdf_deref_obj(texpdf_lookup_dict(catalog, "Pages"));
     texpdf_release_obj(catalog);
   }
-  if (!page_tree) {
-    WARN("Page tree not found.");
-    return NULL;
-  }
 
   /*
    * Negative page numbers are counted from the back.
    */
   {
-    long count = texpdf_number_value(texpdf_lookup_dict(page_tree, "Count"));
+    long count = pdf_file_get_page_count(pf);
+    if (count <= 0) {
+      WARN("Page tree not found.");
+      return NULL;
+    }
     page_idx = page_no + (page_no >= 0 ? -1 : count);
     if (page_idx < 0 || page_idx >= count) {
-	WARN("Page %ld does not exist.", page_no);
-	texpdf_release_obj(page_tree);
-	return NULL;
-      }
+      WARN("Page %ld does not exist.", page_no);
+      return NULL;
+    }
     page_no = page_idx+1;
   }
 
   /*
-   * Seek correct page. Get Media/Crop Box.
+   * Get the page and its Media/Crop Box from the page index of the file.
    * Media box and resources can be inherited.
    */
   {
-    pdf_obj *kids_ref, *kids;
     pdf_obj *crop_box = NULL;
     pdf_obj *tmp;
 
-    tmp = texpdf_lookup_dict(page_tree, "Resources");
-    resources = tmp ? pdf_deref_obj(tmp) : texpdf_new_dict();
+    page_tree = pdf_file_get_page(pf, page_no,
+				  &bbox, &crop_box, &rotate, &resources);
+    if (!page_tree) {
+      WARN("Page %ld not found! Broken PDF file?", page_no);
+      return NULL;
+    }
+    if (!resources)
+      resources = texpdf_new_dict();
 
-    while (1) {
-      long kids_length, i;
- 
-      if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "MediaBox")))) {
+    if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "BleedBox")))) {
+      if (!rect_equal(tmp, bbox)) {
 	if (bbox)
 	  texpdf_release_obj(bbox);
 	bbox = tmp;
-      }
-      if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "BleedBox")))) {
-        if (!rect_equal(tmp, bbox)) {
-	  if (bbox)
-	    texpdf_release_obj(bbox);
-	  bbox = tmp;
-        } else
-          texpdf_release_obj(tmp);
-      }
-      if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "TrimBox")))) {
-        if (!rect_equal(tmp, bbox)) {
-	  if (bbox)
-	    texpdf_release_obj(bbox);
-	  bbox = tmp;
-        } else
-          texpdf_release_obj(tmp);
-      }
-      if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "ArtBox")))) {
-        if (!rect_equal(tmp, bbox)) {
-	  if (bbox)
-	    texpdf_release_obj(bbox);
-	  bbox = tmp;
-        } else
-          texpdf_release_obj(tmp);
-      }
-      if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "CropBox")))) {
-	if (crop_box)
-	  texpdf_release_obj(crop_box);
-	crop_box = tmp;
-      }
-      if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "Rotate")))) {
-	if (rotate)
-	  texpdf_release_obj(rotate);
-	rotate = tmp;
-      }
-      if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "Resources")))) {
-#if 0
-	texpdf_merge_dict(tmp, resources);
-#endif
-	if (resources)
-	  texpdf_release_obj(resources);
-	resources = tmp;
-      }
-
-      kids_ref = texpdf_lookup_dict(page_tree, "Kids");
-      if (!kids_ref)
-	break;
-      kids = pdf_deref_obj(kids_ref);
-      kids_length = texpdf_array_length(kids);
-
-      for (i = 0; i < kids_length; i++) {
-	long count;
-
-	texpdf_release_obj(page_tree);
-	page_tree = pdf_deref_obj(texpdf_get_array(kids, i));
-
-	tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "Count"));
-	if (tmp) {
-	  /* Pages object */
-	  count = texpdf_number_value(tmp);
-	  texpdf_release_obj(tmp);
-	} else
-	  /* Page object */
-	  count = 1;
-
-	if (page_idx < count)
-	  break;
-
-	page_idx -= count;
-      }
-      
-      texpdf_release_obj(kids);
-
-      if (i == kids_length) {
-	WARN("Page %ld not found! Broken PDF file?", page_no);
+      } else
+	texpdf_release_obj(tmp);
+    }
+    if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "TrimBox")))) {
+      if (!rect_equal(tmp, bbox)) {
 	if (bbox)
 	  texpdf_release_obj(bbox);
-	if (crop_box)
-	  texpdf_release_obj(crop_box);
-	if (rotate)
-	  texpdf_release_obj(rotate);
-	texpdf_release_obj(resources);
-	texpdf_release_obj(page_tree);
-	return NULL;
-      }
+	bbox = tmp;
+      } else
+	texpdf_release_obj(tmp);
+    }
+    if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "ArtBox")))) {
+      if (!rect_equal(tmp, bbox)) {
+	if (bbox)
+	  texpdf_release_obj(bbox);
+	bbox = tmp;
+      } else
+	texpdf_release_obj(tmp);
     }
     if (crop_box) {
-      texpdf_release_obj(bbox);
+      if (bbox)
+	texpdf_release_obj(bbox);
       bbox = crop_box;
     }
   }
@@ -437,6 +375,11 @@ pdf_include_page (pdf_ximage *ximage, FILE *image_file, const char *filename)
        * may contain indirect references.
        */
       content_new = pdf_import_object(contents);
+    } else if (PDF_OBJ_ARRAYTYPE(contents) &&
+	       (content_new = pdf_join_flate_streams(contents)) != NULL) {
+      /*
+       * All segments are compressed alike: their data is joined as is.
+       */
     } else if (PDF_OBJ_ARRAYTYPE(contents)) {
       /*
        * Concatenate all content streams.
@@ -601,6 +544,23 @@ static struct operator
 };
 
 
+/* Name the parsed file is kept under, so clipping paths taken from the
+ * same PDF over and over reuse its xref table and page index.
+ */
+static const char *
+clip_file_ident (FILE *file, char *buf)
+{
+  struct stat st;
+
+  if (fstat(fileno(file), &st) < 0 || !S_ISREG(st.st_mode))
+    return NULL;
+  sprintf(buf, "clip:%lu:%lu:%ld:%ld",
+	  (unsigned long) st.st_dev, (unsigned long) st.st_ino,
+	  (long) st.st_size, (long) st.st_mtime);
+
+  return buf;
+}
+
 int
 texpdf_copy_clip (pdf_doc *p, FILE *image_file, int pageNo, double x_user, double y_user)
 {
@@ -608,15 +568,18 @@ texpdf_copy_clip (pdf_doc *p, FILE *image_file, int pageNo, double x_user, doubl
   int depth = 0, top = -1;
   const char *clip_path, *end_path;
   char *save_path, *temp;
+  char ident[96];
   pdf_tmatrix M;
   double stack[6];
   pdf_file *pf;
+
+  texpdf_doc_select(p);
   
-  pf = texpdf_open(NULL, image_file);
+  pf = texpdf_open(clip_file_ident(image_file, ident), image_file);
   if (!pf)
     return -1;
 
-  texpdf_dev_currentmatrix(&M);
+  texpdf_dev_currentmatrix(p, &M);
   texpdf_invertmatrix(&M);
   M.e += x_user; M.f += y_user;
   page_tree = texpdf_get_page_obj (pf, pageNo, NULL, NULL);
@@ -719,7 +682,7 @@ texpdf_copy_clip (pdf_doc *p, FILE *image_file, int pageNo, double x_user, doubl
 	    return -1;
 	  break;
 	case OP_CLOSEandCLIP:
-	  texpdf_dev_closepath();
+	  texpdf_dev_closepath(p);
 	case OP_CLIP:
 #if 0
 	  texpdf_dev_clip();
@@ -763,11 +726,11 @@ texpdf_copy_clip (pdf_doc *p, FILE *image_file, int pageNo, double x_user, doubl
 	    texpdf_dev_transform(&p1, &M);
 	    texpdf_dev_transform(&p2, &M);
 	    texpdf_dev_transform(&p3, &M);
-	    texpdf_dev_moveto(p0.x, p0.y);
-	    texpdf_dev_lineto(p1.x, p1.y);
-	    texpdf_dev_lineto(p2.x, p2.y);
-	    texpdf_dev_lineto(p3.x, p3.y);
-	    texpdf_dev_closepath();
+	    texpdf_dev_moveto(p, p0.x, p0.y);
+	    texpdf_dev_lineto(p, p1.x, p1.y);
+	    texpdf_dev_lineto(p, p2.x, p2.y);
+	    texpdf_dev_lineto(p, p3.x, p3.y);
+	    texpdf_dev_closepath(p);
 	  }
 	  break;
 	case OP_CURVETO:
@@ -782,10 +745,10 @@ texpdf_copy_clip (pdf_doc *p, FILE *image_file, int pageNo, double x_user, doubl
 	  p2.y = stack[top--];
 	  p2.x = stack[top--];
 	  texpdf_dev_transform(&p2, &M);
-	  texpdf_dev_curveto(p2.x, p2.y, p1.x, p1.y, p0.x, p0.y);
+	  texpdf_dev_curveto(p, p2.x, p2.y, p1.x, p1.y, p0.x, p0.y);
 	  break;
 	case OP_CLOSEPATH:
-	  texpdf_dev_closepath();
+	  texpdf_dev_closepath(p);
 	  break;
 	case OP_LINETO:
 	  if (top < 1)
@@ -793,7 +756,7 @@ texpdf_copy_clip (pdf_doc *p, FILE *image_file, int pageNo, double x_user, doubl
 	  p0.y = stack[top--];
 	  p0.x = stack[top--];
 	  texpdf_dev_transform(&p0, &M);
-	  texpdf_dev_lineto(p0.x, p0.y);
+	  texpdf_dev_lineto(p, p0.x, p0.y);
 	  break;
 	case OP_MOVETO:
 	  if (top < 1)
@@ -801,7 +764,7 @@ texpdf_copy_clip (pdf_doc *p, FILE *image_file, int pageNo, double x_user, doubl
 	  p0.y = stack[top--];
 	  p0.x = stack[top--];
 	  texpdf_dev_transform(&p0, &M);
-	  texpdf_dev_moveto(p0.x, p0.y);
+	  texpdf_dev_moveto(p, p0.x, p0.y);
 	  break;
 	case OP_NOOP:
 	  texpdf_doc_add_page_content(p, " n", 2);
@@ -821,7 +784,7 @@ texpdf_copy_clip (pdf_doc *p, FILE *image_file, int pageNo, double x_user, doubl
 	  p1.y = stack[top--];
 	  p1.x = stack[top--];
 	  texpdf_dev_transform(&p1, &M);
-	  texpdf_dev_vcurveto(p1.x, p1.y, p0.x, p0.y);
+	  texpdf_dev_vcurveto(p, p1.x, p1.y, p0.x, p0.y);
 	  break;
 	case OP_CURVETO2:
 	  if (top < 3)
@@ -832,7 +795,7 @@ texpdf_copy_clip (pdf_doc *p, FILE *image_file, int pageNo, double x_user, doubl
 	  p1.y = stack[top--];
 	  p1.x = stack[top--];
 	  texpdf_dev_transform(&p1, &M);
-	  texpdf_dev_ycurveto(p1.x, p1.y, p0.x, p0.y);
+	  texpdf_dev_ycurveto(p, p1.x, p1.y, p0.x, p0.y);
 	  break;
 	default:
 	  return -1;
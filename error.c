@@ -33,11 +33,12 @@
 
 #include "error.h"
 #include "pdfobj.h"
+#include "dpxthread.h"
 #define DPX_MESG        0
 #define DPX_MESG_WARN   1
 #define DPX_MESG_ERROR  2
 
-static int _mesg_type = DPX_MESG;
+static DPX_THREAD_LOCAL int _mesg_type = DPX_MESG;
 #define WANT_NEWLINE() (_mesg_type != DPX_MESG_WARN && _mesg_type != DPX_MESG_ERROR)
 
 static int  really_quiet = 2;
@@ -0,0 +1,427 @@
+/* This is libtexpdf, a PDF output library derived from dvipdfmx,
+   an eXtended version of dvipdfm by Mark A. Wicks.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+#include "libtexpdf.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#define FONT_CACHE_MMAP 1
+#endif
+
+#include "dpxthread.h"
+#include "fontcache.h"
+
+#define FONT_CACHE_SIZE (32L << 20)
+
+#ifdef XETEX
+struct font_face
+{
+  unsigned long     index;
+  FT_Face           face;
+  struct font_face *next;
+};
+#endif
+
+/* A table parsed from the file, see font_cache_find_table() */
+struct font_table
+{
+  char                 kind[4];
+  unsigned long        offset;
+  unsigned long        param;
+  void                *data;
+  long                 size;
+  font_table_free_func free_fn;
+  struct font_table   *next;
+};
+
+struct font_file
+{
+  dev_t          dev;
+  ino_t          ino;
+  off_t          size;
+  time_t         mtime;
+
+  unsigned char *data;
+  unsigned long  length;
+  int            mapped;
+
+  int            refcount;
+#ifdef XETEX
+  struct font_face *faces;
+#endif
+  struct font_table *tables;
+  long           tables_size;
+  font_file     *prev, *next; /* most recently used first */
+};
+
+static struct {
+  font_file *head, *tail;
+  long       size;
+  long       limit;
+} cache = { NULL, NULL, 0, FONT_CACHE_SIZE };
+
+/* Every call changes the list or a reference count, so only the write
+ * side of this lock is used. */
+static dpx_rwlock cache_lock = DPX_RWLOCK_INITIALIZER;
+
+#ifdef XETEX
+static FT_Library ftLib;
+static int        ftLib_ready = 0;
+#endif
+
+static void
+cache_unlink (font_file *file)
+{
+  if (file->prev)
+    file->prev->next = file->next;
+  else
+    cache.head = file->next;
+  if (file->next)
+    file->next->prev = file->prev;
+  else
+    cache.tail = file->prev;
+  file->prev = file->next = NULL;
+}
+
+static void
+cache_push (font_file *file)
+{
+  file->prev = NULL;
+  file->next = cache.head;
+  if (cache.head)
+    cache.head->prev = file;
+  else
+    cache.tail = file;
+  cache.head = file;
+}
+
+static void
+font_file_free (font_file *file)
+{
+#ifdef XETEX
+  while (file->faces) {
+    struct font_face *f = file->faces;
+    file->faces = f->next;
+    FT_Done_Face(f->face);
+    RELEASE(f);
+  }
+#endif
+  while (file->tables) {
+    struct font_table *t = file->tables;
+    file->tables = t->next;
+    t->free_fn(t->data);
+    RELEASE(t);
+  }
+  cache_unlink(file);
+  cache.size -= file->length + file->tables_size;
+#ifdef FONT_CACHE_MMAP
+  if (file->mapped)
+    munmap(file->data, file->length);
+  else
+#endif
+    RELEASE(file->data);
+  RELEASE(file);
+}
+
+/* Drop unused files, least recently used first, until within the limit. */
+static void
+cache_trim (void)
+{
+  font_file *file, *prev;
+
+  for (file = cache.tail; file && cache.size > cache.limit; file = prev) {
+    prev = file->prev;
+    if (file->refcount == 0)
+      font_file_free(file);
+  }
+}
+
+static int
+font_file_load (font_file *file, FILE *fp)
+{
+  size_t length = file->size;
+
+  file->length = length;
+  file->mapped = 0;
+#ifdef FONT_CACHE_MMAP
+  file->data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+  if (file->data != MAP_FAILED) {
+    file->mapped = 1;
+    return 0;
+  }
+#endif
+  file->data = NEW(length, unsigned char);
+  rewind(fp);
+  if (fread(file->data, 1, length, fp) != length) {
+    RELEASE(file->data);
+    return -1;
+  }
+  rewind(fp);
+
+  return 0;
+}
+
+static font_file *
+cache_open (FILE *fp)
+{
+  struct stat st;
+  font_file  *file, *next;
+
+  if (!fp || fstat(fileno(fp), &st) < 0 ||
+      !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+      (unsigned long) st.st_size != st.st_size)
+    return NULL;
+
+  for (file = cache.head; file; file = next) {
+    next = file->next;
+    if (file->dev != st.st_dev || file->ino != st.st_ino)
+      continue;
+    if (file->size == st.st_size && file->mtime == st.st_mtime) {
+      file->refcount++;
+      cache_unlink(file);
+      cache_push(file);
+      return file;
+    }
+    /* The file has changed on disk since it was loaded. */
+    if (file->refcount == 0)
+      font_file_free(file);
+  }
+
+  file = NEW(1, font_file);
+  file->dev   = st.st_dev;
+  file->ino   = st.st_ino;
+  file->size  = st.st_size;
+  file->mtime = st.st_mtime;
+  if (font_file_load(file, fp) < 0) {
+    RELEASE(file);
+    return NULL;
+  }
+  file->refcount = 1;
+#ifdef XETEX
+  file->faces = NULL;
+#endif
+  file->tables      = NULL;
+  file->tables_size = 0;
+  cache_push(file);
+  cache.size += file->length;
+  cache_trim();
+
+  return file;
+}
+
+static void
+cache_release (font_file *file)
+{
+  ASSERT(file->refcount > 0);
+  if (--file->refcount == 0)
+    cache_trim();
+}
+
+font_file *
+font_cache_open (FILE *fp)
+{
+  font_file *file;
+
+  dpx_write_lock(&cache_lock);
+  file = cache_open(fp);
+  dpx_unlock(&cache_lock);
+
+  return file;
+}
+
+void
+font_cache_release (font_file *file)
+{
+  if (!file)
+    return;
+
+  dpx_write_lock(&cache_lock);
+  cache_release(file);
+  dpx_unlock(&cache_lock);
+}
+
+const unsigned char *
+font_cache_data (font_file *file, unsigned long *length)
+{
+  ASSERT(file);
+
+  *length = file->length;
+  return file->data;
+}
+
+static struct font_table *
+table_lookup (font_file *file, const char *kind,
+              unsigned long offset, unsigned long param)
+{
+  struct font_table *t;
+
+  for (t = file->tables; t; t = t->next) {
+    if (t->offset == offset && t->param == param &&
+        !memcmp(t->kind, kind, 4))
+      return t;
+  }
+
+  return NULL;
+}
+
+void *
+font_cache_find_table (font_file *file, const char *kind,
+                       unsigned long offset, unsigned long param)
+{
+  struct font_table *t;
+
+  if (!file)
+    return NULL;
+
+  dpx_write_lock(&cache_lock);
+  t = table_lookup(file, kind, offset, param);
+  if (t)
+    file->refcount++;
+  dpx_unlock(&cache_lock);
+
+  return t ? t->data : NULL;
+}
+
+void *
+font_cache_add_table (font_file *file, const char *kind,
+                      unsigned long offset, unsigned long param,
+                      void *data, long size, font_table_free_func free_fn)
+{
+  struct font_table *t;
+
+  ASSERT(file && data);
+
+  dpx_write_lock(&cache_lock);
+  t = table_lookup(file, kind, offset, param);
+  if (t) {
+    /* Another thread was first */
+    file->refcount++;
+    dpx_unlock(&cache_lock);
+    free_fn(data);
+    return t->data;
+  }
+  t = NEW(1, struct font_table);
+  memcpy(t->kind, kind, 4);
+  t->offset  = offset;
+  t->param   = param;
+  t->data    = data;
+  t->size    = size;
+  t->free_fn = free_fn;
+  t->next    = file->tables;
+  file->tables = t;
+  file->tables_size += size;
+  file->refcount++;
+  cache.size += size;
+  cache_trim();
+  dpx_unlock(&cache_lock);
+
+  return data;
+}
+
+#ifdef XETEX
+FT_Face
+font_cache_face (const char *path, unsigned long index)
+{
+  font_file        *file;
+  struct font_face *f;
+  FT_Face           face = NULL;
+  FILE             *fp;
+
+  fp = fopen(path, FOPEN_RBIN_MODE);
+  if (!fp)
+    return NULL;
+
+  /* Held throughout: the FreeType library is not safe to share either. */
+  dpx_write_lock(&cache_lock);
+  if (!ftLib_ready) {
+    if (FT_Init_FreeType(&ftLib) != 0) {
+      dpx_unlock(&cache_lock);
+      fclose(fp);
+      ERROR("FreeType initialization failed.");
+      return NULL;
+    }
+    ftLib_ready = 1;
+  }
+
+  file = cache_open(fp);
+  fclose(fp);
+
+  if (!file) {
+    /* Not a regular file: give FreeType the path, uncached. */
+    if (FT_New_Face(ftLib, path, index, &face) == 0)
+      face->generic.data = NULL;
+    else
+      face = NULL;
+    goto done;
+  }
+
+  for (f = file->faces; f; f = f->next) {
+    if (f->index == index) {
+      face = f->face;
+      goto done;
+    }
+  }
+
+  if (FT_New_Memory_Face(ftLib, file->data, file->length, index, &face) != 0 &&
+      FT_New_Face(ftLib, path, index, &face) != 0) {
+    cache_release(file);
+    face = NULL;
+    goto done;
+  }
+  face->generic.data = file;
+
+  f = NEW(1, struct font_face);
+  f->index = index;
+  f->face  = face;
+  f->next  = file->faces;
+  file->faces = f;
+
+done:
+  dpx_unlock(&cache_lock);
+
+  return face;
+}
+
+void
+font_cache_ref_face (FT_Face face)
+{
+  if (face && face->generic.data) {
+    dpx_write_lock(&cache_lock);
+    ((font_file *) face->generic.data)->refcount++;
+    dpx_unlock(&cache_lock);
+  }
+}
+
+void
+font_cache_done_face (FT_Face face)
+{
+  if (face && face->generic.data)
+    font_cache_release(face->generic.data);
+}
+#endif /* XETEX */
+
+void
+texpdf_set_font_cache_size (long bytes)
+{
+  dpx_write_lock(&cache_lock);
+  cache.limit = bytes < 0 ? 0 : bytes;
+  cache_trim();
+  dpx_unlock(&cache_lock);
+}
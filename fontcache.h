@@ -0,0 +1,81 @@
+/* This is libtexpdf, a PDF output library derived from dvipdfmx,
+   an eXtended version of dvipdfm by Mark A. Wicks.
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA.
+*/
+
+#ifndef _FONTCACHE_H_
+#define _FONTCACHE_H_
+
+#include <stdio.h>
+
+#ifdef XETEX
+#include "ft2build.h"
+#include FT_FREETYPE_H
+#endif
+
+/* Font files held in memory for the life of the process.
+ *
+ * Files are identified by device, inode, size and modification time, so
+ * a font replaced on disk is loaded afresh. Each file is mapped (or read)
+ * once and shared by every sfnt and FreeType face opened on it, in any
+ * number of documents. Entries are reference counted; files no longer in
+ * use are kept, most recently used first, until the total exceeds the
+ * limit set with texpdf_set_font_cache_size().
+ *
+ * Tables parsed from a file (cmap subtables, hmtx and loca, CFF INDEX
+ * offsets) are kept with it as well, and count against the same limit.
+ */
+typedef struct font_file font_file;
+
+extern font_file *font_cache_open    (FILE *fp);
+extern void       font_cache_release (font_file *file);
+extern const unsigned char *font_cache_data (font_file *file,
+                                             unsigned long *length);
+
+/* Parsed tables are identified by a four-letter kind, their offset in
+ * the file and one more number chosen by the parser. They are shared
+ * between threads and must not be changed. Both functions take a
+ * reference to the file along with the table they return, which is
+ * given back with font_cache_release(). font_cache_add_table() frees
+ * DATA and returns the table already there if another thread added the
+ * same one first.
+ */
+typedef void (*font_table_free_func) (void *data);
+
+extern void      *font_cache_find_table (font_file *file, const char *kind,
+                                         unsigned long offset,
+                                         unsigned long param);
+extern void      *font_cache_add_table  (font_file *file, const char *kind,
+                                         unsigned long offset,
+                                         unsigned long param, void *data,
+                                         long size,
+                                         font_table_free_func free_fn);
+
+#ifdef XETEX
+/* Returns a face for the font file at `path` with a reference held,
+ * or NULL on failure. Faces must be given back with font_cache_done_face().
+ */
+extern FT_Face    font_cache_face      (const char *path, unsigned long index);
+extern void       font_cache_ref_face  (FT_Face face);
+extern void       font_cache_done_face (FT_Face face);
+#endif
+
+/* Memory kept for font files, in bytes (default 32 MiB). Files in use
+ * are never dropped; 0 releases each file as soon as it is unused.
+ */
+extern void       texpdf_set_font_cache_size (long bytes);
+
+#endif /* _FONTCACHE_H_ */
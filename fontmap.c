@@ -29,9 +29,11 @@
 
 #include "dpxfile.h"
 #include "dpxutil.h"
+#include "dpxthread.h"
 
 #include "subfont.h"
 
+#include "fontcache.h"
 #include "fontmap.h"
 
 #ifdef XETEX
@@ -86,8 +88,6 @@ texpdf_init_fontmap_record (fontmap_rec *mrec)
 #ifdef XETEX
   mrec->opt.ft_face   = NULL;
 #endif
-
-  mrec->opt.cff_charsets = NULL;
 }
 
 void
@@ -112,6 +112,9 @@ texpdf_clear_fontmap_record (fontmap_rec *mrec)
     RELEASE(mrec->opt.otl_tags);
   if (mrec->opt.charcoll)
     RELEASE(mrec->opt.charcoll);
+#ifdef XETEX
+  font_cache_done_face(mrec->opt.ft_face);
+#endif
   texpdf_init_fontmap_record(mrec);
 }
 
@@ -156,9 +159,8 @@ texpdf_copy_fontmap_record (fontmap_rec *dst, const fontmap_rec *src)
 
 #ifdef XETEX
   dst->opt.ft_face   = src->opt.ft_face;
+  font_cache_ref_face(dst->opt.ft_face);
 #endif
-
-  dst->opt.cff_charsets = src->opt.cff_charsets;
 }
 
 
@@ -221,6 +223,25 @@ pdftex_fill_in_defaults (fontmap_rec *mrec, const char *tex_name)
 
 fontmap_t *native_fontmap = NULL;
 
+/* Fontmaps are shared by all open documents: records are looked up
+ * under a read lock and only inserted under the write lock.
+ */
+static dpx_rwlock fontmap_lock = DPX_RWLOCK_INITIALIZER;
+
+/* Called with the write lock held. A record of the native fontmap may
+ * be in use by any document, so the first one put under a key stays.
+ */
+static void
+fontmap_put (fontmap_t *map, const char *key, fontmap_rec *mrec)
+{
+  if (map == native_fontmap &&
+      texpdf_ht_lookup_table(map, key, strlen(key))) {
+    hval_free(mrec);
+    return;
+  }
+  ht_insert_table(map, key, strlen(key), mrec);
+}
+
 #define fontmap_invalid(m) (!(m) || !(m)->map_name || !(m)->font_name)
 char *
 texpdf_chop_sfd_name (const char *tex_name, char **sfd_name)
@@ -287,20 +308,12 @@ texpdf_make_subfont_name (const char *map_name, const char *sfd_name, const char
   return  tfm_name;
 }
 
-int
-texpdf_insert_fontmap_record (fontmap_t* map, const char *kp, const fontmap_rec *vp)
+static int
+fontmap_insert (fontmap_t *map, const char *kp, const fontmap_rec *vp)
 {
   fontmap_rec *mrec;
   char        *fnt_name, *sfd_name;
 
-  if (!kp || fontmap_invalid(vp)) {
-    WARN("Invalid fontmap record...");
-    return -1;
-  }
-
-  if (verbose > 3)
-    MESG("fontmap>> insert key=\"%s\"...", kp);
-
   fnt_name = texpdf_chop_sfd_name(kp, &sfd_name);
   if (fnt_name && sfd_name) {
     char  *tfm_name;
@@ -325,7 +338,7 @@ texpdf_insert_fontmap_record (fontmap_t* map, const char *kp, const fontmap_rec
       mrec->map_name = mstrdup(kp); /* link to this entry */
       mrec->charmap.sfd_name   = mstrdup(sfd_name);
       mrec->charmap.subfont_id = mstrdup(subfont_ids[n]);
-      ht_insert_table(map, tfm_name, strlen(tfm_name), mrec);
+      fontmap_put(map, tfm_name, mrec);
       RELEASE(tfm_name);
     }
     RELEASE(fnt_name);
@@ -338,12 +351,32 @@ texpdf_insert_fontmap_record (fontmap_t* map, const char *kp, const fontmap_rec
     RELEASE(mrec->map_name);
     mrec->map_name = NULL;
   }
-  ht_insert_table(map, kp, strlen(kp), mrec);
+  fontmap_put(map, kp, mrec);
+
+  return  0;
+}
+
+int
+texpdf_insert_fontmap_record (fontmap_t* map, const char *kp, const fontmap_rec *vp)
+{
+  int  error;
+
+  if (!kp || fontmap_invalid(vp)) {
+    WARN("Invalid fontmap record...");
+    return -1;
+  }
+
+  if (verbose > 3)
+    MESG("fontmap>> insert key=\"%s\"...", kp);
+
+  dpx_write_lock(&fontmap_lock);
+  error = fontmap_insert(map, kp, vp);
+  dpx_unlock(&fontmap_lock);
 
   if (verbose > 3)
     MESG("\n");
 
-  return  0;
+  return  error;
 }
 
 #ifdef XETEX
@@ -359,6 +392,18 @@ texpdf_insert_native_fontmap_record (const char *path, int index, FT_Face face,
   fontmap_key = malloc(strlen(path) + 40);	// CHECK
   sprintf(fontmap_key, "%s/%d/%c/%d/%d/%d", path, index, layout_dir == 0 ? 'H' : 'V', extend, slant, embolden);
 
+  /* Loaded before, maybe by another document still using the record.
+   * The lock is held until the new record is in, so that no other thread
+   * loading the same font puts in one of its own meanwhile.
+   */
+  dpx_write_lock(&fontmap_lock);
+  if (texpdf_ht_lookup_table(native_fontmap, fontmap_key, strlen(fontmap_key))) {
+    dpx_unlock(&fontmap_lock);
+    font_cache_done_face(face);
+    RELEASE(fontmap_key);
+    return 0;
+  }
+
   if (verbose)
     MESG("<NATIVE-FONTMAP:%s", fontmap_key);
 
@@ -372,6 +417,10 @@ texpdf_insert_native_fontmap_record (const char *path, int index, FT_Face face,
   mrec->opt.ft_face = face;
   if (layout_dir != 0)
     mrec->opt.flags |= FONTMAP_OPT_VERT;
+  /* What pdf_font_findresource() assumes for Identity CMaps anyway;
+   * the record is shared and must not be changed there.
+   */
+  mrec->opt.mapc = 0;
 
   pdftex_fill_in_defaults(mrec, fontmap_key);
   
@@ -379,7 +428,8 @@ texpdf_insert_native_fontmap_record (const char *path, int index, FT_Face face,
   mrec->opt.slant  = slant    / 65536.0;
   mrec->opt.bold   = embolden / 65536.0;
   
-  texpdf_insert_fontmap_record(native_fontmap, mrec->map_name, mrec);
+  fontmap_insert(native_fontmap, mrec->map_name, mrec);
+  dpx_unlock(&fontmap_lock);
   texpdf_clear_fontmap_record(mrec);
   RELEASE(mrec);
 
@@ -389,27 +439,19 @@ texpdf_insert_native_fontmap_record (const char *path, int index, FT_Face face,
   return 0;
 }
 
-static FT_Library ftLib;
-
 int
 texpdf_load_native_font (const char *filename, unsigned long index,
                       int layout_dir, int extend, int slant, int embolden)
 {
-  FT_Face face = NULL;
-  int  error = -1;
-
-  if (FT_Init_FreeType(&ftLib) != 0) {
-    ERROR("FreeType initialization failed.");
-    return error;
-  }
+  FT_Face face;
 
   /* try loading the filename directly */
-  error = FT_New_Face(ftLib, filename, index, &face);
+  face = font_cache_face(filename, index);
+  if (!face)
+    return -1;
 
-  if (error == 0)
-    error = texpdf_insert_native_fontmap_record(filename, index, face,
-                                           layout_dir, extend, slant, embolden);
-  return error;
+  return texpdf_insert_native_fontmap_record(filename, index, face,
+                                          layout_dir, extend, slant, embolden);
 }
 #endif /* XETEX */
 
@@ -475,8 +517,11 @@ texpdf_lookup_fontmap_record (fontmap_t* map, const char *tfm_name)
 {
   fontmap_rec *mrec = NULL;
 
-  if (map && tfm_name)
+  if (map && tfm_name) {
+    dpx_read_lock(&fontmap_lock);
     mrec = texpdf_ht_lookup_table(map, tfm_name, strlen(tfm_name));
+    dpx_unlock(&fontmap_lock);
+  }
 
   return  mrec;
 }
@@ -0,0 +1,213 @@
+/* Microbenchmark for the hash tables in dpxutil.c.
+
+Builds tables of 1 thousand, 100 thousand and 1 million keys shaped like
+named destinations, then looks every key up again and as many absent
+keys, after checking that the table finds exactly what it should and
+visits every entry once when iterated. Up to 100 thousand keys the same
+is done with the fixed table of 503 buckets that ht_table used to be.
+
+Built by "make check"; run it as:
+
+./ht-bench [max-keys]
+
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libtexpdf/libtexpdf.h"
+
+#define OLD_TABLE_SIZE 503
+
+struct old_entry {
+  char  *key;
+  int    keylen;
+  void  *value;
+  struct old_entry *next;
+};
+
+struct old_table {
+  struct old_entry *table[OLD_TABLE_SIZE];
+};
+
+static unsigned int
+old_hash (const void *key, int keylen)
+{
+  unsigned int hkey = 0;
+  int      i;
+
+  for (i = 0; i < keylen; i++) {
+    hkey = (hkey << 5) + hkey + ((const char *)key)[i];
+  }
+
+  return (hkey % OLD_TABLE_SIZE);
+}
+
+static void *
+old_lookup (struct old_table *ht, const void *key, int keylen)
+{
+  struct old_entry *hent;
+
+  for (hent = ht->table[old_hash(key, keylen)]; hent; hent = hent->next) {
+    if (hent->keylen == keylen && !memcmp(hent->key, key, keylen))
+      return hent->value;
+  }
+
+  return NULL;
+}
+
+static void
+old_append (struct old_table *ht, const void *key, int keylen, void *value)
+{
+  struct old_entry *hent, **last;
+
+  for (last = &ht->table[old_hash(key, keylen)]; *last; last = &(*last)->next)
+    ;
+  hent = malloc(sizeof(struct old_entry));
+  hent->key = malloc(keylen);
+  memcpy(hent->key, key, keylen);
+  hent->keylen = keylen;
+  hent->value  = value;
+  hent->next   = NULL;
+  *last = hent;
+}
+
+static void
+old_clear (struct old_table *ht)
+{
+  int i;
+
+  for (i = 0; i < OLD_TABLE_SIZE; i++) {
+    struct old_entry *hent, *next;
+    for (hent = ht->table[i]; hent; hent = next) {
+      next = hent->next;
+      free(hent->key);
+      free(hent);
+    }
+    ht->table[i] = NULL;
+  }
+}
+
+static double
+seconds (void)
+{
+  return (double) clock() / CLOCKS_PER_SEC;
+}
+
+#define KEY_SIZE 32
+
+/* n keys shaped like the destinations of a cross-referenced manual,
+ * followed by n more that are not added to the tables.
+ */
+static char *
+make_keys (long n, int *lengths)
+{
+  char *keys = malloc(2 * n * KEY_SIZE);
+  long  i;
+
+  for (i = 0; i < 2 * n; i++)
+    lengths[i] = sprintf(keys + i * KEY_SIZE, "section.%ld.%ld.%ld",
+                         i / 1000 + 1, i / 10 % 100, i % 10);
+
+  return keys;
+}
+
+#define KEY(i) (keys + (i) * KEY_SIZE), lengths[(i)]
+#define VALUE(i) ((void *) (intptr_t) ((i) + 1))
+/* Lookups in shuffled order */
+#define PICK(i) ((i) * 7919 % n)
+
+/* The old table is quadratic to fill; beyond this it takes minutes. */
+#define OLD_MAX_KEYS 100000
+
+static void
+run (long n)
+{
+  struct ht_table   ht;
+  struct ht_iter    iter;
+  struct old_table *old;
+  int    *lengths = malloc(2 * n * sizeof(int));
+  char   *keys = make_keys(n, lengths);
+  long    i, found, visited;
+  double  t, t_new[3], t_old[3];
+
+  texpdf_ht_init_table(&ht, NULL);
+  t = seconds();
+  for (i = 0; i < n; i++)
+    texpdf_ht_append_table(&ht, KEY(i), VALUE(i));
+  t_new[0] = seconds() - t;
+
+  t = seconds(); found = 0;
+  for (i = 0; i < n; i++)
+    found += texpdf_ht_lookup_table(&ht, KEY(PICK(i))) == VALUE(PICK(i));
+  t_new[1] = seconds() - t;
+  if (found != n) {
+    fprintf(stderr, "%ld of %ld keys found\n", found, n);
+    exit(1);
+  }
+
+  t = seconds(); found = 0;
+  for (i = 0; i < n; i++)
+    found += texpdf_ht_lookup_table(&ht, KEY(n + i)) != NULL;
+  t_new[2] = seconds() - t;
+  if (found != 0) {
+    fprintf(stderr, "%ld absent keys found\n", found);
+    exit(1);
+  }
+
+  visited = 0;
+  if (ht_set_iter(&ht, &iter) >= 0) {
+    do {
+      visited++;
+    } while (ht_iter_next(&iter) >= 0);
+    ht_clear_iter(&iter);
+  }
+  if (visited != n || ht_table_size(&ht) != n) {
+    fprintf(stderr, "%ld entries visited, %ld counted, %ld added\n",
+            visited, ht_table_size(&ht), n);
+    exit(1);
+  }
+  texpdf_ht_clear_table(&ht);
+
+  printf("%8ld keys  insert %7.1f ns  hit %7.1f ns  miss %7.1f ns\n",
+         n, t_new[0] * 1e9 / n, t_new[1] * 1e9 / n, t_new[2] * 1e9 / n);
+
+  if (n <= OLD_MAX_KEYS) {
+    old = calloc(1, sizeof(struct old_table));
+    t = seconds();
+    for (i = 0; i < n; i++)
+      old_append(old, KEY(i), VALUE(i));
+    t_old[0] = seconds() - t;
+
+    t = seconds(); found = 0;
+    for (i = 0; i < n; i++)
+      found += old_lookup(old, KEY(PICK(i))) == VALUE(PICK(i));
+    t_old[1] = seconds() - t;
+
+    t = seconds(); found = 0;
+    for (i = 0; i < n; i++)
+      found += old_lookup(old, KEY(n + i)) != NULL;
+    t_old[2] = seconds() - t;
+    old_clear(old);
+    free(old);
+
+    printf("%8s  503 buckets %7.1f ns       %7.1f ns        %7.1f ns\n",
+           "", t_old[0] * 1e9 / n, t_old[1] * 1e9 / n, t_old[2] * 1e9 / n);
+  }
+
+  free(keys);
+  free(lengths);
+}
+
+int main(int argc, char** argv) {
+  long max = argc > 1 ? atol(argv[1]) : 1000000;
+  long n;
+
+  for (n = 1000; n <= max; n *= 100)
+    run(n);
+  if (n / 100 < max)
+    run(max);
+
+  return 0;
+}
@@ -10,7 +10,7 @@ gcc -g -o library-poc  -I.. ./.libs/libtexpdf.a library-poc.c -lpng -lz `pkg-con
 #include <stdint.h>
 #include "libtexpdf/libtexpdf.h"
 
-int load_font (char* filename) {
+int load_font (pdf_doc *p, char* filename) {
   char fontmap_key[1024];
   uint32_t index = 0;
   int layout_dir = 0;
@@ -20,7 +20,7 @@ int load_font (char* filename) {
   double ptsize = 12.0 * 1.5;
   fontmap_rec  *mrec;
   
-  return texpdf_dev_load_native_font(filename, index, ptsize, layout_dir, extend, slant, embolden);
+  return texpdf_dev_load_native_font(p, filename, index, ptsize, layout_dir, extend, slant, embolden);
 }
 
 int main(int argc, char** argv) {
@@ -37,13 +37,13 @@ int main(int argc, char** argv) {
   texpdf_init_fontmaps();
   texpdf_doc_set_mediabox(p, 0, &mediabox);
   texpdf_doc_begin_page(p, 1.0,72.0,770.0);
-  font_id = load_font(argv[1]);
+  font_id = load_font(p, argv[1]);
   printf("ID: %i\n", font_id);
   texpdf_dev_set_string(p, 92.0,-10.0, "HIJKLMNO", 7, 0, font_id, 1);
 
     texpdf_doc_end_page(p);
     texpdf_close_document(p);
 
-  texpdf_close_device  ();
+  texpdf_close_device  (p);
   texpdf_close_fontmaps();    
 }
@@ -50,15 +50,18 @@ extern int compat_mode;
 #include "cidtype0.h"
 #include "cidtype2.h"
 #include "cmap.h"
+#include "cmap_bin.h"
 #include "cmap_p.h"
 #include "cmap_read.h"
 #include "cmap_write.h"
 #include "cs_type2.h"
 #include "dpxcrypt.h"
 #include "dpxfile.h"
+#include "dpxthread.h"
 #include "dpxutil.h"
 #include "epdf.h"
 #include "error.h"
+#include "fontcache.h"
 #include "fontmap.h"
 #include "jp2image.h"
 #include "jpegimage.h"
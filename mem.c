@@ -45,3 +45,298 @@ void *renew (void *mem, size_t size)
     return NULL;
   }
 }
+
+#ifdef HAVE_POSIX_MEMALIGN
+/*
+ * Small blocks of one size class are carved out of chunks of CHUNK_SIZE
+ * bytes, aligned on CHUNK_SIZE so that the chunk of any block is found
+ * by masking its address.  Each chunk has its own free list.  A class
+ * allocates from chunks that still have room; a chunk that becomes
+ * empty is freed, except for one spare per class which trim_small()
+ * gives back.
+ *
+ * Every thread has an arena of its own, so that allocating takes no
+ * lock.  A block released by another thread than the owner of its
+ * chunk is pushed onto the arena's remote list, which the owner takes
+ * over when it next allocates or trims.  The arena of a thread that
+ * ends, with whatever chunks are still in use, waits for the next new
+ * thread.
+ */
+#define SMALL_ALIGN   16
+#define SMALL_CLASSES (SMALL_MAX / SMALL_ALIGN)
+#define CHUNK_SIZE    65536
+#define CHUNK_HEADER  ((sizeof(small_chunk) + SMALL_ALIGN - 1) & ~(SMALL_ALIGN - 1))
+
+typedef struct small_chunk small_chunk;
+typedef struct small_arena small_arena;
+
+struct small_chunk
+{
+  small_chunk *prev, *next; /* chunks of this class with room */
+  void        *free;        /* released blocks */
+  char        *fresh;       /* never used space */
+  unsigned     used;
+  unsigned     class;
+  int          listed;
+  small_arena *arena;       /* owner */
+};
+
+struct small_arena
+{
+  struct {
+    small_chunk *avail;
+    small_chunk *spare;
+  } classes[SMALL_CLASSES];
+  void        *remote;      /* blocks released by other threads */
+  small_arena *next;        /* in idle_arenas */
+};
+
+static DPX_THREAD_LOCAL small_arena *arena = NULL;
+
+/* Arenas of threads that have ended */
+static small_arena *idle_arenas = NULL;
+static dpx_mutex    arena_lock  = DPX_MUTEX_INITIALIZER;
+
+#ifdef HAVE_PTHREAD
+static pthread_key_t  arena_key;
+static pthread_once_t arena_once = PTHREAD_ONCE_INIT;
+
+static void
+arena_idle (void *a)
+{
+  dpx_mutex_lock(&arena_lock);
+  ((small_arena *) a)->next = idle_arenas;
+  idle_arenas = a;
+  dpx_mutex_unlock(&arena_lock);
+}
+
+static void
+arena_key_create (void)
+{
+  pthread_key_create(&arena_key, arena_idle);
+}
+#endif
+
+static small_arena *
+arena_get (void)
+{
+  small_arena *a;
+
+  dpx_mutex_lock(&arena_lock);
+  a = idle_arenas;
+  if (a)
+    idle_arenas = a->next;
+  dpx_mutex_unlock(&arena_lock);
+  if (!a) {
+    a = NEW(1, small_arena);
+    memset(a, 0, sizeof(small_arena));
+  }
+#ifdef HAVE_PTHREAD
+  pthread_once(&arena_once, arena_key_create);
+  pthread_setspecific(arena_key, a);
+#endif
+  arena = a;
+
+  return a;
+}
+
+#define CHUNK_OF(p)   ((small_chunk *) ((size_t) (p) & ~((size_t) CHUNK_SIZE - 1)))
+#define BLOCK_SIZE(c) (((c) + 1) * SMALL_ALIGN)
+
+static void
+chunk_link (small_chunk *chunk)
+{
+  small_arena *a = chunk->arena;
+
+  chunk->prev = NULL;
+  chunk->next = a->classes[chunk->class].avail;
+  if (chunk->next)
+    chunk->next->prev = chunk;
+  a->classes[chunk->class].avail = chunk;
+  chunk->listed = 1;
+}
+
+static void
+chunk_unlink (small_chunk *chunk)
+{
+  small_arena *a = chunk->arena;
+
+  if (chunk->prev)
+    chunk->prev->next = chunk->next;
+  else
+    a->classes[chunk->class].avail = chunk->next;
+  if (chunk->next)
+    chunk->next->prev = chunk->prev;
+  chunk->listed = 0;
+}
+
+static small_chunk *
+chunk_new (small_arena *a, unsigned class)
+{
+  small_chunk *chunk;
+  void        *mem = NULL;
+
+  if (a->classes[class].spare) {
+    chunk = a->classes[class].spare;
+    a->classes[class].spare = NULL;
+    return chunk;
+  }
+  if (posix_memalign(&mem, CHUNK_SIZE, CHUNK_SIZE) != 0)
+    return NULL;
+  chunk = mem;
+  chunk->free   = NULL;
+  chunk->fresh  = (char *) chunk + CHUNK_HEADER;
+  chunk->used   = 0;
+  chunk->class  = class;
+  chunk->listed = 0;
+  chunk->arena  = a;
+
+  return chunk;
+}
+
+/* Puts P back into its chunk, on the thread that owns the chunk */
+static void
+chunk_release (small_chunk *chunk, void *p)
+{
+  small_arena *a = chunk->arena;
+
+  *(void **) p = chunk->free;
+  chunk->free  = p;
+  chunk->used--;
+  if (!chunk->listed)
+    chunk_link(chunk);
+  if (chunk->used == 0) {
+    chunk_unlink(chunk);
+    if (a->classes[chunk->class].spare)
+      free(chunk);
+    else
+      a->classes[chunk->class].spare = chunk;
+  }
+}
+
+/* Takes back the blocks released by other threads */
+static void
+arena_drain (small_arena *a)
+{
+  void *list, *next;
+
+  list = dpx_atomic_load(&a->remote);
+  while (!dpx_atomic_cas(&a->remote, &list, NULL))
+    ;
+  for (; list; list = next) {
+    next = *(void **) list;
+    chunk_release(CHUNK_OF(list), list);
+  }
+}
+
+static void
+arena_trim (small_arena *a)
+{
+  unsigned i;
+
+  arena_drain(a);
+  for (i = 0; i < SMALL_CLASSES; i++) {
+    if (a->classes[i].spare) {
+      free(a->classes[i].spare);
+      a->classes[i].spare = NULL;
+    }
+  }
+}
+
+void *
+new_small (size_t size)
+{
+  small_arena *a;
+  small_chunk *chunk;
+  unsigned     class;
+  void        *result;
+
+  if (size == 0 || size > SMALL_MAX)
+    return new(size);
+
+  a = arena ? arena : arena_get();
+  if (dpx_atomic_load(&a->remote))
+    arena_drain(a);
+  class = (size - 1) / SMALL_ALIGN;
+  chunk = a->classes[class].avail;
+  if (!chunk) {
+    chunk = chunk_new(a, class);
+    if (!chunk)
+      ERROR("Out of memory - asked for %lu bytes\n", (unsigned long) CHUNK_SIZE);
+    chunk_link(chunk);
+  }
+  if (chunk->free) {
+    result = chunk->free;
+    chunk->free = *(void **) result;
+  } else {
+    result = chunk->fresh;
+    chunk->fresh += BLOCK_SIZE(class);
+  }
+  chunk->used++;
+  /* Full? */
+  if (!chunk->free &&
+      chunk->fresh + BLOCK_SIZE(class) > (char *) chunk + CHUNK_SIZE)
+    chunk_unlink(chunk);
+
+  return result;
+}
+
+void
+release_small (void *p, size_t size)
+{
+  small_chunk *chunk;
+  small_arena *a;
+  void        *head;
+
+  if (!p)
+    return;
+  if (size == 0 || size > SMALL_MAX) {
+    free(p);
+    return;
+  }
+
+  chunk = CHUNK_OF(p);
+  a     = chunk->arena;
+  if (a == arena) {
+    chunk_release(chunk, p);
+    return;
+  }
+  head = dpx_atomic_load(&a->remote);
+  do {
+    *(void **) p = head;
+  } while (!dpx_atomic_cas(&a->remote, &head, p));
+}
+
+/* Returns the spare chunks of this thread, and of the threads which
+ * have ended, to the system
+ */
+void
+trim_small (void)
+{
+  small_arena *a;
+
+  if (arena)
+    arena_trim(arena);
+  dpx_mutex_lock(&arena_lock);
+  for (a = idle_arenas; a; a = a->next)
+    arena_trim(a);
+  dpx_mutex_unlock(&arena_lock);
+}
+#else /* !HAVE_POSIX_MEMALIGN */
+void *
+new_small (size_t size)
+{
+  return new(size);
+}
+
+void
+release_small (void *p, size_t size)
+{
+  free(p);
+}
+
+void
+trim_small (void)
+{
+}
+#endif /* HAVE_POSIX_MEMALIGN */
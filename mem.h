@@ -32,4 +32,13 @@ extern void *renew (void *p, size_t size);
 #define RENEW(p,n,type) (type *) renew(p,(n)*sizeof(type))
 #define RELEASE(p)      free(p)
 
+/* Blocks of up to SMALL_MAX bytes from size-class slabs, for the many
+ * short-lived PDF objects. The size must be given again on release.
+ */
+#define SMALL_MAX 256
+
+extern void *new_small     (size_t size);
+extern void  release_small (void *p, size_t size);
+extern void  trim_small    (void);
+
 #endif /* _MEM_H_ */
@@ -131,4 +131,4 @@ char *mfgets (char *buffer, unsigned long length, FILE *file)
   return buffer;
 }
 
-char work_buffer[WORK_BUFFER_SIZE];
+DPX_THREAD_LOCAL char work_buffer[WORK_BUFFER_SIZE];
@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include "numbers.h"
+#include "dpxthread.h"
 
 #ifdef IODEBUG
 FILE *mfopen (const char *name, const char *mode,
@@ -61,7 +62,7 @@ extern off_t xfile_size (FILE *file, const char *name);
 
 extern char *mfgets (char *buffer, unsigned long size, FILE *file);
 
-extern char work_buffer[];
+extern DPX_THREAD_LOCAL char work_buffer[];
 
 #define WORK_BUFFER_SIZE 1024
 
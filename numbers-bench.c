@@ -0,0 +1,174 @@
+/* Microbenchmark for the number formatting used in PDF output.
+
+Compares sprint_fixed() and sprint_long() against the routines they
+replaced (pdfdev.c's p_dtoa() and sprintf()), after checking that
+sprint_fixed() writes exactly what p_dtoa() did.
+
+Built by "make check"; run it as:
+
+./numbers-bench [count]
+
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "libtexpdf/libtexpdf.h"
+
+static int
+old_itoa (long value, char *buf)
+{
+  int   sign, ndigits;
+  char *p = buf;
+
+  if (value < 0) {
+    *p++  = '-';
+    value = -value;
+    sign  = 1;
+  } else {
+    sign  = 0;
+  }
+
+  ndigits = 0;
+  do {
+    p[ndigits++] = (value % 10) + '0';
+    value /= 10;
+  } while (value != 0);
+
+  {
+    int i;
+
+    for (i = 0; i < ndigits / 2 ; i++) {
+      char tmp = p[i];
+      p[i] = p[ndigits-i-1];
+      p[ndigits-i-1] = tmp;
+    }
+  }
+  p[ndigits] = '\0';
+
+  return  (sign ? ndigits + 1 : ndigits);
+}
+
+static int
+old_dtoa (double value, int prec, char *buf)
+{
+  const long p[10] = { 1, 10, 100, 1000, 10000,
+		       100000, 1000000, 10000000, 100000000, 1000000000 };
+  long i, f;
+  char *c = buf;
+  int n;
+
+  if (value < 0) {
+    value = -value;
+    *c++ = '-';
+    n = 1;
+  } else
+    n = 0;
+
+  i = (long) value;
+  f = (long) ((value-i)*p[prec] + 0.5);
+
+  if (f == p[prec]) {
+    f = 0;
+    i++;
+  }
+
+  if (i) {
+    int m = old_itoa(i, c);
+    c += m;
+    n += m;
+  } else if (!f) {
+    *(c = buf) = '0';
+    n = 1;
+  }
+
+  if (f) {
+    int j = prec;
+
+    *c++ = '.';
+
+    while (j--) {
+      c[j] = (f % 10) + '0';
+      f /= 10;
+    }
+    c += prec-1;
+    n += 1+prec;
+
+    while (*c == '0') {
+      c--;
+      n--;
+    }
+  }
+
+  *(++c) = 0;
+
+  return n;
+}
+
+static double
+seconds (void)
+{
+  return (double) clock() / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char** argv) {
+  long    count = argc > 1 ? atol(argv[1]) : 2000000;
+  double *values = malloc(count * sizeof(double));
+  long   *labels = malloc(count * sizeof(long));
+  char    a[64], b[64];
+  long    i, sum;
+  int     prec;
+  double  t;
+
+  srand(1);
+  for (i = 0; i < count; i++) {
+    /* Coordinates in big points, with a few exact integers */
+    values[i] = (rand() % 4 == 0) ? (double) (rand() % 2000 - 1000)
+      : (rand() / (double) RAND_MAX - 0.5) * 2000.0;
+    labels[i] = rand() % 1000000;
+  }
+
+  for (prec = 0; prec <= 8; prec++) {
+    for (i = 0; i < count; i++) {
+      int la = sprint_fixed(a, values[i], prec);
+      int lb = old_dtoa(values[i], prec, b);
+      if (la != lb || strcmp(a, b)) {
+        fprintf(stderr, "mismatch at precision %d: %s vs %s\n", prec, a, b);
+        return 1;
+      }
+    }
+  }
+
+  t = seconds(); sum = 0;
+  for (i = 0; i < count; i++)
+    sum += old_dtoa(values[i], 2, a);
+  printf("p_dtoa        %8.1f ns/number\n", (seconds() - t) * 1e9 / count);
+
+  t = seconds();
+  for (i = 0; i < count; i++)
+    sum += sprint_fixed(a, values[i], 2);
+  printf("sprint_fixed  %8.1f ns/number\n", (seconds() - t) * 1e9 / count);
+
+  t = seconds();
+  for (i = 0; i < count; i++)
+    sum += sprintf(a, "%g", values[i]);
+  printf("sprintf %%g    %8.1f ns/number\n", (seconds() - t) * 1e9 / count);
+
+  t = seconds();
+  for (i = 0; i < count; i++)
+    sum += sprintf(a, "%lu %hu obj\n", labels[i], 0);
+  printf("sprintf obj   %8.1f ns/label\n", (seconds() - t) * 1e9 / count);
+
+  t = seconds();
+  for (i = 0; i < count; i++) {
+    int len = sprint_long(a, labels[i]);
+    sum += len + sprint_long(a + len + 1, 0);
+  }
+  printf("sprint_long   %8.1f ns/label\n", (seconds() - t) * 1e9 / count);
+
+  free(values);
+  free(labels);
+
+  return sum == 0;
+}
@@ -22,6 +22,8 @@
 
 #include "libtexpdf.h"
 
+#include <limits.h>
+
 unsigned char get_unsigned_byte (FILE *file)
 {
   int ch;
@@ -163,3 +165,100 @@ int32_t sqxfw (int32_t sq, fixword fw)
   return (sign > 0) ? result : -result;
 }
 
+/* Number formatting for PDF output. These are used for every
+   coordinate and object number written, so they avoid sprintf(). */
+
+static const char digit_pairs[201] =
+  "00010203040506070809" "10111213141516171819"
+  "20212223242526272829" "30313233343536373839"
+  "40414243444546474849" "50515253545556575859"
+  "60616263646566676869" "70717273747576777879"
+  "80818283848586878889" "90919293949596979899";
+
+/* Writes the last n digits of value, zero-padded, ending before end */
+static void put_digits (char *end, unsigned long value, int n)
+{
+  while (n >= 2) {
+    unsigned r = value % 100;
+    value /= 100;
+    end -= 2;
+    memcpy(end, digit_pairs + 2*r, 2);
+    n -= 2;
+  }
+  if (n)
+    end[-1] = '0' + value % 10;
+}
+
+int sprint_ulong (char *buf, unsigned long value)
+{
+  unsigned long limit = 10;
+  int           len = 1;
+
+  while (value >= limit) {
+    len++;
+    if (limit > ULONG_MAX / 10)
+      break;
+    limit *= 10;
+  }
+  put_digits(buf + len, value, len);
+  buf[len] = '\0';
+
+  return len;
+}
+
+int sprint_long (char *buf, long value)
+{
+  if (value < 0) {
+    buf[0] = '-';
+    return 1 + sprint_ulong(buf + 1, - (unsigned long) value);
+  }
+  return sprint_ulong(buf, value);
+}
+
+int sprint_fixed (char *buf, double value, int prec)
+{
+  static const long p[10] = { 1, 10, 100, 1000, 10000,
+			      100000, 1000000, 10000000, 100000000, 1000000000 };
+  char *c = buf;
+  long  i, f;
+
+  if (value < 0) {
+    value = -value;
+    *c++ = '-';
+  }
+
+  i = (long) value;
+  f = (long) ((value-i)*p[prec] + 0.5);
+
+  if (f == p[prec]) {
+    f = 0;
+    i++;
+  }
+
+  if (!i && !f) {
+    buf[0] = '0';
+    buf[1] = '\0';
+    return 1;
+  }
+
+  if (i)
+    c += sprint_ulong(c, i);
+
+  if (f) {
+    /* Fraction without trailing zeros */
+    while (f % 100 == 0) {
+      f /= 100;
+      prec -= 2;
+    }
+    if (f % 10 == 0) {
+      f /= 10;
+      prec--;
+    }
+    *c++ = '.';
+    put_digits(c + prec, f, prec);
+    c += prec;
+  }
+  *c = '\0';
+
+  return c - buf;
+}
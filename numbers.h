@@ -69,6 +69,15 @@ typedef int32_t fixword;
 
 extern int32_t sqxfw (int32_t sq, fixword fw);
 
+/* Write a number for PDF output into buf, NUL-terminated, and return
+   its length. sprint_fixed() rounds to prec (at most 9) decimals and
+   leaves out trailing zeros, and a zero integer part before them.
+*/
+
+extern int sprint_ulong (char *buf, unsigned long value);
+extern int sprint_long  (char *buf, long value);
+extern int sprint_fixed (char *buf, double value, int prec);
+
 #ifndef MAX
 #  define MAX(a,b) ((a)>(b)?(a):(b))
 #endif
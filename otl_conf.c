@@ -485,7 +485,10 @@ otl_read_conf (const char *conf_name)
   return rule;
 }
 
-static pdf_obj *otl_confs = NULL;
+/* Shared by the documents open, counted in otl_confs_users */
+static pdf_obj   *otl_confs = NULL;
+static int        otl_confs_users = 0;
+static dpx_mutex  otl_confs_lock  = DPX_MUTEX_INITIALIZER;
 
 pdf_obj *
 otl_find_conf (const char *conf_name)
@@ -605,18 +608,24 @@ otl_conf_find_opt (pdf_obj *conf, const char *opt_tag)
 void
 otl_init_conf (void)
 {
-  if (otl_confs)
-    texpdf_release_obj(otl_confs);
-  otl_confs = texpdf_new_dict();
+  dpx_mutex_lock(&otl_confs_lock);
+  if (otl_confs_users++ == 0) {
+    otl_confs = texpdf_new_dict();
 
-  if (verbose > VERBOSE_LEVEL_MIN + 10) {
-    texpdf_release_obj(texpdf_ref_obj(otl_confs));
+    if (verbose > VERBOSE_LEVEL_MIN + 10) {
+      texpdf_release_obj(texpdf_ref_obj(otl_confs));
+    }
   }
+  dpx_mutex_unlock(&otl_confs_lock);
 }
 
 void
 otl_close_conf (void)
 {
-  texpdf_release_obj(otl_confs);
-  otl_confs = NULL;
+  dpx_mutex_lock(&otl_confs_lock);
+  if (otl_confs_users > 0 && --otl_confs_users == 0) {
+    texpdf_release_obj(otl_confs);
+    otl_confs = NULL;
+  }
+  dpx_mutex_unlock(&otl_confs_lock);
 }
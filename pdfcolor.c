@@ -183,7 +183,8 @@ texpdf_color_to_string (const pdf_color *color, char *buffer)
   int i, len = 0;
 
   for (i = 0; i < color->num_components; i++) {
-    len += sprintf(buffer+len, " %g", ROUND(color->values[i], 0.001));
+    buffer[len++] = ' ';
+    len += sprint_fixed(buffer+len, ROUND(color->values[i], 0.001), 3);
   }
   return len;
 }
@@ -264,41 +265,72 @@ texpdf_color_set_default (const pdf_color *color)
 
 #define DEV_COLOR_STACK_MAX 128
 
-static struct {
+/* Color stack of a document's device, see texpdf_init_device() */
+struct pdf_color_stack {
   int       current;
   pdf_color stroke[DEV_COLOR_STACK_MAX];
   pdf_color fill[DEV_COLOR_STACK_MAX];
-} color_stack = {
-  0,
 };
 
+static DPX_THREAD_LOCAL struct pdf_color_stack *color_stack = NULL;
+
+struct pdf_color_stack *
+pdf_color_new_stack (void)
+{
+  struct pdf_color_stack *stack = NEW(1, struct pdf_color_stack);
+
+  stack->current = 0;
+  texpdf_color_black(stack->stroke);
+  texpdf_color_black(stack->fill);
+
+  return stack;
+}
+
+void
+pdf_color_release_stack (struct pdf_color_stack *stack)
+{
+  RELEASE(stack);
+}
+
 void
-texpdf_color_clear_stack (void)
+pdf_color_select_stack (struct pdf_color_stack *stack)
 {
-  if (color_stack.current > 0) {
+  color_stack = stack;
+}
+
+void
+texpdf_color_clear_stack (pdf_doc *p)
+{
+  texpdf_doc_select(p);
+
+  if (color_stack->current > 0) {
     WARN("You've mistakenly made a global color change within nested colors.");
   }
-  color_stack.current = 0;
-  texpdf_color_black(color_stack.stroke);
-  texpdf_color_black(color_stack.fill);
+  color_stack->current = 0;
+  texpdf_color_black(color_stack->stroke);
+  texpdf_color_black(color_stack->fill);
   return;
 }
 
 void
 texpdf_color_set (pdf_doc *p, pdf_color *sc, pdf_color *fc)
 {
-  texpdf_color_copycolor(&color_stack.stroke[color_stack.current], sc);
-  texpdf_color_copycolor(&color_stack.fill[color_stack.current], fc);
+  texpdf_doc_select(p);
+
+  texpdf_color_copycolor(&color_stack->stroke[color_stack->current], sc);
+  texpdf_color_copycolor(&color_stack->fill[color_stack->current], fc);
   texpdf_dev_reset_color(p, 0);
 }
 
 void
 texpdf_color_push (pdf_doc *p, pdf_color *sc, pdf_color *fc)
 {
-  if (color_stack.current >= DEV_COLOR_STACK_MAX-1) {
+  texpdf_doc_select(p);
+
+  if (color_stack->current >= DEV_COLOR_STACK_MAX-1) {
     WARN("Color stack overflow. Just ignore.");
   } else {
-    color_stack.current++;
+    color_stack->current++;
     texpdf_color_set(p, sc, fc);
   }
   return;
@@ -307,20 +339,24 @@ texpdf_color_push (pdf_doc *p, pdf_color *sc, pdf_color *fc)
 void
 texpdf_color_pop (pdf_doc *p)
 {
-  if (color_stack.current <= 0) {
+  texpdf_doc_select(p);
+
+  if (color_stack->current <= 0) {
     WARN("Color stack underflow. Just ignore.");
   } else {
-    color_stack.current--;
+    color_stack->current--;
     texpdf_dev_reset_color(p, 0);
   }
   return;
 }
 
 void
-texpdf_color_get_current (pdf_color **sc, pdf_color **fc)
+texpdf_color_get_current (pdf_doc *p, pdf_color **sc, pdf_color **fc)
 {
-  *sc = &color_stack.stroke[color_stack.current];
-  *fc = &color_stack.fill[color_stack.current];
+  texpdf_doc_select(p);
+
+  *sc = &color_stack->stroke[color_stack->current];
+  *fc = &color_stack->fill[color_stack->current];
   return;
 }
 
@@ -333,9 +369,9 @@ texpdf_color_get_current (pdf_color **sc, pdf_color **fc)
 void
 texpdf_dev_preserve_color (void)
 {
-  if (color_stack.current > 0) {
-    current_stroke = color_stack.stroke[color_stack.current];
-    current_fill   = color_stack.fill[color_stack.current];
+  if (color_stack->current > 0) {
+    current_stroke = color_stack->stroke[color_stack->current];
+    current_fill   = color_stack->fill[color_stack->current];
   }
 }
 #endif
@@ -1018,15 +1054,19 @@ print_iccp_header (iccHeader *icch, unsigned char *checksum)
 }
 
 
+/* Profiles are loaded by image readers which are not given the document,
+ * so this does not look at the color mode of its device. That only matters
+ * for the PDF/X modes below, which are not supported.
+ */
 static int
 iccp_devClass_allowed (int dev_class)
 {
+#if 0
   int    colormode;
 
   colormode = texpdf_dev_get_param(PDF_DEV_PARAM_COLORMODE);
 
   switch (colormode) {
-#if 0
   case PDF_DEV_COLORMODE_PDFX1:
     break;
   case PDF_DEV_COLORMODE_PDFX3:
@@ -1034,21 +1074,80 @@ iccp_devClass_allowed (int dev_class)
       return 0;
     }
     break;
-#endif
   default:
+#endif
     if (dev_class != str2iccSig("scnr") &&
 	dev_class != str2iccSig("mntr") &&
 	dev_class != str2iccSig("prtr") &&
 	dev_class != str2iccSig("spac")) {
       return 0;
     }
+#if 0
     break;
   }
+#endif
 
 
   return 1;
 }
 
+/* Unpacked header and checksum of the profiles read so far, keyed by
+ * the whole profile and shared by all open documents. What is embedded
+ * is still decided for each document, as it depends on its version.
+ */
+struct iccp_info
+{
+  iccHeader     icch;
+  unsigned char checksum[16];
+};
+
+static struct ht_table iccp_infos;
+static int             iccp_infos_users = 0;
+static dpx_rwlock      iccp_infos_lock  = DPX_RWLOCK_INITIALIZER;
+
+static void
+iccp_hval_free (void *hval)
+{
+  RELEASE(hval);
+}
+
+/* Returns the header and checksum of PROFILE, or NULL if its header
+ * is invalid
+ */
+static const struct iccp_info *
+iccp_get_info (const char *ident, const void *profile, long proflen)
+{
+  struct iccp_info *info, *found;
+
+  dpx_read_lock(&iccp_infos_lock);
+  info = texpdf_ht_lookup_table(&iccp_infos, profile, (int) proflen);
+  dpx_unlock(&iccp_infos_lock);
+  if (info)
+    return info;
+
+  info = NEW(1, struct iccp_info);
+  iccp_init_iccHeader(&info->icch);
+  if (iccp_unpack_header(&info->icch, profile, proflen, 1) < 0) { /* check size */
+    WARN("Invalid ICC profile header in \"%s\"", ident);
+    print_iccp_header(&info->icch, NULL);
+    RELEASE(info);
+    return NULL;
+  }
+  iccp_get_checksum(info->checksum, profile, proflen);
+
+  dpx_write_lock(&iccp_infos_lock);
+  found = texpdf_ht_lookup_table(&iccp_infos, profile, (int) proflen);
+  if (!found)
+    texpdf_ht_append_table(&iccp_infos, profile, (int) proflen, info);
+  dpx_unlock(&iccp_infos_lock);
+  if (found) {
+    RELEASE(info);
+    info = found;
+  }
+
+  return info;
+}
+
 int
 iccp_load_profile (const char *ident,
 		   const void *profile, long proflen)
@@ -1061,13 +1160,13 @@ iccp_load_profile (const char *ident,
   int       colorspace;
   unsigned char checksum[16];
   struct iccbased_cdata *cdata;
+  const struct iccp_info *info;
 
-  iccp_init_iccHeader(&icch);
-  if (iccp_unpack_header(&icch, profile, proflen, 1) < 0) { /* check size */
-    WARN("Invalid ICC profile header in \"%s\"", ident);
-    print_iccp_header(&icch, NULL);
+  info = iccp_get_info(ident, profile, proflen);
+  if (!info)
     return -1;
-  }
+  icch = info->icch;
+  memcpy(checksum, info->checksum, 16);
 
   if (!iccp_version_supported((icch.version >> 24) & 0xff,
 			      (icch.version >> 16) & 0xff)) {
@@ -1099,7 +1198,6 @@ iccp_load_profile (const char *ident,
     return -1;
   }
 
-  iccp_get_checksum(checksum, profile, proflen);
   if (memcmp(icch.ID,  nullbytes16, 16) &&
       memcmp(icch.ID,  checksum, 16)) {
     WARN("Invalid ICC profile: Inconsistent checksum.");
@@ -1146,7 +1244,7 @@ iccp_load_profile (const char *ident,
 
 #if 0
 #define WBUF_SIZE 4096
-static unsigned char wbuf[WBUF_SIZE];
+static DPX_THREAD_LOCAL unsigned char wbuf[WBUF_SIZE];
 
 static pdf_obj *
 iccp_load_file_stream (unsigned char *checksum, long length, FILE *fp)
@@ -1325,14 +1423,38 @@ typedef struct {
   void    *cdata;
 } pdf_colorspace;
 
-static struct {
+struct cspc_cache {
   int  count;
   int  capacity;
   pdf_colorspace *colorspaces;
-} cspc_cache = {
-  0, 0, NULL
+
+  /* ICCBased colour spaces are compared by checksum when they have one.
+   * Those that do are indexed by it; the others are counted, and looked
+   * for one by one. */
+  struct ht_table checksums;
+  int             unindexed;
 };
 
+/* Color spaces of the document selected on this thread, see
+ * texpdf_init_colors()
+ */
+static DPX_THREAD_LOCAL struct cspc_cache *cspc_cache = NULL;
+
+static void
+hval_free (void *hval)
+{
+  RELEASE(hval);
+}
+
+static const unsigned char *
+iccbased_checksum (const struct iccbased_cdata *cdata)
+{
+  if (cdata && memcmp(cdata->checksum, nullbytes16, 16))
+    return cdata->checksum;
+
+  return NULL;
+}
+
 int
 pdf_colorspace_findresource (const char *ident,
 			     int type, const void *cdata)
@@ -1340,9 +1462,17 @@ pdf_colorspace_findresource (const char *ident,
   pdf_colorspace *colorspace;
   int  cspc_id, cmp = -1;
 
+  if (type == PDF_COLORSPACE_TYPE_ICCBASED && cspc_cache->unindexed == 0) {
+    const unsigned char *checksum = iccbased_checksum(cdata);
+    if (checksum) {
+      int *id = texpdf_ht_lookup_table(&cspc_cache->checksums, checksum, 16);
+      return id ? *id : -1;
+    }
+  }
+
   for (cspc_id = 0;
-       cmp && cspc_id < cspc_cache.count; cspc_id++) {
-    colorspace = &cspc_cache.colorspaces[cspc_id];
+       cmp && cspc_id < cspc_cache->count; cspc_id++) {
+    colorspace = &cspc_cache->colorspaces[cspc_id];
     if (colorspace->subtype != type)
       continue;
 
@@ -1422,13 +1552,13 @@ pdf_colorspace_defineresource (const char *ident,
   int  cspc_id;
   pdf_colorspace *colorspace;
 
-  if (cspc_cache.count >= cspc_cache.capacity) {
-    cspc_cache.capacity   += 16;
-    cspc_cache.colorspaces = RENEW(cspc_cache.colorspaces,
-				   cspc_cache.capacity, pdf_colorspace);
+  if (cspc_cache->count >= cspc_cache->capacity) {
+    cspc_cache->capacity   += 16;
+    cspc_cache->colorspaces = RENEW(cspc_cache->colorspaces,
+				   cspc_cache->capacity, pdf_colorspace);
   }
-  cspc_id    = cspc_cache.count;
-  colorspace = &cspc_cache.colorspaces[cspc_id];
+  cspc_id    = cspc_cache->count;
+  colorspace = &cspc_cache->colorspaces[cspc_id];
 
   texpdf_init_colorspace_struct(colorspace);
   if (ident) {
@@ -1439,6 +1569,17 @@ pdf_colorspace_defineresource (const char *ident,
   colorspace->cdata    = cdata;
   colorspace->resource = resource;
 
+  if (subtype == PDF_COLORSPACE_TYPE_ICCBASED) {
+    const unsigned char *checksum = iccbased_checksum(cdata);
+    if (!checksum)
+      cspc_cache->unindexed++;
+    else if (!texpdf_ht_lookup_table(&cspc_cache->checksums, checksum, 16)) {
+      int *id = NEW(1, int);
+      *id = cspc_id;
+      texpdf_ht_append_table(&cspc_cache->checksums, checksum, 16, id);
+    }
+  }
+
   if (verbose) {
     MESG("(ColorSpace:%s", ident);
     if (verbose > 1) {
@@ -1457,7 +1598,7 @@ pdf_colorspace_defineresource (const char *ident,
     MESG(")");
   }
 
-  cspc_cache.count++;
+  cspc_cache->count++;
 
   return cspc_id;
 }
@@ -1467,7 +1608,7 @@ texpdf_get_colorspace_reference (int cspc_id)
 {
   pdf_colorspace *colorspace;
 
-  colorspace = &cspc_cache.colorspaces[cspc_id];
+  colorspace = &cspc_cache->colorspaces[cspc_id];
   if (!colorspace->reference) {
     colorspace->reference = texpdf_ref_obj(colorspace->resource);
     texpdf_release_obj(colorspace->resource); /* .... */
@@ -1484,7 +1625,7 @@ texpdf_get_colorspace_num_components (int cspc_id)
   pdf_colorspace *colorspace;
   int  num_components;
 
-  colorspace = &cspc_cache.colorspaces[cspc_id];
+  colorspace = &cspc_cache->colorspaces[cspc_id];
 
   switch (colorspace->subtype) {
   case PDF_COLORSPACE_TYPE_ICCBASED:
@@ -1518,36 +1659,67 @@ texpdf_get_colorspace_subtype (int cspc_id)
 {
   pdf_colorspace *colorspace;
 
-  colorspace = &cspc_cache.colorspaces[cspc_id];
+  colorspace = &cspc_cache->colorspaces[cspc_id];
 
   return colorspace->subtype;
 }
 #endif
 
 void
-texpdf_init_colors (void)
+pdf_color_select_cspcs (struct cspc_cache *cache)
 {
-  cspc_cache.count    = 0;
-  cspc_cache.capacity = 0;
-  cspc_cache.colorspaces = NULL;
+  cspc_cache = cache;
 }
 
 void
-texpdf_close_colors (void)
+texpdf_init_colors (pdf_doc *p)
+{
+  texpdf_doc_select(p);
+  if (p->colorspaces)
+    texpdf_close_colors(p);
+
+  p->colorspaces = NEW(1, struct cspc_cache);
+  pdf_color_select_cspcs(p->colorspaces);
+  cspc_cache->count    = 0;
+  cspc_cache->capacity = 0;
+  cspc_cache->colorspaces = NULL;
+  texpdf_ht_init_table(&cspc_cache->checksums, hval_free);
+  cspc_cache->unindexed = 0;
+
+  dpx_write_lock(&iccp_infos_lock);
+  if (iccp_infos_users++ == 0)
+    texpdf_ht_init_table(&iccp_infos, iccp_hval_free);
+  dpx_unlock(&iccp_infos_lock);
+}
+
+void
+texpdf_close_colors (pdf_doc *p)
 {
   int  i;
 
-  for (i = 0; i < cspc_cache.count; i++) {
+  texpdf_doc_select(p);
+  if (!cspc_cache)
+    return;
+
+  for (i = 0; i < cspc_cache->count; i++) {
     pdf_colorspace *colorspace;
 
-    colorspace = &cspc_cache.colorspaces[i];
+    colorspace = &cspc_cache->colorspaces[i];
     pdf_flush_colorspace(colorspace);
     pdf_clean_colorspace_struct(colorspace);
   }
-  RELEASE(cspc_cache.colorspaces);
-  cspc_cache.colorspaces = NULL;
-  cspc_cache.count = cspc_cache.capacity = 0;
-
+  RELEASE(cspc_cache->colorspaces);
+  cspc_cache->colorspaces = NULL;
+  cspc_cache->count = cspc_cache->capacity = 0;
+  texpdf_ht_clear_table(&cspc_cache->checksums);
+  RELEASE(cspc_cache);
+  p->colorspaces = NULL;
+  pdf_color_select_cspcs(NULL);
+
+  dpx_write_lock(&iccp_infos_lock);
+  if (iccp_infos_users > 0 && --iccp_infos_users == 0)
+    texpdf_ht_clear_table(&iccp_infos);
+  dpx_unlock(&iccp_infos_lock);
 }
 
 #define PDF_COLORSPACE_FAMILY_DEVICE   0
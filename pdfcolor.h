@@ -122,8 +122,12 @@ extern int      iccp_check_colorspace     (int colortype,
 extern int      iccp_load_profile (const char *ident,
 				   const void *profile, long proflen);
 
-extern void     texpdf_init_colors  (void);
-extern void     texpdf_close_colors (void);
+extern void     texpdf_init_colors  (pdf_doc *p);
+extern void     texpdf_close_colors (pdf_doc *p);
+/* Makes cache the color spaces the calling thread defines and looks up,
+ * see texpdf_doc_select()
+ */
+extern void     pdf_color_select_cspcs (struct cspc_cache *cache);
 
 /** XXX I don't know. */
 extern pdf_obj *texpdf_get_colorspace_reference      (int cspc_id);
@@ -153,11 +157,16 @@ extern void     texpdf_color_pop   (pdf_doc *p);
 /* Color stack
  */
 /** Empties the color stack */
-extern void     texpdf_color_clear_stack (void);
+extern void     texpdf_color_clear_stack (pdf_doc *p);
 /** Copy current top of color stack.
 Fills the (already allocated) `sc` and `fc` colors with the stroke and fill color
 at the top of the color stack. */
-extern void     texpdf_color_get_current (pdf_color **sc, pdf_color **fc);
+extern void     texpdf_color_get_current (pdf_doc *p, pdf_color **sc, pdf_color **fc);
+
+/* Color stack of a document's device, see texpdf_init_device() */
+extern struct pdf_color_stack *pdf_color_new_stack (void);
+extern void     pdf_color_release_stack (struct pdf_color_stack *stack);
+extern void     pdf_color_select_stack  (struct pdf_color_stack *stack);
 
 #if 0
 /* Reinstall color */
@@ -44,135 +44,139 @@ texpdf_dev_scale (void)
  */
 
 #define TEX_ONE_HUNDRED_BP 6578176
-static struct {
-  double dvi2pts;
-  long   min_bp_val; /* Shortest resolvable distance in the output PDF.     */
-  int    precision;  /* Number of decimal digits (in fractional part) kept. */
-} dev_unit = {
-  0.0,
-  658,
-  2
-};
-
 
-double
-dev_unit_dviunit (void)
+/* Device state of a document: units, text state and fonts of the page
+ * content written here. texpdf_init_device() gives each document its own,
+ * and the one in use on the calling thread is switched with the document
+ * by texpdf_doc_select().
+ */
+struct pdf_dev
 {
-  return (1.0/dev_unit.dvi2pts);
-}
+  struct {
+    double dvi2pts;
+    long   min_bp_val; /* Shortest resolvable distance in the output PDF.     */
+    int    precision;  /* Number of decimal digits (in fractional part) kept. */
+  } unit;
 
-#define DEV_PRECISION_MAX  8
-static unsigned long ten_pow[10] = {
-  1ul, 10ul, 100ul, 1000ul, 10000ul, 100000ul, 1000000ul, 10000000ul, 100000000ul, 1000000000ul
-};
+  struct {
+    /* Text composition (direction) mode is ignored (always same
+     * as font's writing mode) if autorotate is unset (value zero).
+     */
+    int    autorotate;
 
-static double ten_pow_inv[10] = {
-  1.0, 0.1,  0.01,  0.001,  0.0001,  0.00001,  0.000001,  0.0000001,  0.00000001,  0.000000001
-};
+    /*
+     * Ignore color migrated to here. This is device's capacity.
+     * colormode 0 for ignore colors
+     */
+    int    colormode;
+  } param;
 
-#define bpt2spt(b) ( (spt_t) round( (b) / dev_unit.dvi2pts  ) )
-#define spt2bpt(s) ( (s) * dev_unit.dvi2pts )
-#define dround_at(v,p) (ROUND( (v), ten_pow_inv[(p)] ))
+  int motion_state; /* GRAPHICS_MODE, TEXT_MODE or STRING_MODE */
 
-static int
-p_itoa (long value, char *buf)
-{
-  int   sign, ndigits;
-  char *p = buf;
+  struct {
+    /* Current font.
+     * This is index within fonts.
+     */
+    int       font_id;
 
-  if (value < 0) {
-    *p++  = '-';
-    value = -value;
-    sign  = 1;
-  } else {
-    sign  = 0;
-  }
+    /* Dvipdfmx does compression of text by doing text positioning
+     * in relative motion and uses string array [(foo) -250 (bar)]
+     * with kerning (negative kern is used for white space as suited
+     * for TeX). This is offset within current string.
+     */
+    spt_t     offset;
 
-  ndigits = 0;
-  /* Generate at least one digit in reverse order */
-  do {
-    p[ndigits++] = (value % 10) + '0';
-    value /= 10;
-  } while (value != 0);
+    /* This is reference point of strings.
+     * It may include error correction induced by rounding.
+     */
+    spt_t     ref_x;
+    spt_t     ref_y;
 
-  /* Reverse the digits */
-  {
-    int i;
+    /* Using text raise and leading is highly recommended for
+     * text extraction to work properly. But not implemented yet.
+     * We can't do consice output for \TeX without this.
+     */
+    spt_t     raise;    /* unused */
+    spt_t     leading;  /* unused */
 
-    for (i = 0; i < ndigits / 2 ; i++) {
-      char tmp = p[i];
-      p[i] = p[ndigits-i-1];
-      p[ndigits-i-1] = tmp;
-    }
-  }
-  p[ndigits] = '\0';
+    /* This is not always text matrix but rather font matrix.
+     * We do not use horizontal scaling in PDF text state parameter
+     * since they always apply scaling in fixed direction regardless
+     * of writing mode.
+     */
+    struct {
+      double  slant;
+      double  extend;
+      int     rotate; /* TEXT_WMODE_XX */
+    } matrix;
+
+    /* Fake bold parameter:
+     * If bold_param is positive, use text rendering mode
+     * fill-then-stroke with stroking line width specified
+     * by bold_param.
+     */
+    double    bold_param;
 
-  return  (sign ? ndigits + 1 : ndigits);
-}
+    /* Text composition (direction) mode. */
+    int       dir_mode;
 
-/* ... */
-static int
-p_dtoa (double value, int prec, char *buf)
-{
-  const long p[10] = { 1, 10, 100, 1000, 10000,
-		       100000, 1000000, 10000000, 100000000, 1000000000 };
-  long i, f;
-  char *c = buf;
-  int n;
-
-  if (value < 0) {
-    value = -value;
-    *c++ = '-';
-    n = 1;
-  } else
-    n = 0;
-
-  i = (long) value;
-  f = (long) ((value-i)*p[prec] + 0.5);
-
-  if (f == p[prec]) {
-    f = 0;
-    i++;
-  }
+    /* internal */
 
-  if (i) {
-    int m = p_itoa(i, c);
-    c += m;
-    n += m;
-  } else if (!f) {
-    *(c = buf) = '0';
-    n = 1;
-  }
+    /* Flag indicating text matrix to be forcibly reset.
+     * Enabled if synthetic font features (slant, extend, etc)
+     * are used for current font or when text rotation mode
+     * changes.
+     */
+    int       force_reset;
 
-  if (f) {
-    int j = prec;
+    /* This information is duplicated from dev[font_id].format.
+     * Set to 1 if font is composite (Type0) font.
+     */
+    int       is_mb;
+  } text_state;
 
-    *c++ = '.';
+  struct dev_font *fonts;
+  int num_fonts;
+  int max_fonts;
+  int num_phys_fonts;
 
-    while (j--) {
-      c[j] = (f % 10) + '0';
-      f /= 10;
-    }
-    c += prec-1;
-    n += 1+prec;
+  /* Origins pushed by texpdf_dev_push_coord() */
+  pdf_coord *coords;
+  int num_coords;
+  int max_coords;
 
-    while (*c == '0') {
-      c--;
-      n--;
-    }
-  }
+  struct pdf_gstates     *gstates;
+  struct pdf_color_stack *colors;
+};
+
+static DPX_THREAD_LOCAL struct pdf_dev *dev = NULL;
 
-  *(++c) = 0;
 
-  return n;
+double
+dev_unit_dviunit (void)
+{
+  return (1.0/dev->unit.dvi2pts);
 }
 
+#define DEV_PRECISION_MAX  8
+static unsigned long ten_pow[10] = {
+  1ul, 10ul, 100ul, 1000ul, 10000ul, 100000ul, 1000000ul, 10000000ul, 100000000ul, 1000000000ul
+};
+
+static double ten_pow_inv[10] = {
+  1.0, 0.1,  0.01,  0.001,  0.0001,  0.00001,  0.000001,  0.0000001,  0.00000001,  0.000000001
+};
+
+#define bpt2spt(b) ( (spt_t) round( (b) / dev->unit.dvi2pts  ) )
+#define spt2bpt(s) ( (s) * dev->unit.dvi2pts )
+#define dround_at(v,p) (ROUND( (v), ten_pow_inv[(p)] ))
+
 static int
 dev_sprint_bp (char *buf, spt_t value, spt_t *error)
 {
   double  value_in_bp;
   double  error_in_bp;
-  int     prec = dev_unit.precision;
+  int     prec = dev->unit.precision;
 
   value_in_bp = spt2bpt(value);
   if (error) {
@@ -180,7 +184,7 @@ dev_sprint_bp (char *buf, spt_t value, spt_t *error)
     *error = bpt2spt(error_in_bp);
   }
 
-  return  p_dtoa(value_in_bp, prec, buf);
+  return  sprint_fixed(buf, value_in_bp, prec);
 }
 
 /* They are affected by precision (set at device initialization). */
@@ -188,20 +192,20 @@ int
 texpdf_sprint_matrix (char *buf, const pdf_tmatrix *M)
 {
   int  len;
-  int  prec2 = MIN(dev_unit.precision + 2, DEV_PRECISION_MAX);
-  int  prec0 = MAX(dev_unit.precision, 2);
+  int  prec2 = MIN(dev->unit.precision + 2, DEV_PRECISION_MAX);
+  int  prec0 = MAX(dev->unit.precision, 2);
 
-  len  = p_dtoa(M->a, prec2, buf);
+  len  = sprint_fixed(buf, M->a, prec2);
   buf[len++] = ' ';
-  len += p_dtoa(M->b, prec2, buf+len);
+  len += sprint_fixed(buf+len, M->b, prec2);
   buf[len++] = ' ';
-  len += p_dtoa(M->c, prec2, buf+len);
+  len += sprint_fixed(buf+len, M->c, prec2);
   buf[len++] = ' ';
-  len += p_dtoa(M->d, prec2, buf+len);
+  len += sprint_fixed(buf+len, M->d, prec2);
   buf[len++] = ' ';
-  len += p_dtoa(M->e, prec0, buf+len);
+  len += sprint_fixed(buf+len, M->e, prec0);
   buf[len++] = ' ';
-  len += p_dtoa(M->f, prec0, buf+len);
+  len += sprint_fixed(buf+len, M->f, prec0);
   buf[len]   = '\0'; /* xxx_sprint_xxx NULL terminates strings. */
 
   return  len;
@@ -212,13 +216,13 @@ pdf_sprint_rect (char *buf, const pdf_rect *rect)
 {
   int  len;
 
-  len  = p_dtoa(rect->llx, dev_unit.precision, buf);
+  len  = sprint_fixed(buf, rect->llx, dev->unit.precision);
   buf[len++] = ' ';
-  len += p_dtoa(rect->lly, dev_unit.precision, buf+len);
+  len += sprint_fixed(buf+len, rect->lly, dev->unit.precision);
   buf[len++] = ' ';
-  len += p_dtoa(rect->urx, dev_unit.precision, buf+len);
+  len += sprint_fixed(buf+len, rect->urx, dev->unit.precision);
   buf[len++] = ' ';
-  len += p_dtoa(rect->ury, dev_unit.precision, buf+len);
+  len += sprint_fixed(buf+len, rect->ury, dev->unit.precision);
   buf[len]   = '\0'; /* xxx_sprint_xxx NULL terminates strings. */
 
   return  len;
@@ -229,9 +233,9 @@ pdf_sprint_coord (char *buf, const pdf_coord *p)
 {
   int  len;
 
-  len  = p_dtoa(p->x, dev_unit.precision, buf);
+  len  = sprint_fixed(buf, p->x, dev->unit.precision);
   buf[len++] = ' ';
-  len += p_dtoa(p->y, dev_unit.precision, buf+len);
+  len += sprint_fixed(buf+len, p->y, dev->unit.precision);
   buf[len]   = '\0'; /* xxx_sprint_xxx NULL terminates strings. */
 
   return  len;
@@ -242,7 +246,7 @@ pdf_sprint_length (char *buf, double value)
 {
   int  len;
 
-  len = p_dtoa(value, dev_unit.precision, buf);
+  len = sprint_fixed(buf, value, dev->unit.precision);
   buf[len] = '\0'; /* xxx_sprint_xxx NULL terminates strings. */
 
   return  len;
@@ -254,31 +258,13 @@ pdf_sprint_number (char *buf, double value)
 {
   int  len;
 
-  len = p_dtoa(value, DEV_PRECISION_MAX, buf);
+  len = sprint_fixed(buf, value, DEV_PRECISION_MAX);
   buf[len] = '\0'; /* xxx_sprint_xxx NULL terminates strings. */
 
   return  len;
 }
 
 
-static struct
-{
-  /* Text composition (direction) mode is ignored (always same
-   * as font's writing mode) if autorotate is unset (value zero).
-   */
-  int    autorotate;
-
-  /*
-   * Ignore color migrated to here. This is device's capacity.
-   * colormode 0 for ignore colors
-   */
-  int    colormode;
-
-} dev_param = {
-  1, /* autorotate */
-  1, /* colormode  */
-};
-
 /*
  * Text handling routines.
  */
@@ -294,10 +280,8 @@ static struct
 #define TEXT_MODE      2
 #define STRING_MODE    3
 
-static int motion_state = GRAPHICS_MODE;
-
 #define FORMAT_BUF_SIZE 4096
-static char format_buffer[FORMAT_BUF_SIZE];
+static DPX_THREAD_LOCAL char format_buffer[FORMAT_BUF_SIZE];
 
 /*
  * In PDF, vertical text positioning is always applied when current font
@@ -323,83 +307,6 @@ static char format_buffer[FORMAT_BUF_SIZE];
 #define ANGLE_CHANGES(m1,m2) ((abs((m1)-(m2)) % 5) == 0 ? 0 : 1)
 #define ROTATE_TEXT(m)       ((m) != TEXT_WMODE_HH && (m) != TEXT_WMODE_VV)
 
-static struct {
-
-  /* Current font.
-   * This is index within dev_fonts.
-   */
-  int       font_id;
-
-  /* Dvipdfmx does compression of text by doing text positioning
-   * in relative motion and uses string array [(foo) -250 (bar)]
-   * with kerning (negative kern is used for white space as suited
-   * for TeX). This is offset within current string.
-   */
-  spt_t     offset;
-
-  /* This is reference point of strings.
-   * It may include error correction induced by rounding.
-   */
-  spt_t     ref_x;
-  spt_t     ref_y;
-
-  /* Using text raise and leading is highly recommended for
-   * text extraction to work properly. But not implemented yet.
-   * We can't do consice output for \TeX without this.
-   */
-  spt_t     raise;    /* unused */
-  spt_t     leading;  /* unused */
-
-  /* This is not always text matrix but rather font matrix.
-   * We do not use horizontal scaling in PDF text state parameter
-   * since they always apply scaling in fixed direction regardless
-   * of writing mode.
-   */
-  struct {
-    double  slant;
-    double  extend;
-    int     rotate; /* TEXT_WMODE_XX */
-  } matrix;
-
-  /* Fake bold parameter:
-   * If bold_param is positive, use text rendering mode
-   * fill-then-stroke with stroking line width specified
-   * by bold_param.
-   */
-  double    bold_param;
-
-  /* Text composition (direction) mode. */
-  int       dir_mode;
-
-  /* internal */
-
-  /* Flag indicating text matrix to be forcibly reset.
-   * Enabled if synthetic font features (slant, extend, etc)
-   * are used for current font or when text rotation mode
-   * changes.
-   */
-  int       force_reset;
-
-  /* This information is duplicated from dev[font_id].format.
-   * Set to 1 if font is composite (Type0) font.
-   */
-  int       is_mb;
-} text_state = {
-  -1,            /* font   */
-  0,             /* offset */
-  0, 0,          /* ref_x, ref_y   */
-  0, 0,          /* raise, leading */
-  {0.0, 1.0, 0},
-
-  0.0,  /* Experimental boldness param */
-
-  0,    /* dir_mode      */
-
-  /* internal */
-  0,    /* force_reset   */
-  0     /* is_mb         */
-};
-
 #define PDF_FONTTYPE_SIMPLE    1
 #define PDF_FONTTYPE_BITMAP    2
 #define PDF_FONTTYPE_COMPOSITE 3
@@ -468,14 +375,8 @@ struct dev_font {
 
   cff_charsets *cff_charsets;
 };
-static struct dev_font *dev_fonts = NULL;
-
-static int num_dev_fonts   = 0;
-static int max_dev_fonts   = 0;
-static int num_phys_fonts  = 0;
-
-#define CURRENTFONT() ((text_state.font_id < 0) ? NULL : &(dev_fonts[text_state.font_id]))
-#define GET_FONT(n)   (&(dev_fonts[(n)]))
+#define CURRENTFONT() ((dev->text_state.font_id < 0) ? NULL : &(dev->fonts[dev->text_state.font_id]))
+#define GET_FONT(n)   (&(dev->fonts[(n)]))
 
 
 static void
@@ -518,8 +419,8 @@ dev_set_text_matrix (pdf_doc *p, spt_t xpos, spt_t ypos, double slant, double ex
     tm.c =  0.0; tm.d =  -extend;
     break;
   }
-  tm.e = xpos * dev_unit.dvi2pts;
-  tm.f = ypos * dev_unit.dvi2pts;
+  tm.e = xpos * dev->unit.dvi2pts;
+  tm.f = ypos * dev->unit.dvi2pts;
 
   format_buffer[len++] = ' ';
   len += texpdf_sprint_matrix(format_buffer+len, &tm);
@@ -529,11 +430,11 @@ dev_set_text_matrix (pdf_doc *p, spt_t xpos, spt_t ypos, double slant, double ex
 
   texpdf_doc_add_page_content(p, format_buffer, len);  /* op: Tm */
 
-  text_state.ref_x = xpos;
-  text_state.ref_y = ypos;
-  text_state.matrix.slant  = slant;
-  text_state.matrix.extend = extend;
-  text_state.matrix.rotate = rotate;
+  dev->text_state.ref_x = xpos;
+  dev->text_state.ref_y = ypos;
+  dev->text_state.matrix.slant  = slant;
+  dev->text_state.matrix.extend = extend;
+  dev->text_state.matrix.rotate = rotate;
 }
 
 /*
@@ -553,54 +454,56 @@ reset_text_state (pdf_doc *p)
    * This sometimes write unnecessary "Tm"s when transition from
    * GRAPHICS_MODE to TEXT_MODE occurs.
    */
-  if (text_state.force_reset ||
-      text_state.matrix.slant  != 0.0 ||
-      text_state.matrix.extend != 1.0 ||
-      ROTATE_TEXT(text_state.matrix.rotate)) {
+  if (dev->text_state.force_reset ||
+      dev->text_state.matrix.slant  != 0.0 ||
+      dev->text_state.matrix.extend != 1.0 ||
+      ROTATE_TEXT(dev->text_state.matrix.rotate)) {
     dev_set_text_matrix(p, 0, 0,
-                        text_state.matrix.slant,
-                        text_state.matrix.extend,
-                        text_state.matrix.rotate);
+                        dev->text_state.matrix.slant,
+                        dev->text_state.matrix.extend,
+                        dev->text_state.matrix.rotate);
   }
-  text_state.ref_x = 0;
-  text_state.ref_y = 0;
-  text_state.offset   = 0;
-  text_state.force_reset = 0;
+  dev->text_state.ref_x = 0;
+  dev->text_state.ref_y = 0;
+  dev->text_state.offset   = 0;
+  dev->text_state.force_reset = 0;
 }
 
 static void
 text_mode (pdf_doc *p)
 {
-  switch (motion_state) {
+  switch (dev->motion_state) {
   case TEXT_MODE:
     break;
   case STRING_MODE:
-    texpdf_doc_add_page_content(p, text_state.is_mb ? ">]TJ" : ")]TJ", 4);  /* op: TJ */
+    texpdf_doc_add_page_content(p, dev->text_state.is_mb ? ">]TJ" : ")]TJ", 4);  /* op: TJ */
     break;
   case GRAPHICS_MODE:
     reset_text_state(p);
     break;
   }
-  motion_state      = TEXT_MODE;
-  text_state.offset = 0;
+  dev->motion_state      = TEXT_MODE;
+  dev->text_state.offset = 0;
 }
 
 void
 texpdf_graphics_mode (pdf_doc *p)
 {
-  switch (motion_state) {
+  texpdf_doc_select(p);
+
+  switch (dev->motion_state) {
   case GRAPHICS_MODE:
     break;
   case STRING_MODE:
-    texpdf_doc_add_page_content(p, text_state.is_mb ? ">]TJ" : ")]TJ", 4);  /* op: TJ */
+    texpdf_doc_add_page_content(p, dev->text_state.is_mb ? ">]TJ" : ")]TJ", 4);  /* op: TJ */
     /* continue */
   case TEXT_MODE:
     texpdf_doc_add_page_content(p, " ET", 3);  /* op: ET */
-    text_state.force_reset =  0;
-    text_state.font_id     = -1;
+    dev->text_state.force_reset =  0;
+    dev->text_state.font_id     = -1;
     break;
   }
-  motion_state = GRAPHICS_MODE;
+  dev->motion_state = GRAPHICS_MODE;
 }
 
 static void
@@ -610,8 +513,8 @@ start_string (pdf_doc *p, spt_t xpos, spt_t ypos, double slant, double extend, i
   spt_t desired_delx, desired_dely;
   int   len = 0;
 
-  delx = xpos - text_state.ref_x;
-  dely = ypos - text_state.ref_y;
+  delx = xpos - dev->text_state.ref_x;
+  dely = ypos - dev->text_state.ref_y;
   /*
    * Precompensating for line transformation matrix.
    *
@@ -760,35 +663,35 @@ start_string (pdf_doc *p, spt_t xpos, spt_t ypos, double slant, double extend, i
    * dvipdfm wrongly using "TD" in place of "Td".
    * The TD operator set leading, but we are not using T* etc.
    */
-  texpdf_doc_add_page_content(p, text_state.is_mb ? " Td[<" : " Td[(", 5);  /* op: Td */
+  texpdf_doc_add_page_content(p, dev->text_state.is_mb ? " Td[<" : " Td[(", 5);  /* op: Td */
 
   /* Error correction */
-  text_state.ref_x = xpos - error_delx;
-  text_state.ref_y = ypos - error_dely;
+  dev->text_state.ref_x = xpos - error_delx;
+  dev->text_state.ref_y = ypos - error_dely;
 
-  text_state.offset   = 0;
+  dev->text_state.offset   = 0;
 }
 
 static void
 string_mode (pdf_doc *p, spt_t xpos, spt_t ypos, double slant, double extend, int rotate)
 {
-  switch (motion_state) {
+  switch (dev->motion_state) {
   case STRING_MODE:
     break;
   case GRAPHICS_MODE:
     reset_text_state(p);
     /* continue */
   case TEXT_MODE:
-    if (text_state.force_reset) {
+    if (dev->text_state.force_reset) {
       dev_set_text_matrix(p, xpos, ypos, slant, extend, rotate);
-      texpdf_doc_add_page_content(p, text_state.is_mb ? "[<" : "[(", 2);  /* op: */
-      text_state.force_reset = 0;
+      texpdf_doc_add_page_content(p, dev->text_state.is_mb ? "[<" : "[(", 2);  /* op: */
+      dev->text_state.force_reset = 0;
     } else {
       start_string(p, xpos, ypos, slant, extend, rotate);
     }
     break;
   }
-  motion_state = STRING_MODE;
+  dev->motion_state = STRING_MODE;
 }
 
 /*
@@ -824,24 +727,24 @@ dev_set_font (pdf_doc *doc, int font_id)
   else
     real_font = font;
 
-  text_state.is_mb = (font->format == PDF_FONTTYPE_COMPOSITE) ? 1 : 0;
+  dev->text_state.is_mb = (font->format == PDF_FONTTYPE_COMPOSITE) ? 1 : 0;
 
   vert_font  = font->wmode ? 1 : 0;
-  if (dev_param.autorotate) {
-    vert_dir = text_state.dir_mode;
+  if (dev->param.autorotate) {
+    vert_dir = dev->text_state.dir_mode;
   } else {
     vert_dir = vert_font;
   }
   text_rotate = (vert_font << 2)|vert_dir;
 
-  if (font->slant  != text_state.matrix.slant  ||
-      font->extend != text_state.matrix.extend ||
-      ANGLE_CHANGES(text_rotate, text_state.matrix.rotate)) {
-    text_state.force_reset = 1;
+  if (font->slant  != dev->text_state.matrix.slant  ||
+      font->extend != dev->text_state.matrix.extend ||
+      ANGLE_CHANGES(text_rotate, dev->text_state.matrix.rotate)) {
+    dev->text_state.force_reset = 1;
   }
-  text_state.matrix.slant  = font->slant;
-  text_state.matrix.extend = font->extend;
-  text_state.matrix.rotate = text_rotate;
+  dev->text_state.matrix.slant  = font->slant;
+  dev->text_state.matrix.extend = font->extend;
+  dev->text_state.matrix.rotate = text_rotate;
 
   if (!real_font->resource) {
     real_font->resource   = texpdf_get_font_reference(real_font->font_id);
@@ -855,25 +758,25 @@ dev_set_font (pdf_doc *doc, int font_id)
     real_font->used_on_this_page = 1;
   }
 
-  font_scale = (double) font->sptsize * dev_unit.dvi2pts;
+  font_scale = (double) font->sptsize * dev->unit.dvi2pts;
   len  = sprintf(format_buffer, " /%s", real_font->short_name); /* space not necessary. */
   format_buffer[len++] = ' ';
-  len += p_dtoa(font_scale, MIN(dev_unit.precision+1, DEV_PRECISION_MAX), format_buffer+len);
+  len += sprint_fixed(format_buffer+len, font_scale, MIN(dev->unit.precision+1, DEV_PRECISION_MAX));
   format_buffer[len++] = ' ';
   format_buffer[len++] = 'T';
   format_buffer[len++] = 'f';
   texpdf_doc_add_page_content(doc, format_buffer, len);  /* op: Tf */
 
-  if (font->bold > 0.0 || font->bold != text_state.bold_param) {
+  if (font->bold > 0.0 || font->bold != dev->text_state.bold_param) {
     if (font->bold <= 0.0)
       len = sprintf(format_buffer, " 0 Tr");
     else
       len = sprintf(format_buffer, " 2 Tr %.6f w", font->bold); /* _FIXME_ */
     texpdf_doc_add_page_content(doc, format_buffer, len);  /* op: Tr w */
   }
-  text_state.bold_param = font->bold;
+  dev->text_state.bold_param = font->bold;
 
-  text_state.font_id    = font_id;
+  dev->text_state.font_id    = font_id;
 
   return  0;
 }
@@ -885,7 +788,7 @@ dev_set_font (pdf_doc *doc, int font_id)
 int
 texpdf_dev_currentfont (void)
 {
-  return text_state.font_id;
+  return dev->text_state.font_id;
 }
 
 double
@@ -895,7 +798,7 @@ texpdf_dev_get_font_ptsize (int font_id)
 
   font = GET_FONT(font_id);
   if (font) {
-    return font->sptsize * dev_unit.dvi2pts;
+    return font->sptsize * dev->unit.dvi2pts;
   }
 
   return 1.0;
@@ -903,10 +806,12 @@ texpdf_dev_get_font_ptsize (int font_id)
 #endif
 
 int
-texpdf_dev_get_font_wmode (int font_id)
+texpdf_dev_get_font_wmode (pdf_doc *p, int font_id)
 {
   struct dev_font *font;
 
+  texpdf_doc_select(p);
+
   font = GET_FONT(font_id);
   if (font) {
     return font->wmode;
@@ -915,8 +820,8 @@ texpdf_dev_get_font_wmode (int font_id)
   return 0;
 }
 
-static unsigned char sbuf0[FORMAT_BUF_SIZE];
-static unsigned char sbuf1[FORMAT_BUF_SIZE];
+static DPX_THREAD_LOCAL unsigned char sbuf0[FORMAT_BUF_SIZE];
+static DPX_THREAD_LOCAL unsigned char sbuf1[FORMAT_BUF_SIZE];
 
 static int
 handle_multibyte_string (struct dev_font *font,
@@ -1042,34 +947,36 @@ handle_multibyte_string (struct dev_font *font,
 }
 
 
-static pdf_coord *dev_coords = NULL;
-static int num_dev_coords = 0;
-static int max_dev_coords = 0;
-
-void texpdf_dev_get_coord(double *xpos, double *ypos)
+void texpdf_dev_get_coord(pdf_doc *p, double *xpos, double *ypos)
 {
-  if (num_dev_coords > 0) {
-    *xpos = dev_coords[num_dev_coords-1].x;
-    *ypos = dev_coords[num_dev_coords-1].y;
+  texpdf_doc_select(p);
+
+  if (dev->num_coords > 0) {
+    *xpos = dev->coords[dev->num_coords-1].x;
+    *ypos = dev->coords[dev->num_coords-1].y;
   } else {
     *xpos = *ypos = 0.0;
   }
 }
 
-void texpdf_dev_push_coord(double xpos, double ypos)
+void texpdf_dev_push_coord(pdf_doc *p, double xpos, double ypos)
 {
-  if (num_dev_coords >= max_dev_coords) {
-    max_dev_coords += 4;
-    dev_coords = RENEW(dev_coords, max_dev_coords, pdf_coord);
+  texpdf_doc_select(p);
+
+  if (dev->num_coords >= dev->max_coords) {
+    dev->max_coords += 4;
+    dev->coords = RENEW(dev->coords, dev->max_coords, pdf_coord);
   }
-  dev_coords[num_dev_coords].x = xpos;
-  dev_coords[num_dev_coords].y = ypos;
-  num_dev_coords++;
+  dev->coords[dev->num_coords].x = xpos;
+  dev->coords[dev->num_coords].y = ypos;
+  dev->num_coords++;
 }
 
-void texpdf_dev_pop_coord(void)
+void texpdf_dev_pop_coord(pdf_doc *p)
 {
-  if (num_dev_coords > 0) num_dev_coords--;
+  texpdf_doc_select(p);
+
+  if (dev->num_coords > 0) dev->num_coords--;
 }
 
 /*
@@ -1099,11 +1006,13 @@ texpdf_dev_set_string (pdf_doc *p, spt_t xpos, spt_t ypos,
   spt_t            text_xorigin;
   spt_t            text_yorigin;
 
-  if (font_id < 0 || font_id >= num_dev_fonts) {
-    ERROR("Invalid font: %d (%d)", font_id, num_dev_fonts);
+  texpdf_doc_select(p);
+
+  if (font_id < 0 || font_id >= dev->num_fonts) {
+    ERROR("Invalid font: %d (%d)", font_id, dev->num_fonts);
     return;
   }
-  if (font_id != text_state.font_id) {
+  if (font_id != dev->text_state.font_id) {
     dev_set_font(p, font_id);
   }
 
@@ -1118,8 +1027,8 @@ texpdf_dev_set_string (pdf_doc *p, spt_t xpos, spt_t ypos,
   else
     real_font = font;
 
-  text_xorigin = text_state.ref_x;
-  text_yorigin = text_state.ref_y;
+  text_xorigin = dev->text_state.ref_x;
+  text_yorigin = dev->text_state.ref_y;
 
   str_ptr = instr_ptr;
   length  = instr_len;
@@ -1142,9 +1051,9 @@ texpdf_dev_set_string (pdf_doc *p, spt_t xpos, spt_t ypos,
     }
   }
 
-  if (num_dev_coords > 0) {
-    xpos -= bpt2spt(dev_coords[num_dev_coords-1].x);
-    ypos -= bpt2spt(dev_coords[num_dev_coords-1].y);
+  if (dev->num_coords > 0) {
+    xpos -= bpt2spt(dev->coords[dev->num_coords-1].x);
+    ypos -= bpt2spt(dev->coords[dev->num_coords-1].y);
   }
 
   /*
@@ -1162,17 +1071,17 @@ texpdf_dev_set_string (pdf_doc *p, spt_t xpos, spt_t ypos,
    * (in 1000 units per em) but dvipdfmx does not take into account of this...
    */
 
-  if (text_state.dir_mode==0) {
+  if (dev->text_state.dir_mode==0) {
     /* Left-to-right */
-    delh = text_xorigin + text_state.offset - xpos;
+    delh = text_xorigin + dev->text_state.offset - xpos;
     delv = ypos - text_yorigin;
-  } else if (text_state.dir_mode==1) {
+  } else if (dev->text_state.dir_mode==1) {
     /* Top-to-bottom */
-    delh = ypos - text_yorigin + text_state.offset;
+    delh = ypos - text_yorigin + dev->text_state.offset;
     delv = xpos - text_xorigin;
   } else {
     /* Bottom-to-top */
-    delh = ypos + text_yorigin + text_state.offset;
+    delh = ypos + text_yorigin + dev->text_state.offset;
     delv = xpos + text_xorigin;
   }
 
@@ -1186,8 +1095,8 @@ texpdf_dev_set_string (pdf_doc *p, spt_t xpos, spt_t ypos,
    */
 #define WORD_SPACE_MAX(f) (spt_t) (3.0 * (f)->extend * (f)->sptsize)
 
-  if (text_state.force_reset ||
-      labs(delv) > dev_unit.min_bp_val ||
+  if (dev->text_state.force_reset ||
+      labs(delv) > dev->unit.min_bp_val ||
       labs(delh) > WORD_SPACE_MAX(font)) {
     text_mode(p);
     kern = 0;
@@ -1199,28 +1108,28 @@ texpdf_dev_set_string (pdf_doc *p, spt_t xpos, spt_t ypos,
    * single text block. There are point_size/1000 rounding error per character.
    * If you really care about accuracy, you should compensate this here too.
    */
-  if (motion_state != STRING_MODE)
+  if (dev->motion_state != STRING_MODE)
     string_mode(p, xpos, ypos,
-                font->slant, font->extend, text_state.matrix.rotate);
+                font->slant, font->extend, dev->text_state.matrix.rotate);
   else if (kern != 0) {
     /*
      * Same issues as earlier. Use floating point for simplicity.
      * This routine needs to be fast, so we don't call sprintf() or strcpy().
      */
-    text_state.offset -= 
+    dev->text_state.offset -= 
       (spt_t) (kern * font->extend * (font->sptsize / 1000.0));
-    format_buffer[len++] = text_state.is_mb ? '>' : ')';
+    format_buffer[len++] = dev->text_state.is_mb ? '>' : ')';
     if (font->wmode)
-      len += p_itoa(-kern, format_buffer + len);
+      len += sprint_long(format_buffer + len, -kern);
     else {
-      len += p_itoa( kern, format_buffer + len);
+      len += sprint_long(format_buffer + len, kern);
     }
-    format_buffer[len++] = text_state.is_mb ? '<' : '(';
+    format_buffer[len++] = dev->text_state.is_mb ? '<' : '(';
     texpdf_doc_add_page_content(p, format_buffer, len);  /* op: */
     len = 0;
   }
 
-  if (text_state.is_mb) {
+  if (dev->text_state.is_mb) {
     if (FORMAT_BUF_SIZE - len < 2 * length)
       ERROR("Buffer overflow...");
     for (i = 0; i < length; i++) {
@@ -1238,60 +1147,86 @@ texpdf_dev_set_string (pdf_doc *p, spt_t xpos, spt_t ypos,
   /* I think if you really care about speed, you should avoid memcopy here. */
   texpdf_doc_add_page_content(p, format_buffer, len);  /* op: */
 
-  text_state.offset += width;
+  dev->text_state.offset += width;
+}
+
+void
+pdf_dev_select (struct pdf_dev *device)
+{
+  dev = device;
+  pdf_dev_select_gstates(dev ? dev->gstates : NULL);
+  pdf_color_select_stack(dev ? dev->colors  : NULL);
 }
 
 void
 texpdf_init_device (pdf_doc *p, double dvi2pts, int precision, int black_and_white)
 {
+  texpdf_doc_select(p);
+
+  if (p->dev)
+    texpdf_close_device(p);
+  p->dev = NEW(1, struct pdf_dev);
+  memset(p->dev, 0, sizeof(struct pdf_dev));
+  p->dev->gstates = texpdf_dev_init_gstates();
+  p->dev->colors  = pdf_color_new_stack();
+  pdf_dev_select(p->dev);
+
   if (precision < 0 ||
       precision > DEV_PRECISION_MAX)
     WARN("Number of decimal digits out of range [0-%d].",
          DEV_PRECISION_MAX);
 
   if (precision < 0) {
-    dev_unit.precision  = 0;
+    dev->unit.precision  = 0;
   } else if (precision > DEV_PRECISION_MAX) {
-    dev_unit.precision  = DEV_PRECISION_MAX;
+    dev->unit.precision  = DEV_PRECISION_MAX;
   } else {
-    dev_unit.precision  = precision;
+    dev->unit.precision  = precision;
   }
-  dev_unit.dvi2pts      = dvi2pts;
-  dev_unit.min_bp_val   = (long) ROUND(1.0/(ten_pow[dev_unit.precision]*dvi2pts), 1);
-  if (dev_unit.min_bp_val < 0)
-    dev_unit.min_bp_val = -dev_unit.min_bp_val;
+  dev->unit.dvi2pts      = dvi2pts;
+  dev->unit.min_bp_val   = (long) ROUND(1.0/(ten_pow[dev->unit.precision]*dvi2pts), 1);
+  if (dev->unit.min_bp_val < 0)
+    dev->unit.min_bp_val = -dev->unit.min_bp_val;
 
-  dev_param.colormode = (black_and_white ? 0 : 1);
+  dev->param.autorotate = 1;
+  dev->param.colormode  = (black_and_white ? 0 : 1);
 
-  texpdf_graphics_mode(p);
-  texpdf_color_clear_stack();
-  texpdf_dev_init_gstates();
+  dev->motion_state = GRAPHICS_MODE;
 
-  num_dev_fonts  = max_dev_fonts = 0;
-  dev_fonts      = NULL;
-  num_dev_coords = max_dev_coords = 0;
-  dev_coords     = NULL;
+  dev->text_state.font_id       = -1;
+  dev->text_state.matrix.slant  = 0.0;
+  dev->text_state.matrix.extend = 1.0;
+  dev->text_state.matrix.rotate = TEXT_WMODE_HH;
 }
 
 void
-texpdf_close_device (void)
+texpdf_close_device (pdf_doc *p)
 {
-  if (dev_fonts) {
+  texpdf_doc_select(p);
+
+  if (!dev)
+    return;
+
+  if (dev->fonts) {
     int    i;
 
-    for (i = 0; i < num_dev_fonts; i++) {
-      if (dev_fonts[i].tex_name)
-        RELEASE(dev_fonts[i].tex_name);
-      if (dev_fonts[i].resource)
-        texpdf_release_obj(dev_fonts[i].resource);
-      dev_fonts[i].tex_name = NULL;
-      dev_fonts[i].resource = NULL;
-      dev_fonts[i].cff_charsets = NULL;
+    for (i = 0; i < dev->num_fonts; i++) {
+      if (dev->fonts[i].tex_name)
+        RELEASE(dev->fonts[i].tex_name);
+      if (dev->fonts[i].resource)
+        texpdf_release_obj(dev->fonts[i].resource);
+      dev->fonts[i].tex_name = NULL;
+      dev->fonts[i].resource = NULL;
+      dev->fonts[i].cff_charsets = NULL;
     }
-    RELEASE(dev_fonts);
+    RELEASE(dev->fonts);
   }
-  if (dev_coords) RELEASE(dev_coords);
-  texpdf_dev_clear_gstates();
+  if (dev->coords) RELEASE(dev->coords);
+  texpdf_dev_clear_gstates(dev->gstates);
+  pdf_color_release_stack(dev->colors);
+  RELEASE(dev);
+  p->dev = NULL;
+  pdf_dev_select(NULL);
 }
 
 /*
@@ -1300,23 +1235,25 @@ texpdf_close_device (void)
  * as the font stuff.
  */
 void
-texpdf_dev_reset_fonts (void)
+texpdf_dev_reset_fonts (pdf_doc *p)
 {
   int  i;
 
-  for (i = 0; i < num_dev_fonts; i++) {
-    dev_fonts[i].used_on_this_page = 0;
+  texpdf_doc_select(p);
+
+  for (i = 0; i < dev->num_fonts; i++) {
+    dev->fonts[i].used_on_this_page = 0;
   }
 
-  text_state.font_id       = -1;
+  dev->text_state.font_id       = -1;
 
-  text_state.matrix.slant  = 0.0;
-  text_state.matrix.extend = 1.0;
-  text_state.matrix.rotate = TEXT_WMODE_HH;
+  dev->text_state.matrix.slant  = 0.0;
+  dev->text_state.matrix.extend = 1.0;
+  dev->text_state.matrix.rotate = TEXT_WMODE_HH;
 
-  text_state.bold_param    = 0.0;
+  dev->text_state.bold_param    = 0.0;
 
-  text_state.is_mb         = 0;
+  dev->text_state.is_mb         = 0;
 }
 
 void
@@ -1324,7 +1261,9 @@ texpdf_dev_reset_color (pdf_doc *p, int force)
 {
   pdf_color *sc, *fc;
 
-  texpdf_color_get_current(&sc, &fc);
+  texpdf_doc_select(p);
+
+  texpdf_color_get_current(p, &sc, &fc);
   texpdf_dev_set_color(p, sc,    0, force);
   texpdf_dev_set_color(p, fc, 0x20, force);
 }
@@ -1349,14 +1288,16 @@ texpdf_dev_set_origin (double phys_x, double phys_y)
 void
 texpdf_dev_bop (pdf_doc *p, const pdf_tmatrix *M)
 {
+  texpdf_doc_select(p);
+
   texpdf_graphics_mode(p);
 
-  text_state.force_reset  = 0;
+  dev->text_state.force_reset  = 0;
 
   texpdf_dev_gsave(p);
   texpdf_dev_concat(p, M);
 
-  texpdf_dev_reset_fonts();
+  texpdf_dev_reset_fonts(p);
   texpdf_dev_reset_color(p, 0);
 }
 
@@ -1365,6 +1306,8 @@ texpdf_dev_eop (pdf_doc *p)
 {
   int  depth;
 
+  texpdf_doc_select(p);
+
   texpdf_graphics_mode(p);
 
   depth = texpdf_dev_current_depth();
@@ -1417,11 +1360,13 @@ print_fontmap (const char *font_name, fontmap_rec *mrec)
 
 }
 
-int texpdf_dev_load_native_font(const char *filename, uint32_t index,
+int texpdf_dev_load_native_font(pdf_doc *p, const char *filename, uint32_t index,
                         spt_t ptsize, int layout_dir, int extend, int slant, int embolden) {
   fontmap_rec  *mrec;
   char         *fontmap_key = malloc(strlen(filename) + 40); // CHECK this is enough
 
+  texpdf_doc_select(p);
+
   sprintf(fontmap_key, "%s/%u/%c/%d/%d/%d", filename, index, layout_dir == 0 ? 'H' : 'V', extend, slant, embolden);
   mrec = texpdf_lookup_fontmap_record(native_fontmap, fontmap_key);
   if (mrec == NULL) {
@@ -1432,7 +1377,7 @@ int texpdf_dev_load_native_font(const char *filename, uint32_t index,
     /* FIXME: would be more efficient if pdf_load_native_font returned the mrec ptr (or NULL for error)
               so we could avoid doing a second lookup for the item we just inserted */
   }
-  return texpdf_dev_locate_font(native_fontmap, fontmap_key, ptsize);
+  return texpdf_dev_locate_font(p, native_fontmap, fontmap_key, ptsize);
 }
 
 /* _FIXME_
@@ -1442,12 +1387,14 @@ int texpdf_dev_load_native_font(const char *filename, uint32_t index,
  * of the same font at different sizes.
  */
 int
-texpdf_dev_locate_font (fontmap_t* map, const char *font_name, spt_t ptsize)
+texpdf_dev_locate_font (pdf_doc *p, fontmap_t* map, const char *font_name, spt_t ptsize)
 {
   int              i;
   fontmap_rec     *mrec;
   struct dev_font *font;
 
+  texpdf_doc_select(p);
+
   if (!font_name)
     return  -1;
 
@@ -1456,11 +1403,11 @@ texpdf_dev_locate_font (fontmap_t* map, const char *font_name, spt_t ptsize)
     return -1;
   }
 
-  for (i = 0; i < num_dev_fonts; i++) {
-    if (strcmp(font_name, dev_fonts[i].tex_name) == 0) {
-      if (ptsize == dev_fonts[i].sptsize)
+  for (i = 0; i < dev->num_fonts; i++) {
+    if (strcmp(font_name, dev->fonts[i].tex_name) == 0) {
+      if (ptsize == dev->fonts[i].sptsize)
         return i; /* found a dev_font that matches the request */
-      if (dev_fonts[i].format != PDF_FONTTYPE_BITMAP)
+      if (dev->fonts[i].format != PDF_FONTTYPE_BITMAP)
         break; /* new dev_font will share pdf resource with /i/ */
     }
   }
@@ -1469,12 +1416,12 @@ texpdf_dev_locate_font (fontmap_t* map, const char *font_name, spt_t ptsize)
    * Make sure we have room for a new one, even though we may not
    * actually create one.
    */
-  if (num_dev_fonts >= max_dev_fonts) {
-    max_dev_fonts += 16;
-    dev_fonts      = RENEW(dev_fonts, max_dev_fonts, struct dev_font);
+  if (dev->num_fonts >= dev->max_fonts) {
+    dev->max_fonts += 16;
+    dev->fonts      = RENEW(dev->fonts, dev->max_fonts, struct dev_font);
   }
 
-  font = &dev_fonts[num_dev_fonts];
+  font = &dev->fonts[dev->num_fonts];
 
   /* New font */
   mrec = texpdf_lookup_fontmap_record(map, font_name);
@@ -1482,23 +1429,22 @@ texpdf_dev_locate_font (fontmap_t* map, const char *font_name, spt_t ptsize)
   if (verbose > 1)
     print_fontmap(font_name, mrec);
 
-  font->font_id = pdf_font_findresource(map, font_name, ptsize * dev_unit.dvi2pts, mrec);
+  font->font_id = pdf_font_findresource(map, font_name, ptsize * dev->unit.dvi2pts, mrec);
   if (font->font_id < 0)
     return  -1;
 
-  if (mrec)
-    font->cff_charsets = mrec->opt.cff_charsets;
+  font->cff_charsets = texpdf_get_font_cff_charsets(font->font_id);
 
   /* We found device font here. */
-  if (i < num_dev_fonts) {
+  if (i < dev->num_fonts) {
     font->real_font_index = i;
-    strcpy(font->short_name, dev_fonts[i].short_name);
+    strcpy(font->short_name, dev->fonts[i].short_name);
   }
   else {
     font->real_font_index = -1;
     font->short_name[0] = 'F';
-    p_itoa(num_phys_fonts + 1, &font->short_name[1]); /* NULL terminated here */
-    num_phys_fonts++;
+    sprint_long(&font->short_name[1], dev->num_phys_fonts + 1); /* NULL terminated here */
+    dev->num_phys_fonts++;
   }
 
   font->used_on_this_page = 0;
@@ -1557,7 +1503,7 @@ texpdf_dev_locate_font (fontmap_t* map, const char *font_name, spt_t ptsize)
     }
   }
 
-  return  num_dev_fonts++;
+  return  dev->num_fonts++;
 }
 
 
@@ -1569,9 +1515,9 @@ dev_sprint_line (char *buf, spt_t width,
   int    len = 0;
   double w;
 
-  w = width * dev_unit.dvi2pts;
+  w = width * dev->unit.dvi2pts;
 
-  len += p_dtoa(w, MIN(dev_unit.precision+1, DEV_PRECISION_MAX), buf+len);
+  len += sprint_fixed(buf+len, w, MIN(dev->unit.precision+1, DEV_PRECISION_MAX));
   buf[len++] = ' ';
   buf[len++] = 'w';
   buf[len++] = ' ';
@@ -1600,9 +1546,11 @@ texpdf_dev_set_rule (pdf_doc *p, spt_t xpos, spt_t ypos, spt_t width, spt_t heig
   int    len = 0;
   double width_in_bp;
 
-  if (num_dev_coords > 0) {
-    xpos -= bpt2spt(dev_coords[num_dev_coords-1].x);
-    ypos -= bpt2spt(dev_coords[num_dev_coords-1].y);
+  texpdf_doc_select(p);
+
+  if (dev->num_coords > 0) {
+    xpos -= bpt2spt(dev->coords[dev->num_coords-1].x);
+    ypos -= bpt2spt(dev->coords[dev->num_coords-1].y);
   }
 
   texpdf_graphics_mode(p);
@@ -1611,15 +1559,15 @@ texpdf_dev_set_rule (pdf_doc *p, spt_t xpos, spt_t ypos, spt_t width, spt_t heig
   format_buffer[len++] = 'q';
   format_buffer[len++] = ' ';
   /* Don't use too thick line. */
-  width_in_bp = ((width < height) ? width : height) * dev_unit.dvi2pts;
+  width_in_bp = ((width < height) ? width : height) * dev->unit.dvi2pts;
   if (width_in_bp < 0.0 || /* Shouldn't happen */
       width_in_bp > PDF_LINE_THICKNESS_MAX) {
     pdf_rect rect;
 
-    rect.llx =  dev_unit.dvi2pts * xpos;
-    rect.lly =  dev_unit.dvi2pts * ypos;
-    rect.urx =  dev_unit.dvi2pts * width;
-    rect.ury =  dev_unit.dvi2pts * height;
+    rect.llx =  dev->unit.dvi2pts * xpos;
+    rect.lly =  dev->unit.dvi2pts * ypos;
+    rect.urx =  dev->unit.dvi2pts * width;
+    rect.ury =  dev->unit.dvi2pts * height;
     len += pdf_sprint_rect(format_buffer+len, &rect);
     format_buffer[len++] = ' ';
     format_buffer[len++] = 'r';
@@ -1633,7 +1581,7 @@ texpdf_dev_set_rule (pdf_doc *p, spt_t xpos, spt_t ypos, spt_t width, spt_t heig
        *  device resolution. See, PDF Reference Manual 4th ed., sec. 4.3.2,
        *  "Details of Graphics State Parameters", p. 185.
        */
-      if (height < dev_unit.min_bp_val) {
+      if (height < dev->unit.min_bp_val) {
         WARN("Too thin line: height=%ld (%g bp)", height, width_in_bp);
         WARN("Please consider using \"-d\" option.");
       }
@@ -1644,7 +1592,7 @@ texpdf_dev_set_rule (pdf_doc *p, spt_t xpos, spt_t ypos, spt_t width, spt_t heig
                              xpos + width,
                              ypos + height/2);
     } else {
-      if (width < dev_unit.min_bp_val) {
+      if (width < dev->unit.min_bp_val) {
         WARN("Too thin line: width=%ld (%g bp)", width, width_in_bp);
         WARN("Please consider using \"-d\" option.");
       }
@@ -1663,7 +1611,7 @@ texpdf_dev_set_rule (pdf_doc *p, spt_t xpos, spt_t ypos, spt_t width, spt_t heig
 
 /* Rectangle in device space coordinate. */
 void
-texpdf_dev_set_rect (pdf_rect *rect,
+texpdf_dev_set_rect (pdf_doc *p, pdf_rect *rect,
                   spt_t x_user, spt_t y_user,
                   spt_t width,  spt_t height, spt_t depth)
 {
@@ -1671,12 +1619,14 @@ texpdf_dev_set_rect (pdf_rect *rect,
   pdf_coord   p0, p1, p2, p3;
   double      min_x, min_y, max_x, max_y;
 
-  dev_x = x_user * dev_unit.dvi2pts;
-  dev_y = y_user * dev_unit.dvi2pts;
-  if (text_state.dir_mode) {
-    p0.x = dev_x - dev_unit.dvi2pts * depth;
-    p0.y = dev_y - dev_unit.dvi2pts * width;
-    p1.x = dev_x + dev_unit.dvi2pts * height;
+  texpdf_doc_select(p);
+
+  dev_x = x_user * dev->unit.dvi2pts;
+  dev_y = y_user * dev->unit.dvi2pts;
+  if (dev->text_state.dir_mode) {
+    p0.x = dev_x - dev->unit.dvi2pts * depth;
+    p0.y = dev_y - dev->unit.dvi2pts * width;
+    p1.x = dev_x + dev->unit.dvi2pts * height;
     p1.y = p0.y;
     p2.x = p1.x;
     p2.y = dev_y;
@@ -1684,11 +1634,11 @@ texpdf_dev_set_rect (pdf_rect *rect,
     p3.y = p2.y;
   } else {
     p0.x = dev_x;
-    p0.y = dev_y - dev_unit.dvi2pts * depth;
-    p1.x = dev_x + dev_unit.dvi2pts * width;
+    p0.y = dev_y - dev->unit.dvi2pts * depth;
+    p1.x = dev_x + dev->unit.dvi2pts * width;
     p1.y = p0.y;
     p2.x = p1.x;
-    p2.y = dev_y + dev_unit.dvi2pts * height;
+    p2.y = dev_y + dev->unit.dvi2pts * height;
     p3.x = p0.x;
     p3.y = p2.y;
   }
@@ -1723,22 +1673,26 @@ texpdf_dev_set_rect (pdf_rect *rect,
 }
 
 int
-texpdf_dev_get_dirmode (void)
+texpdf_dev_get_dirmode (pdf_doc *p)
 {
-  return text_state.dir_mode;
+  texpdf_doc_select(p);
+
+  return dev->text_state.dir_mode;
 }
 
 void
-texpdf_dev_set_dirmode (int text_dir)
+texpdf_dev_set_dirmode (pdf_doc *p, int text_dir)
 {
   struct dev_font *font;
   int text_rotate;
   int vert_dir, vert_font;
 
+  texpdf_doc_select(p);
+
   font = CURRENTFONT();
 
   vert_font = (font && font->wmode) ? 1 : 0;
-  if (dev_param.autorotate) {
+  if (dev->param.autorotate) {
     vert_dir = text_dir;
   } else {
     vert_dir = vert_font;
@@ -1746,12 +1700,12 @@ texpdf_dev_set_dirmode (int text_dir)
   text_rotate = (vert_font << 2)|vert_dir;
 
   if (font &&
-      ANGLE_CHANGES(text_rotate, text_state.matrix.rotate)) {
-    text_state.force_reset = 1;
+      ANGLE_CHANGES(text_rotate, dev->text_state.matrix.rotate)) {
+    dev->text_state.force_reset = 1;
   }
 
-  text_state.matrix.rotate = text_rotate;
-  text_state.dir_mode      = text_dir;
+  dev->text_state.matrix.rotate = text_rotate;
+  dev->text_state.dir_mode      = text_dir;
 }
 
 static void
@@ -1764,30 +1718,32 @@ dev_set_param_autorotate (int auto_rotate)
 
   vert_font = (font && font->wmode) ? 1 : 0;
   if (auto_rotate) {
-    vert_dir = text_state.dir_mode;
+    vert_dir = dev->text_state.dir_mode;
   } else {
     vert_dir = vert_font;
   }
   text_rotate = (vert_font << 2)|vert_dir;
 
-  if (ANGLE_CHANGES(text_rotate, text_state.matrix.rotate)) {
-    text_state.force_reset = 1;
+  if (ANGLE_CHANGES(text_rotate, dev->text_state.matrix.rotate)) {
+    dev->text_state.force_reset = 1;
   }
-  text_state.matrix.rotate = text_rotate;
-  dev_param.autorotate     = auto_rotate;
+  dev->text_state.matrix.rotate = text_rotate;
+  dev->param.autorotate     = auto_rotate;
 }
 
 int
-texpdf_dev_get_param (int param_type)
+texpdf_dev_get_param (pdf_doc *p, int param_type)
 {
   int value = 0;
 
+  texpdf_doc_select(p);
+
   switch (param_type) {
   case PDF_DEV_PARAM_AUTOROTATE:
-    value = dev_param.autorotate;
+    value = dev->param.autorotate;
     break;
   case PDF_DEV_PARAM_COLORMODE:
-    value = dev_param.colormode;
+    value = dev->param.colormode;
     break;
   default:
     ERROR("Unknown device parameter: %d", param_type);
@@ -1797,14 +1753,16 @@ texpdf_dev_get_param (int param_type)
 }
 
 void
-texpdf_dev_set_param (int param_type, int value)
+texpdf_dev_set_param (pdf_doc *p, int param_type, int value)
 {
+  texpdf_doc_select(p);
+
   switch (param_type) {
   case PDF_DEV_PARAM_AUTOROTATE:
     dev_set_param_autorotate(value);
     break;
   case PDF_DEV_PARAM_COLORMODE:
-    dev_param.colormode = value; /* 0 for B&W */
+    dev->param.colormode = value; /* 0 for B&W */
     break;
   default:
     ERROR("Unknown device parameter: %d", param_type);
@@ -1827,16 +1785,18 @@ texpdf_dev_put_image (pdf_doc *doc,
   pdf_rect     r;
   int          len = 0;
 
-  if (num_dev_coords > 0) {
-    ref_x -= dev_coords[num_dev_coords-1].x;
-    ref_y -= dev_coords[num_dev_coords-1].y;
+  texpdf_doc_select(doc);
+
+  if (dev->num_coords > 0) {
+    ref_x -= dev->coords[dev->num_coords-1].x;
+    ref_y -= dev->coords[dev->num_coords-1].y;
   }
 
   pdf_copymatrix(&M, &(p->matrix));
   M.e += ref_x; M.f += ref_y;
   /* Just rotate by -90, but not tested yet. Any problem if M has scaling? */
-  if (dev_param.autorotate &&
-      text_state.dir_mode) {
+  if (dev->param.autorotate &&
+      dev->text_state.dir_mode) {
     double tmp;
     tmp = -M.a; M.a = M.b; M.b = tmp;
     tmp = -M.c; M.c = M.d; M.d = tmp;
@@ -1882,7 +1842,7 @@ texpdf_dev_put_image (pdf_doc *doc,
     pdf_rect rect;
     pdf_coord corner[4];
 
-    texpdf_dev_set_rect(&rect, 65536 * ref_x, 65536 * ref_y,
+    texpdf_dev_set_rect(doc, &rect, 65536 * ref_x, 65536 * ref_y,
 	65536 * (r.urx - r.llx), 65536 * (r.ury - r.lly), 0);
 
     corner[0].x = rect.llx; corner[0].y = rect.lly;
@@ -88,7 +88,10 @@ extern void   texpdf_init_device   (pdf_doc *p, double unit_conv, int precision,
 This should be the last thing you do when writing the PDF file.
 */
 
-extern void   texpdf_close_device  (void);
+extern void   texpdf_close_device  (pdf_doc *p);
+
+/* Makes device the one the calling thread draws with, see texpdf_doc_select() */
+extern void   pdf_dev_select (struct pdf_dev *device);
 
 /* returns 1.0/unit_conv */
 extern double dev_unit_dviunit  (void);
@@ -182,10 +185,10 @@ extern int    texpdf_dev_put_image  (pdf_doc *doc, int xobj_id,
 
 /* The design_size and ptsize required by PK font support...
  */
-extern int    texpdf_dev_load_native_font(const char *filename, uint32_t index,
+extern int    texpdf_dev_load_native_font(pdf_doc *p, const char *filename, uint32_t index,
                         spt_t ptsize, int layout_dir, int extend, int slant, int embolden);
 
-extern int    texpdf_dev_locate_font (fontmap_t* map, const char *font_name, spt_t ptsize);
+extern int    texpdf_dev_locate_font (pdf_doc *p, fontmap_t* map, const char *font_name, spt_t ptsize);
 
 extern int    texpdf_dev_setfont     (const char *font_name, spt_t ptsize);
 
@@ -204,18 +207,18 @@ extern double texpdf_dev_scale      (void);
 extern int    texpdf_dev_currentfont     (void); /* returns font_id */
 extern double texpdf_dev_get_font_ptsize (int font_id);
 #endif
-extern int    texpdf_dev_get_font_wmode  (int font_id); /* ps: special support want this (pTeX). */
+extern int    texpdf_dev_get_font_wmode  (pdf_doc *p, int font_id); /* ps: special support want this (pTeX). */
 
 /* Text composition (direction) mode
  * This affects only when auto_rotate is enabled.
  */
-extern int    texpdf_dev_get_dirmode     (void);
-extern void   texpdf_dev_set_dirmode     (int dir_mode);
+extern int    texpdf_dev_get_dirmode     (pdf_doc *p);
+extern void   texpdf_dev_set_dirmode     (pdf_doc *p, int dir_mode);
 
 /* Set rect to rectangle in device space.
  * Unit conversion spt_t to bp and transformation applied within it.
  */
-extern void   texpdf_dev_set_rect   (pdf_rect *rect,
+extern void   texpdf_dev_set_rect   (pdf_doc *p, pdf_rect *rect,
 				  spt_t x_pos, spt_t y_pos,
 				  spt_t width, spt_t height, spt_t depth);
 
@@ -224,15 +227,15 @@ extern void   texpdf_dev_set_rect   (pdf_rect *rect,
 #define PDF_DEV_PARAM_AUTOROTATE  1
 #define PDF_DEV_PARAM_COLORMODE   2
 
-extern int    texpdf_dev_get_param (int param_type);
-extern void   texpdf_dev_set_param (int param_type, int value);
+extern int    texpdf_dev_get_param (pdf_doc *p, int param_type);
+extern void   texpdf_dev_set_param (pdf_doc *p, int param_type, int value);
 
 /* Text composition mode is ignored (always same as font's
  * writing mode) and glyph rotation is not enabled if
  * auto_rotate is unset.
  */
-#define texpdf_dev_set_autorotate(v) texpdf_dev_set_param(PDF_DEV_PARAM_AUTOROTATE, (v))
-#define texpdf_dev_set_colormode(v)  texpdf_dev_set_param(PDF_DEV_PARAM_COLORMODE,  (v))
+#define texpdf_dev_set_autorotate(p, v) texpdf_dev_set_param((p), PDF_DEV_PARAM_AUTOROTATE, (v))
+#define texpdf_dev_set_colormode(p, v)  texpdf_dev_set_param((p), PDF_DEV_PARAM_COLORMODE,  (v))
 
 /*
  * For pdf_doc, pdf_draw and others.
@@ -241,7 +244,7 @@ extern void   texpdf_dev_set_param (int param_type, int value);
 /* Force reselecting font and color:
  * XFrom (content grabbing) and Metapost support want them.
  */
-extern void   texpdf_dev_reset_fonts (void);
+extern void   texpdf_dev_reset_fonts (pdf_doc *p);
 extern void   texpdf_dev_reset_color (pdf_doc *p, int force);
 
 /* Initialization of transformation matrix with M and others.
@@ -256,8 +259,8 @@ extern void   texpdf_dev_eop (pdf_doc *p);
  */
 extern void   texpdf_graphics_mode (pdf_doc *p);
 
-extern void   texpdf_dev_get_coord(double *xpos, double *ypos);
-extern void   texpdf_dev_push_coord(double xpos, double ypos);
-extern void   texpdf_dev_pop_coord(void);
+extern void   texpdf_dev_get_coord(pdf_doc *p, double *xpos, double *ypos);
+extern void   texpdf_dev_push_coord(pdf_doc *p, double xpos, double ypos);
+extern void   texpdf_dev_pop_coord(pdf_doc *p);
 
 #endif /* _PDFDEV_H_ */
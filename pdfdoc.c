@@ -36,15 +36,39 @@
 #define PDFDOC_ARTICLE_ALLOC_SIZE 16
 #define PDFDOC_BEAD_ALLOC_SIZE    16
 
-/* XXX Need to eliminate statics if this is going to be reentrant! */
 static int verbose = 0;
-static char *thumb_basename = NULL;
 
 static char * my_name = "libtexpdf";
 
+/* Documents are numbered as they are opened so that a thread can tell
+ * whether the one it is given is still the one it works on, even if
+ * another document has since been allocated at the same address.
+ */
+static unsigned long last_serial = 0;
+static dpx_mutex     serial_lock = DPX_MUTEX_INITIALIZER;
+static DPX_THREAD_LOCAL unsigned long current_serial = 0;
+
+void
+texpdf_doc_select (pdf_doc *p)
+{
+  ASSERT(p);
+
+  if (p->serial == current_serial)
+    return;
+  current_serial = p->serial;
+  pdf_out_select(p->output);
+  pdf_dev_select(p->dev);
+  pdf_res_select(p->resources);
+  pdf_color_select_cspcs(p->colorspaces);
+  pdf_font_select(p->fonts);
+  pdf_ximage_select(p->images);
+}
+
 void
 texpdf_doc_enable_manual_thumbnails (pdf_doc* p)
 {
+  texpdf_doc_select(p);
+
 #if HAVE_LIBPNG
   p->manual_thumb_enabled = 1;
 #else
@@ -52,6 +76,18 @@ texpdf_doc_enable_manual_thumbnails (pdf_doc* p)
 #endif
 }
 
+void
+texpdf_doc_enable_incremental_contents (pdf_doc *p)
+{
+  texpdf_doc_select(p);
+
+#ifdef HAVE_ZLIB
+  p->incremental_contents = 1;
+#else
+  WARN("Incremental compression is not supported without zlib.");
+#endif
+}
+
 static pdf_obj *
 read_thumbnail (pdf_doc *p, const char *thumb_filename) 
 {
@@ -259,6 +295,8 @@ texpdf_doc_set_bop_content (pdf_doc *p, const char *content, unsigned length)
 {
   ASSERT(p);
 
+  texpdf_doc_select(p);
+
   if (p->pages.bop) {
     texpdf_release_obj(p->pages.bop);
     p->pages.bop = NULL;
@@ -277,6 +315,8 @@ texpdf_doc_set_bop_content (pdf_doc *p, const char *content, unsigned length)
 void
 texpdf_doc_set_eop_content (pdf_doc *p, const char *content, unsigned length)
 {
+  texpdf_doc_select(p);
+
   if (p->pages.eop) {
     texpdf_release_obj(p->pages.eop);
     p->pages.eop = NULL;
@@ -323,10 +363,10 @@ asn_date (char *date_string)
 {
   long        tz_offset;
   time_t      current_time;
-  struct tm  *bd_time;
+  struct tm   bd_buf, *bd_time;
 
   time(&current_time);
-  bd_time = localtime(&current_time);
+  bd_time = localtime_r(&current_time, &bd_buf);
 
 #ifdef HAVE_TM_GMTOFF
   tz_offset = bd_time->tm_gmtoff;
@@ -433,6 +473,8 @@ texpdf_doc_get_page_resources (pdf_doc *p, const char *category)
     return NULL;
   }
 
+  texpdf_doc_select(p);
+
   if (p->pending_forms) {
     if (p->pending_forms->form.resources) {
       res_dict = p->pending_forms->form.resources;
@@ -463,6 +505,8 @@ texpdf_doc_add_page_resource (pdf_doc *p, const char *category,
   pdf_obj *resources;
   pdf_obj *duplicate;
 
+  texpdf_doc_select(p);
+
   if (!PDF_OBJ_INDIRECTTYPE(resource_ref)) {
     WARN("Passed non indirect reference...");
     resource_ref = texpdf_ref_obj(resource_ref); /* leak */
@@ -802,113 +846,27 @@ texpdf_doc_get_page (pdf_file *pf, long page_no, long *count_p,
 		  pdf_rect *bbox, pdf_obj **resources_p) {
   pdf_obj *page_tree = NULL;
   pdf_obj *resources = NULL, *box = NULL, *rotate = NULL;
-  pdf_obj *catalog;
-
-  catalog = pdf_file_get_catalog(pf);
+  long     count;
 
-  page_tree = pdf_deref_obj(texpdf_lookup_dict(catalog, "Pages"));
-
-  if (!PDF_OBJ_DICTTYPE(page_tree))
-    goto error;
-
-  {
-    long count;
-    pdf_obj *tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "Count"));
-    if (!PDF_OBJ_NUMBERTYPE(tmp)) {
-      if (tmp)
-	texpdf_release_obj(tmp);
-      goto error;
-    }
-    count = texpdf_number_value(tmp);
-    texpdf_release_obj(tmp);
-    if (count_p)
-      *count_p = count;
-    if (page_no <= 0 || page_no > count) {
-	WARN("Page %ld does not exist.", page_no);
-	goto error_silent;
-      }
+  count = pdf_file_get_page_count(pf);
+  if (count_p)
+    *count_p = count;
+  if (page_no <= 0 || page_no > count) {
+    WARN("Page %ld does not exist.", page_no);
+    goto error_silent;
   }
 
   /*
-   * Seek correct page. Get MediaBox, CropBox and Resources.
-   * (Note that these entries can be inherited.)
+   * Get the page with its MediaBox, CropBox and Resources, which may be
+   * inherited, from the page index of the file.
    */
   {
-    pdf_obj *media_box = NULL, *crop_box = NULL, *kids, *tmp;
-    int depth = PDF_OBJ_MAX_DEPTH;
-    long page_idx = page_no-1, kids_length = 1, i = 0;
-
-    while (--depth && i != kids_length) {
-      if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "MediaBox")))) {
-	if (media_box)
-	  texpdf_release_obj(media_box);
-	media_box = tmp;
-      }
-
-      if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "CropBox")))) {
-	if (crop_box)
-	  texpdf_release_obj(crop_box);
-	crop_box = tmp;
-      }
-
-      if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "Rotate")))) {
-	if (rotate)
-	  texpdf_release_obj(rotate);
-	rotate = tmp;
-      }
-
-      if ((tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "Resources")))) {
-	if (resources)
-	  texpdf_release_obj(resources);
-	resources = tmp;
-      }
+    pdf_obj *media_box = NULL, *crop_box = NULL;
 
-      kids = pdf_deref_obj(texpdf_lookup_dict(page_tree, "Kids"));
-      if (!kids)
-	break;
-      else if (!PDF_OBJ_ARRAYTYPE(kids)) {
-	texpdf_release_obj(kids);
-	goto error;
-      }
-      kids_length = texpdf_array_length(kids);
-
-      for (i = 0; i < kids_length; i++) {
-	long count;
-
-	texpdf_release_obj(page_tree);
-	page_tree = pdf_deref_obj(texpdf_get_array(kids, i));
-	if (!PDF_OBJ_DICTTYPE(page_tree))
-	  goto error;
-
-	tmp = pdf_deref_obj(texpdf_lookup_dict(page_tree, "Count"));
-	if (PDF_OBJ_NUMBERTYPE(tmp)) {
-	  /* Pages object */
-	  count = texpdf_number_value(tmp);
-	  texpdf_release_obj(tmp);
-	} else if (!tmp)
-	  /* Page object */
-	  count = 1;
-	else {
-	  texpdf_release_obj(tmp);
-	  goto error;
-	}
-
-	if (page_idx < count)
-	  break;
-
-	page_idx -= count;
-      }
-      
-      texpdf_release_obj(kids);
-    }
-
-    if (!depth || kids_length == i) {
-      if (media_box)
-	texpdf_release_obj(media_box);
-     if (crop_box)
-	texpdf_release_obj(crop_box);
+    page_tree = pdf_file_get_page(pf, page_no,
+				  &media_box, &crop_box, &rotate, &resources);
+    if (!page_tree)
       goto error;
-    }
 
     if (crop_box)
       box = crop_box;
@@ -1107,6 +1065,8 @@ texpdf_doc_bookmarks_up (pdf_doc *p)
 {
   pdf_olitem *parent, *item;
 
+  texpdf_doc_select(p);
+
   item = p->outlines.current;
   if (!item || !item->parent) {
     WARN("Can't go up above the bookmark root node!");
@@ -1133,6 +1093,8 @@ texpdf_doc_bookmarks_down (pdf_doc *p)
 {
   pdf_olitem *item, *first;
 
+  texpdf_doc_select(p);
+
   item = p->outlines.current;
   if (!item->dict) {
     pdf_obj *tcolor, *action;
@@ -1185,6 +1147,8 @@ texpdf_doc_bookmarks_down (pdf_doc *p)
 int
 texpdf_doc_bookmarks_depth (pdf_doc *p)
 {
+  texpdf_doc_select(p);
+
   return p->outlines.current_depth;
 }
 
@@ -1195,6 +1159,8 @@ texpdf_doc_bookmarks_add (pdf_doc *p, pdf_obj *dict, int is_open)
 
   ASSERT(p && dict);
 
+  texpdf_doc_select(p);
+
   item = p->outlines.current;
 
   if (!item) {
@@ -1298,6 +1264,8 @@ texpdf_doc_add_names (pdf_doc *p, const char *category,
 {
   int      i;
 
+  texpdf_doc_select(p);
+
   for (i = 0; p->names[i].category != NULL; i++) {
     if (!strcmp(p->names[i].category, category)) {
       break;
@@ -1516,6 +1484,8 @@ texpdf_doc_add_annot (pdf_doc *p, unsigned page_no, const pdf_rect *rect,
   double    xpos, ypos;
   pdf_rect  annbox;
 
+  texpdf_doc_select(p);
+
   page = doc_get_page_entry(p, page_no);
   if (!page->annots)
     page->annots = texpdf_new_array();
@@ -1524,7 +1494,7 @@ texpdf_doc_add_annot (pdf_doc *p, unsigned page_no, const pdf_rect *rect,
     pdf_rect  mediabox;
 
     texpdf_doc_get_mediabox(p, page_no, &mediabox);
-    texpdf_dev_get_coord(&xpos, &ypos);
+    texpdf_dev_get_coord(p, &xpos, &ypos);
     annbox.llx = rect->llx - xpos; annbox.lly = rect->lly - ypos;
     annbox.urx = rect->urx - xpos; annbox.ury = rect->ury - ypos;
 
@@ -1579,6 +1549,8 @@ texpdf_doc_begin_article (pdf_doc *p, const char *article_id, pdf_obj *article_i
 {
   pdf_article *article;
 
+  texpdf_doc_select(p);
+
   if (article_id == NULL || strlen(article_id) == 0)
     ERROR("Article thread without internal identifier.");
 
@@ -1634,6 +1606,8 @@ texpdf_doc_add_bead (pdf_doc* p, const char *article_id,
   pdf_bead    *bead;
   long         i;
 
+  texpdf_doc_select(p);
+
   if (!article_id) {
     ERROR("No article identifier specified.");
   }
@@ -1842,6 +1816,8 @@ texpdf_doc_set_mediabox (pdf_doc *p, unsigned page_no, const pdf_rect *mediabox)
 {
   pdf_page *page;
 
+  texpdf_doc_select(p);
+
   if (page_no == 0) {
     p->pages.mediabox.llx = mediabox->llx;
     p->pages.mediabox.lly = mediabox->lly;
@@ -1864,6 +1840,8 @@ texpdf_doc_get_mediabox (pdf_doc *p, unsigned page_no, pdf_rect *mediabox)
 {
   pdf_page *page;
 
+  texpdf_doc_select(p);
+
   if (page_no == 0) {
     mediabox->llx = p->pages.mediabox.llx;
     mediabox->lly = p->pages.mediabox.lly;
@@ -1893,6 +1871,8 @@ texpdf_doc_current_page_resources (pdf_doc *p)
   pdf_obj  *resources;
   pdf_page *currentpage;
 
+  texpdf_doc_select(p);
+
   if (p->pending_forms) {
     if (p->pending_forms->form.resources) {
       resources = p->pending_forms->form.resources;
@@ -1916,6 +1896,8 @@ texpdf_doc_get_dictionary (pdf_doc *p, const char *category)
 {
   pdf_obj *dict = NULL;
 
+  texpdf_doc_select(p);
+
   ASSERT(category);
 
   if (!strcmp(category, "Names")) {
@@ -1952,6 +1934,8 @@ texpdf_doc_get_dictionary (pdf_doc *p, const char *category)
 long
 texpdf_doc_current_page_number (pdf_doc *p)
 {
+  texpdf_doc_select(p);
+
   return (long) (PAGECOUNT(p) + 1);
 }
 
@@ -1960,6 +1944,8 @@ texpdf_doc_ref_page (pdf_doc *p, unsigned long page_no)
 {
   pdf_page *page;
 
+  texpdf_doc_select(p);
+
   page = doc_get_page_entry(p, page_no);
   if (!page->page_obj) {
     page->page_obj = texpdf_new_dict();
@@ -1975,6 +1961,8 @@ texpdf_doc_get_reference (pdf_doc *p, const char *category)
   pdf_obj *ref = NULL;
   long     page_no;
 
+  texpdf_doc_select(p);
+
   ASSERT(category);
 
   page_no = texpdf_doc_current_page_number(p);
@@ -2016,7 +2004,10 @@ pdf_doc_new_page (pdf_doc *p)
   }
 
   currentpage->background = NULL;
-  currentpage->contents   = texpdf_new_stream(STREAM_COMPRESS);
+  if (p->incremental_contents)
+    currentpage->contents = texpdf_new_stream(STREAM_COMPRESS|STREAM_DEFLATE_INCREMENTAL);
+  else
+    currentpage->contents = texpdf_new_stream(STREAM_COMPRESS);
   currentpage->resources  = texpdf_new_dict();
 
   currentpage->annots = NULL;
@@ -2114,9 +2105,9 @@ pdf_doc_finish_page (pdf_doc *p)
     char    *thumb_filename;
     pdf_obj *thumb_ref;
 
-    thumb_filename = NEW(strlen(thumb_basename)+7, char);
+    thumb_filename = NEW(strlen(p->thumb_basename)+7, char);
     sprintf(thumb_filename, "%s.%ld",
-            thumb_basename, (p->pages.num_entries % 99999) + 1L);
+            p->thumb_basename, (p->pages.num_entries % 99999) + 1L);
     thumb_ref = read_thumbnail(p, thumb_filename);
     RELEASE(thumb_filename);
     if (thumb_ref)
@@ -2125,12 +2116,17 @@ pdf_doc_finish_page (pdf_doc *p)
 
   p->pages.num_entries++;
 
+  /* Most objects made for this page are gone by now */
+  trim_small();
+
   return;
 }
 
 void
 texpdf_doc_set_bgcolor (pdf_doc *p, const pdf_color *color)
 {
+  texpdf_doc_select(p);
+
   if (color)
     texpdf_color_copycolor(&p->bgcolor, color);
   else { /* as clear... */
@@ -2146,7 +2142,7 @@ doc_fill_page_background (pdf_doc *p)
   int        cm;
   pdf_obj   *saved_content;
 
-  cm = texpdf_dev_get_param(PDF_DEV_PARAM_COLORMODE);
+  cm = texpdf_dev_get_param(p, PDF_DEV_PARAM_COLORMODE);
   if (!cm || texpdf_color_is_white(&p->bgcolor)) {
     return;
   }
@@ -2177,6 +2173,8 @@ texpdf_doc_begin_page (pdf_doc *p, double scale, double x_origin, double y_origi
 {
   pdf_tmatrix  M;
 
+  texpdf_doc_select(p);
+
   M.a = scale; M.b = 0.0;
   M.c = 0.0  ; M.d = scale;
   M.e = x_origin;
@@ -2192,6 +2190,8 @@ texpdf_doc_begin_page (pdf_doc *p, double scale, double x_origin, double y_origi
 void
 texpdf_doc_end_page (pdf_doc *p)
 {
+  texpdf_doc_select(p);
+
   texpdf_dev_eop(p);
   doc_fill_page_background(p);
 
@@ -2205,6 +2205,8 @@ texpdf_doc_add_page_content (pdf_doc *p, const char *buffer, unsigned length)
 {
   pdf_page *currentpage;
 
+  texpdf_doc_select(p);
+
   if (p->pending_forms) {
     texpdf_add_stream(p->pending_forms->form.contents, buffer, length);
   } else {
@@ -2237,18 +2239,22 @@ texpdf_open_document (const char *filename,
 {
   pdf_doc *p = malloc(sizeof(pdf_doc));
   pdf_init(p);
-  pdf_out_init(filename, do_encryption);
+  dpx_mutex_lock(&serial_lock);
+  p->serial = ++last_serial;
+  dpx_mutex_unlock(&serial_lock);
+  p->output = pdf_out_init(filename, do_encryption);
+  texpdf_doc_select(p);
 
   pdf_doc_init_catalog(p);
 
   p->opt.annot_grow = annot_grow_amount;
   p->opt.outline_open_depth = bookmark_open_depth;
 
-  texpdf_init_resources();
-  texpdf_init_colors();
-  texpdf_init_fonts();
+  texpdf_init_resources(p);
+  texpdf_init_colors(p);
+  texpdf_init_fonts(p);
   /* Thumbnail want this to be initialized... */
-  texpdf_init_images();
+  texpdf_init_images(p);
 
   pdf_doc_init_docinfo(p);
 
@@ -2270,12 +2276,12 @@ texpdf_open_document (const char *filename,
   if (p->manual_thumb_enabled) {
     if (strlen(filename) > 4 &&
         !strncmp(".pdf", filename + strlen(filename) - 4, 4)) {
-      thumb_basename = NEW(strlen(filename)-4+1, char);
-      strncpy(thumb_basename, filename, strlen(filename)-4);
-      thumb_basename[strlen(filename)-4] = 0;
+      p->thumb_basename = NEW(strlen(filename)-4+1, char);
+      strncpy(p->thumb_basename, filename, strlen(filename)-4);
+      p->thumb_basename[strlen(filename)-4] = 0;
     } else {
-      thumb_basename = NEW(strlen(filename)+1, char);
-      strcpy(thumb_basename, filename);
+      p->thumb_basename = NEW(strlen(filename)+1, char);
+      strcpy(p->thumb_basename, filename);
     }
   }
 
@@ -2287,6 +2293,8 @@ texpdf_open_document (const char *filename,
 void
 texpdf_doc_set_creator (pdf_doc *p, const char *creator)
 {
+  texpdf_doc_select(p);
+
   if (!creator ||
       creator[0] == '\0')
     return;
@@ -2300,6 +2308,7 @@ texpdf_doc_set_creator (pdf_doc *p, const char *creator)
 void
 texpdf_close_document (pdf_doc *p)
 {
+  texpdf_doc_select(p);
 
   /*
    * Following things were kept around so user can add dictionary items.
@@ -2312,16 +2321,18 @@ texpdf_close_document (pdf_doc *p)
 
   pdf_doc_close_catalog  (p);
 
-  texpdf_close_images();
-  texpdf_close_fonts ();
-  texpdf_close_colors();
+  texpdf_close_images(p);
+  texpdf_close_fonts (p);
+  texpdf_close_colors(p);
 
-  texpdf_close_resources(); /* Should be at last. */
+  texpdf_close_resources(p); /* Should be at last. */
 
-  pdf_out_flush();
+  pdf_out_flush(p->output);
+  p->output = NULL;
 
-  if (thumb_basename)
-    RELEASE(thumb_basename);
+  if (p->thumb_basename)
+    RELEASE(p->thumb_basename);
+  p->thumb_basename = NULL;
 
   return;
 }
@@ -2392,6 +2403,8 @@ texpdf_doc_begin_grabbing (pdf_doc *p, const char *ident,
   struct form_list_node *fnode;
   xform_info  info;
 
+  texpdf_doc_select(p);
+
   texpdf_dev_push_gstate();
 
   fnode = NEW(1, struct form_list_node);
@@ -2443,7 +2456,7 @@ texpdf_doc_begin_grabbing (pdf_doc *p, const char *ident,
    * Make sure the object is self-contained by adding the
    * current font and color to the object stream.
    */
-  texpdf_dev_reset_fonts();
+  texpdf_dev_reset_fonts(p);
   texpdf_dev_reset_color(p, 1);  /* force color operators to be added to stream */
 
   return xobj_id;
@@ -2456,6 +2469,8 @@ texpdf_doc_end_grabbing (pdf_doc *p, pdf_obj *attrib)
   pdf_obj  *procset;
   struct form_list_node *fnode;
 
+  texpdf_doc_select(p);
+
   if (!p->pending_forms) {
     WARN("Tried to close a nonexistent form XOject.");
     return;
@@ -2488,7 +2503,7 @@ texpdf_doc_end_grabbing (pdf_doc *p, pdf_obj *attrib)
 
   texpdf_dev_pop_gstate();
 
-  texpdf_dev_reset_fonts();
+  texpdf_dev_reset_fonts(p);
   texpdf_dev_reset_color(p, 0);
 
   RELEASE(fnode);
@@ -2496,64 +2511,63 @@ texpdf_doc_end_grabbing (pdf_doc *p, pdf_obj *attrib)
   return;
 }
 
-/* Urgh */
-static struct
-{
-  int      dirty;
-  int      broken;
-  pdf_obj *annot_dict;
-  pdf_rect rect;
-} breaking_state = {0, 0, NULL, {0.0, 0.0, 0.0, 0.0}};
-
 static void
-reset_box (void)
+reset_box (pdf_doc *p)
 {
-  breaking_state.rect.llx = breaking_state.rect.lly =  HUGE_VAL;
-  breaking_state.rect.urx = breaking_state.rect.ury = -HUGE_VAL;
-  breaking_state.dirty    = 0;
+  p->breaking_state.rect.llx = p->breaking_state.rect.lly =  HUGE_VAL;
+  p->breaking_state.rect.urx = p->breaking_state.rect.ury = -HUGE_VAL;
+  p->breaking_state.dirty    = 0;
 }
 
 void
 texpdf_doc_begin_annot (pdf_doc *p, pdf_obj *dict) /* XXX */
 {
-  breaking_state.annot_dict = dict;
-  breaking_state.broken = 0;
-  reset_box();
+  texpdf_doc_select(p);
+
+  p->breaking_state.annot_dict = dict;
+  p->breaking_state.broken = 0;
+  reset_box(p);
 }
 
 void
 texpdf_doc_end_annot (pdf_doc *p)
 {
+  texpdf_doc_select(p);
+
   texpdf_doc_break_annot(p);
-  breaking_state.annot_dict = NULL;
+  p->breaking_state.annot_dict = NULL;
 }
 
 void
 texpdf_doc_break_annot (pdf_doc *p)
 {
-  if (breaking_state.dirty) {
+  texpdf_doc_select(p);
+
+  if (p->breaking_state.dirty) {
     pdf_obj  *annot_dict;
 
     /* Copy dict */
     annot_dict = texpdf_new_dict();
-    texpdf_merge_dict(annot_dict, breaking_state.annot_dict);
-    texpdf_doc_add_annot(p, texpdf_doc_current_page_number(p), &(breaking_state.rect),
-		      annot_dict, !breaking_state.broken);
+    texpdf_merge_dict(annot_dict, p->breaking_state.annot_dict);
+    texpdf_doc_add_annot(p, texpdf_doc_current_page_number(p), &(p->breaking_state.rect),
+		      annot_dict, !p->breaking_state.broken);
     texpdf_release_obj(annot_dict);
 
-    breaking_state.broken = 1;
+    p->breaking_state.broken = 1;
   }
-  reset_box();
+  reset_box(p);
 }
 
 void
 texpdf_doc_expand_box (pdf_doc *p, const pdf_rect *rect)
 {
-  breaking_state.rect.llx = MIN(breaking_state.rect.llx, rect->llx);
-  breaking_state.rect.lly = MIN(breaking_state.rect.lly, rect->lly);
-  breaking_state.rect.urx = MAX(breaking_state.rect.urx, rect->urx);
-  breaking_state.rect.ury = MAX(breaking_state.rect.ury, rect->ury);
-  breaking_state.dirty    = 1;
+  texpdf_doc_select(p);
+
+  p->breaking_state.rect.llx = MIN(p->breaking_state.rect.llx, rect->llx);
+  p->breaking_state.rect.lly = MIN(p->breaking_state.rect.lly, rect->lly);
+  p->breaking_state.rect.urx = MAX(p->breaking_state.rect.urx, rect->urx);
+  p->breaking_state.rect.ury = MAX(p->breaking_state.rect.ury, rect->ury);
+  p->breaking_state.dirty    = 1;
 }
 
 #if 0
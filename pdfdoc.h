@@ -42,6 +42,18 @@ extern pdf_doc* texpdf_open_document (
 				    int check_gotos);
 extern void     texpdf_close_document (pdf_doc *p);
 
+/* Makes p the document the calling thread works on: objects are labelled
+ * and written in the selected document, resources, fonts, images and color
+ * spaces are defined and looked up in it, and its device (text state,
+ * fonts, graphics and color stacks) is the one drawn with. Every function
+ * taking a pdf_doc does this itself; call it before functions which don't
+ * (texpdf_ref_obj(), texpdf_release_obj(), texpdf_dev_transform(),
+ * pdf_defineresource(), ...) when another document has been used on this
+ * thread since. A document must not be used by two threads at the same
+ * time.
+ */
+extern void     texpdf_doc_select (pdf_doc *p);
+
 
 /* PDF document metadata */
 extern void     texpdf_doc_set_creator   (pdf_doc *p, const char *creator);
@@ -131,6 +143,11 @@ extern void     texpdf_doc_expand_box  (pdf_doc *p, const pdf_rect *rect);
 /* Manual thumbnail */
 extern void     texpdf_doc_enable_manual_thumbnails (pdf_doc *p);
 
+/* Compress page contents as they are produced instead of keeping the
+ * whole uncompressed page in memory until it is written.
+ */
+extern void     texpdf_doc_enable_incremental_contents (pdf_doc *p);
+
 #if 0
 /* PageLabels - */
 extern void     pdf_doc_set_pagelabel (long  page_start,
@@ -240,7 +240,7 @@ static const struct {
 
 
 #define FORMAT_BUFF_LEN 1024
-static char    fmt_buf[FORMAT_BUFF_LEN];
+static DPX_THREAD_LOCAL char fmt_buf[FORMAT_BUFF_LEN];
 
 static void
 init_a_path (pdf_path *p)
@@ -727,6 +727,8 @@ texpdf_dev__rectshape (pdf_doc *doc, const pdf_rect    *r,
   pdf_coord p;
   double    wd, ht;
 
+  texpdf_doc_select(doc);
+
   ASSERT(r && PT_OP_VALID(opchr));
 
   isclip = (opchr == 'W' || opchr == ' ') ? 1 : 0;
@@ -779,7 +781,30 @@ texpdf_dev__rectshape (pdf_doc *doc, const pdf_rect    *r,
   return 0;
 }
 
-static int path_added = 0;
+typedef struct m_stack_elem
+{
+  void                *data;
+  struct m_stack_elem *prev;
+} m_stack_elem;
+
+typedef struct m_stack
+{
+  int           size;
+  m_stack_elem *top;
+  m_stack_elem *bottom;
+} m_stack;
+
+/* Graphics state stack of a document, made by texpdf_dev_init_gstates().
+ * path_added is set when texpdf_dev_rectadd() has written a path that the
+ * next flush must paint even if the current path is empty.
+ */
+struct pdf_gstates
+{
+  m_stack stack;
+  int     path_added;
+};
+
+static DPX_THREAD_LOCAL struct pdf_gstates *gstates = NULL;
 
 /* FIXME */
 static int
@@ -798,14 +823,16 @@ texpdf_dev__flushpath (pdf_doc *p, pdf_path  *pa,
   int        isclip = 0;
   int        isrect, i, j;
 
+  texpdf_doc_select(p);
+
   ASSERT(pa && PT_OP_VALID(opchr));
 
   isclip = (opchr == 'W') ? 1 : 0;
 
-  if (PA_LENGTH(pa) <= 0 && path_added == 0)
+  if (PA_LENGTH(pa) <= 0 && gstates->path_added == 0)
     return 0;
 
-  path_added = 0;
+  gstates->path_added = 0;
   texpdf_graphics_mode(p);
   isrect = pdf_path__isarect(pa, ignore_rule); 
   if (isrect) {
@@ -894,19 +921,6 @@ typedef struct pdf_gstate_
 } pdf_gstate;
 
 
-typedef struct m_stack_elem
-{
-  void                *data;
-  struct m_stack_elem *prev;
-} m_stack_elem;
-
-typedef struct m_stack
-{
-  int           size;
-  m_stack_elem *top;
-  m_stack_elem *bottom;
-} m_stack;
-
 static void
 m_stack_init (m_stack *stack)
 {
@@ -979,7 +993,14 @@ m_stack_top (m_stack *stack)
 
 #define m_stack_depth(s)    ((s)->size)
 
-static m_stack gs_stack;
+/* Selects doc and returns the graphics state stack of its device */
+static m_stack *
+doc_gstates (pdf_doc *doc)
+{
+  texpdf_doc_select(doc);
+
+  return &gstates->stack;
+}
 
 static void
 init_a_gstate (pdf_gstate *gs)
@@ -1058,46 +1079,58 @@ copy_a_gstate (pdf_gstate *gs1, pdf_gstate *gs2)
   return;
 }
     
-void
+struct pdf_gstates *
 texpdf_dev_init_gstates (void)
 {
+  struct pdf_gstates *gss;
   pdf_gstate *gs;
 
-  m_stack_init(&gs_stack);
+  gss = NEW(1, struct pdf_gstates);
+  m_stack_init(&gss->stack);
+  gss->path_added = 0;
 
   gs = NEW(1, pdf_gstate);
   init_a_gstate(gs);
 
-  m_stack_push(&gs_stack, gs); /* Initial state */
+  m_stack_push(&gss->stack, gs); /* Initial state */
 
-  return;
+  return gss;
 }
 
 void
-texpdf_dev_clear_gstates (void)
+texpdf_dev_clear_gstates (struct pdf_gstates *gss)
 {
   pdf_gstate *gs;
 
-  if (m_stack_depth(&gs_stack) > 1) /* at least 1 elem. */
+  if (m_stack_depth(&gss->stack) > 1) /* at least 1 elem. */
     WARN("GS stack depth is not zero at the end of the document.");
 
-  while ((gs = m_stack_pop(&gs_stack)) != NULL) {
+  while ((gs = m_stack_pop(&gss->stack)) != NULL) {
     clear_a_gstate(gs);
     RELEASE(gs);
   }
+  RELEASE(gss);
   return;
 }
 
+void
+pdf_dev_select_gstates (struct pdf_gstates *gss)
+{
+  gstates = gss;
+}
+
 int
 texpdf_dev_gsave (pdf_doc *p)
 {
   pdf_gstate *gs0, *gs1;
 
-  gs0 = m_stack_top(&gs_stack);
+  texpdf_doc_select(p);
+
+  gs0 = m_stack_top(&gstates->stack);
   gs1 = NEW(1, pdf_gstate);
   init_a_gstate(gs1);
   copy_a_gstate(gs1, gs0);
-  m_stack_push(&gs_stack, gs1);
+  m_stack_push(&gstates->stack, gs1);
 
   texpdf_doc_add_page_content(p, " q", 2);  /* op: q */
 
@@ -1109,18 +1142,20 @@ texpdf_dev_grestore (pdf_doc *p)
 {
   pdf_gstate *gs;
 
-  if (m_stack_depth(&gs_stack) <= 1) { /* Initial state at bottom */
+  texpdf_doc_select(p);
+
+  if (m_stack_depth(&gstates->stack) <= 1) { /* Initial state at bottom */
     WARN("Too many grestores.");
     return  -1;
   }
 
-  gs = m_stack_pop(&gs_stack);
+  gs = m_stack_pop(&gstates->stack);
   clear_a_gstate(gs);
   RELEASE(gs);
 
   texpdf_doc_add_page_content(p, " Q", 2);  /* op: Q */
 
-  texpdf_dev_reset_fonts();
+  texpdf_dev_reset_fonts(p);
 
   return  0;
 }
@@ -1129,7 +1164,7 @@ texpdf_dev_grestore (pdf_doc *p)
 int
 texpdf_dev_push_gstate (void)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = &gstates->stack;
   pdf_gstate *gs0;
 
   gs0 = NEW(1, pdf_gstate);
@@ -1145,7 +1180,7 @@ texpdf_dev_push_gstate (void)
 int
 texpdf_dev_pop_gstate (void)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = &gstates->stack;
   pdf_gstate *gs;
 
   if (m_stack_depth(gss) <= 1) { /* Initial state at bottom */
@@ -1164,13 +1199,13 @@ texpdf_dev_pop_gstate (void)
 int
 texpdf_dev_current_depth (void)
 {
-  return (m_stack_depth(&gs_stack) - 1); /* 0 means initial state */
+  return (m_stack_depth(&gstates->stack) - 1); /* 0 means initial state */
 }
 
 void
 texpdf_dev_grestore_to (pdf_doc *p, int depth)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(p);
   pdf_gstate *gs;
 
   ASSERT(depth >= 0);
@@ -1185,15 +1220,15 @@ texpdf_dev_grestore_to (pdf_doc *p, int depth)
     clear_a_gstate(gs);
     RELEASE(gs);
   }
-  texpdf_dev_reset_fonts();
+  texpdf_dev_reset_fonts(p);
 
   return;
 }
 
 int
-texpdf_dev_currentpoint (pdf_coord *p)
+texpdf_dev_currentpoint (pdf_doc *doc, pdf_coord *p)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_coord  *cpt = &gs->cp;
 
@@ -1205,9 +1240,9 @@ texpdf_dev_currentpoint (pdf_coord *p)
 }
 
 int
-texpdf_dev_currentmatrix (pdf_tmatrix *M)
+texpdf_dev_currentmatrix (pdf_doc *doc, pdf_tmatrix *M)
 {
-  m_stack     *gss = &gs_stack;
+  m_stack     *gss = doc_gstates(doc);
   pdf_gstate  *gs  = m_stack_top(gss);
   pdf_tmatrix *CTM = &gs->matrix;
 
@@ -1222,7 +1257,7 @@ texpdf_dev_currentmatrix (pdf_tmatrix *M)
 int
 texpdf_dev_currentcolor (pdf_color *color, int is_fill)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = &gstates->stack;
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_color  *fcl = &gs->fillcolor;
   pdf_color  *scl = &gs->strokecolor;
@@ -1246,12 +1281,12 @@ texpdf_dev_set_color (pdf_doc *p, const pdf_color *color, char mask, int force)
 {
   int len;
 
-  pdf_gstate *gs  = m_stack_top(&gs_stack);
+  pdf_gstate *gs  = m_stack_top(doc_gstates(p));
   pdf_color *current = mask ? &gs->fillcolor : &gs->strokecolor;
 
   ASSERT(texpdf_color_is_valid(color));
 
-  if (!(texpdf_dev_get_param(PDF_DEV_PARAM_COLORMODE) &&
+  if (!(texpdf_dev_get_param(p, PDF_DEV_PARAM_COLORMODE) &&
 	(force || texpdf_color_compare(color, current))))
     /* If "color" is already the current color, then do nothing
      * unless a color operator is forced
@@ -1283,7 +1318,7 @@ texpdf_dev_set_color (pdf_doc *p, const pdf_color *color, char mask, int force)
 int
 texpdf_dev_concat (pdf_doc *p, const pdf_tmatrix *M)
 {
-  m_stack     *gss = &gs_stack;
+  m_stack     *gss = doc_gstates(p);
   pdf_gstate  *gs  = m_stack_top(gss);
   pdf_path    *cpa = &gs->path;
   pdf_coord   *cpt = &gs->cp;
@@ -1337,7 +1372,7 @@ texpdf_dev_concat (pdf_doc *p, const pdf_tmatrix *M)
 int
 texpdf_dev_setmiterlimit (pdf_doc *p, double mlimit)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(p);
   pdf_gstate *gs  = m_stack_top(gss);
   int         len = 0;
   char       *buf = fmt_buf;
@@ -1357,7 +1392,7 @@ texpdf_dev_setmiterlimit (pdf_doc *p, double mlimit)
 int
 texpdf_dev_setlinecap (pdf_doc *p, int capstyle)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(p);
   pdf_gstate *gs  = m_stack_top(gss);
   int         len = 0;
   char       *buf = fmt_buf;
@@ -1374,7 +1409,7 @@ texpdf_dev_setlinecap (pdf_doc *p, int capstyle)
 int
 texpdf_dev_setlinejoin (pdf_doc *p, int joinstyle)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(p);
   pdf_gstate *gs  = m_stack_top(gss);
   int         len = 0;
   char       *buf = fmt_buf;
@@ -1391,7 +1426,7 @@ texpdf_dev_setlinejoin (pdf_doc *p, int joinstyle)
 int
 texpdf_dev_setlinewidth (pdf_doc *p, double width)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(p);
   pdf_gstate *gs  = m_stack_top(gss);  
   int         len = 0;
   char       *buf = fmt_buf;
@@ -1411,7 +1446,7 @@ texpdf_dev_setlinewidth (pdf_doc *p, double width)
 int
 texpdf_dev_setdash (pdf_doc *p, int count, double *pattern, double offset)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(p);
   pdf_gstate *gs  = m_stack_top(gss);
   int         len = 0;
   char       *buf = fmt_buf;
@@ -1438,7 +1473,7 @@ texpdf_dev_setdash (pdf_doc *p, int count, double *pattern, double offset)
 int
 texpdf_dev_setflat (int flatness)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = &gstates->stack;
   pdf_gstate *gs  = m_stack_top(gss);
   int         len = 0;
   char       *buf = fmt_buf;
@@ -1460,7 +1495,7 @@ texpdf_dev_setflat (int flatness)
 int
 texpdf_dev_clip (pdf_doc *p)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(p);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
 
@@ -1470,7 +1505,7 @@ texpdf_dev_clip (pdf_doc *p)
 int
 texpdf_dev_eoclip (pdf_doc *p)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(p);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
 
@@ -1480,7 +1515,7 @@ texpdf_dev_eoclip (pdf_doc *p)
 int
 texpdf_dev_flushpath (pdf_doc *p, char p_op, int fill_rule)
 {
-  m_stack    *gss   = &gs_stack;
+  m_stack    *gss   = doc_gstates(p);
   pdf_gstate *gs    = m_stack_top(gss);
   pdf_path   *cpa   = &gs->path;
   int         error = 0;
@@ -1500,7 +1535,7 @@ texpdf_dev_flushpath (pdf_doc *p, char p_op, int fill_rule)
 int
 texpdf_dev_newpath (pdf_doc *doc)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *p   = &gs->path;
 
@@ -1514,9 +1549,9 @@ texpdf_dev_newpath (pdf_doc *doc)
 }
 
 int
-texpdf_dev_moveto (double x, double y)
+texpdf_dev_moveto (pdf_doc *doc, double x, double y)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;
@@ -1527,9 +1562,9 @@ texpdf_dev_moveto (double x, double y)
 }
 
 int
-texpdf_dev_rmoveto (double x, double y)
+texpdf_dev_rmoveto (pdf_doc *doc, double x, double y)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;
@@ -1541,9 +1576,9 @@ texpdf_dev_rmoveto (double x, double y)
 }
 
 int
-texpdf_dev_lineto (double x, double y)
+texpdf_dev_lineto (pdf_doc *doc, double x, double y)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;
@@ -1555,9 +1590,9 @@ texpdf_dev_lineto (double x, double y)
 }
 
 int
-texpdf_dev_rlineto (double x, double y)
+texpdf_dev_rlineto (pdf_doc *doc, double x, double y)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;
@@ -1569,11 +1604,11 @@ texpdf_dev_rlineto (double x, double y)
 }
 
 int
-texpdf_dev_curveto (double x0, double y0,
+texpdf_dev_curveto (pdf_doc *doc, double x0, double y0,
                  double x1, double y1,
                  double x2, double y2)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;
@@ -1587,10 +1622,10 @@ texpdf_dev_curveto (double x0, double y0,
 }
 
 int
-texpdf_dev_vcurveto (double x0, double y0,
+texpdf_dev_vcurveto (pdf_doc *doc, double x0, double y0,
                   double x1, double y1)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;
@@ -1603,10 +1638,10 @@ texpdf_dev_vcurveto (double x0, double y0,
 }
 
 int
-texpdf_dev_ycurveto (double x0, double y0,
+texpdf_dev_ycurveto (pdf_doc *doc, double x0, double y0,
                   double x1, double y1)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;
@@ -1619,11 +1654,11 @@ texpdf_dev_ycurveto (double x0, double y0,
 }
 
 int
-texpdf_dev_rcurveto (double x0, double y0,
+texpdf_dev_rcurveto (pdf_doc *doc, double x0, double y0,
                   double x1, double y1,
                   double x2, double y2)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;
@@ -1638,9 +1673,9 @@ texpdf_dev_rcurveto (double x0, double y0,
 
 
 int
-texpdf_dev_closepath (void)
+texpdf_dev_closepath (pdf_doc *doc)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_coord  *cpt = &gs->cp;
   pdf_path   *cpa = &gs->path;
@@ -1652,7 +1687,7 @@ texpdf_dev_closepath (void)
 void
 texpdf_dev_dtransform (pdf_coord *p, const pdf_tmatrix *M)
 {
-  m_stack     *gss = &gs_stack;
+  m_stack     *gss = &gstates->stack;
   pdf_gstate  *gs  = m_stack_top(gss);
   pdf_tmatrix *CTM = &gs->matrix;
 
@@ -1666,7 +1701,7 @@ texpdf_dev_dtransform (pdf_coord *p, const pdf_tmatrix *M)
 void
 texpdf_dev_idtransform (pdf_coord *p, const pdf_tmatrix *M)
 {
-  m_stack     *gss = &gs_stack;
+  m_stack     *gss = &gstates->stack;
   pdf_gstate  *gs  = m_stack_top(gss);
   pdf_tmatrix *CTM = &gs->matrix;
 
@@ -1680,7 +1715,7 @@ texpdf_dev_idtransform (pdf_coord *p, const pdf_tmatrix *M)
 void
 texpdf_dev_transform (pdf_coord *p, const pdf_tmatrix *M)
 {
-  m_stack     *gss = &gs_stack;
+  m_stack     *gss = &gstates->stack;
   pdf_gstate  *gs  = m_stack_top(gss);
   pdf_tmatrix *CTM = &gs->matrix;
 
@@ -1695,7 +1730,7 @@ texpdf_dev_transform (pdf_coord *p, const pdf_tmatrix *M)
 void
 texpdf_dev_itransform (pdf_coord *p, const pdf_tmatrix *M)
 {
-  m_stack     *gss = &gs_stack;
+  m_stack     *gss = &gstates->stack;
   pdf_gstate  *gs  = m_stack_top(gss);
   pdf_tmatrix *CTM = &gs->matrix;
 
@@ -1708,10 +1743,10 @@ texpdf_dev_itransform (pdf_coord *p, const pdf_tmatrix *M)
 #endif
 
 int
-texpdf_dev_arc  (double c_x , double c_y, double r,
+texpdf_dev_arc  (pdf_doc *doc, double c_x , double c_y, double r,
               double a_0 , double a_1)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;
@@ -1724,10 +1759,10 @@ texpdf_dev_arc  (double c_x , double c_y, double r,
 
 /* *negative* arc */
 int
-texpdf_dev_arcn (double c_x , double c_y, double r,
+texpdf_dev_arcn (pdf_doc *doc, double c_x , double c_y, double r,
               double a_0 , double a_1)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;
@@ -1739,13 +1774,13 @@ texpdf_dev_arcn (double c_x , double c_y, double r,
 }
 
 int
-texpdf_dev_arcx (double c_x , double c_y,
+texpdf_dev_arcx (pdf_doc *doc, double c_x , double c_y,
               double r_x , double r_y,
               double a_0 , double a_1,
               int    a_d ,
               double xar)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;
@@ -1758,10 +1793,10 @@ texpdf_dev_arcx (double c_x , double c_y,
 
 /* Required by Tpic */
 int
-texpdf_dev_bspline (double x0, double y0,
+texpdf_dev_bspline (pdf_doc *doc, double x0, double y0,
                  double x1, double y1, double x2, double y2)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   pdf_path   *cpa = &gs->path;
   pdf_coord  *cpt = &gs->cp;  
@@ -1801,6 +1836,8 @@ texpdf_dev_rectfill  (pdf_doc *p, double x, double y,
 {
   pdf_rect r;
 
+  texpdf_doc_select(p);
+
   r.llx = x;
   r.lly = y;
   r.urx = x + w;
@@ -1815,6 +1852,8 @@ texpdf_dev_rectclip (pdf_doc *p, double x, double y,
 {
   pdf_rect r;
 
+  texpdf_doc_select(p);
+
   r.llx = x;
   r.lly = y;
   r.urx = x + w;
@@ -1829,28 +1868,30 @@ texpdf_dev_rectadd (pdf_doc *p, double x, double y,
 {
   pdf_rect r;
 
+  texpdf_doc_select(p);
+
   r.llx = x;
   r.lly = y;
   r.urx = x + w;
   r.ury = y + h;
-  path_added = 1;
+  gstates->path_added = 1;
 
   return  texpdf_dev__rectshape(p, &r, NULL, ' ');
 }
 
 void
-texpdf_dev_set_fixed_point (double x, double y)
+texpdf_dev_set_fixed_point (pdf_doc *doc, double x, double y)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   gs->pt_fixee.x = x;
   gs->pt_fixee.y = y;
 }
 
 void
-texpdf_dev_get_fixed_point (pdf_coord *p)
+texpdf_dev_get_fixed_point (pdf_doc *doc, pdf_coord *p)
 {
-  m_stack    *gss = &gs_stack;
+  m_stack    *gss = doc_gstates(doc);
   pdf_gstate *gs  = m_stack_top(gss);
   p->x = gs->pt_fixee.x;
   p->y = gs->pt_fixee.y;
@@ -29,8 +29,10 @@
 #define  PDF_DASH_SIZE_MAX  16
 #define  PDF_GSAVE_MAX      256
 
-extern void  texpdf_dev_init_gstates  (void);
-extern void  texpdf_dev_clear_gstates (void);
+/* Graphics state stack of a document's device, see texpdf_init_device() */
+extern struct pdf_gstates *texpdf_dev_init_gstates  (void);
+extern void  texpdf_dev_clear_gstates (struct pdf_gstates *gss);
+extern void  pdf_dev_select_gstates   (struct pdf_gstates *gss);
 
 #define pdf_copymatrix(m,n) do {\
   (m)->a = (n)->a; (m)->b = (n)->b;\
@@ -59,8 +61,8 @@ extern void  texpdf_dev_clear_gstates (void);
 
 typedef struct pdf_path_ pdf_path;
 
-extern int    texpdf_dev_currentmatrix (pdf_tmatrix *M);
-extern int    texpdf_dev_currentpoint  (pdf_coord *cp);
+extern int    texpdf_dev_currentmatrix (pdf_doc *p, pdf_tmatrix *M);
+extern int    texpdf_dev_currentpoint  (pdf_doc *p, pdf_coord *cp);
 
 extern int    texpdf_dev_setlinewidth  (pdf_doc *p, double  width);
 extern int    texpdf_dev_setmiterlimit (pdf_doc *p, double  mlimit);
@@ -74,25 +76,25 @@ extern int    texpdf_dev_setflat       (int     flatness);
 #endif
 
 /* Path Construction */
-extern int    texpdf_dev_moveto        (double x , double y);
-extern int    texpdf_dev_rmoveto       (double x , double y);
-extern int    texpdf_dev_closepath     (void);
+extern int    texpdf_dev_moveto        (pdf_doc *p, double x , double y);
+extern int    texpdf_dev_rmoveto       (pdf_doc *p, double x , double y);
+extern int    texpdf_dev_closepath     (pdf_doc *p);
 
-extern int    texpdf_dev_lineto        (double x0 , double y0);
-extern int    texpdf_dev_rlineto       (double x0 , double y0);
-extern int    texpdf_dev_curveto       (double x0 , double y0,
+extern int    texpdf_dev_lineto        (pdf_doc *p, double x0 , double y0);
+extern int    texpdf_dev_rlineto       (pdf_doc *p, double x0 , double y0);
+extern int    texpdf_dev_curveto       (pdf_doc *p, double x0 , double y0,
                                      double x1 , double y1,
                                      double x2 , double y2);
-extern int    texpdf_dev_vcurveto      (double x0 , double y0,
+extern int    texpdf_dev_vcurveto      (pdf_doc *p, double x0 , double y0,
                                      double x1 , double y1);
-extern int    texpdf_dev_ycurveto      (double x0 , double y0,
+extern int    texpdf_dev_ycurveto      (pdf_doc *p, double x0 , double y0,
                                      double x1 , double y1);
-extern int    texpdf_dev_rcurveto      (double x0 , double y0,
+extern int    texpdf_dev_rcurveto      (pdf_doc *p, double x0 , double y0,
                                      double x1 , double y1,
                                      double x2 , double y2);
-extern int    texpdf_dev_arc           (double c_x, double c_y, double r,
+extern int    texpdf_dev_arc           (pdf_doc *p, double c_x, double c_y, double r,
                                      double a_0, double a_1);
-extern int    texpdf_dev_arcn          (double c_x, double c_y, double r,
+extern int    texpdf_dev_arcn          (pdf_doc *p, double c_x, double c_y, double r,
                                      double a_0, double a_1);
   
 #define PDF_FILL_RULE_NONZERO 0
@@ -123,7 +125,8 @@ extern int    texpdf_dev_flushpath     (pdf_doc *p, char p_op, int fill_rule);
 #define texpdf_dev_fillstroke(p) texpdf_dev_flushpath(p, 'B', PDF_FILL_RULE_NONZERO)
 
 extern int    texpdf_dev_concat        (pdf_doc *p, const pdf_tmatrix *M);
-/* NULL pointer of M mean apply current transformation */
+/* NULL pointer of M mean apply current transformation (of the document
+ * last selected on this thread, see texpdf_doc_select()) */
 extern void   texpdf_dev_dtransform    (pdf_coord *p, const pdf_tmatrix *M);
 extern void   texpdf_dev_idtransform   (pdf_coord *p, const pdf_tmatrix *M);
 extern void   texpdf_dev_transform     (pdf_coord *p, const pdf_tmatrix *M);
@@ -141,13 +144,13 @@ extern int    texpdf_dev_pop_gstate (void);
 
 
 /* extension */
-extern int    texpdf_dev_arcx          (double c_x, double c_y,
+extern int    texpdf_dev_arcx          (pdf_doc *p, double c_x, double c_y,
                                      double r_x, double r_y,
                                      double a_0, double a_1,
                                      int    a_d, /* arc direction   */
                                      double xar  /* x-axis-rotation */
                                     );
-extern int    texpdf_dev_bspline       (double x0, double y0,
+extern int    texpdf_dev_bspline       (pdf_doc *p, double x0, double y0,
                                      double x1, double y1,
                                      double x2, double y2);
 
@@ -166,8 +169,8 @@ extern void   texpdf_dev_grestore_to   (pdf_doc *p, int depth);
 extern int    texpdf_dev_currentcolor  (pdf_color *color, int is_fill);
 #endif
 
-extern void texpdf_dev_set_fixed_point (double x, double y);
-extern void texpdf_dev_get_fixed_point (pdf_coord *p);
+extern void texpdf_dev_set_fixed_point (pdf_doc *p, double x, double y);
+extern void texpdf_dev_get_fixed_point (pdf_doc *p, pdf_coord *cp);
 
 extern void   texpdf_dev_set_color     (pdf_doc *p, const pdf_color *color, char mask, int force);
 #define texpdf_dev_set_strokingcolor(p, c)     texpdf_dev_set_color(p, c,    0, 0);
@@ -56,13 +56,28 @@ pdf_encoding_set_verbose (void)
 #define FLAG_IS_PREDEFINED  (1 << 0)
 #define FLAG_USED_BY_TYPE3  (1 << 1)
 
-typedef struct pdf_encoding
+/* The glyph names of an encoding, read once and shared by all open
+ * documents
+ */
+typedef struct enc_vector
 {
   char     *ident;
+  char     *enc_name;
+  char     *glyphs[256];     /* ".notdef" must be represented as NULL */
+} enc_vector;
 
+static struct ht_table enc_vectors;
+static int             enc_vectors_users = 0;
+static dpx_rwlock      enc_vectors_lock  = DPX_RWLOCK_INITIALIZER;
+
+typedef struct pdf_encoding
+{
+  /* Those of the shared enc_vector */
+  char     *ident;
   char     *enc_name;
+  char    **glyphs;
+
   int       flags;
-  char     *glyphs[256];     /* ".notdef" must be represented as NULL */
   char      is_used[256];
 
   struct pdf_encoding *baseenc;
@@ -71,9 +86,7 @@ typedef struct pdf_encoding
   pdf_obj  *resource;
 } pdf_encoding;
 
-static int      pdf_encoding_new_encoding (const char *enc_name,
-					   const char *ident,
-					   const char **encoding_vec,
+static int      pdf_encoding_new_encoding (enc_vector *vec,
 					   const char *baseenc_name,
 					   int flags);
 
@@ -86,7 +99,7 @@ texpdf_init_encoding_struct (pdf_encoding *encoding)
 
   encoding->enc_name = NULL;
 
-  memset(encoding->glyphs,  0, 256*sizeof(char *));
+  encoding->glyphs   = NULL;
   memset(encoding->is_used, 0, 256);
 
   encoding->tounicode = NULL;
@@ -156,8 +169,6 @@ pdf_flush_encoding (pdf_encoding *encoding)
 static void
 pdf_clean_encoding_struct (pdf_encoding *encoding)
 {
-  int   code;
-
   ASSERT(encoding);
 
   if (encoding->resource)
@@ -165,23 +176,83 @@ pdf_clean_encoding_struct (pdf_encoding *encoding)
 
   if (encoding->tounicode)
     texpdf_release_obj(encoding->tounicode);
-  if (encoding->ident)
-    RELEASE(encoding->ident);
-  if (encoding->enc_name)
-    RELEASE(encoding->enc_name);
 
   encoding->ident    = NULL;
   encoding->enc_name = NULL;
+  encoding->glyphs   = NULL;
+
+  return;
+}
+
+static enc_vector *
+enc_vector_new (const char *enc_name, const char *ident,
+                const char **encoding_vec)
+{
+  enc_vector *vec;
+  int         code;
+
+  vec = NEW(1, enc_vector);
+  vec->ident = NEW(strlen(ident)+1, char);
+  strcpy(vec->ident, ident);
+  vec->enc_name  = NEW(strlen(enc_name)+1, char);
+  strcpy(vec->enc_name, enc_name);
 
   for (code = 0; code < 256; code++) {
-    if (encoding->glyphs[code])
-      RELEASE(encoding->glyphs[code]);
-    encoding->glyphs[code] = NULL;
+    if (encoding_vec[code] && strcmp(encoding_vec[code], ".notdef")) {
+      vec->glyphs[code] = NEW(strlen(encoding_vec[code])+1, char);
+      strcpy(vec->glyphs[code], encoding_vec[code]);
+    } else {
+      vec->glyphs[code] = NULL;
+    }
   }
-  encoding->ident    = NULL;
-  encoding->enc_name = NULL;
 
-  return;
+  return vec;
+}
+
+static void CDECL
+enc_vector_free (void *hval)
+{
+  enc_vector *vec = hval;
+  int         code;
+
+  for (code = 0; code < 256; code++) {
+    if (vec->glyphs[code])
+      RELEASE(vec->glyphs[code]);
+  }
+  RELEASE(vec->ident);
+  RELEASE(vec->enc_name);
+  RELEASE(vec);
+}
+
+/* Adds VEC unless another thread was first; returns the one to use */
+static enc_vector *
+enc_vector_insert (enc_vector *vec)
+{
+  enc_vector *found;
+
+  dpx_write_lock(&enc_vectors_lock);
+  found = texpdf_ht_lookup_table(&enc_vectors, vec->ident, strlen(vec->ident));
+  if (!found)
+    ht_insert_table(&enc_vectors, vec->ident, strlen(vec->ident), vec);
+  dpx_unlock(&enc_vectors_lock);
+  if (found) {
+    enc_vector_free(vec);
+    return found;
+  }
+
+  return vec;
+}
+
+static enc_vector *
+enc_vector_lookup (const char *ident)
+{
+  enc_vector *vec;
+
+  dpx_read_lock(&enc_vectors_lock);
+  vec = texpdf_ht_lookup_table(&enc_vectors, ident, strlen(ident));
+  dpx_unlock(&enc_vectors_lock);
+
+  return vec;
 }
 
 #if 0
@@ -270,11 +341,17 @@ load_encoding_file (const char *filename)
   char    *wbuf;
   const char *p, *endptr;
   const char *enc_vec[256];
-  int      code, fsize, enc_id;
+  enc_vector *vec;
+  int      code, fsize;
 
   if (!filename)
     return -1;
 
+  /* Already read for another document */
+  vec = enc_vector_lookup(filename);
+  if (vec)
+    return pdf_encoding_new_encoding(vec, NULL, 0);
+
   if (verbose) {
     MESG("(Encoding:%s", filename);
   }
@@ -320,8 +397,8 @@ load_encoding_file (const char *filename)
   for (code = 0; code < 256; code++) {
     enc_vec[code] = texpdf_name_value(texpdf_get_array(encoding_array, code));
   }
-  enc_id = pdf_encoding_new_encoding(enc_name ? texpdf_name_value(enc_name) : NULL,
-				     filename, enc_vec, NULL, 0);
+  vec = enc_vector_new(enc_name ? texpdf_name_value(enc_name) : NULL,
+                       filename, enc_vec);
 
   if (enc_name) {
     if (verbose > 1)
@@ -332,43 +409,68 @@ load_encoding_file (const char *filename)
 
   if (verbose) MESG(")");
 
-  return enc_id;
+  return pdf_encoding_new_encoding(enc_vector_insert(vec), NULL, 0);
 }
 
 #define CHECK_ID(n) do { \
-  if ((n) < 0 || (n) >= enc_cache.count) { \
+  if ((n) < 0 || (n) >= enc_cache->count) { \
      ERROR("Invalid encoding id: %d", (n)); \
   } \
 } while (0)
 
 #define CACHE_ALLOC_SIZE 16u
 
-struct {
+struct enc_cache {
   int           count;
   int           capacity;
   pdf_encoding *encodings;
-} enc_cache = {
-  0, 0, NULL
 };
 
+/* Encodings of the document selected on this thread, see
+ * texpdf_init_fonts()
+ */
+static DPX_THREAD_LOCAL struct enc_cache *enc_cache = NULL;
+
 void
+pdf_encoding_select_cache (struct enc_cache *cache)
+{
+  enc_cache = cache;
+}
+
+static enc_vector *
+predefined_vector (const char *name, const char **encoding_vec)
+{
+  enc_vector *vec = enc_vector_lookup(name);
+
+  return vec ? vec : enc_vector_insert(enc_vector_new(name, name, encoding_vec));
+}
+
+struct enc_cache *
 texpdf_init_encodings (void)
 {
-  enc_cache.count     = 0;
-  enc_cache.capacity  = 3;
-  enc_cache.encodings = NEW(enc_cache.capacity, pdf_encoding);
+  struct enc_cache *cache = NEW(1, struct enc_cache);
+
+  cache->count     = 0;
+  cache->capacity  = 3;
+  cache->encodings = NEW(cache->capacity, pdf_encoding);
+  pdf_encoding_select_cache(cache);
+
+  dpx_write_lock(&enc_vectors_lock);
+  if (enc_vectors_users++ == 0)
+    texpdf_ht_init_table(&enc_vectors, enc_vector_free);
+  dpx_unlock(&enc_vectors_lock);
 
   /*
    * PDF Predefined Encodings
    */
-  pdf_encoding_new_encoding("WinAnsiEncoding", "WinAnsiEncoding",
-			    WinAnsiEncoding, NULL, FLAG_IS_PREDEFINED);
-  pdf_encoding_new_encoding("MacRomanEncoding", "MacRomanEncoding",
-			    MacRomanEncoding, NULL, FLAG_IS_PREDEFINED);
-  pdf_encoding_new_encoding("MacExpertEncoding", "MacExpertEncoding",
-			    MacExpertEncoding, NULL, FLAG_IS_PREDEFINED);
-
-  return;
+  pdf_encoding_new_encoding(predefined_vector("WinAnsiEncoding", WinAnsiEncoding),
+			    NULL, FLAG_IS_PREDEFINED);
+  pdf_encoding_new_encoding(predefined_vector("MacRomanEncoding", MacRomanEncoding),
+			    NULL, FLAG_IS_PREDEFINED);
+  pdf_encoding_new_encoding(predefined_vector("MacExpertEncoding", MacExpertEncoding),
+			    NULL, FLAG_IS_PREDEFINED);
+
+  return cache;
 }
 
 /*
@@ -385,37 +487,29 @@ texpdf_init_encodings (void)
  */
 
 static int
-pdf_encoding_new_encoding (const char *enc_name, const char *ident,
-			   const char **encoding_vec,
+pdf_encoding_new_encoding (enc_vector *vec,
 			   const char *baseenc_name, int flags)
 {
-  int      enc_id, code;
+  int      enc_id;
 
   pdf_encoding *encoding;
 
-  enc_id   = enc_cache.count;
-  if (enc_cache.count++ >= enc_cache.capacity) {
-    enc_cache.capacity += 16;
-    enc_cache.encodings = RENEW(enc_cache.encodings,
-                                enc_cache.capacity,  pdf_encoding);
+  enc_id   = enc_cache->count;
+  if (enc_cache->count++ >= enc_cache->capacity) {
+    enc_cache->capacity += 16;
+    enc_cache->encodings = RENEW(enc_cache->encodings,
+                                enc_cache->capacity,  pdf_encoding);
   }
-  encoding = &enc_cache.encodings[enc_id];
+  encoding = &enc_cache->encodings[enc_id];
 
   texpdf_init_encoding_struct(encoding);
 
-  encoding->ident = NEW(strlen(ident)+1, char);
-  strcpy(encoding->ident, ident);
-  encoding->enc_name  = NEW(strlen(enc_name)+1, char);
-  strcpy(encoding->enc_name, enc_name);
+  encoding->ident    = vec->ident;
+  encoding->enc_name = vec->enc_name;
+  encoding->glyphs   = vec->glyphs;
 
   encoding->flags = flags;
 
-  for (code = 0; code < 256; code++)
-    if (encoding_vec[code] && strcmp(encoding_vec[code], ".notdef")) {
-      encoding->glyphs[code] = NEW(strlen(encoding_vec[code])+1, char);
-      strcpy(encoding->glyphs[code], encoding_vec[code]);
-    }
-
   if (!baseenc_name && !(flags & FLAG_IS_PREDEFINED)
       && is_similar_charset(encoding->glyphs, WinAnsiEncoding)) {
     /* Dvipdfmx default setting. */
@@ -428,7 +522,7 @@ pdf_encoding_new_encoding (const char *enc_name, const char *ident,
     if (baseenc_id < 0 || !pdf_encoding_is_predefined(baseenc_id))
       ERROR("Illegal base encoding %s for encoding %s\n",
 	    baseenc_name, encoding->enc_name);
-    encoding->baseenc = &enc_cache.encodings[baseenc_id];
+    encoding->baseenc = &enc_cache->encodings[baseenc_id];
   }
 
   if (flags & FLAG_IS_PREDEFINED)
@@ -444,9 +538,9 @@ void pdf_encoding_complete (void)
 {
   int  enc_id;
 
-  for (enc_id = 0; enc_id < enc_cache.count; enc_id++) {
+  for (enc_id = 0; enc_id < enc_cache->count; enc_id++) {
     if (!pdf_encoding_is_predefined(enc_id)) {
-      pdf_encoding *encoding = &enc_cache.encodings[enc_id];
+      pdf_encoding *encoding = &enc_cache->encodings[enc_id];
       /* Section 5.5.4 of the PDF 1.5 reference says that the encoding
        * of a Type 3 font must be completely described by a Differences
        * array, but implementation note 56 explains that this is rather
@@ -471,21 +565,28 @@ texpdf_close_encodings (void)
 {
   int  enc_id;
 
-  if (enc_cache.encodings) {
-    for (enc_id = 0; enc_id < enc_cache.count; enc_id++) {
+  if (!enc_cache)
+    return;
+
+  if (enc_cache->encodings) {
+    for (enc_id = 0; enc_id < enc_cache->count; enc_id++) {
       pdf_encoding *encoding;
 
-      encoding = &enc_cache.encodings[enc_id];
+      encoding = &enc_cache->encodings[enc_id];
       if (encoding) {
         pdf_flush_encoding(encoding);
         pdf_clean_encoding_struct(encoding);
       }
     }
-    RELEASE(enc_cache.encodings);
+    RELEASE(enc_cache->encodings);
   }
-  enc_cache.encodings = NULL;
-  enc_cache.count     = 0;
-  enc_cache.capacity  = 0;
+  RELEASE(enc_cache);
+  pdf_encoding_select_cache(NULL);
+
+  dpx_write_lock(&enc_vectors_lock);
+  if (enc_vectors_users > 0 && --enc_vectors_users == 0)
+    texpdf_ht_clear_table(&enc_vectors);
+  dpx_unlock(&enc_vectors_lock);
 }
 
 int
@@ -495,8 +596,8 @@ pdf_encoding_findresource (const char *enc_name)
   pdf_encoding *encoding;
 
   ASSERT(enc_name);
-  for (enc_id = 0; enc_id < enc_cache.count; enc_id++) {
-    encoding = &enc_cache.encodings[enc_id];
+  for (enc_id = 0; enc_id < enc_cache->count; enc_id++) {
+    encoding = &enc_cache->encodings[enc_id];
     if (encoding->ident &&
         !strcmp(enc_name, encoding->ident))
       return enc_id;
@@ -520,7 +621,7 @@ pdf_encoding_get_encoding (int enc_id)
 
   CHECK_ID(enc_id);
 
-  encoding = &enc_cache.encodings[enc_id];
+  encoding = &enc_cache->encodings[enc_id];
 
   return encoding->glyphs;
 }
@@ -532,7 +633,7 @@ texpdf_get_encoding_obj (int enc_id)
 
   CHECK_ID(enc_id);
 
-  encoding = &enc_cache.encodings[enc_id];
+  encoding = &enc_cache->encodings[enc_id];
 
   return encoding->resource;
 }
@@ -544,7 +645,7 @@ pdf_encoding_is_predefined (int enc_id)
 
   CHECK_ID(enc_id);
 
-  encoding = &enc_cache.encodings[enc_id];
+  encoding = &enc_cache->encodings[enc_id];
 
   return (encoding->flags & FLAG_IS_PREDEFINED) ? 1 : 0;
 }
@@ -556,7 +657,7 @@ pdf_encoding_used_by_type3 (int enc_id)
 
   CHECK_ID(enc_id);
 
-  encoding = &enc_cache.encodings[enc_id];
+  encoding = &enc_cache->encodings[enc_id];
 
   encoding->flags |= FLAG_USED_BY_TYPE3;
 }
@@ -569,7 +670,7 @@ pdf_encoding_get_name (int enc_id)
 
   CHECK_ID(enc_id);
 
-  encoding = &enc_cache.encodings[enc_id];
+  encoding = &enc_cache->encodings[enc_id];
 
   return encoding->enc_name;
 }
@@ -584,7 +685,7 @@ pdf_encoding_get_name (int enc_id)
 #include "agl.h"
 
 #define WBUF_SIZE 1024
-static unsigned char wbuf[WBUF_SIZE];
+static DPX_THREAD_LOCAL unsigned char wbuf[WBUF_SIZE];
 static unsigned char range_min[1] = {0x00u};
 static unsigned char range_max[1] = {0xFFu};
 
@@ -599,7 +700,7 @@ pdf_encoding_add_usedchars (int encoding_id, const char *is_used)
   if (!is_used || pdf_encoding_is_predefined(encoding_id))
     return;
 
-  encoding = &enc_cache.encodings[encoding_id];
+  encoding = &enc_cache->encodings[encoding_id];
 
   for (code = 0; code <= 0xff; code++)
     encoding->is_used[code] |= is_used[code];
@@ -610,7 +711,7 @@ pdf_encoding_get_tounicode (int encoding_id)
 {
   CHECK_ID(encoding_id);
 
-  return enc_cache.encodings[encoding_id].tounicode;
+  return enc_cache->encodings[encoding_id].tounicode;
 }
 
 
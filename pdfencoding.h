@@ -27,8 +27,10 @@
 
 extern void      pdf_encoding_set_verbose    (void);
 
-extern void      texpdf_init_encodings          (void);
+/* texpdf_init_fonts() makes one for each document and selects it */
+extern struct enc_cache *texpdf_init_encodings (void);
 extern void      texpdf_close_encodings         (void);
+extern void      pdf_encoding_select_cache   (struct enc_cache *cache);
 
 /* Creates Encoding resource and ToUnicode CMap 
  * for all non-predefined encodings.
@@ -43,8 +43,19 @@ static long permission;
 static unsigned char key_data[MAX_KEY_LEN], id_string[MAX_KEY_LEN];
 static unsigned char opwd_string[MAX_STR_LEN], upwd_string[MAX_STR_LEN];
 
-static unsigned long current_label = 0;
-static unsigned current_generation = 0;
+/* The key a document is encrypted with. pdf_out_init() takes a copy of
+ * the one texpdf_enc_set_passwd() computed, so that the next document
+ * may be set up with other passwords while this one is written.
+ */
+struct pdf_enc_key
+{
+  unsigned char size;
+  unsigned char data[MAX_KEY_LEN];
+};
+
+/* Object being written on this thread */
+static DPX_THREAD_LOCAL unsigned long current_label = 0;
+static DPX_THREAD_LOCAL unsigned current_generation = 0;
 
 static ARC4_KEY key;
 static MD5_CONTEXT md5_ctx;
@@ -397,24 +408,44 @@ void texpdf_enc_set_passwd (unsigned bits, unsigned perm, const char *owner_pw,
   compute_user_password();
 }
 
-void pdf_encrypt_data (unsigned char *data, unsigned long len)
+pdf_enc_key *pdf_enc_new_key (void)
 {
-  unsigned char *result;
+  pdf_enc_key *enc_key = NEW (1, pdf_enc_key);
 
-  memcpy(in_buf, key_data, key_size);
-  in_buf[key_size]   = (unsigned char)(current_label) & 0xFF;
-  in_buf[key_size+1] = (unsigned char)(current_label >> 8) & 0xFF;
-  in_buf[key_size+2] = (unsigned char)(current_label >> 16) & 0xFF;
-  in_buf[key_size+3] = (unsigned char)(current_generation) & 0xFF;
-  in_buf[key_size+4] = (unsigned char)(current_generation >> 8) & 0xFF;
+  enc_key->size = key_size;
+  memcpy(enc_key->data, key_data, MAX_KEY_LEN);
 
-  texpdf_MD5_init(&md5_ctx);
-  texpdf_MD5_write(&md5_ctx, in_buf, key_size+5);
-  texpdf_MD5_final(md5_buf, &md5_ctx);
+  return enc_key;
+}
+
+void pdf_enc_release_key (pdf_enc_key *enc_key)
+{
+  RELEASE (enc_key);
+}
+
+void pdf_encrypt_data (const pdf_enc_key *enc_key, unsigned char *data, unsigned long len)
+{
+  unsigned char *result;
+  unsigned char  size = enc_key->size;
+  /* Not the static buffers: documents may be written on several threads */
+  unsigned char  buf[MAX_KEY_LEN+5], digest[MAX_KEY_LEN];
+  MD5_CONTEXT    md5;
+  ARC4_KEY       arc4;
+
+  memcpy(buf, enc_key->data, size);
+  buf[size]   = (unsigned char)(current_label) & 0xFF;
+  buf[size+1] = (unsigned char)(current_label >> 8) & 0xFF;
+  buf[size+2] = (unsigned char)(current_label >> 16) & 0xFF;
+  buf[size+3] = (unsigned char)(current_generation) & 0xFF;
+  buf[size+4] = (unsigned char)(current_generation >> 8) & 0xFF;
+
+  texpdf_MD5_init(&md5);
+  texpdf_MD5_write(&md5, buf, size+5);
+  texpdf_MD5_final(digest, &md5);
   
   result = NEW (len, unsigned char);
-  ARC4_set_key(&key, (key_size > 10 ? MAX_KEY_LEN : key_size+5), md5_buf);
-  ARC4(&key, len, data, result);
+  ARC4_set_key(&arc4, (size > 10 ? MAX_KEY_LEN : size+5), digest);
+  ARC4(&arc4, len, data, result);
   memcpy(data, result, len);
   RELEASE (result);
 }
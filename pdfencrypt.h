@@ -33,7 +33,11 @@ extern void texpdf_enc_compute_id_string (char *dviname, char *pdfname);
 extern void texpdf_enc_set_label (unsigned long label);
 extern void texpdf_enc_set_generation (unsigned generation);
 extern void texpdf_enc_set_passwd (unsigned size, unsigned perm, const char *owner, const char *user);
-extern void pdf_encrypt_data (unsigned char *data, unsigned long len);
+/* Key of a document, copied from the one set up by texpdf_enc_set_passwd() */
+typedef struct pdf_enc_key pdf_enc_key;
+extern pdf_enc_key *pdf_enc_new_key (void);
+extern void pdf_enc_release_key (pdf_enc_key *enc_key);
+extern void pdf_encrypt_data (const pdf_enc_key *enc_key, unsigned char *data, unsigned long len);
 extern pdf_obj *pdf_encrypt_obj (void);
 
 #endif /* _PDFENCRYPT_H_ */
@@ -59,7 +59,9 @@ pdf_font_make_uniqueTag (char *tag)
   int    i;
   char   ch;
   static char first = 1;
+  static dpx_mutex tag_lock = DPX_MUTEX_INITIALIZER;
 
+  dpx_mutex_lock(&tag_lock);
   if (first) {
     srand(time(NULL));
     first = 0;
@@ -69,6 +71,7 @@ pdf_font_make_uniqueTag (char *tag)
     ch = rand() % 26;
     tag[i] = ch + 'A';
   }
+  dpx_mutex_unlock(&tag_lock);
   tag[6] = '\0';
 }
 
@@ -229,38 +232,103 @@ pdf_clean_font_struct (pdf_font *font)
 
 #define CACHE_ALLOC_SIZE 16u
 
-static struct {
+struct pdf_fonts {
   int       count;
   int       capacity;
   pdf_font *fonts;
-} font_cache = {
-  0, 0, NULL
+
+  struct enc_cache       *encodings;
+  struct Type0Font_cache *type0fonts;
 };
 
+/* Fonts of the document selected on this thread, see texpdf_init_fonts() */
+static DPX_THREAD_LOCAL struct pdf_fonts *font_cache = NULL;
+
 void
-texpdf_init_fonts (void)
+pdf_font_select (struct pdf_fonts *fonts)
+{
+  font_cache = fonts;
+  pdf_encoding_select_cache(fonts ? fonts->encodings : NULL);
+  Type0Font_cache_select(fonts ? fonts->type0fonts : NULL);
+}
+
+struct pdf_font_job
+{
+  dpx_task           task;
+  void             (*load) (void *font);
+  void              *font;
+  struct pdf_fonts  *fonts;
+  pdf_obj_log       *log;
+};
+
+static void
+run_font_job (dpx_task *task)
+{
+  pdf_font_job *job = (pdf_font_job *) task;
+
+  pdf_font_select(job->fonts);
+  pdf_obj_log_set(job->log);
+  job->load(job->font);
+  pdf_obj_log_set(NULL);
+  pdf_font_select(NULL);
+}
+
+pdf_font_job *
+pdf_font_job_start (void (*load) (void *font), void *font)
 {
-  ASSERT(font_cache.fonts == NULL);  
+  pdf_font_job *job;
+
+  /* Loaders' messages would be mixed up */
+  if (!pdf_out_workers() || __verbose) {
+    load(font);
+    return NULL;
+  }
+
+  job = NEW(1, pdf_font_job);
+  job->task.run = run_font_job;
+  job->load  = load;
+  job->font  = font;
+  job->fonts = font_cache;
+  job->log   = pdf_obj_log_new();
+  dpx_workers_submit(&job->task);
+
+  return job;
+}
+
+void
+pdf_font_job_finish (pdf_font_job *job)
+{
+  dpx_workers_wait(&job->task);
+  pdf_obj_log_replay(job->log);
+  RELEASE(job);
+}
+
+void
+texpdf_init_fonts (pdf_doc *p)
+{
+  texpdf_doc_select(p);
+  ASSERT(p->fonts == NULL);
 
   agl_init_map();
   otl_init_conf();
 
   CMap_cache_init();
-  texpdf_init_encodings();
 
-  Type0Font_cache_init();
+  p->fonts = font_cache = NEW(1, struct pdf_fonts);
+  font_cache->encodings  = texpdf_init_encodings();
+  font_cache->type0fonts = Type0Font_cache_init();
 
-  font_cache.count    = 0;
-  font_cache.capacity = CACHE_ALLOC_SIZE;
-  font_cache.fonts    = NEW(font_cache.capacity, pdf_font);
+  font_cache->count    = 0;
+  font_cache->capacity = CACHE_ALLOC_SIZE;
+  font_cache->fonts    = NEW(font_cache->capacity, pdf_font);
 }
 
 #define CHECK_ID(n) do {\
-  if ((n) < 0 || (n) >= font_cache.count) {\
+  if ((n) < 0 || (n) >= font_cache->count) {\
     ERROR("Invalid font ID: %d", (n));\
   }\
 } while (0)
-#define GET_FONT(n)  (&(font_cache.fonts[(n)]))
+#define GET_FONT(n)  (&(font_cache->fonts[(n)]))
 
 
 pdf_obj *
@@ -325,6 +393,20 @@ texpdf_get_font_wmode (int font_id)
   }
 }
 
+void *
+texpdf_get_font_cff_charsets (int font_id)
+{
+  pdf_font *font;
+
+  CHECK_ID(font_id);
+
+  font = GET_FONT(font_id);
+  if (font->subtype == PDF_FONT_FONTTYPE_TYPE0)
+    return Type0Font_get_cff_charsets(Type0Font_cache_get(font->font_id));
+
+  return NULL;
+}
+
 int
 texpdf_get_font_subtype (int font_id)
 {
@@ -417,13 +499,62 @@ try_load_ToUnicode_CMap (pdf_font *font)
   return  0;
 }
 
+static void
+load_font (void *data)
+{
+  pdf_font *font = data;
+
+  /* Type 0 is handled separately... */
+  switch (font->subtype) {
+  case PDF_FONT_FONTTYPE_TYPE1:
+    if (__verbose)
+      MESG("[Type1]");
+    if (!pdf_font_get_flag(font, PDF_FONT_FLAG_BASEFONT))
+      pdf_font_load_type1(font);
+    break;
+  case PDF_FONT_FONTTYPE_TYPE1C:
+    if (__verbose)
+      MESG("[Type1C]");
+    pdf_font_load_type1c(font);
+    break;
+  case PDF_FONT_FONTTYPE_TRUETYPE:
+    if (__verbose)
+      MESG("[TrueType]");
+    pdf_font_load_truetype(font);
+    break;
+  case PDF_FONT_FONTTYPE_TYPE3:
+    if (__verbose)
+      MESG("[Type3/PK]");
+    pdf_font_load_pkfont (font);
+    break;
+  case PDF_FONT_FONTTYPE_TYPE0:
+    break;
+  default:
+    ERROR("Unknown font type: %d", font->subtype);
+    break;
+  }
+}
+
+/*
+ * With compression workers (texpdf_set_compression_threads()), fonts are
+ * parsed and subset on them, several at a time; CID-keyed fonts likewise
+ * in CIDFont_cache_close(). Whatever a loader labels or releases is kept
+ * aside and written once all fonts before it are, so object labels and
+ * output order do not depend on which loader finishes first.
+ */
 void
-texpdf_close_fonts (void)
+texpdf_close_fonts (pdf_doc *p)
 {
   int  font_id;
+  pdf_font_job **jobs;
 
+  texpdf_doc_select(p);
+  if (!font_cache)
+    return;
+
+  jobs = font_cache->count > 0 ? NEW(font_cache->count, pdf_font_job *) : NULL;
   for (font_id = 0;
-       font_id < font_cache.count; font_id++) {
+       font_id < font_cache->count; font_id++) {
     pdf_font  *font;
 
     font = GET_FONT(font_id);
@@ -455,38 +586,7 @@ texpdf_close_fonts (void)
     /* Must come before load_xxx */
     try_load_ToUnicode_CMap(font);
 
-    /* Type 0 is handled separately... */
-    switch (font->subtype) {
-    case PDF_FONT_FONTTYPE_TYPE1:
-      if (__verbose)
-	MESG("[Type1]");
-      if (!pdf_font_get_flag(font, PDF_FONT_FLAG_BASEFONT))
-	pdf_font_load_type1(font);
-      break;
-    case PDF_FONT_FONTTYPE_TYPE1C:
-      if (__verbose)
-	MESG("[Type1C]");
-      pdf_font_load_type1c(font);
-      break;
-    case PDF_FONT_FONTTYPE_TRUETYPE:
-      if (__verbose)
-	MESG("[TrueType]");
-      pdf_font_load_truetype(font);
-      break;
-    case PDF_FONT_FONTTYPE_TYPE3:
-      if (__verbose)
-	MESG("[Type3/PK]");
-      pdf_font_load_pkfont (font);
-      break;
-    case PDF_FONT_FONTTYPE_TYPE0:
-      break;
-    default:
-      ERROR("Unknown font type: %d", font->subtype);
-      break;
-    }
-
-    if (font->encoding_id >= 0 && font->subtype != PDF_FONT_FONTTYPE_TYPE0)
-      pdf_encoding_add_usedchars(font->encoding_id, font->usedchars);
+    jobs[font_id] = pdf_font_job_start(load_font, font);
 
     if (__verbose) {
       if (font->subtype != PDF_FONT_FONTTYPE_TYPE0)
@@ -494,9 +594,21 @@ texpdf_close_fonts (void)
     }
   }
 
+  /* Encodings are left alone while fonts are being loaded */
+  for (font_id = 0; font_id < font_cache->count; font_id++) {
+    pdf_font *font = GET_FONT(font_id);
+
+    if (jobs[font_id])
+      pdf_font_job_finish(jobs[font_id]);
+    if (font->encoding_id >= 0 && font->subtype != PDF_FONT_FONTTYPE_TYPE0)
+      pdf_encoding_add_usedchars(font->encoding_id, font->usedchars);
+  }
+  if (jobs)
+    RELEASE(jobs);
+
   pdf_encoding_complete();
 
-  for (font_id = 0; font_id < font_cache.count; font_id++) {
+  for (font_id = 0; font_id < font_cache->count; font_id++) {
     pdf_font *font = GET_FONT(font_id);
 
     if (font->encoding_id >= 0 && font->subtype != PDF_FONT_FONTTYPE_TYPE0) {
@@ -525,10 +637,7 @@ texpdf_close_fonts (void)
     pdf_flush_font(font);
     pdf_clean_font_struct(font);
   }
-  RELEASE(font_cache.fonts);
-  font_cache.fonts    = NULL;
-  font_cache.count    = 0;
-  font_cache.capacity = 0;
+  RELEASE(font_cache->fonts);
 
   Type0Font_cache_close();
 
@@ -538,6 +647,10 @@ texpdf_close_fonts (void)
   otl_close_conf();
   agl_close_map (); /* After encoding */
 
+  RELEASE(font_cache);
+  p->fonts = NULL;
+  pdf_font_select(NULL);
+
   return;
 }
 
@@ -617,7 +730,7 @@ pdf_font_findresource (fontmap_t* map, const char *tex_name,
     }
 
     for (font_id = 0;
-	 font_id < font_cache.count; font_id++) {
+	 font_id < font_cache->count; font_id++) {
       font = GET_FONT(font_id);
       if (font->subtype == PDF_FONT_FONTTYPE_TYPE0 &&
 	  font->font_id == type0_id &&
@@ -632,10 +745,10 @@ pdf_font_findresource (fontmap_t* map, const char *tex_name,
     }
 
     if (!found) {
-      font_id = font_cache.count;
-      if (font_cache.count >= font_cache.capacity) {
-	font_cache.capacity += CACHE_ALLOC_SIZE;
-	font_cache.fonts     = RENEW(font_cache.fonts, font_cache.capacity, pdf_font);
+      font_id = font_cache->count;
+      if (font_cache->count >= font_cache->capacity) {
+	font_cache->capacity += CACHE_ALLOC_SIZE;
+	font_cache->fonts     = RENEW(font_cache->fonts, font_cache->capacity, pdf_font);
       }
       font    = GET_FONT(font_id);
       texpdf_init_font_struct(font);
@@ -645,7 +758,7 @@ pdf_font_findresource (fontmap_t* map, const char *tex_name,
       font->encoding_id = cmap_id;
       font->fontmap     = map;
 
-      font_cache.count++;
+      font_cache->count++;
 
       if (__verbose) {
 	MESG("\npdf_font>> Type0 font \"%s\"", fontname);
@@ -661,7 +774,7 @@ pdf_font_findresource (fontmap_t* map, const char *tex_name,
     int  found = 0;
 
     for (font_id = 0;
-	 font_id < font_cache.count; font_id++) {
+	 font_id < font_cache->count; font_id++) {
       font = GET_FONT(font_id);
       switch (font->subtype) {
       case PDF_FONT_FONTTYPE_TYPE1:
@@ -708,10 +821,10 @@ pdf_font_findresource (fontmap_t* map, const char *tex_name,
 
 
     if (!found) {
-      font_id = font_cache.count;
-      if (font_cache.count >= font_cache.capacity) {
-	font_cache.capacity += CACHE_ALLOC_SIZE;
-	font_cache.fonts     = RENEW(font_cache.fonts, font_cache.capacity, pdf_font);
+      font_id = font_cache->count;
+      if (font_cache->count >= font_cache->capacity) {
+	font_cache->capacity += CACHE_ALLOC_SIZE;
+	font_cache->fonts     = RENEW(font_cache->fonts, font_cache->capacity, pdf_font);
       }
 
       font = GET_FONT(font_id);
@@ -740,7 +853,7 @@ pdf_font_findresource (fontmap_t* map, const char *tex_name,
 	return -1;
       }
 
-      font_cache.count++;
+      font_cache->count++;
 
       if (__verbose) {
 	MESG("\npdf_font>> Simple font \"%s\"", fontname);
@@ -24,6 +24,7 @@
 #define _PDFFONT_H_
 
 #include "pdfobj.h"
+#include "pdftypes.h"
 #include "fontmap.h"
 #include "pdflimits.h"
 
@@ -49,8 +50,23 @@ extern void texpdf_font_set_dpi (int font_dpi);
 typedef struct pdf_font pdf_font;
 
 /* texpdf_open_document() call them. */
-extern void     texpdf_init_fonts  (void);
-extern void     texpdf_close_fonts (void);
+extern void     texpdf_init_fonts  (pdf_doc *p);
+extern void     texpdf_close_fonts (pdf_doc *p);
+/* Makes fonts the ones the calling thread loads and looks up,
+ * see texpdf_doc_select()
+ */
+extern void     pdf_font_select    (struct pdf_fonts *fonts);
+
+/* Runs load(font) on a worker thread if the document has some, with the
+ * fonts of the calling thread selected. Returns NULL if the font was
+ * loaded right away instead. pdf_font_job_finish() waits for the job and
+ * writes the objects it made, so jobs must be finished in the order the
+ * fonts are to be written.
+ */
+typedef struct pdf_font_job pdf_font_job;
+
+extern pdf_font_job *pdf_font_job_start  (void (*load) (void *font), void *font);
+extern void          pdf_font_job_finish (pdf_font_job *job);
 
 /* font_name is used when mrec is NULL.
  * font_scale (point size) used by PK font.
@@ -69,6 +85,7 @@ extern char    *texpdf_get_font_fontname  (int font_id); /* without unique tag *
 #endif /* 0 */
 extern int      texpdf_get_font_encoding  (int font_id);
 extern int      texpdf_get_font_wmode     (int font_id);
+extern void    *texpdf_get_font_cff_charsets (int font_id);
 
 /* Each font drivers use the followings. */
 extern int      pdf_font_is_in_use      (pdf_font *font);
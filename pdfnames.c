@@ -32,7 +32,7 @@ char *
 printable_key (const char *key, int keylen)
 {
 #define MAX_KEY 32
-  static char pkey[MAX_KEY+4];
+  static DPX_THREAD_LOCAL char pkey[MAX_KEY+4];
   int    i, len;
   unsigned char hi, lo;
 
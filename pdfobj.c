@@ -26,6 +26,17 @@
 #include <zlib.h>
 #endif /* HAVE_ZLIB */
 
+#ifdef HAVE_SYS_UIO_H
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#define INPUT_MMAP 1
+#endif
+
 #define STREAM_ALLOC_SIZE      4096u
 #define ARRAY_ALLOC_SIZE       256
 #define IND_OBJECTS_ALLOC_SIZE 512
@@ -66,9 +77,16 @@ struct pdf_string
   unsigned short length;
 };
 
+/* Names are interned: every name object with the same string shares a
+ * single pdf_name, so that dictionary keys can be compared by pointer.
+ */
 struct pdf_name
 {
-  char *name;
+  char            *name;
+  unsigned         length;
+  unsigned         hash;     /* name_hash(name) */
+  int              refcount; /* number of name objects using it, atomic */
+  struct pdf_name *next;     /* in name_table */
 };
 
 struct pdf_array
@@ -78,13 +96,28 @@ struct pdf_array
   struct pdf_obj **values;
 };
 
+struct dict_entry
+{
+  struct pdf_obj *key;
+  struct pdf_obj *value;
+};
+
+/* Entries are kept in insertion order, which is also the output order.
+ * Once a dictionary has DICT_INDEX_MIN entries, an open-addressed table
+ * of entry numbers (plus one; zero marks a free slot) indexes them by
+ * the hash of the key.
+ */
 struct pdf_dict
 {
-  struct pdf_obj  *key;
-  struct pdf_obj  *value;
-  struct pdf_dict *next;
+  struct dict_entry *entries;
+  unsigned           size;
+  unsigned           max;
+  unsigned          *index;
+  unsigned           index_size; /* power of two, or 0 */
 };
 
+#define DICT_INDEX_MIN 16
+
 struct pdf_stream
 {
   struct pdf_obj *dict;
@@ -93,6 +126,12 @@ struct pdf_stream
   unsigned long   stream_length;
   unsigned long   max_length;
   unsigned char   _flags;
+  struct deflate_job *deflated;   /* compression running in a worker */
+#ifdef HAVE_ZLIB
+  z_stream       *deflating;      /* see STREAM_DEFLATE_INCREMENTAL */
+#endif
+  unsigned long   raw_length;     /* bytes added before compression */
+  struct input_map *borrowed;     /* stream points into this, read-only */
 };
 
 struct pdf_indirect
@@ -113,14 +152,33 @@ typedef struct pdf_dict     pdf_dict;
 typedef struct pdf_stream   pdf_stream;
 typedef struct pdf_indirect pdf_indirect;
 
-static FILE *pdf_output_file = NULL;
+/* Everything written to the output PDF goes through a sink: bytes are
+ * collected in a large buffer, which is handed on together with any big
+ * block that follows it (with a single writev() where available).  The
+ * destination is either a file or a callback set by the host.
+ */
+#define SINK_BUF_SIZE (64*1024)
+
+typedef struct pdf_sink pdf_sink;
+
+struct pdf_sink
+{
+  FILE              *file;
+  int                fd;      /* -1 to go through stdio */
+  texpdf_output_func func;    /* used instead of FILE if non-NULL */
+  void              *closure;
+  unsigned char     *buffer;
+  long               length;
+  long               size;
+  pdf_output        *output;  /* document written here, if any */
+};
+
+static pdf_sink  error_sink = { NULL, -1, NULL, NULL, NULL, 0, 0, NULL };
 
-static long pdf_output_file_position = 0;
-static long pdf_output_line_position = 0;
-static long compression_saved        = 0;
+static texpdf_output_func output_func    = NULL;
+static void              *output_closure = NULL;
 
 #define FORMAT_BUF_SIZE 4096
-static char format_buffer[FORMAT_BUF_SIZE];
 
 typedef struct xref_entry
 {
@@ -131,12 +189,69 @@ typedef struct xref_entry
   pdf_obj       *indirect;   /* used for imported objects        */
 } xref_entry;
 
-static xref_entry *output_xref;
+/* Everything that changes while a document is written. Each document
+ * has its own; objects labelled or released are written to the one that
+ * is current on the calling thread, see pdf_out_select().
+ */
+struct pdf_output
+{
+  pdf_sink       sink;
+  long           file_position;
+  long           line_position;
+  long           compression_saved;
+
+  xref_entry    *xref;
+  unsigned long  max_ind_objects;
+  unsigned long  next_label;
+  unsigned long  startxref;
+
+  pdf_obj       *trailer_dict;
+  pdf_obj       *xref_stream;    /* PDF 1.5 and later */
+  pdf_obj       *current_objstm; /* being filled */
+  int            do_objstm;
+  pdf_obj       *output_stream;  /* objects are written here instead */
+  int            enc_mode;
+  int            doc_enc_mode;
+  pdf_enc_key   *enc_key;        /* if doc_enc_mode */
+  int            workers;        /* holds the compression workers */
+
+  /* PDF files imported into this document, by name. Their objects are
+   * mapped to labels of this document.
+   */
+  struct ht_table files;
+
+  /* Objects waiting for a stream ahead of them, see flush_pending() */
+  struct {
+    pdf_obj     **objects;       /* circular buffer */
+    unsigned long head;
+    unsigned long count;
+    unsigned long max;
+    int           flushing;
+  } pending;
+};
+
+static DPX_THREAD_LOCAL pdf_output *output = NULL;
+
+/* Objects made while a log is set, see pdf_obj_log_replay() */
+struct obj_list
+{
+  pdf_obj     **objects;
+  unsigned long count;
+  unsigned long max;
+};
+
+struct pdf_obj_log
+{
+  struct obj_list labelled; /* by label - LOG_LABEL_BASE */
+  struct obj_list refs;     /* linked references to those */
+  struct obj_list released; /* labelled objects, in release order */
+};
 
-static unsigned long pdf_max_ind_objects;
-static unsigned long next_label;
+/* Labels handed out while a log is set; no real document gets this far */
+#define LOG_LABEL_BASE 0x40000000UL
+#define LOG_LABEL(l)   ((l) >= LOG_LABEL_BASE)
 
-static unsigned long startxref;
+static DPX_THREAD_LOCAL pdf_obj_log *obj_log = NULL;
 
 struct pdf_file
 {
@@ -147,63 +262,141 @@ struct pdf_file
   long        num_obj;
   long        file_size;
   int         version;
+  unsigned long *offsets;     /* sorted offsets of type 1 objects */
+  long           num_offsets; /* built on demand, see next_object_offset() */
+  struct input_map *map;      /* whole file in memory, or NULL */
+  /* Parsed objects kept in xref_table[].direct, most recently used first */
+  struct cache_link *cache;
+  long           cache_head, cache_tail;
+  unsigned long  cache_size;
+  /* Flat index of the page tree, see pdf_file_get_page() */
+  struct page_entry *pages;
+  long           num_pages;   /* -1 until the index is built */
+};
+
+/* Only references are kept, so that the objects themselves stay under
+ * the cache limit and are read again when they have been dropped.
+ */
+struct page_entry
+{
+  pdf_obj *page;
+  /* nodes holding the inheritable attributes, nearest the page first */
+  pdf_obj *media_box, *crop_box, *rotate, *resources;
 };
 
-static pdf_obj *output_stream; /* XXX needs to be re-entrant */
+struct cache_link
+{
+  long          prev, next;  /* object numbers, -1 at either end */
+  unsigned long size;        /* estimated memory held by the object */
+};
 
-#define OBJSTM_MAX_OBJS  200
-/* the limit is only 100 for linearized PDF */
+#define IMPORT_CACHE_SIZE (32L << 20)
+
+static unsigned long import_cache_limit = IMPORT_CACHE_SIZE;
+
+/* An input PDF file mapped into memory. Objects are parsed in place and
+ * stream bodies are left in the map until something modifies them, so
+ * the map lives until the file and all such streams are released.
+ */
+struct input_map
+{
+  char *data;
+  long  size;
+  int   refcount;
+};
+
+static struct input_map *
+input_map_new (FILE *file, long size)
+{
+#ifdef INPUT_MMAP
+  struct input_map *map;
+  void  *data;
+
+  if (size <= 0)
+    return NULL;
+  data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  if (data == MAP_FAILED)
+    return NULL;
+  map = NEW(1, struct input_map);
+  map->data     = data;
+  map->size     = size;
+  map->refcount = 1;
+
+  return map;
+#else
+  return NULL;
+#endif
+}
 
-static int enc_mode;
-static int doc_enc_mode;
+static void
+input_map_release (struct input_map *map)
+{
+  if (map && --map->refcount == 0) {
+#ifdef INPUT_MMAP
+    munmap(map->data, map->size);
+#endif
+    RELEASE(map);
+  }
+}
 
-static pdf_obj *trailer_dict; /* XXX needs to be re-entrant */
-static pdf_obj *xref_stream; /* XXX needs to be re-entrant */
+#define OBJSTM_MAX_OBJS  200
+/* the limit is only 100 for linearized PDF */
+#define OBJSTM_MAX_BYTES (64L << 10)
+/* Closing streams at this size keeps them small enough to be deflated
+ * in parallel while later ones are filled. */
 
 /* Internal static routines */
 
 static int texpdf_check_for_pdf_version (FILE *file);
 
-static void pdf_flush_obj (pdf_obj *object, FILE *file);
+static void pdf_flush_obj (pdf_obj *object, pdf_sink *sink);
 static void pdf_label_obj (pdf_obj *object);
-static void pdf_write_obj (pdf_obj *object, FILE *file);
+static void pdf_write_obj (pdf_obj *object, pdf_sink *sink);
 
 static void  set_objstm_data (pdf_obj *objstm, long *data);
 static long *get_objstm_data (pdf_obj *objstm);
 static void  release_objstm  (pdf_obj *objstm);
 
-static void pdf_out_char (FILE *file, char c);
-static void pdf_out      (FILE *file, const void *buffer, long length);
+static void pdf_out_char (pdf_sink *sink, char c);
+static void pdf_out      (pdf_sink *sink, const void *buffer, long length);
+static void sink_close   (pdf_sink *sink, int flush);
 
 static pdf_obj *texpdf_new_ref  (pdf_obj *object);
-static void release_indirect (pdf_indirect *data);
-static void write_indirect   (pdf_indirect *indirect, FILE *file);
+static void write_indirect   (pdf_indirect *indirect, pdf_sink *sink);
 
-static void release_boolean (pdf_obj *data);
-static void write_boolean   (pdf_boolean *data, FILE *file);
+static void write_boolean   (pdf_boolean *data, pdf_sink *sink);
 
-static void write_null   (FILE *file);
+static void write_null   (pdf_sink *sink);
 
-static void release_number (pdf_number *number);
-static void write_number   (pdf_number *number, FILE *file);
+static void write_number   (pdf_number *number, pdf_sink *sink);
 
-static void write_string   (pdf_string *str, FILE *file);
+static void write_string   (pdf_string *str, pdf_sink *sink);
 static void release_string (pdf_string *str);
 
-static void write_name   (pdf_name *name, FILE *file);
+static void write_name   (pdf_name *name, pdf_sink *sink);
 static void release_name (pdf_name *name);
 
-static void write_array   (pdf_array *array, FILE *file);
+static void write_array   (pdf_array *array, pdf_sink *sink);
 static void release_array (pdf_array *array);
 
-static void write_dict   (pdf_dict *dict, FILE *file);
+static void write_dict   (pdf_dict *dict, pdf_sink *sink);
 static void release_dict (pdf_dict *dict);
 
-static void write_stream   (pdf_stream *stream, FILE *file);
+static void write_stream   (pdf_stream *stream, pdf_sink *sink);
+static void stream_reserve (pdf_stream *data, unsigned long length);
+#ifdef HAVE_ZLIB
+static void stream_deflate (pdf_stream *data, const void *input, long length, int flush);
+#endif
 static void release_stream (pdf_stream *stream);
 
+static void pdf_free_obj  (pdf_obj *object);
+static void flush_pending (int wait);
+static void name_table_trim (void);
+static void pdf_file_free   (pdf_file *pf);
+
 static int  verbose = 0;
 static char compression_level = 9;
+static int  compression_threads = 0;
 
 void
 texpdf_set_compression (int level)
@@ -225,6 +418,12 @@ texpdf_set_compression (int level)
   return;
 }
 
+void
+texpdf_set_compression_threads (int num_threads)
+{
+  compression_threads = num_threads > 0 ? num_threads : 0;
+}
+
 static unsigned pdf_version = PDF_VERSION_DEFAULT;
 
 void
@@ -254,108 +453,249 @@ texpdf_obj_set_verbose(void)
   verbose++;
 }
 
-static pdf_obj *current_objstm = NULL;
-static int do_objstm;
-
 static void
 add_xref_entry (unsigned long label, unsigned char type, unsigned long field2, unsigned short field3)
 {
-  if (label >= pdf_max_ind_objects) {
-    pdf_max_ind_objects = (label/IND_OBJECTS_ALLOC_SIZE+1)*IND_OBJECTS_ALLOC_SIZE;
-    output_xref = RENEW(output_xref, pdf_max_ind_objects, xref_entry);
+  if (label >= output->max_ind_objects) {
+    output->max_ind_objects = (label/IND_OBJECTS_ALLOC_SIZE+1)*IND_OBJECTS_ALLOC_SIZE;
+    output->xref = RENEW(output->xref, output->max_ind_objects, xref_entry);
   }
 
-  output_xref[label].type   = type;
-  output_xref[label].field2 = field2;
-  output_xref[label].field3 = field3;
-  output_xref[label].direct   = NULL;
-  output_xref[label].indirect = NULL;
+  output->xref[label].type   = type;
+  output->xref[label].field2 = field2;
+  output->xref[label].field3 = field3;
+  output->xref[label].direct   = NULL;
+  output->xref[label].indirect = NULL;
 }
 
 #define BINARY_MARKER "%\344\360\355\370\n"
-void
+pdf_output *
 pdf_out_init (const char *filename, int do_encryption)
 {
   char v;
 
-  output_xref = NULL;
-  pdf_max_ind_objects = 0;
+  output = NEW(1, pdf_output);
+  output->xref = NULL;
+  output->max_ind_objects = 0;
   add_xref_entry(0, 0, 0, 0xffff);
-  next_label = 1;
+  output->next_label = 1;
 
   if (pdf_version >= 5) {
-    xref_stream = texpdf_new_stream(STREAM_COMPRESS);
-    xref_stream->flags |= OBJ_NO_ENCRYPT;
-    trailer_dict = texpdf_stream_dict(xref_stream);
-    texpdf_add_dict(trailer_dict, texpdf_new_name("Type"), texpdf_new_name("XRef"));
-    do_objstm = 1;
+    output->xref_stream = texpdf_new_stream(STREAM_COMPRESS);
+    output->xref_stream->flags |= OBJ_NO_ENCRYPT;
+    output->trailer_dict = texpdf_stream_dict(output->xref_stream);
+    texpdf_add_dict(output->trailer_dict, texpdf_new_name("Type"), texpdf_new_name("XRef"));
+    output->do_objstm = 1;
   } else {
-    xref_stream = NULL;
-    trailer_dict = texpdf_new_dict();
-    do_objstm = 0;
+    output->xref_stream = NULL;
+    output->trailer_dict = texpdf_new_dict();
+    output->do_objstm = 0;
   }
 
-  output_stream = NULL;
-
-  if (filename == NULL) { /* no filename: writing to stdout */
+  output->output_stream  = NULL;
+  output->current_objstm = NULL;
+  output->pending.objects  = NULL;
+  output->pending.head     = 0;
+  output->pending.count    = 0;
+  output->pending.max      = 0;
+  output->pending.flushing = 0;
+
+  output->workers = 0;
+  if (compression_threads > 0)
+    output->workers = dpx_workers_init(compression_threads) > 0;
+  texpdf_ht_init_table(&output->files, (void (*)(void *)) pdf_file_free);
+
+  output->sink.file    = NULL;
+  output->sink.fd      = -1;
+  output->sink.func    = output_func;
+  output->sink.closure = output_closure;
+  if (output_func) {
+    /* The host takes the bytes; filename is not used. */
+  } else if (filename == NULL) { /* no filename: writing to stdout */
 #ifdef WIN32
     setmode(fileno(stdout), _O_BINARY);
 #endif
-    pdf_output_file = stdout;
+    output->sink.file = stdout;
   } else {
-    pdf_output_file = MFOPEN(filename, FOPEN_WBIN_MODE);
-    if (!pdf_output_file) {
+    output->sink.file = MFOPEN(filename, FOPEN_WBIN_MODE);
+    if (!output->sink.file) {
       if (strlen(filename) < 128)
         ERROR("Unable to open \"%s\".", filename);
       else
         ERROR("Unable to open file.");
     }
   }
-  pdf_out(pdf_output_file, "%PDF-1.", strlen("%PDF-1."));
+#ifdef HAVE_SYS_UIO_H
+  if (output->sink.file) {
+    /* stdio is bypassed from here on */
+    fflush(output->sink.file);
+    output->sink.fd = fileno(output->sink.file);
+  }
+#endif
+  output->sink.buffer = NEW(SINK_BUF_SIZE, unsigned char);
+  output->sink.length = 0;
+  output->sink.size   = SINK_BUF_SIZE;
+  output->sink.output = output;
+  output->file_position = output->line_position = 0;
+  output->compression_saved = 0;
+
+  pdf_out(&output->sink, "%PDF-1.", strlen("%PDF-1."));
   v = '0' + pdf_version;
-  pdf_out(pdf_output_file, &v, 1);
-  pdf_out(pdf_output_file, "\n", 1);
-  pdf_out(pdf_output_file, BINARY_MARKER, strlen(BINARY_MARKER));
+  pdf_out(&output->sink, &v, 1);
+  pdf_out(&output->sink, "\n", 1);
+  pdf_out(&output->sink, BINARY_MARKER, strlen(BINARY_MARKER));
+
+  output->enc_mode = 0;
+  output->doc_enc_mode = do_encryption;
+  output->enc_key = do_encryption ? pdf_enc_new_key() : NULL;
+
+  return output;
+}
+
+void
+pdf_out_select (pdf_output *doc)
+{
+  output = doc;
+}
+
+int
+pdf_out_workers (void)
+{
+  return output && output->workers;
+}
+
+static void
+obj_list_push (struct obj_list *list, pdf_obj *object)
+{
+  if (list->count >= list->max) {
+    list->max = list->max ? 2 * list->max : 16;
+    list->objects = RENEW(list->objects, list->max, pdf_obj *);
+  }
+  list->objects[list->count++] = object;
+}
+
+pdf_obj_log *
+pdf_obj_log_new (void)
+{
+  pdf_obj_log *log = NEW(1, pdf_obj_log);
+
+  memset(log, 0, sizeof(pdf_obj_log));
+
+  return log;
+}
+
+/* Returns the log set before */
+pdf_obj_log *
+pdf_obj_log_set (pdf_obj_log *log)
+{
+  pdf_obj_log *previous = obj_log;
+
+  obj_log = log;
+
+  return previous;
+}
+
+/*
+ * The labels of the log follow those handed out so far, in the order
+ * they were taken, and the released objects are written in the order
+ * they were released.
+ */
+void
+pdf_obj_log_replay (pdf_obj_log *log)
+{
+  unsigned long base, i;
+
+  if (!output)
+    ERROR("pdf_obj_log_replay(): no document is open.");
+
+  base = output->next_label;
+  output->next_label += log->labelled.count;
+  for (i = 0; i < log->labelled.count; i++)
+    log->labelled.objects[i]->label = base + i;
+  for (i = 0; i < log->refs.count; i++) {
+    pdf_obj *ref = log->refs.objects[i];
 
-  enc_mode = 0;
-  doc_enc_mode = do_encryption;
+    ((pdf_indirect *) ref->data)->label += base - LOG_LABEL_BASE;
+    texpdf_release_obj(ref);
+  }
+  for (i = 0; i < log->released.count; i++) {
+    pdf_obj *object = log->released.objects[i];
+
+    /* Released for good this time */
+    object->refcount = 1;
+    texpdf_release_obj(object);
+  }
+
+  if (log->labelled.objects)
+    RELEASE(log->labelled.objects);
+  if (log->refs.objects)
+    RELEASE(log->refs.objects);
+  if (log->released.objects)
+    RELEASE(log->released.objects);
+  RELEASE(log);
+}
+
+/* Entries of the xref table go out this many at a time */
+#define XREF_TABLE_CHUNK 512
+
+/* Writes value as exactly width decimal digits, zero-padded */
+static void
+format_digits (char *p, unsigned long value, int width)
+{
+  while (width--) {
+    p[width] = '0' + value % 10;
+    value /= 10;
+  }
 }
 
 static void
 texpdf_dump_xref_table (void)
 {
+  char buffer[20*XREF_TABLE_CHUNK];
   long length;
   unsigned long i;
 
-  pdf_out(pdf_output_file, "xref\n", 5);
+  pdf_out(&output->sink, "xref\n", 5);
 
-  length = sprintf(format_buffer, "%d %lu\n", 0, next_label);
-  pdf_out(pdf_output_file, format_buffer, length);
+  length = sprintf(buffer, "%d %lu\n", 0, output->next_label);
+  pdf_out(&output->sink, buffer, length);
 
   /*
    * Every space counts.  The space after the 'f' and 'n' is * *essential*.
    * The PDF spec says the lines must be 20 characters long including the
    * end of line character.
    */
-  for (i = 0; i < next_label; i++) {
-    unsigned char type = output_xref[i].type;
+  length = 0;
+  for (i = 0; i < output->next_label; i++) {
+    char *line = buffer + length;
+    unsigned char type = output->xref[i].type;
     if (type > 1)
       ERROR("object type %hu not allowed in xref table", type);
-    length = sprintf(format_buffer, "%010lu %05hu %c \n",
-		     output_xref[i].field2, output_xref[i].field3,
-		     type ? 'n' : 'f');
-    pdf_out(pdf_output_file, format_buffer, length);
+    format_digits(line, output->xref[i].field2, 10);
+    line[10] = ' ';
+    format_digits(line + 11, output->xref[i].field3, 5);
+    line[16] = ' ';
+    line[17] = type ? 'n' : 'f';
+    line[18] = ' ';
+    line[19] = '\n';
+    length += 20;
+    if (length == sizeof(buffer)) {
+      pdf_out(&output->sink, buffer, length);
+      length = 0;
+    }
   }
+  if (length > 0)
+    pdf_out(&output->sink, buffer, length);
 }
 
 static void
 texpdf_dump_trailer_dict (void)
 {
-  pdf_out(pdf_output_file, "trailer\n", 8);
-  enc_mode = 0;
-  write_dict(trailer_dict->data, pdf_output_file);
-  texpdf_release_obj(trailer_dict);
-  pdf_out_char(pdf_output_file, '\n');
+  pdf_out(&output->sink, "trailer\n", 8);
+  output->enc_mode = 0;
+  write_dict(output->trailer_dict->data, &output->sink);
+  texpdf_release_obj(output->trailer_dict);
+  pdf_out_char(&output->sink, '\n');
 }
 
 /*
@@ -367,12 +707,13 @@ texpdf_dump_xref_stream (void)
 {
   unsigned long pos, i;
   unsigned poslen;
-  unsigned char buf[7] = {0, 0, 0, 0, 0};
+  unsigned char *buf;
+  pdf_stream *stream;
 
   pdf_obj *w;
 
   /* determine the necessary size of the offset field */
-  pos = startxref; /* maximal offset value */
+  pos = output->startxref; /* maximal offset value */
   poslen = 1;
   while (pos >>= 8)
     poslen++;
@@ -381,81 +722,108 @@ texpdf_dump_xref_stream (void)
   texpdf_add_array(w, texpdf_new_number(1));      /* type                */
   texpdf_add_array(w, texpdf_new_number(poslen)); /* offset (big-endian) */
   texpdf_add_array(w, texpdf_new_number(2));      /* generation          */
-  texpdf_add_dict(trailer_dict, texpdf_new_name("W"), w);
+  texpdf_add_dict(output->trailer_dict, texpdf_new_name("W"), w);
 
   /* We need the xref entry for the xref stream right now */
-  add_xref_entry(next_label-1, 1, startxref, 0);
+  add_xref_entry(output->next_label-1, 1, output->startxref, 0);
 
-  for (i = 0; i < next_label; i++) {
+  /* All entries have the same size: fill them in place */
+  stream = output->xref_stream->data;
+  stream_reserve(stream, output->next_label * (poslen+3));
+  buf = stream->stream + stream->stream_length;
+  for (i = 0; i < output->next_label; i++) {
     unsigned j;
     unsigned short f3;
-    buf[0] = output_xref[i].type;
-    pos = output_xref[i].field2;
+    buf[0] = output->xref[i].type;
+    pos = output->xref[i].field2;
     for (j = poslen; j--; ) {
       buf[1+j] = (unsigned char) pos;
       pos >>= 8;
     }
-    f3 = output_xref[i].field3;
+    f3 = output->xref[i].field3;
     buf[poslen+1] = (unsigned char) (f3 >> 8);
     buf[poslen+2] = (unsigned char) (f3);
-    texpdf_add_stream(xref_stream, &buf, poslen+3);
+    buf += poslen+3;
   }
+  stream->stream_length += output->next_label * (poslen+3);
 
-  texpdf_release_obj(xref_stream);
+  texpdf_release_obj(output->xref_stream);
 }
 
 void
-pdf_out_flush (void)
+pdf_out_flush (pdf_output *doc)
 {
-  if (pdf_output_file) {
+  pdf_output *previous = output;
+
+  if (doc) {
+    char buffer[32];
     long length;
+    int  workers = doc->workers;
+
+    output = doc;
 
     /* Flush current object stream */
-    if (current_objstm) {
-      release_objstm(current_objstm);
-      current_objstm =NULL;
+    if (output->current_objstm) {
+      release_objstm(output->current_objstm);
+      output->current_objstm =NULL;
     }
+    /* Everything must be on disk before we know where the xref goes */
+    flush_pending(1);
 
     /*
      * Label xref stream - we need the number of correct objects
      * for the xref stream dictionary (= trailer).
      * Labelling it in pdf_out_init (with 1)  does not work (why?).
      */
-    if (xref_stream)
-      pdf_label_obj(xref_stream);
+    if (output->xref_stream)
+      pdf_label_obj(output->xref_stream);
 
     /* Record where this xref is for trailer */
-    startxref = pdf_output_file_position;
+    output->startxref = output->file_position;
 
-    texpdf_add_dict(trailer_dict, texpdf_new_name("Size"),
-		 texpdf_new_number(next_label));
+    texpdf_add_dict(output->trailer_dict, texpdf_new_name("Size"),
+		 texpdf_new_number(output->next_label));
 
-    if (xref_stream)
+    if (output->xref_stream) {
       texpdf_dump_xref_stream();
-    else {
+      flush_pending(1);
+    } else {
       texpdf_dump_xref_table();
       texpdf_dump_trailer_dict();
     }
 
     /* Done with xref table */
-    RELEASE(output_xref);
+    RELEASE(output->xref);
 
-    pdf_out(pdf_output_file, "startxref\n", 10);
-    length = sprintf(format_buffer, "%lu\n", startxref);
-    pdf_out(pdf_output_file, format_buffer, length);
-    pdf_out(pdf_output_file, "%%EOF\n", 6);
+    pdf_out(&output->sink, "startxref\n", 10);
+    length = sprintf(buffer, "%lu\n", output->startxref);
+    pdf_out(&output->sink, buffer, length);
+    pdf_out(&output->sink, "%%EOF\n", 6);
 
     MESG("\n");
     if (verbose) {
       if (compression_level > 0) {
-	MESG("Compression saved %ld bytes%s\n", compression_saved,
+	MESG("Compression saved %ld bytes%s\n", output->compression_saved,
 	     pdf_version < 5 ? ". Try \"-V 5\" for better compression" : "");
       }
     }
-    MESG("%ld bytes written", pdf_output_file_position);
-
-    MFCLOSE(pdf_output_file);
+    MESG("%ld bytes written", output->file_position);
+
+    sink_close(&output->sink, 1);
+    if (output->pending.objects)
+      RELEASE(output->pending.objects);
+    /* Nothing more is written: objects of imported files are just freed */
+    output = NULL;
+    texpdf_ht_clear_table(&doc->files);
+    if (doc->enc_key)
+      pdf_enc_release_key(doc->enc_key);
+    RELEASE(doc);
+    if (workers)
+      dpx_workers_close();
   }
+  /* Other documents open on this thread are left as they were */
+  output = previous != doc ? previous : NULL;
+  name_table_trim();
 }
 
 void
@@ -465,15 +833,19 @@ texpdf_error_cleanup (void)
    * This routine is the cleanup required for an abnormal exit.
    * For now, simply close the file.
    */
-  if (pdf_output_file)
-    MFCLOSE(pdf_output_file);
+  if (output) {
+    /* Don't write anything: we may be here because writing failed. */
+    pdf_output *doc = output;
+    output = NULL;
+    sink_close(&doc->sink, 0);
+  }
 }
 
 
 void
 texpdf_set_root (pdf_obj *object)
 {
-  if (texpdf_add_dict(trailer_dict, texpdf_new_name("Root"), texpdf_ref_obj(object))) {
+  if (texpdf_add_dict(output->trailer_dict, texpdf_new_name("Root"), texpdf_ref_obj(object))) {
     ERROR("Root object already set!");
   }
   /* Adobe Readers don't like a document catalog inside an encrypted
@@ -481,14 +853,14 @@ texpdf_set_root (pdf_obj *object)
    * Note that we don't set OBJ_NO_ENCRYPT since the name dictionary in
    * a document catalog may contain strings, which should be encrypted.
    */
-  if (doc_enc_mode)
+  if (output->doc_enc_mode)
     object->flags |= OBJ_NO_OBJSTM;
 }
 
 void
 texpdf_set_info (pdf_obj *object)
 {
-  if (texpdf_add_dict(trailer_dict, texpdf_new_name("Info"), texpdf_ref_obj(object))) {
+  if (texpdf_add_dict(output->trailer_dict, texpdf_new_name("Info"), texpdf_ref_obj(object))) {
     ERROR ("Info object already set!");
   }
 }
@@ -496,7 +868,7 @@ texpdf_set_info (pdf_obj *object)
 void
 texpdf_set_id (pdf_obj *id)
 {
-  if (texpdf_add_dict(trailer_dict, texpdf_new_name("ID"), id)) {
+  if (texpdf_add_dict(output->trailer_dict, texpdf_new_name("ID"), id)) {
     ERROR ("ID already set!");
   }
 }
@@ -504,26 +876,141 @@ texpdf_set_id (pdf_obj *id)
 void
 texpdf_set_encrypt (pdf_obj *encrypt)
 {
-  if (texpdf_add_dict(trailer_dict, texpdf_new_name("Encrypt"), texpdf_ref_obj(encrypt))) {
+  if (texpdf_add_dict(output->trailer_dict, texpdf_new_name("Encrypt"), texpdf_ref_obj(encrypt))) {
     ERROR("Encrypt object already set!");
   }
   encrypt->flags |= OBJ_NO_ENCRYPT;
 }
 
+static void
+sink_emit (pdf_sink *sink, const void *data, long length)
+{
+  if (length <= 0)
+    return;
+  if (sink->func) {
+    if (sink->func(sink->closure, data, length) != 0)
+      ERROR("Output function failed while writing PDF.");
+  } else if (fwrite(data, 1, length, sink->file) != (size_t) length) {
+    ERROR("Writing PDF output failed.");
+  }
+}
+
+#ifdef HAVE_SYS_UIO_H
+static void
+sink_writev (pdf_sink *sink, struct iovec *iov, int iovcnt)
+{
+  ssize_t n;
+
+  while (iovcnt > 0) {
+    n = writev(sink->fd, iov, iovcnt);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("Writing PDF output failed.");
+    }
+    /* Skip what has been written; short writes are rare but legal. */
+    while (iovcnt > 0 && (size_t) n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base  = (char *) iov->iov_base + n;
+      iov->iov_len  -= n;
+    }
+  }
+}
+#endif
+
+/* Hands on the buffered bytes, followed by DATA (may be NULL). */
+static void
+sink_flush (pdf_sink *sink, const void *data, long length)
+{
+#ifdef HAVE_SYS_UIO_H
+  if (sink->fd >= 0) {
+    struct iovec iov[2];
+    int          iovcnt = 0;
+
+    if (sink->length > 0) {
+      iov[iovcnt].iov_base = sink->buffer;
+      iov[iovcnt].iov_len  = sink->length;
+      iovcnt++;
+    }
+    if (length > 0) {
+      iov[iovcnt].iov_base = (void *) data;
+      iov[iovcnt].iov_len  = length;
+      iovcnt++;
+    }
+    sink->length = 0;
+    sink_writev(sink, iov, iovcnt);
+    return;
+  }
+#endif
+  sink_emit(sink, sink->buffer, sink->length);
+  sink->length = 0;
+  sink_emit(sink, data, length);
+}
+
+static void
+sink_write (pdf_sink *sink, const void *data, long length)
+{
+  if (sink->length + length <= sink->size) {
+    memcpy(sink->buffer + sink->length, data, length);
+    sink->length += length;
+  } else if (length < sink->size / 2) {
+    /* Small piece: send the full buffer and start a new one */
+    sink_flush(sink, NULL, 0);
+    memcpy(sink->buffer, data, length);
+    sink->length = length;
+  } else {
+    sink_flush(sink, data, length);
+  }
+}
+
+static void
+sink_close (pdf_sink *sink, int flush)
+{
+  if (flush) {
+    sink_flush(sink, NULL, 0);
+    if (sink->file && sink->fd < 0 && fflush(sink->file) != 0)
+      ERROR("Writing PDF output failed.");
+  }
+  if (sink->file)
+    MFCLOSE(sink->file);
+  sink->file = NULL;
+  sink->fd   = -1;
+  sink->func = NULL;
+  RELEASE(sink->buffer);
+  sink->buffer = NULL;
+  sink->length = sink->size = 0;
+}
+
+void
+texpdf_set_output_func (texpdf_output_func func, void *closure)
+{
+  output_func    = func;
+  output_closure = closure;
+}
+
 static
-void pdf_out_char (FILE *file, char c)
+void pdf_out_char (pdf_sink *sink, char c)
 {
-  if (output_stream && file ==  pdf_output_file)
-    texpdf_add_stream(output_stream, &c, 1);
+  pdf_output *doc = sink->output;
+
+  if (doc && doc->output_stream)
+    texpdf_add_stream(doc->output_stream, &c, 1);
   else {
-    fputc(c, file);
+    if (sink->length < sink->size)
+      sink->buffer[sink->length++] = c;
+    else
+      sink_write(sink, &c, 1);
     /* Keep tallys for xref table *only* if writing a pdf file. */
-    if (file == pdf_output_file) {
-      pdf_output_file_position += 1;
+    if (doc) {
+      doc->file_position += 1;
       if (c == '\n')
-        pdf_output_line_position  = 0;
+        doc->line_position  = 0;
       else
-        pdf_output_line_position += 1;
+        doc->line_position += 1;
     }
   }
 }
@@ -536,20 +1023,22 @@ static char xchar[] = "0123456789abcdef";
 } while (0)
 
 static
-void pdf_out (FILE *file, const void *buffer, long length)
+void pdf_out (pdf_sink *sink, const void *buffer, long length)
 {
-  if (output_stream && file ==  pdf_output_file)
-    texpdf_add_stream(output_stream, buffer, length);
+  pdf_output *doc = sink->output;
+
+  if (doc && doc->output_stream)
+    texpdf_add_stream(doc->output_stream, buffer, length);
   else {
-    fwrite(buffer, 1, length, file);
+    sink_write(sink, buffer, length);
     /* Keep tallys for xref table *only* if writing a pdf file */
-    if (file == pdf_output_file) {
-      pdf_output_file_position += length;
-      pdf_output_line_position += length;
+    if (doc) {
+      doc->file_position += length;
+      doc->line_position += length;
       /* "foo\nbar\n "... */
       if (length > 0 &&
 	((const char *)buffer)[length-1] == '\n')
-        pdf_output_line_position = 0;
+        doc->line_position = 0;
     }
   }
 }
@@ -565,12 +1054,12 @@ int pdf_need_white (int type1, int type2)
 }
 
 static
-void pdf_out_white (FILE *file)
+void pdf_out_white (pdf_sink *sink)
 {
-  if (file == pdf_output_file && pdf_output_line_position >= 80) {
-    pdf_out_char(file, '\n');
+  if (sink->output && sink->output->line_position >= 80) {
+    pdf_out_char(sink, '\n');
   } else {
-    pdf_out_char(file, ' ');
+    pdf_out_char(sink, ' ');
   }
 }
 
@@ -580,6 +1069,25 @@ void pdf_out_white (FILE *file)
 
 #define INVALIDOBJ(o)  ((o) == NULL || (o)->type <= 0 || (o)->type > PDF_UNDEFINED)
 
+/* Objects and their fixed-size data are allocated together, as one
+ * small block; see new_small() in mem.c.
+ */
+static size_t
+obj_size (int type)
+{
+  switch (type) {
+  case PDF_BOOLEAN:  return sizeof(pdf_obj) + sizeof(pdf_boolean);
+  case PDF_NUMBER:   return sizeof(pdf_obj) + sizeof(pdf_number);
+  case PDF_STRING:   return sizeof(pdf_obj) + sizeof(pdf_string);
+  case PDF_ARRAY:    return sizeof(pdf_obj) + sizeof(pdf_array);
+  case PDF_DICT:     return sizeof(pdf_obj) + sizeof(pdf_dict);
+  case PDF_STREAM:   return sizeof(pdf_obj) + sizeof(pdf_stream);
+  case PDF_INDIRECT: return sizeof(pdf_obj) + sizeof(pdf_indirect);
+  }
+
+  return sizeof(pdf_obj);
+}
+
 static pdf_obj *
 texpdf_new_obj(int type)
 {
@@ -588,9 +1096,9 @@ texpdf_new_obj(int type)
   if (type > PDF_UNDEFINED || type < 0)
     ERROR("Invalid object type: %d", type);
 
-  result = NEW(1, pdf_obj);
+  result = new_small(obj_size(type));
   result->type  = type;
-  result->data  = NULL;
+  result->data  = obj_size(type) > sizeof(pdf_obj) ? result + 1 : NULL;
   result->label      = 0;
   result->generation = 0;
   result->refcount   = 1;
@@ -618,7 +1126,14 @@ pdf_label_obj (pdf_obj *object)
    * Don't change label on an already labeled object. Ignore such calls.
    */
   if (object->label == 0) {
-    object->label      = next_label++;
+    if (obj_log) {
+      object->label = LOG_LABEL_BASE + obj_log->labelled.count;
+      obj_list_push(&obj_log->labelled, object);
+    } else {
+      if (!output)
+        ERROR("pdf_label_obj(): no document is open.");
+      object->label = output->next_label++;
+    }
     object->generation = 0;
   }
 }
@@ -636,6 +1151,10 @@ pdf_transfer_label (pdf_obj *dst, pdf_obj *src)
   dst->generation = src->generation;
   src->label      = 0;
   src->generation = 0;
+  if (LOG_LABEL(dst->label)) {
+    ASSERT(obj_log);
+    obj_log->labelled.objects[dst->label - LOG_LABEL_BASE] = dst;
+  }
 }
 
 /*
@@ -662,7 +1181,7 @@ texpdf_ref_obj (pdf_obj *object)
   
   if (object->refcount == 0) {
     MESG("\nTrying to refer already released object!!!\n");
-    pdf_write_obj(object, stderr);
+    pdf_write_obj(object, &error_sink);
     ERROR("Cannot continue...");
   }
 
@@ -674,20 +1193,18 @@ texpdf_ref_obj (pdf_obj *object)
 }
 
 static void
-release_indirect (pdf_indirect *data)
-{
-  RELEASE(data);
-}
-
-static void
-write_indirect (pdf_indirect *indirect, FILE *file)
+write_indirect (pdf_indirect *indirect, pdf_sink *sink)
 {
+  char buffer[48];
   long length;
 
   ASSERT(!indirect->pf);
 
-  length = sprintf(format_buffer, "%lu %hu R", indirect->label, indirect->generation);
-  pdf_out(file, format_buffer, length);
+  length  = sprint_ulong(buffer, indirect->label);
+  buffer[length++] = ' ';
+  length += sprint_ulong(buffer + length, indirect->generation);
+  memcpy(buffer + length, " R", 2);
+  pdf_out(sink, buffer, length + 2);
 }
 
 /* The undefined object is used as a placeholder in pdfnames.c
@@ -716,9 +1233,9 @@ texpdf_new_null (void)
 }
 
 static void
-write_null (FILE *file)
+write_null (pdf_sink *sink)
 {
-  pdf_out(file, "null", 4);
+  pdf_out(sink, "null", 4);
 }
 
 pdf_obj *
@@ -728,26 +1245,19 @@ texpdf_new_boolean (char value)
   pdf_boolean *data;
 
   result = texpdf_new_obj(PDF_BOOLEAN);
-  data   = NEW(1, pdf_boolean);
+  data   = result->data;
   data->value  = value;
-  result->data = data;
 
   return result;
 }
 
 static void
-release_boolean (pdf_obj *data)
-{
-  RELEASE (data);
-}
-
-static void
-write_boolean (pdf_boolean *data, FILE *file)
+write_boolean (pdf_boolean *data, pdf_sink *sink)
 {
   if (data->value) {
-    pdf_out(file, "true", 4);
+    pdf_out(sink, "true", 4);
   } else {
-    pdf_out(file, "false", 5);
+    pdf_out(sink, "false", 5);
   }
 }
 
@@ -770,27 +1280,21 @@ texpdf_new_number (double value)
   pdf_number *data;
 
   result = texpdf_new_obj(PDF_NUMBER);
-  data   = NEW(1, pdf_number);
+  data   = result->data;
   data->value  = value;
-  result->data = data;
 
   return result;
 }
 
 static void
-release_number (pdf_number *data)
+write_number (pdf_number *number, pdf_sink *sink)
 {
-  RELEASE (data);
-}
-
-static void
-write_number (pdf_number *number, FILE *file)
-{
-  int count;
+  char buffer[64];
+  int  count;
 
-  count = pdf_sprint_number(format_buffer, number->value);
+  count = pdf_sprint_number(buffer, number->value);
 
-  pdf_out(file, format_buffer, count);
+  pdf_out(sink, buffer, count);
 }
 
 
@@ -826,8 +1330,7 @@ texpdf_new_string (const void *str, unsigned length)
   ASSERT(str);
 
   result = texpdf_new_obj(PDF_STRING);
-  data   = NEW(1, pdf_string);
-  result->data = data;
+  data   = result->data;
   data->length = length;
 
   if (length) {
@@ -920,16 +1423,16 @@ pdfobj_escape_str (char *buffer, int bufsize, const unsigned char *s, int len)
 }
 
 static void
-write_string (pdf_string *str, FILE *file)
+write_string (pdf_string *str, pdf_sink *sink)
 {
   unsigned char *s;
-  char wbuf[FORMAT_BUF_SIZE]; /* Shouldn't use format_buffer[]. */
+  char wbuf[FORMAT_BUF_SIZE];
   int  nescc = 0, i, count;
 
   s = str->string;
 
-  if (enc_mode)
-    pdf_encrypt_data(s, str->length);
+  if (sink->output && sink->output->enc_mode)
+    pdf_encrypt_data(sink->output->enc_key, s, str->length);
 
   /*
    * Count all ASCII non-printable characters.
@@ -943,13 +1446,13 @@ write_string (pdf_string *str, FILE *file)
    * ASCII hex string.
    */
   if (nescc > str->length / 3) {
-    pdf_out_char(file, '<');
+    pdf_out_char(sink, '<');
     for (i = 0; i < str->length; i++) {
-      pdf_out_xchar(file, s[i]);
+      pdf_out_xchar(sink, s[i]);
     }
-    pdf_out_char(file, '>');
+    pdf_out_char(sink, '>');
   } else {
-    pdf_out_char(file, '(');
+    pdf_out_char(sink, '(');
     /*
      * This section of code probably isn't speed critical.  Escaping the
      * characters in the string one at a time may seem slow, but it's
@@ -960,9 +1463,9 @@ write_string (pdf_string *str, FILE *file)
      */ 
     for (i = 0; i < str->length; i++) {
       count = pdfobj_escape_str(wbuf, FORMAT_BUF_SIZE, &(s[i]), 1);
-      pdf_out(file, wbuf, count);
+      pdf_out(sink, wbuf, count);
     }
-    pdf_out_char(file, ')');
+    pdf_out_char(sink, ')');
   }
 }
 
@@ -973,7 +1476,6 @@ release_string (pdf_string *data)
     RELEASE(data->string);
     data->string = NULL;
   }
-  RELEASE(data);
 }
 
 void
@@ -998,18 +1500,85 @@ texpdf_set_string (pdf_obj *object, unsigned char *str, unsigned length)
   }
 }
 
-/* Name does *not* include the /. */ 
-pdf_obj *
-texpdf_new_name (const char *name)
+static unsigned
+name_hash (const char *name, unsigned length)
+{
+  unsigned hash = 5381;
+
+  while (length-- > 0)
+    hash = (hash << 5) + hash + (unsigned char) *name++;
+
+  return hash;
+}
+
+#define NAME_TABLE_MIN 1024
+
+static struct {
+  pdf_name **buckets;
+  unsigned   size;   /* power of two */
+  unsigned   count;
+} name_table = { NULL, 0, 0 };
+
+/* Shared by every document and thread. Names are looked up under the
+ * read lock and only added or freed under the write lock, so a name
+ * whose reference count is raised under either cannot be freed.
+ */
+static dpx_rwlock name_lock = DPX_RWLOCK_INITIALIZER;
+
+static void
+name_table_grow (void)
+{
+  pdf_name **buckets;
+  unsigned   size, i;
+
+  size    = name_table.size ? 2 * name_table.size : NAME_TABLE_MIN;
+  buckets = NEW(size, pdf_name *);
+  memset(buckets, 0, size * sizeof(pdf_name *));
+  for (i = 0; i < name_table.size; i++) {
+    pdf_name *data, *next;
+
+    for (data = name_table.buckets[i]; data; data = next) {
+      next = data->next;
+      data->next = buckets[data->hash & (size - 1)];
+      buckets[data->hash & (size - 1)] = data;
+    }
+  }
+  if (name_table.buckets)
+    RELEASE(name_table.buckets);
+  name_table.buckets = buckets;
+  name_table.size    = size;
+}
+
+/* Returns the interned copy of NAME, or NULL if there is none */
+static pdf_name *
+name_lookup (const char *name, unsigned length, unsigned hash)
 {
-  pdf_obj  *result;
-  unsigned  length;
   pdf_name *data;
 
-  result = texpdf_new_obj(PDF_NAME);
-  data   = NEW (1, pdf_name);
-  result->data = data;
-  length = strlen(name);
+  if (name_table.size == 0)
+    return NULL;
+  for (data = name_table.buckets[hash & (name_table.size - 1)];
+       data; data = data->next) {
+    if (data->hash == hash && data->length == length &&
+        (length == 0 || !memcmp(data->name, name, length)))
+      return data;
+  }
+
+  return NULL;
+}
+
+static pdf_name *
+name_intern (const char *name, unsigned length, unsigned hash)
+{
+  pdf_name *data;
+
+  data = name_lookup(name, length, hash);
+  if (data)
+    return data;
+
+  if (name_table.count >= name_table.size)
+    name_table_grow();
+  data = NEW(1, pdf_name);
   if (length != 0) {
     data->name = NEW(length+1, char);
     memcpy(data->name, name, length);
@@ -1017,18 +1586,85 @@ texpdf_new_name (const char *name)
   } else {
     data->name = NULL;
   }
+  data->length   = length;
+  data->hash     = hash;
+  data->refcount = 0;
+  data->next     = name_table.buckets[hash & (name_table.size - 1)];
+  name_table.buckets[hash & (name_table.size - 1)] = data;
+  name_table.count++;
+
+  return data;
+}
+
+/* Frees interned names no longer used by any object. Names which are
+ * released are kept until then since most of them ("Type", "Font", ...)
+ * are needed again soon.
+ */
+static void
+name_table_trim (void)
+{
+  unsigned i;
+
+  dpx_write_lock(&name_lock);
+  for (i = 0; i < name_table.size; i++) {
+    pdf_name *data, **prev;
+
+    prev = &name_table.buckets[i];
+    while ((data = *prev) != NULL) {
+      if (dpx_atomic_load(&data->refcount) > 0) {
+        prev = &data->next;
+        continue;
+      }
+      *prev = data->next;
+      if (data->name)
+        RELEASE(data->name);
+      RELEASE(data);
+      name_table.count--;
+    }
+  }
+  if (name_table.count == 0 && name_table.buckets) {
+    RELEASE(name_table.buckets);
+    name_table.buckets = NULL;
+    name_table.size    = 0;
+  }
+  dpx_unlock(&name_lock);
+}
+
+/* Name does *not* include the /. */ 
+pdf_obj *
+texpdf_new_name (const char *name)
+{
+  pdf_obj  *result;
+  pdf_name *data;
+  unsigned  length, hash;
+
+  length = strlen(name);
+  hash   = name_hash(name, length);
+  dpx_read_lock(&name_lock);
+  data = name_lookup(name, length, hash);
+  if (data)
+    dpx_atomic_add(&data->refcount, 1);
+  dpx_unlock(&name_lock);
+  if (!data) {
+    dpx_write_lock(&name_lock);
+    data = name_intern(name, length, hash);
+    dpx_atomic_add(&data->refcount, 1);
+    dpx_unlock(&name_lock);
+  }
+  result = texpdf_new_obj(PDF_NAME);
+  result->data = data;
 
   return result;
 }
 
 static void
-write_name (pdf_name *name, FILE *file)
+write_name (pdf_name *name, pdf_sink *sink)
 {
   char *s;
   int i, length;
 
   s      = name->name;
-  length = name->name ? strlen(name->name) : 0;
+  length = name->length;
   /*
    * From PDF Reference, 3rd ed., p.33:
    *
@@ -1048,14 +1684,14 @@ write_name (pdf_name *name, FILE *file)
                      (c) == '{' || (c) == '}' || \
                      (c) == '%')
 #endif
-  pdf_out_char(file, '/');
+  pdf_out_char(sink, '/');
   for (i = 0; i < length; i++) {
     if (s[i] < '!' || s[i] > '~' || s[i] == '#' || is_delim(s[i])) {
       /*     ^ "space" is here. */
-      pdf_out_char (file, '#');
-      pdf_out_xchar(file, s[i]);
+      pdf_out_char (sink, '#');
+      pdf_out_xchar(sink, s[i]);
     } else {
-      pdf_out_char (file, s[i]);
+      pdf_out_char (sink, s[i]);
     }
   }
 }
@@ -1063,11 +1699,9 @@ write_name (pdf_name *name, FILE *file)
 static void
 release_name (pdf_name *data)
 {
-  if (data->name != NULL) {
-    RELEASE(data->name);
-    data->name = NULL;
-  }
-  RELEASE(data);
+  /* The string itself stays in name_table for reuse */
+  ASSERT(dpx_atomic_load(&data->refcount) > 0);
+  dpx_atomic_add(&data->refcount, -1);
 }
 
 char *
@@ -1094,19 +1728,18 @@ texpdf_new_array (void)
   pdf_array *data;
 
   result = texpdf_new_obj(PDF_ARRAY);
-  data   = NEW(1, pdf_array);
+  data   = result->data;
   data->values = NULL;
   data->max    = 0;
   data->size   = 0;
-  result->data = data;
 
   return result;
 }
 
 static void
-write_array (pdf_array *array, FILE *file)
+write_array (pdf_array *array, pdf_sink *sink)
 {
-  pdf_out_char(file, '[');
+  pdf_out_char(sink, '[');
   if (array->size > 0) {
     unsigned long i;
     int type1 = PDF_UNDEFINED, type2;
@@ -1115,14 +1748,14 @@ write_array (pdf_array *array, FILE *file)
       if (array->values[i]) {
 	type2 = array->values[i]->type;
 	if (type1 != PDF_UNDEFINED && pdf_need_white(type1, type2))
-	  pdf_out_white(file);
+	  pdf_out_white(sink);
 	type1 = type2;
-	pdf_write_obj(array->values[i], file);
+	pdf_write_obj(array->values[i], sink);
       } else
 	WARN("PDF array element #ld undefined.", i);
     }
   }
-  pdf_out_char(file, ']');
+  pdf_out_char(sink, ']');
 }
 
 pdf_obj *
@@ -1168,7 +1801,6 @@ release_array (pdf_array *data)
     RELEASE(data->values);
     data->values = NULL;
   }
-  RELEASE(data);
 }
 
 /*
@@ -1288,25 +1920,26 @@ pdf_pop_array (pdf_obj *array)
 #endif
 
 static void
-write_dict (pdf_dict *dict, FILE *file)
+write_dict (pdf_dict *dict, pdf_sink *sink)
 {
+  unsigned i;
+
 #if 0
-  pdf_out (file, "<<\n", 3); /* dropping \n saves few kb. */
+  pdf_out (sink, "<<\n", 3); /* dropping \n saves few kb. */
 #else
-  pdf_out (file, "<<", 2);
+  pdf_out (sink, "<<", 2);
 #endif
-  while (dict->key != NULL) {
-    pdf_write_obj(dict->key, file);
-    if (pdf_need_white(PDF_NAME, (dict->value)->type)) {
-      pdf_out_white(file);
+  for (i = 0; i < dict->size; i++) {
+    pdf_write_obj(dict->entries[i].key, sink);
+    if (pdf_need_white(PDF_NAME, (dict->entries[i].value)->type)) {
+      pdf_out_white(sink);
     }
-    pdf_write_obj(dict->value, file);
+    pdf_write_obj(dict->entries[i].value, sink);
 #if 0
-    pdf_out_char (file, '\n'); /* removing this saves few kb. */
+    pdf_out_char (sink, '\n'); /* removing this saves few kb. */
 #endif
-    dict = dict->next;
   }
-  pdf_out (file, ">>", 2);
+  pdf_out (sink, ">>", 2);
 }
 
 pdf_obj *
@@ -1316,11 +1949,12 @@ texpdf_new_dict (void)
   pdf_dict *data;
 
   result = texpdf_new_obj(PDF_DICT);
-  data   = NEW(1, pdf_dict);
-  data->key    = NULL;
-  data->value  = NULL;
-  data->next   = NULL;
-  result->data = data;
+  data   = result->data;
+  data->entries    = NULL;
+  data->size       = 0;
+  data->max        = 0;
+  data->index      = NULL;
+  data->index_size = 0;
 
   return result;
 }
@@ -1328,26 +1962,113 @@ texpdf_new_dict (void)
 static void
 release_dict (pdf_dict *data)
 {
-  pdf_dict *next;
+  unsigned i;
 
-  while (data != NULL && data->key != NULL) {
-    texpdf_release_obj(data->key);
-    texpdf_release_obj(data->value);
-    data->key   = NULL;
-    data->value = NULL;
-    next = data->next;
-    RELEASE(data);
-    data = next;
+  for (i = 0; i < data->size; i++) {
+    texpdf_release_obj(data->entries[i].key);
+    texpdf_release_obj(data->entries[i].value);
+  }
+  if (data->entries)
+    RELEASE(data->entries);
+  if (data->index)
+    RELEASE(data->index);
+}
+
+/* (Re)builds the hash index of all entries */
+static void
+dict_build_index (pdf_dict *data)
+{
+  unsigned i, n, mask;
+
+  if (data->size < DICT_INDEX_MIN) {
+    if (data->index)
+      RELEASE(data->index);
+    data->index      = NULL;
+    data->index_size = 0;
+    return;
+  }
+  /* Keep the table at most half full */
+  for (n = 2 * DICT_INDEX_MIN; n < 2 * data->size; n <<= 1)
+    ;
+  if (n != data->index_size) {
+    if (data->index)
+      RELEASE(data->index);
+    data->index      = NEW(n, unsigned);
+    data->index_size = n;
+  }
+  memset(data->index, 0, n * sizeof(unsigned));
+  mask = n - 1;
+  for (i = 0; i < data->size; i++) {
+    unsigned h = ((pdf_name *) data->entries[i].key->data)->hash & mask;
+
+    while (data->index[h])
+      h = (h + 1) & mask;
+    data->index[h] = i + 1;
   }
-  RELEASE(data);
 }
 
-/* Array is ended by a node with NULL this pointer */
+/* Returns the entry number of NAME, or -1 */
+static long
+dict_find (pdf_dict *data, pdf_name *name)
+{
+  unsigned i;
+
+  if (data->index) {
+    unsigned mask = data->index_size - 1;
+
+    for (i = name->hash & mask; data->index[i]; i = (i + 1) & mask) {
+      if (data->entries[data->index[i]-1].key->data == name)
+        return data->index[i] - 1;
+    }
+    return -1;
+  }
+  for (i = 0; i < data->size; i++) {
+    if (data->entries[i].key->data == name)
+      return i;
+  }
+
+  return -1;
+}
+
+#define NAME_IS(n,s,l,h) ((n)->hash == (h) && (n)->length == (l) && \
+                          ((l) == 0 || !memcmp((n)->name, (s), (l))))
+
+/* Same as dict_find() for a plain string. The keys are compared by
+ * their strings: the name table is not consulted, since an unused name
+ * found there could be freed at any time by another thread.
+ */
+static long
+dict_find_string (pdf_dict *data, const char *name)
+{
+  unsigned i, length, hash;
+
+  length = strlen(name);
+  hash   = name_hash(name, length);
+  if (data->index) {
+    unsigned mask = data->index_size - 1;
+
+    for (i = hash & mask; data->index[i]; i = (i + 1) & mask) {
+      if (NAME_IS((pdf_name *) data->entries[data->index[i]-1].key->data,
+                  name, length, hash))
+        return data->index[i] - 1;
+    }
+    return -1;
+  }
+  for (i = 0; i < data->size; i++) {
+    if (NAME_IS((pdf_name *) data->entries[i].key->data, name, length, hash))
+      return i;
+  }
+
+  return -1;
+}
+
 /* texpdf_add_dict returns 0 if the key is new and non-zero otherwise */
 int
 texpdf_add_dict (pdf_obj *dict, pdf_obj *key, pdf_obj *value)
 {
-  pdf_dict *data, *new_node;
+  pdf_dict *data;
+  pdf_name *name;
+  long      i;
 
   TYPECHECK(dict, PDF_DICT);
   TYPECHECK(key,  PDF_NAME);
@@ -1356,28 +2077,39 @@ texpdf_add_dict (pdf_obj *dict, pdf_obj *key, pdf_obj *value)
   if (value != NULL && INVALIDOBJ(value))
     ERROR("texpdf_add_dict(): Passed invalid value");
 
+  data = dict->data;
+  name = key->data;
   /* If this key already exists, simply replace the value */
-  for (data = dict->data; data->key != NULL; data = data->next) {
-    if (!strcmp(texpdf_name_value(key), texpdf_name_value(data->key))) {
-      /* Release the old value */
-      texpdf_release_obj(data->value);
-      /* Release the new key (we don't need it) */
-      texpdf_release_obj(key);
-      data->value = value;
-      return 1;
+  i = dict_find(data, name);
+  if (i >= 0) {
+    /* Release the old value */
+    texpdf_release_obj(data->entries[i].value);
+    /* Release the new key (we don't need it) */
+    texpdf_release_obj(key);
+    data->entries[i].value = value;
+    return 1;
+  }
+  /* We didn't find the key: append it */
+  if (data->size == data->max) {
+    data->max = data->max ? 2 * data->max : 4;
+    data->entries = RENEW(data->entries, data->max, struct dict_entry);
+  }
+  data->entries[data->size].key   = key;
+  data->entries[data->size].value = value;
+  data->size++;
+  if (data->size >= DICT_INDEX_MIN) {
+    if (2 * data->size > data->index_size)
+      dict_build_index(data);
+    else {
+      unsigned mask = data->index_size - 1;
+      unsigned h    = name->hash & mask;
+
+      while (data->index[h])
+        h = (h + 1) & mask;
+      data->index[h] = data->size;
     }
   }
-  /*
-   * We didn't find the key. We build a new "end" node and add
-   * the new key just before the end
-   */
-  new_node = NEW (1, pdf_dict);
-  new_node->key = NULL;
-  new_node->value = NULL;
-  new_node->next = NULL;
-  data->next  = new_node;
-  data->key   = key;
-  data->value = value;
+
   return 0;
 }
 
@@ -1385,44 +2117,12 @@ texpdf_add_dict (pdf_obj *dict, pdf_obj *key, pdf_obj *value)
 void
 texpdf_put_dict (pdf_obj *dict, const char *key, pdf_obj *value)
 {
-  pdf_dict *data;
-
   TYPECHECK(dict, PDF_DICT);
 
   if (!key) {
     ERROR("texpdf_put_dict(): Passed invalid key.");
   }
-  /* It seems that NULL is sometimes used for null object... */
-  if (value != NULL && INVALIDOBJ(value)) {
-    ERROR("texpdf_add_dict(): Passed invalid value.");
-  }
-
-  data = dict->data;
-
-  while (data->key != NULL) {
-    if (!strcmp(key, texpdf_name_value(data->key))) {
-      texpdf_release_obj(data->value);
-      data->value = value;
-      break;
-    }
-    data = data->next;
-  }
-
-  /*
-   * If we didn't find the key, build a new "end" node and add
-   * the new key just before the end
-   */
-  if (data->key == NULL) {
-    pdf_dict *new_node;
-
-    new_node = NEW (1, pdf_dict);
-    new_node->key   = NULL;
-    new_node->value = NULL;
-    new_node->next  = NULL;
-    data->next  = new_node;
-    data->key   = texpdf_new_name(key);
-    data->value = value;
-  }
+  texpdf_add_dict(dict, texpdf_new_name(key), value);
 }
 #endif
 
@@ -1431,14 +2131,15 @@ void
 texpdf_merge_dict (pdf_obj *dict1, pdf_obj *dict2)
 {
   pdf_dict *data;
+  unsigned  i;
 
   TYPECHECK(dict1, PDF_DICT);
   TYPECHECK(dict2, PDF_DICT);
 
   data = dict2->data;
-  while (data->key != NULL) {
-    texpdf_add_dict(dict1, texpdf_link_obj(data->key), texpdf_link_obj(data->value));
-    data = data->next;
+  for (i = 0; i < data->size; i++) {
+    texpdf_add_dict(dict1, texpdf_link_obj(data->entries[i].key),
+                    texpdf_link_obj(data->entries[i].value));
   }
 }
 
@@ -1448,40 +2149,34 @@ texpdf_foreach_dict (pdf_obj *dict,
 {
   int       error = 0;
   pdf_dict *data;
+  unsigned  i;
 
   ASSERT(proc);
 
   TYPECHECK(dict, PDF_DICT);
 
   data = dict->data;
-  while (!error &&
-	 data->key != NULL) {
-    error = proc(data->key, data->value, pdata);
-    data = data->next;
+  for (i = 0; !error && i < data->size; i++) {
+    error = proc(data->entries[i].key, data->entries[i].value, pdata);
   }
 
   return error;
 }
 
-#define pdf_match_name(o,s) ((o) && (s) && !strcmp(((pdf_name *)(o)->data)->name, (s)))
 pdf_obj *
 texpdf_lookup_dict (pdf_obj *dict, const char *name)
 {
   pdf_dict *data;
+  long      i;
 
   ASSERT(name);
 
   TYPECHECK(dict, PDF_DICT);
 
   data = dict->data;
-  while (data->key != NULL) {
-    if (!strcmp(name, texpdf_name_value(data->key))) {
-      return data->value;
-    }
-    data = data->next;
-  }
+  i    = dict_find_string(data, name);
 
-  return NULL;
+  return i >= 0 ? data->entries[i].value : NULL;
 }
 
 /* Returns array of dictionary keys */
@@ -1490,16 +2185,17 @@ pdf_dict_keys (pdf_obj *dict)
 {
   pdf_obj  *keys;
   pdf_dict *data;
+  unsigned  i;
 
   TYPECHECK(dict, PDF_DICT);
 
   keys = texpdf_new_array();
-  for (data = dict->data; (data &&
-			   data->key != NULL); data = data->next) {
+  data = dict->data;
+  for (i = 0; i < data->size; i++) {
     /* We duplicate name object rather than linking keys.
      * If we forget to free keys, broken PDF is generated.
      */
-    texpdf_add_array(keys, texpdf_new_name(texpdf_name_value(data->key)));
+    texpdf_add_array(keys, texpdf_new_name(texpdf_name_value(data->entries[i].key)));
   }
 
   return keys;
@@ -1508,22 +2204,23 @@ pdf_dict_keys (pdf_obj *dict)
 void
 texpdf_remove_dict (pdf_obj *dict, const char *name)
 {
-  pdf_dict *data, **data_p;
+  pdf_dict *data;
+  long      i;
 
   TYPECHECK(dict, PDF_DICT);
 
-  data   = dict->data;
-  data_p = (pdf_dict **) (void *) &(dict->data);
-  while (data->key != NULL) {
-    if (pdf_match_name(data->key, name)) {
-      texpdf_release_obj(data->key);
-      texpdf_release_obj(data->value);
-      *data_p = data->next;
-      RELEASE(data);
-      break;
-    }
-    data_p = &(data->next);
-    data   = data->next;
+  if (!name)
+    return;
+  data = dict->data;
+  i    = dict_find_string(data, name);
+  if (i >= 0) {
+    texpdf_release_obj(data->entries[i].key);
+    texpdf_release_obj(data->entries[i].value);
+    data->size--;
+    memmove(data->entries + i, data->entries + i + 1,
+            (data->size - i) * sizeof(struct dict_entry));
+    if (data->index)
+      dict_build_index(data);
   }
 }
 
@@ -1534,7 +2231,7 @@ texpdf_new_stream (int flags)
   pdf_stream *data;
 
   result = texpdf_new_obj(PDF_STREAM);
-  data   = NEW(1, pdf_stream);
+  data   = result->data;
   /*
    * Although we are using an arbitrary pdf_object here, it must have
    * type=PDF_DICT and cannot be an indirect reference.  This will be
@@ -1546,30 +2243,114 @@ texpdf_new_stream (int flags)
   data->stream_length = 0;
   data->max_length    = 0;
   data->objstm_data = NULL;
+  data->deflated    = NULL;
+#ifdef HAVE_ZLIB
+  data->deflating   = NULL;
+#endif
+  data->raw_length  = 0;
+  data->borrowed    = NULL;
 
-  result->data = data;
   result->flags |= OBJ_NO_OBJSTM;
 
   return result;
 }
 
+#ifdef HAVE_ZLIB
+/*
+ * Background compression
+ *
+ * With compression threads enabled, a large stream that is about to be
+ * written is deflated by a worker instead, and the object is parked in
+ * the pending queue (see flush_pending() below) until the result is in.
+ */
+#define DEFLATE_ASYNC_MIN 4096u
+/* Shorter streams are compressed in place; a worker round trip costs more. */
+
+typedef struct deflate_job
+{
+  dpx_task             task; /* must be first */
+  const unsigned char *data;
+  unsigned long        data_length;
+  unsigned char       *buffer;
+  unsigned long        length;
+  int                  level;
+  int                  error;
+} deflate_job;
+
 static void
-write_stream (pdf_stream *stream, FILE *file)
+deflate_job_run (dpx_task *task)
+{
+  deflate_job *job = (deflate_job *) task;
+  uLongf       length;
+
+  /* We are not in the main thread: NEW() would call ERROR() from here. */
+  length = compressBound(job->data_length);
+  job->buffer = malloc(length);
+  if (!job->buffer) {
+    job->error = 1;
+    return;
+  }
+#ifdef HAVE_ZLIB_COMPRESS2
+  job->error = compress2(job->buffer, &length,
+                         job->data, job->data_length, job->level) != Z_OK;
+#else
+  job->error = compress(job->buffer, &length,
+                        job->data, job->data_length) != Z_OK;
+#endif
+  job->length = length;
+}
+
+/* Returns 1 if the stream is now being compressed by a worker. */
+static int
+deflate_in_background (pdf_obj *object)
+{
+  pdf_stream  *stream;
+  deflate_job *job;
+
+  if (!output->workers || object->type != PDF_STREAM)
+    return 0;
+
+  stream = object->data;
+  if (!(stream->_flags & STREAM_COMPRESS) || compression_level == 0 ||
+      stream->deflating || stream->stream_length < DEFLATE_ASYNC_MIN)
+    return 0;
+
+  job = NEW(1, deflate_job);
+  job->task.run    = deflate_job_run;
+  job->data        = stream->stream;
+  job->data_length = stream->stream_length;
+  job->buffer      = NULL;
+  job->length      = 0;
+  job->level       = compression_level;
+  job->error       = 0;
+  stream->deflated = job;
+  dpx_workers_submit(&job->task);
+
+  return 1;
+}
+#else
+#define deflate_in_background(o) 0
+#endif /* HAVE_ZLIB */
+
+static void
+write_stream (pdf_stream *stream, pdf_sink *sink)
 {
   unsigned char *filtered;
   unsigned long  filtered_length;
   unsigned long  buffer_length;
   unsigned char *buffer;
 
+#ifdef HAVE_ZLIB
+  /* Finishing may move stream->stream, so do it before taking a pointer. */
+  if (stream->deflating)
+    stream_deflate(stream, NULL, 0, Z_FINISH);
+#endif
+
   /*
-   * Always work from a copy of the stream. All filters read from
-   * "filtered" and leave their result in "filtered".
+   * Filters read from "filtered" and leave their result in a new buffer.
+   * We only need our own copy when the data is encrypted in place.
    */
-#if 0
-  filtered = NEW(stream->stream_length + 1, unsigned char);
-#endif
-  filtered = NEW(stream->stream_length, unsigned char);
-  memcpy(filtered, stream->stream, stream->stream_length);
+  filtered        = stream->stream;
   filtered_length = stream->stream_length;
 
 #if 0
@@ -1578,15 +2359,15 @@ write_stream (pdf_stream *stream, FILE *file)
 #endif
 
 #ifdef HAVE_ZLIB
-  /* Apply compression filter if requested */
-  if (stream->stream_length > 0 &&
-      (stream->_flags & STREAM_COMPRESS) &&
-      compression_level > 0) {
+  /* Apply compression filter if requested, or if compression has
+   * already started at an earlier level. */
+  if (stream->deflating || stream->deflated ||
+      (stream->stream_length > 0 &&
+       (stream->_flags & STREAM_COMPRESS) &&
+       compression_level > 0)) {
 
     pdf_obj *filters = texpdf_lookup_dict(stream->dict, "Filter");
 
-    buffer_length = filtered_length + filtered_length/1000 + 14;
-    buffer = NEW(buffer_length, unsigned char);
     {
       pdf_obj *filter_name = texpdf_new_name("FlateDecode");
 
@@ -1603,22 +2384,42 @@ write_stream (pdf_stream *stream, FILE *file)
          */
         texpdf_add_dict(stream->dict, texpdf_new_name("Filter"), filter_name);
     }
+    if (stream->deflating) {
+      /* Already compressed as it was added */
+      buffer        = NULL;
+      buffer_length = stream->stream_length;
+      filtered_length = stream->raw_length;
+    } else if (stream->deflated) {
+      deflate_job *job = stream->deflated;
+
+      dpx_workers_wait(&job->task);
+      if (job->error)
+        ERROR("Zlib error");
+      buffer        = job->buffer;
+      buffer_length = job->length;
+      RELEASE(job);
+      stream->deflated = NULL;
+    } else {
+      buffer_length = filtered_length + filtered_length/1000 + 14;
+      buffer = NEW(buffer_length, unsigned char);
 #ifdef HAVE_ZLIB_COMPRESS2    
-    if (compress2(buffer, &buffer_length, filtered,
-		  filtered_length, compression_level)) {
-      ERROR("Zlib error");
-    }
+      if (compress2(buffer, &buffer_length, filtered,
+		    filtered_length, compression_level)) {
+        ERROR("Zlib error");
+      }
 #else 
-    if (compress(buffer, &buffer_length, filtered,
-		 filtered_length)) {
-      ERROR ("Zlib error");
-    }
+      if (compress(buffer, &buffer_length, filtered,
+		   filtered_length)) {
+        ERROR ("Zlib error");
+      }
 #endif /* HAVE_ZLIB_COMPRESS2 */
-    RELEASE(filtered);
-    compression_saved += filtered_length - buffer_length
-      - (filters ? strlen("/FlateDecode "): strlen("/Filter/FlateDecode\n"));
+    }
+    if (sink->output)
+      sink->output->compression_saved += filtered_length - buffer_length
+        - (filters ? strlen("/FlateDecode "): strlen("/Filter/FlateDecode\n"));
 
-    filtered        = buffer;
+    if (buffer)
+      filtered      = buffer;
     filtered_length = buffer_length;
   }
 #endif /* HAVE_ZLIB */
@@ -1638,17 +2439,23 @@ write_stream (pdf_stream *stream, FILE *file)
   texpdf_add_dict(stream->dict,
 	       texpdf_new_name("Length"), texpdf_new_number(filtered_length));
 
-  pdf_write_obj(stream->dict, file);
+  pdf_write_obj(stream->dict, sink);
 
-  pdf_out(file, "\nstream\n", 8);
+  pdf_out(sink, "\nstream\n", 8);
 
-  if (enc_mode)
-    pdf_encrypt_data(filtered, filtered_length);
+  if (sink->output && sink->output->enc_mode && filtered_length > 0) {
+    if (filtered == stream->stream) {
+      filtered = NEW(filtered_length, unsigned char);
+      memcpy(filtered, stream->stream, filtered_length);
+    }
+    pdf_encrypt_data(sink->output->enc_key, filtered, filtered_length);
+  }
 
   if (filtered_length > 0) {
-    pdf_out(file, filtered, filtered_length);
+    pdf_out(sink, filtered, filtered_length);
   }
-  RELEASE(filtered);
+  if (filtered != stream->stream)
+    RELEASE(filtered);
 
   /*
    * This stream length "object" gets reset every time write_stream is
@@ -1657,8 +2464,8 @@ write_stream (pdf_stream *stream, FILE *file)
    * filters, this could be a problem.
    */
 
-  pdf_out(file, "\n", 1);
-  pdf_out(file, "endstream", 9);
+  pdf_out(sink, "\n", 1);
+  pdf_out(sink, "endstream", 9);
 }
 
 static void
@@ -1667,19 +2474,93 @@ release_stream (pdf_stream *stream)
   texpdf_release_obj(stream->dict);
   stream->dict = NULL;
 
-  if (stream->stream) {
+#ifdef HAVE_ZLIB
+  if (stream->deflated) {
+    /* Written elsewhere or abandoned: the worker must be done with our data */
+    dpx_workers_wait(&stream->deflated->task);
+    if (stream->deflated->buffer)
+      free(stream->deflated->buffer);
+    RELEASE(stream->deflated);
+    stream->deflated = NULL;
+  }
+  if (stream->deflating) {
+    deflateEnd(stream->deflating);
+    RELEASE(stream->deflating);
+    stream->deflating = NULL;
+  }
+#endif
+
+  if (stream->borrowed) {
+    input_map_release(stream->borrowed);
+    stream->borrowed = NULL;
+  } else if (stream->stream) {
     RELEASE(stream->stream);
-    stream->stream = NULL;
   }
+  stream->stream = NULL;
 
   if (stream->objstm_data) {
     RELEASE(stream->objstm_data);
     stream->objstm_data = NULL;
   }
+}
 
-  RELEASE(stream);
+/* Makes room for LENGTH more bytes, growing geometrically */
+static void
+stream_reserve (pdf_stream *data, unsigned long length)
+{
+  if (data->borrowed) {
+    /* Stop sharing the input file before changing the data. */
+    unsigned char *copy;
+
+    data->max_length = data->stream_length + length + STREAM_ALLOC_SIZE;
+    copy = NEW(data->max_length, unsigned char);
+    memcpy(copy, data->stream, data->stream_length);
+    data->stream = copy;
+    input_map_release(data->borrowed);
+    data->borrowed = NULL;
+  }
+  if (data->stream_length + length > data->max_length) {
+    data->max_length += length + STREAM_ALLOC_SIZE;
+    if (data->max_length < 2 * data->stream_length)
+      data->max_length = 2 * data->stream_length;
+    data->stream      = RENEW(data->stream, data->max_length, unsigned char);
+  }
 }
 
+#ifdef HAVE_ZLIB
+/*
+ * Streams with STREAM_DEFLATE_INCREMENTAL are compressed as data comes
+ * in: only the deflated bytes are kept, and write_stream() has nothing
+ * left to do but finish the zlib stream.
+ */
+static void
+stream_deflate (pdf_stream *data, const void *input, long length, int flush)
+{
+  z_stream *z = data->deflating;
+  int       status;
+
+  if (!z) {
+    z = data->deflating = NEW(1, z_stream);
+    z->zalloc = Z_NULL; z->zfree = Z_NULL; z->opaque = Z_NULL;
+    if (deflateInit(z, compression_level) != Z_OK)
+      ERROR("Zlib error: %s", z->msg ? z->msg : "deflateInit() failed");
+  }
+
+  z->next_in  = (z_const Bytef *) input;
+  z->avail_in = length;
+  data->raw_length += length;
+  do {
+    stream_reserve(data, STREAM_ALLOC_SIZE);
+    z->next_out  = data->stream + data->stream_length;
+    z->avail_out = data->max_length - data->stream_length;
+    status = deflate(z, flush);
+    if (status != Z_OK && status != Z_STREAM_END && status != Z_BUF_ERROR)
+      ERROR("Zlib error: %s", z->msg ? z->msg : "deflate() failed");
+    data->stream_length = data->max_length - z->avail_out;
+  } while (z->avail_in > 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+}
+#endif /* HAVE_ZLIB */
+
 pdf_obj *
 texpdf_stream_dict (pdf_obj *stream)
 {
@@ -1700,6 +2581,10 @@ pdf_stream_dataptr (pdf_obj *stream)
   TYPECHECK(stream, PDF_STREAM);
 
   data = stream->data;
+#ifdef HAVE_ZLIB
+  if (data->deflating)
+    ERROR("pdf_stream_dataptr(): Stream data has been compressed already.");
+#endif
 
   return (const void *) data->stream;
 }
@@ -1712,6 +2597,10 @@ pdf_stream_length (pdf_obj *stream)
   TYPECHECK(stream, PDF_STREAM);
 
   data = stream->data;
+#ifdef HAVE_ZLIB
+  if (data->deflating)
+    return (long) data->raw_length;
+#endif
 
   return (long) data->stream_length;
 }
@@ -1740,10 +2629,18 @@ texpdf_add_stream (pdf_obj *stream, const void *stream_data, long length)
   if (length < 1)
     return;
   data = stream->data;
-  if (data->stream_length + length > data->max_length) {
-    data->max_length += length + STREAM_ALLOC_SIZE;
-    data->stream      = RENEW(data->stream, data->max_length, unsigned char);
+#ifdef HAVE_ZLIB
+  /* Once started, the stream is compressed to the end whatever the
+   * compression level has been set to since. */
+  if (data->deflating ||
+      ((data->_flags & STREAM_DEFLATE_INCREMENTAL) &&
+       (data->_flags & STREAM_COMPRESS) && compression_level > 0 &&
+       data->stream_length == 0)) {
+    stream_deflate(data, stream_data, length, Z_NO_FLUSH);
+    return;
   }
+#endif
+  stream_reserve(data, length);
   memcpy(data->stream + data->stream_length, stream_data, length);
   data->stream_length += length;
 }
@@ -2156,6 +3053,143 @@ pdf_concat_stream (pdf_obj *dst, pdf_obj *src)
   return error;
 }
 
+#if HAVE_ZLIB
+/* Append the deflate data of the zlib stream in data to dst. Blocks are
+ * copied as they are; inflating them only finds where the final block
+ * starts and ends. Unless this is the last segment, the final block
+ * loses its BFINAL bit and is followed by an empty stored block, so the
+ * next segment starts on a byte boundary.
+ */
+static int
+append_deflate_blocks (pdf_obj *dst, const unsigned char *data, long length,
+		       int last, uLong *adler)
+{
+  pdf_stream    *stream = dst->data;
+  unsigned char *p;
+  z_stream z;
+  Bytef    wbuf[WBUF_SIZE];
+  long     final_byte = -1, end = -1;
+  int      final_mask = 0, unused = 0;
+
+  /* Deflate, no preset dictionary */
+  if (length < 2 || (data[0] & 0x0f) != 8 || (data[1] & 0x20) ||
+      ((data[0] << 8) | data[1]) % 31 != 0)
+    return -1;
+
+  z.zalloc = Z_NULL; z.zfree = Z_NULL; z.opaque = Z_NULL;
+  z.next_in = (z_const Bytef *) data; z.avail_in = length;
+  if (inflateInit(&z) != Z_OK)
+    return -1;
+
+  for (;;) {
+    z.next_out = wbuf; z.avail_out = WBUF_SIZE;
+    if (inflate(&z, Z_BLOCK) != Z_OK)
+      break;
+    *adler = adler32(*adler, wbuf, WBUF_SIZE - z.avail_out);
+    if (z.data_type & 128) {
+      /* At a block boundary; the low bits count the unused bits of
+       * the last byte read, where the next block header begins. */
+      long used = z.next_in - data;
+      int  pos  = z.data_type & 7;
+
+      if (z.data_type & 64) {
+	end    = used;
+	unused = pos;
+	break;
+      }
+      if (pos) {
+	final_byte = used - 1;
+	final_mask = 0x100 >> pos;
+      } else {
+	final_byte = used;
+	final_mask = 1;
+      }
+    }
+  }
+  inflateEnd(&z);
+  if (end < 0 || final_byte < 2 || final_byte >= end)
+    return -1;
+
+  texpdf_add_stream(dst, data + 2, end - 2);
+  if (!last) {
+    /* Empty stored block: header bits and padding, LEN and NLEN. The
+     * header fits in the spare bits of the last byte if there are three.
+     */
+    static const unsigned char stored[5] = {0x00, 0x00, 0x00, 0xff, 0xff};
+
+    p = stream->stream + stream->stream_length - (end - 2);
+    p[final_byte - 2] &= ~final_mask;
+    p[end - 3]        &= 0xff >> unused;
+    if (unused >= 3)
+      texpdf_add_stream(dst, stored + 1, 4);
+    else
+      texpdf_add_stream(dst, stored, 5);
+  }
+
+  return 0;
+}
+#endif /* HAVE_ZLIB */
+
+/* Join the content streams in the array contents into one FlateDecode
+ * stream without recompressing them. Returns NULL if some segment is
+ * not a FlateDecode stream without DecodeParms; the caller then has to
+ * decode them with pdf_concat_stream().
+ */
+pdf_obj *
+pdf_join_flate_streams (pdf_obj *contents)
+{
+#if HAVE_ZLIB
+  pdf_obj *dst;
+  uLong    adler = adler32(0L, Z_NULL, 0);
+  unsigned char trailer[4];
+  int      i, len;
+
+  if (!PDF_OBJ_ARRAYTYPE(contents) || compression_level == 0)
+    return NULL;
+
+  dst = texpdf_new_stream(0);
+  texpdf_add_stream(dst, "\x78\x9c", 2);
+  len = texpdf_array_length(contents);
+  for (i = 0; i < len; i++) {
+    pdf_obj *seg = pdf_deref_obj(texpdf_get_array(contents, i));
+    pdf_obj *filter;
+    int      error = -1;
+
+    if (PDF_OBJ_STREAMTYPE(seg) &&
+	!texpdf_lookup_dict(texpdf_stream_dict(seg), "DecodeParms")) {
+      filter = texpdf_lookup_dict(texpdf_stream_dict(seg), "Filter");
+      if (PDF_OBJ_ARRAYTYPE(filter) && texpdf_array_length(filter) == 1)
+	filter = texpdf_get_array(filter, 0);
+      if (PDF_OBJ_NAMETYPE(filter) &&
+	  !strcmp(texpdf_name_value(filter), "FlateDecode"))
+	error = append_deflate_blocks(dst, pdf_stream_dataptr(seg),
+				      pdf_stream_length(seg),
+				      i == len - 1, &adler);
+    }
+    if (seg)
+      texpdf_release_obj(seg);
+    if (error < 0) {
+      texpdf_release_obj(dst);
+      return NULL;
+    }
+  }
+  if (len == 0) {
+    texpdf_release_obj(dst);
+    return NULL;
+  }
+
+  trailer[0] = (adler >> 24) & 0xff; trailer[1] = (adler >> 16) & 0xff;
+  trailer[2] = (adler >>  8) & 0xff; trailer[3] =  adler        & 0xff;
+  texpdf_add_stream(dst, trailer, 4);
+  texpdf_add_dict(texpdf_stream_dict(dst),
+		  texpdf_new_name("Filter"), texpdf_new_name("FlateDecode"));
+
+  return dst;
+#else
+  return NULL;
+#endif /* HAVE_ZLIB */
+}
+
 static pdf_obj *
 pdf_stream_uncompress (pdf_obj *src) {
   pdf_obj *dst = texpdf_new_stream(0);
@@ -2195,68 +3229,75 @@ pdf_stream_get_flags (pdf_obj *stream)
 #endif
 
 static void
-pdf_write_obj (pdf_obj *object, FILE *file)
+pdf_write_obj (pdf_obj *object, pdf_sink *sink)
 {
   if (object == NULL) {
-    write_null(file);
+    write_null(sink);
     return;
   }
 
   if (INVALIDOBJ(object) || PDF_OBJ_UNDEFINED(object))
     ERROR("pdf_write_obj: Invalid object, type = %d\n", object->type);
 
-  if (file == stderr)
+  if (sink == &error_sink) {
+    error_sink.file = stderr;
     fprintf(stderr, "{%d}", object->refcount);
+  }
 
   switch (object->type) {
   case PDF_BOOLEAN:
-    write_boolean(object->data, file);
+    write_boolean(object->data, sink);
     break;
   case PDF_NUMBER:
-    write_number (object->data, file);
+    write_number (object->data, sink);
     break;
   case PDF_STRING:
-    write_string (object->data, file);
+    write_string (object->data, sink);
     break;
   case PDF_NAME:
-    write_name(object->data, file);
+    write_name(object->data, sink);
     break;
   case PDF_ARRAY:
-    write_array(object->data, file);
+    write_array(object->data, sink);
     break;
   case PDF_DICT:
-    write_dict (object->data, file);
+    write_dict (object->data, sink);
     break;
   case PDF_STREAM:
-    write_stream(object->data, file);
+    write_stream(object->data, sink);
     break;
   case PDF_NULL:
-    write_null(file);
+    write_null(sink);
     break;
   case PDF_INDIRECT:
-    write_indirect(object->data, file);
+    write_indirect(object->data, sink);
     break;
   }
 }
 
 /* Write the object to the file */ 
 static void
-pdf_flush_obj (pdf_obj *object, FILE *file)
+pdf_flush_obj (pdf_obj *object, pdf_sink *sink)
 {
+  char buffer[48];
   long length;
 
   /*
    * Record file position
    */
   add_xref_entry(object->label, 1,
-		 pdf_output_file_position, object->generation);
-  length = sprintf(format_buffer, "%lu %hu obj\n", object->label, object->generation);
-  enc_mode = doc_enc_mode && !(object->flags & OBJ_NO_ENCRYPT);
+		 output->file_position, object->generation);
+  length  = sprint_ulong(buffer, object->label);
+  buffer[length++] = ' ';
+  length += sprint_ulong(buffer + length, object->generation);
+  memcpy(buffer + length, " obj\n", 5);
+  length += 5;
+  output->enc_mode = output->doc_enc_mode && !(object->flags & OBJ_NO_ENCRYPT);
   texpdf_enc_set_label(object->label);
   texpdf_enc_set_generation(object->generation);
-  pdf_out(file, format_buffer, length);
-  pdf_write_obj(object, file);
-  pdf_out(file, "\nendobj\n", 8);
+  pdf_out(sink, buffer, length);
+  pdf_write_obj(object, sink);
+  pdf_out(sink, "\nendobj\n", 8);
 }
 
 static long
@@ -2275,11 +3316,11 @@ pdf_add_objstm (pdf_obj *objstm, pdf_obj *object)
   add_xref_entry(object->label, 2, objstm->label, pos-1);
  
   /* redirect output into objstm */
-  output_stream = objstm;
-  enc_mode = 0;
-  pdf_write_obj(object, pdf_output_file);
-  pdf_out_char(pdf_output_file, '\n');
-  output_stream = NULL;
+  output->output_stream = objstm;
+  output->enc_mode = 0;
+  pdf_write_obj(object, &output->sink);
+  pdf_out_char(&output->sink, '\n');
+  output->output_stream = NULL;
 
   return pos;
 }
@@ -2288,38 +3329,109 @@ static void
 release_objstm (pdf_obj *objstm)
 {
   long *data = get_objstm_data(objstm);
-  long pos = data[0];
+  long pos = data[0], i;
   pdf_obj *dict;
   pdf_stream *stream;
   unsigned char *old_buf;
   unsigned long old_length;
+  char *p;
   stream = (pdf_stream *) objstm->data;
 
   /* Precede stream data by offset table */
   old_buf = stream->stream;
   old_length = stream->stream_length;
-  /* Reserve 22 bytes for each entry (two 10 digit numbers plus two spaces) */
-  stream->stream = NEW(old_length + 22*pos, unsigned char);
-  stream->stream_length = 0;
-
-  {
-    long i = 2*pos, *val = data+2;
-    while (i--) {
-      long length = sprintf(format_buffer, "%ld ", *(val++));
-      texpdf_add_stream(objstm, format_buffer, length);
-    }
+  /* Reserve 42 bytes for each entry (two 20 digit numbers plus two spaces) */
+  stream->max_length = old_length + 42*pos;
+  stream->stream = NEW(stream->max_length, unsigned char);
+
+  p = (char *) stream->stream;
+  for (i = 1; i <= pos; i++) {
+    p += sprint_long(p, data[2*i]);
+    *p++ = ' ';
+    p += sprint_long(p, data[2*i+1]);
+    *p++ = ' ';
   }
+  stream->stream_length = p - (char *) stream->stream;
 
   dict = texpdf_stream_dict(objstm);
   texpdf_add_dict(dict, texpdf_new_name("Type"), texpdf_new_name("ObjStm"));
   texpdf_add_dict(dict, texpdf_new_name("N"), texpdf_new_number(pos));
   texpdf_add_dict(dict, texpdf_new_name("First"), texpdf_new_number(stream->stream_length));
   
-  texpdf_add_stream(objstm, old_buf, old_length);
+  memcpy(p, old_buf, old_length);
+  stream->stream_length += old_length;
   RELEASE(old_buf);
+  /* Deflated by a worker if there are any */
   texpdf_release_obj(objstm);
 }
 
+/*
+ * Objects released while a stream ahead of them is still being
+ * compressed wait here, so that the file is written in release order.
+ */
+#define PENDING_MAX 256
+/* Beyond this many queued objects we block on the oldest one. */
+
+static void
+pending_push (pdf_obj *object)
+{
+  if (output->pending.count >= output->pending.max) {
+    pdf_obj     **objects;
+    unsigned long i;
+
+    objects = NEW(output->pending.max + PENDING_MAX, pdf_obj *);
+    for (i = 0; i < output->pending.count; i++)
+      objects[i] = output->pending.objects[(output->pending.head + i) % output->pending.max];
+    if (output->pending.objects)
+      RELEASE(output->pending.objects);
+    output->pending.objects = objects;
+    output->pending.head    = 0;
+    output->pending.max    += PENDING_MAX;
+  }
+  output->pending.objects[(output->pending.head + output->pending.count) % output->pending.max] = object;
+  output->pending.count++;
+}
+
+static int
+pending_ready (pdf_obj *object)
+{
+#ifdef HAVE_ZLIB
+  if (object->type == PDF_STREAM && ((pdf_stream *) object->data)->deflated)
+    return dpx_workers_poll(&((pdf_stream *) object->data)->deflated->task);
+#endif
+  return 1;
+}
+
+/*
+ * Write queued objects whose data is ready, in queue order.
+ * With wait set, block until the queue is empty.
+ */
+static void
+flush_pending (int wait)
+{
+  if (output->pending.flushing)
+    return; /* the outer call picks up anything queued meanwhile */
+
+  output->pending.flushing = 1;
+  while (output->pending.count > 0) {
+    pdf_obj *object = output->pending.objects[output->pending.head];
+
+    if (!wait && output->pending.count < PENDING_MAX && !pending_ready(object))
+      break;
+    output->pending.head = (output->pending.head + 1) % output->pending.max;
+    output->pending.count--;
+    pdf_flush_obj(object, &output->sink);
+    pdf_free_obj(object);
+  }
+  output->pending.flushing = 0;
+
+  if (output->pending.count == 0 && output->pending.objects) {
+    RELEASE(output->pending.objects);
+    output->pending.objects = NULL;
+    output->pending.head = output->pending.max = 0;
+  }
+}
+
 void
 texpdf_release_obj (pdf_obj *object)
 {
@@ -2328,69 +3440,79 @@ texpdf_release_obj (pdf_obj *object)
   if (INVALIDOBJ(object) || object->refcount <= 0) {
     MESG("\ntexpdf_release_obj: object=%p, type=%d, refcount=%d\n",
 	 object, object->type, object->refcount);
-    pdf_write_obj(object, stderr);
+    pdf_write_obj(object, &error_sink);
     ERROR("texpdf_release_obj:  Called with invalid object.");
   }
   object->refcount -= 1;
   if (object->refcount == 0) {
+    if (object->label && obj_log) {
+      /* Written by pdf_obj_log_replay() */
+      obj_list_push(&obj_log->released, object);
+      return;
+    }
     /*
      * Nothing is using this object so it's okay to remove it.
      * Nonzero "label" means object needs to be written before it's destroyed.
      */
-    if (object->label && pdf_output_file != NULL) {
-      if (!do_objstm || object->flags & OBJ_NO_OBJSTM
-	  || (doc_enc_mode && object->flags & OBJ_NO_ENCRYPT)
-	  || object->generation)
-	pdf_flush_obj(object, pdf_output_file);
-      else {
-        if (!current_objstm) {
+    if (object->label && output != NULL) {
+      if (!output->do_objstm || object->flags & OBJ_NO_OBJSTM
+	  || (output->doc_enc_mode && object->flags & OBJ_NO_ENCRYPT)
+	  || object->generation) {
+	if (output->pending.count > 0 || deflate_in_background(object)) {
+	  /* Written and freed by flush_pending() */
+	  pending_push(object);
+	  flush_pending(0);
+	  return;
+	}
+	pdf_flush_obj(object, &output->sink);
+      } else {
+        if (!output->current_objstm) {
 	  long *data = NEW(2*OBJSTM_MAX_OBJS+2, long);
 	  data[0] = data[1] = 0;
-	  current_objstm = texpdf_new_stream(STREAM_COMPRESS);
-	  set_objstm_data(current_objstm, data);
-	  pdf_label_obj(current_objstm);
+	  output->current_objstm = texpdf_new_stream(STREAM_COMPRESS);
+	  set_objstm_data(output->current_objstm, data);
+	  pdf_label_obj(output->current_objstm);
 	}
-	if (pdf_add_objstm(current_objstm, object) == OBJSTM_MAX_OBJS) {
-	  release_objstm(current_objstm);
-	  current_objstm = NULL;
+	if (pdf_add_objstm(output->current_objstm, object) == OBJSTM_MAX_OBJS ||
+	    pdf_stream_length(output->current_objstm) >= OBJSTM_MAX_BYTES) {
+	  release_objstm(output->current_objstm);
+	  output->current_objstm = NULL;
 	}
       }
     }
-    switch (object->type) {
-    case PDF_BOOLEAN:
-      release_boolean(object->data);
-      break;
-    case PDF_NULL:
-      break;
-    case PDF_NUMBER:
-      release_number(object->data);
-      break;
-    case PDF_STRING:
-      release_string(object->data);
-      break;
-    case PDF_NAME:
-      release_name(object->data);
-      break;
-    case PDF_ARRAY:
-      release_array(object->data);
-      break;
-    case PDF_DICT:
-      release_dict(object->data);
-      break;
-    case PDF_STREAM:
-      release_stream(object->data);
-      break;
-    case PDF_INDIRECT:
-      release_indirect(object->data);
-      break;
-    }
-    /* This might help detect freeing already freed objects */
-    object->type = -1;
-    object->data = NULL;
-    RELEASE(object);
+    pdf_free_obj(object);
   }
 }
 
+static void
+pdf_free_obj (pdf_obj *object)
+{
+  size_t size;
+
+  switch (object->type) {
+  case PDF_STRING:
+    release_string(object->data);
+    break;
+  case PDF_NAME:
+    release_name(object->data);
+    break;
+  case PDF_ARRAY:
+    release_array(object->data);
+    break;
+  case PDF_DICT:
+    release_dict(object->data);
+    break;
+  case PDF_STREAM:
+    release_stream(object->data);
+    break;
+  }
+  size = obj_size(object->type);
+  /* This might help detect freeing already freed objects */
+  object->type = -1;
+  object->data = NULL;
+  release_small(object, size);
+}
+
 static int
 backup_line (FILE *pdf_input_file)
 {
@@ -2491,24 +3613,200 @@ texpdf_parse_trailer (pdf_file *pf)
  * is that an object before an xref table will grab the whole table
  * :-(
  */
+static int CDECL
+offset_cmp (const void *v1, const void *v2)
+{
+  unsigned long o1 = *(const unsigned long *) v1;
+  unsigned long o2 = *(const unsigned long *) v2;
+
+  return o1 < o2 ? -1 : o1 > o2;
+}
+
+static void
+release_offsets (pdf_file *pf)
+{
+  if (pf->offsets)
+    RELEASE(pf->offsets);
+  pf->offsets = NULL;
+  pf->num_offsets = 0;
+}
+
+static void
+build_offsets (pdf_file *pf)
+{
+  long  i, n = 0;
+
+  pf->offsets = NEW(pf->num_obj + 1, unsigned long);
+  for (i = 0; i < pf->num_obj; i++) {
+    if (pf->xref_table[i].type == 1)
+      pf->offsets[n++] = pf->xref_table[i].field2;
+  }
+  qsort(pf->offsets, n, sizeof(unsigned long), offset_cmp);
+  pf->num_offsets = n;
+}
+
+/* The offsets are sorted once, after the xref has been read, and
+ * dropped again whenever the xref table is changed.
+ */
 static long
 next_object_offset (pdf_file *pf, unsigned long obj_num)
 {
   long  next = pf->file_size;  /* Worst case */
-  long  i, curr;
+  long  lo, hi, mid;
+  unsigned long curr;
+
+  if (!pf->offsets)
+    build_offsets(pf);
 
   curr = pf->xref_table[obj_num].field2;
-  /* Check all other type 1 objects to find next one */
-  for (i = 0; i < pf->num_obj; i++) {
-    if (pf->xref_table[i].type == 1 &&
-        pf->xref_table[i].field2 > curr &&
-        pf->xref_table[i].field2 < next)
-      next = pf->xref_table[i].field2;
+  /* Find the first type 1 object after this one */
+  lo = 0; hi = pf->num_offsets;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (pf->offsets[mid] <= curr)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  if (lo < pf->num_offsets && pf->offsets[lo] < next)
+    next = pf->offsets[lo];
 
   return  next;
 }
 
+/* Rough count of the memory held by a parsed object, not following
+ * references. Stream data still in the mapped input file is free.
+ */
+static unsigned long
+obj_mem_size (pdf_obj *object)
+{
+  unsigned long size, i;
+
+  if (!object)
+    return 0;
+  size = obj_size(object->type);
+  switch (object->type) {
+  case PDF_STRING:
+    size += ((pdf_string *) object->data)->length + 1;
+    break;
+  case PDF_ARRAY: {
+    pdf_array *array = object->data;
+    size += array->max * sizeof(pdf_obj *);
+    for (i = 0; i < array->size; i++)
+      size += obj_mem_size(array->values[i]);
+    break;
+  }
+  case PDF_DICT: {
+    pdf_dict *dict = object->data;
+    size += dict->max * sizeof(struct dict_entry) +
+      dict->index_size * sizeof(unsigned);
+    for (i = 0; i < dict->size; i++)
+      size += obj_mem_size(dict->entries[i].key) +
+	obj_mem_size(dict->entries[i].value);
+    break;
+  }
+  case PDF_STREAM: {
+    pdf_stream *stream = object->data;
+    size += obj_mem_size(stream->dict);
+    if (!stream->borrowed)
+      size += stream->max_length;
+    if (stream->objstm_data)
+      size += 2 * (stream->objstm_data[0] + 1) * sizeof(long);
+    break;
+  }
+  }
+
+  return size;
+}
+
+static void
+cache_unlink (pdf_file *pf, long n)
+{
+  struct cache_link *l = pf->cache + n;
+
+  if (l->prev >= 0)
+    pf->cache[l->prev].next = l->next;
+  else
+    pf->cache_head = l->next;
+  if (l->next >= 0)
+    pf->cache[l->next].prev = l->prev;
+  else
+    pf->cache_tail = l->prev;
+}
+
+static void
+cache_push (pdf_file *pf, long n)
+{
+  struct cache_link *l = pf->cache + n;
+
+  l->prev = -1;
+  l->next = pf->cache_head;
+  if (pf->cache_head >= 0)
+    pf->cache[pf->cache_head].prev = n;
+  else
+    pf->cache_tail = n;
+  pf->cache_head = n;
+}
+
+static void
+cache_evict (pdf_file *pf, long n)
+{
+  cache_unlink(pf, n);
+  pf->cache_size -= pf->cache[n].size;
+  texpdf_release_obj(pf->xref_table[n].direct);
+  pf->xref_table[n].direct = NULL;
+}
+
+/* Drop the least recently used objects until the cache is within its
+ * budget, always keeping the object `keep`.
+ */
+static void
+cache_trim (pdf_file *pf, long keep)
+{
+  long n = pf->cache_tail;
+
+  while (n >= 0 && pf->cache_size > import_cache_limit) {
+    long prev = pf->cache[n].prev;
+    if (n != keep)
+      cache_evict(pf, n);
+    n = prev;
+  }
+}
+
+/* Store object in the cache of parsed objects, which takes over the
+ * reference passed in.
+ */
+static pdf_obj *
+cache_insert (pdf_file *pf, long n, pdf_obj *object)
+{
+  pf->xref_table[n].direct = object;
+  pf->cache[n].size = obj_mem_size(object);
+  pf->cache_size += pf->cache[n].size;
+  cache_push(pf, n);
+  cache_trim(pf, n);
+
+  return object;
+}
+
+static pdf_obj *
+cache_lookup (pdf_file *pf, long n)
+{
+  pdf_obj *object = pf->xref_table[n].direct;
+
+  if (object && pf->cache_head != n) {
+    cache_unlink(pf, n);
+    cache_push(pf, n);
+  }
+
+  return object;
+}
+
+void
+texpdf_set_import_cache_size (long bytes)
+{
+  import_cache_limit = bytes < 0 ? 0 : bytes;
+}
+
 #define checklabel(pf, n, g) ((n) > 0 && (n) < (pf)->num_obj && ( \
   ((pf)->xref_table[(n)].type == 1 && (pf)->xref_table[(n)].field3 == (g)) || \
   ((pf)->xref_table[(n)].type == 2 && !(g))))
@@ -2519,14 +3817,36 @@ texpdf_new_indirect (pdf_file *pf, unsigned long obj_num, unsigned short obj_gen
   pdf_obj      *result;
   pdf_indirect *indirect;
 
-  indirect = NEW(1, pdf_indirect);
+  result   = texpdf_new_obj(PDF_INDIRECT);
+  indirect = result->data;
   indirect->pf         = pf;
   indirect->obj        = NULL;
   indirect->label      = obj_num;
   indirect->generation = obj_gen;
 
-  result   = texpdf_new_obj(PDF_INDIRECT);
-  result->data = indirect;
+  return result;
+}
+
+pdf_obj *
+pdf_file_stream (pdf_file *pf, int flags, const void *data, long length)
+{
+  pdf_obj    *result;
+  pdf_stream *stream;
+  const char *p = data;
+
+  result = texpdf_new_stream(flags);
+  if (!pf || !pf->map || length < 1 ||
+      p < pf->map->data || p + length > pf->map->data + pf->map->size) {
+    texpdf_add_stream(result, data, length);
+    return result;
+  }
+
+  stream = result->data;
+  stream->stream        = (unsigned char *) p;
+  stream->stream_length = length;
+  stream->max_length    = 0;
+  stream->borrowed      = pf->map;
+  pf->map->refcount++;
 
   return result;
 }
@@ -2545,12 +3865,18 @@ pdf_read_object (unsigned long obj_num, unsigned short obj_gen,
   if (length <= 0)
     return NULL;
 
-  buffer = NEW(length + 1, char);
-
-  seek_absolute(pf->file, offset);
-  fread(buffer, sizeof(char), length, pf->file);
-
-  p      = buffer;
+  /* Parse in place if the file is mapped. The last object in the file
+   * is still copied: the parser may look a byte or two past its end.
+   */
+  if (pf->map && limit < pf->map->size) {
+    buffer = NULL;
+    p      = pf->map->data + offset;
+  } else {
+    buffer = NEW(length + 1, char);
+    seek_absolute(pf->file, offset);
+    fread(buffer, sizeof(char), length, pf->file);
+    p      = buffer;
+  }
   endptr = p + length;
 
   /* Check for obj_num and obj_gen */
@@ -2679,7 +4005,7 @@ read_objstm (pdf_file *pf, unsigned long num)
     goto error;
   RELEASE(data);
   
-  return pf->xref_table[num].direct = objstm;
+  return cache_insert(pf, num, objstm);
 
  error:
   WARN("Cannot parse object stream.");
@@ -2705,7 +4031,7 @@ texpdf_get_object (pdf_file *pf, unsigned long obj_num, unsigned short obj_gen)
     return texpdf_new_null();
   }
 
-  if ((result = pf->xref_table[obj_num].direct)) {
+  if ((result = cache_lookup(pf, obj_num))) {
     return texpdf_link_obj(result);
   }
 
@@ -2726,7 +4052,7 @@ texpdf_get_object (pdf_file *pf, unsigned long obj_num, unsigned short obj_gen)
 
     if (objstm_num >= pf->num_obj ||
 	pf->xref_table[objstm_num].type != 1 ||
-	!((objstm = pf->xref_table[objstm_num].direct) ||
+	!((objstm = cache_lookup(pf, objstm_num)) ||
 	  (objstm = read_objstm(pf, objstm_num))))
       goto error;
 
@@ -2739,14 +4065,15 @@ texpdf_get_object (pdf_file *pf, unsigned long obj_num, unsigned short obj_gen)
 
     length = pdf_stream_length(objstm);
     p = (const char *) pdf_stream_dataptr(objstm) + first + data[2*index+1];
-    q = p + (index == n-1 ? length : first+data[2*index+3]);
+    q = (const char *) pdf_stream_dataptr(objstm) +
+      (index == n-1 ? length : first+data[2*index+3]);
     result = texpdf_parse_pdf_object(&p, q, pf);
     if (!result)
       goto error;
   }
 
   /* Make sure the caller doesn't free this object */
-  pf->xref_table[obj_num].direct = texpdf_link_obj(result);
+  cache_insert(pf, obj_num, texpdf_link_obj(result));
 
   return result;
 
@@ -2770,6 +4097,10 @@ texpdf_new_ref (pdf_obj *object)
   }
   result = texpdf_new_indirect(NULL, object->label, object->generation);
   OBJ_OBJ(result) = object;
+  if (LOG_LABEL(object->label)) {
+    ASSERT(obj_log);
+    obj_list_push(&obj_log->refs, texpdf_link_obj(result));
+  }
   return result;
 }
 
@@ -2815,8 +4146,12 @@ extend_xref (pdf_file *pf, long new_size)
 {
   unsigned long i;
 
+  release_offsets(pf);
   pf->xref_table = RENEW(pf->xref_table, new_size, xref_entry);
+  pf->cache      = RENEW(pf->cache, new_size, struct cache_link);
   for (i = pf->num_obj; i < new_size; i++) {
+    pf->cache[i].prev = pf->cache[i].next = -1;
+    pf->cache[i].size = 0;
     pf->xref_table[i].direct   = NULL;
     pf->xref_table[i].indirect = NULL;
     pf->xref_table[i].type     = 0;
@@ -2836,6 +4171,8 @@ texpdf_parse_xref_table (pdf_file *pf, long xref_pos)
   char          flag;
   int           r;
 
+  release_offsets(pf);
+
   /*
    * This routine reads one xref segment. It may be called multiple times
    * on the same file.  xref tables sometimes come in pieces.
@@ -2928,6 +4265,7 @@ texpdf_parse_xrefstm_subsec (pdf_file *pf,
   if ((*length -= wsum*size) < 0)
     return -1;
 
+  release_offsets(pf);
   if (pf->num_obj < first+size)
     extend_xref(pf, first+size);  /* TODO: change! why? */
 
@@ -3113,8 +4451,6 @@ read_xref (pdf_file *pf)
   return NULL;
 }
 
-static struct ht_table *pdf_files = NULL;
-
 static pdf_file *
 pdf_file_new (FILE *file)
 {
@@ -3127,13 +4463,36 @@ pdf_file_new (FILE *file)
   pf->catalog = NULL;
   pf->num_obj = 0;
   pf->version = 0;
+  pf->offsets = NULL;
+  pf->num_offsets = 0;
+  pf->cache   = NULL;
+  pf->cache_head = pf->cache_tail = -1;
+  pf->cache_size = 0;
+  pf->pages     = NULL;
+  pf->num_pages = -1;
 
   seek_end(file);
   pf->file_size = tell_position(file);
+  pf->map = input_map_new(file, pf->file_size);
 
   return pf;
 }
 
+static void
+release_page_entry (struct page_entry *e)
+{
+  if (e->page)
+    texpdf_release_obj(e->page);
+  if (e->media_box)
+    texpdf_release_obj(e->media_box);
+  if (e->crop_box)
+    texpdf_release_obj(e->crop_box);
+  if (e->rotate)
+    texpdf_release_obj(e->rotate);
+  if (e->resources)
+    texpdf_release_obj(e->resources);
+}
+
 static void
 pdf_file_free (pdf_file *pf)
 {
@@ -3150,7 +4509,17 @@ pdf_file_free (pdf_file *pf)
       texpdf_release_obj(pf->xref_table[i].indirect);
   }
 
+  if (pf->pages) {
+    for (i = 0; i < pf->num_pages; i++)
+      release_page_entry(&pf->pages[i]);
+    RELEASE(pf->pages);
+  }
+
   RELEASE(pf->xref_table);
+  if (pf->cache)
+    RELEASE(pf->cache);
+  release_offsets(pf);
+  input_map_release(pf->map);
   if (pf->trailer)
     texpdf_release_obj(pf->trailer);
   if (pf->catalog)
@@ -3159,11 +4528,12 @@ pdf_file_free (pdf_file *pf)
   RELEASE(pf);  
 }
 
+/* Imported files are kept by the document they are imported into and
+ * closed with it. There is nothing left to do here.
+ */
 void
 texpdf_files_init (void)
 {
-  pdf_files = NEW(1, struct ht_table);
-  texpdf_ht_init_table(pdf_files, (void (*)(void *)) pdf_file_free);
 }
 
 int
@@ -3187,15 +4557,162 @@ pdf_file_get_catalog (pdf_file *pf)
   return pf->catalog;
 }
 
+/* Add the pages below node to the index, from entry next on, and return
+ * the next free entry (or -1 if the tree is broken). node is usually an
+ * indirect reference; `inherited' holds the nodes where the inheritable
+ * attributes were last found, without references.
+ */
+static long
+index_page_tree (pdf_file *pf, pdf_obj *node, const struct page_entry *inherited,
+		 long next, int depth)
+{
+  struct page_entry attrs = *inherited;
+  pdf_obj *dict, *kids;
+  long     i;
+
+  if (!--depth)
+    return -1;
+
+  dict = pdf_deref_obj(node);
+  if (!PDF_OBJ_DICTTYPE(dict)) {
+    if (dict)
+      texpdf_release_obj(dict);
+    return -1;
+  }
+
+  if (texpdf_lookup_dict(dict, "MediaBox"))
+    attrs.media_box = node;
+  if (texpdf_lookup_dict(dict, "CropBox"))
+    attrs.crop_box = node;
+  if (texpdf_lookup_dict(dict, "Rotate"))
+    attrs.rotate = node;
+  if (texpdf_lookup_dict(dict, "Resources"))
+    attrs.resources = node;
+
+  kids = pdf_deref_obj(texpdf_lookup_dict(dict, "Kids"));
+  if (!kids) {
+    /* Page object */
+    if (next < pf->num_pages) {
+      struct page_entry *e = &pf->pages[next];
+      e->page      = texpdf_link_obj(node);
+      e->media_box = attrs.media_box ? texpdf_link_obj(attrs.media_box) : NULL;
+      e->crop_box  = attrs.crop_box  ? texpdf_link_obj(attrs.crop_box)  : NULL;
+      e->rotate    = attrs.rotate    ? texpdf_link_obj(attrs.rotate)    : NULL;
+      e->resources = attrs.resources ? texpdf_link_obj(attrs.resources) : NULL;
+    }
+    next++;
+  } else if (!PDF_OBJ_ARRAYTYPE(kids)) {
+    next = -1;
+  } else {
+    for (i = 0; next >= 0 && i < texpdf_array_length(kids); i++)
+      next = index_page_tree(pf, texpdf_get_array(kids, i), &attrs, next, depth);
+  }
+
+  if (kids)
+    texpdf_release_obj(kids);
+  texpdf_release_obj(dict);
+
+  return next;
+}
+
+/* The page tree is walked once, the first time a page is asked for.
+ * Entries for pages that could not be reached are left empty.
+ */
+static void
+build_page_index (pdf_file *pf)
+{
+  struct page_entry none = { NULL, NULL, NULL, NULL, NULL };
+  pdf_obj *root, *page_tree, *count;
+
+  pf->num_pages = 0;
+  root      = texpdf_lookup_dict(pf->catalog, "Pages");
+  page_tree = pdf_deref_obj(root);
+  if (!PDF_OBJ_DICTTYPE(page_tree)) {
+    if (page_tree)
+      texpdf_release_obj(page_tree);
+    return;
+  }
+  count = pdf_deref_obj(texpdf_lookup_dict(page_tree, "Count"));
+  if (PDF_OBJ_NUMBERTYPE(count) && texpdf_number_value(count) > 0) {
+    long i;
+
+    pf->num_pages = (long) texpdf_number_value(count);
+    /* Every page is an object of its own */
+    if (pf->num_pages > pf->num_obj)
+      pf->num_pages = pf->num_obj;
+    pf->pages = NEW(pf->num_pages, struct page_entry);
+    for (i = 0; i < pf->num_pages; i++)
+      pf->pages[i] = none;
+    index_page_tree(pf, root, &none, 0, PDF_OBJ_MAX_DEPTH);
+  }
+  if (count)
+    texpdf_release_obj(count);
+  texpdf_release_obj(page_tree);
+}
+
+long
+pdf_file_get_page_count (pdf_file *pf)
+{
+  ASSERT(pf);
+
+  if (pf->num_pages < 0)
+    build_page_index(pf);
+
+  return pf->num_pages;
+}
+
+/* The value of key in the page tree node, if any */
+static pdf_obj *
+page_attribute (pdf_obj *node, const char *key)
+{
+  pdf_obj *dict, *value = NULL;
+
+  if (!node)
+    return NULL;
+
+  dict = pdf_deref_obj(node);
+  if (PDF_OBJ_DICTTYPE(dict))
+    value = pdf_deref_obj(texpdf_lookup_dict(dict, key));
+  if (dict)
+    texpdf_release_obj(dict);
+
+  return value;
+}
+
+pdf_obj *
+pdf_file_get_page (pdf_file *pf, long page_no,
+		   pdf_obj **media_box, pdf_obj **crop_box,
+		   pdf_obj **rotate, pdf_obj **resources)
+{
+  struct page_entry *e;
+
+  if (page_no <= 0 || page_no > pdf_file_get_page_count(pf))
+    return NULL;
+
+  e = &pf->pages[page_no - 1];
+  if (!e->page)
+    return NULL;
+
+#define GET_ATTR(p, n, k) if (p) *(p) = page_attribute((n), (k))
+  GET_ATTR(media_box, e->media_box, "MediaBox");
+  GET_ATTR(crop_box,  e->crop_box,  "CropBox");
+  GET_ATTR(rotate,    e->rotate,    "Rotate");
+  GET_ATTR(resources, e->resources, "Resources");
+#undef GET_ATTR
+
+  return pdf_deref_obj(e->page);
+}
+
 pdf_file *
 texpdf_open (const char *ident, FILE *file)
 {
   pdf_file *pf = NULL;
 
-  ASSERT(pdf_files);
+  if (!output)
+    ERROR("texpdf_open(): no document is open.");
 
   if (ident)
-    pf = (pdf_file *) texpdf_ht_lookup_table(pdf_files, ident, strlen(ident));
+    pf = (pdf_file *) texpdf_ht_lookup_table(&output->files, ident, strlen(ident));
 
   if (pf) {
     pf->file = file;
@@ -3243,7 +4760,7 @@ texpdf_open (const char *ident, FILE *file)
     }
 
     if (ident)
-      texpdf_ht_append_table(pdf_files, ident, strlen(ident), pf);
+      texpdf_ht_append_table(&output->files, ident, strlen(ident), pf);
   }
 
   return pf;
@@ -3263,9 +4780,6 @@ texpdf_close (pdf_file *pf)
 void
 texpdf_files_close (void)
 {
-  ASSERT(pdf_files);
-  texpdf_ht_clear_table(pdf_files);
-  RELEASE(pdf_files);
 }
 
 static int
@@ -41,12 +41,19 @@
 #define PDF_OBJ_INVALID 0
 
 #define STREAM_COMPRESS (1 << 0)
+/* Deflate data as it is added rather than when the stream is written.
+ * Only the compressed bytes are kept, so pdf_stream_dataptr() may not be
+ * used on such a stream.
+ */
+#define STREAM_DEFLATE_INCREMENTAL (1 << 1)
 
 /* A deeper object hierarchy will be considered as (illegal) loop. */
 #define PDF_OBJ_MAX_DEPTH  30
 
 typedef struct pdf_obj  pdf_obj;
 typedef struct pdf_file pdf_file;
+/* Writer state of one output document */
+typedef struct pdf_output pdf_output;
 
 /* External interface to pdf routines */
 
@@ -54,8 +61,42 @@ extern int      pdf_obj_get_verbose (void);
 extern void     texpdf_obj_set_verbose (void);
 extern void     texpdf_error_cleanup   (void);
 
-extern void     pdf_out_init      (const char *filename, int do_encryption);
-extern void     pdf_out_flush     (void);
+/** Receive the PDF output through a function
+
+Instead of writing a file, the document is passed to `func` in large
+blocks, in order, each time with `closure`. `func` returns 0 on success;
+any other value is treated as a write error. While a function is set,
+the filename given to `texpdf_open_document` is ignored; pass NULL to go
+back to files. Must be called before `texpdf_open_document`.
+
+*/
+typedef int (*texpdf_output_func) (void *closure, const void *data, long length);
+
+extern void     texpdf_set_output_func (texpdf_output_func func, void *closure);
+
+/* Opens the output file and makes it the document objects are written
+ * to on the calling thread; pdf_out_select() switches to another one.
+ * pdf_out_flush() writes the cross-reference section and trailer of the
+ * given document, closes it and frees its state.
+ */
+extern pdf_output *pdf_out_init   (const char *filename, int do_encryption);
+extern void     pdf_out_select    (pdf_output *doc);
+extern void     pdf_out_flush     (pdf_output *doc);
+
+/* While a log is set on a thread, objects labelled and released there go
+ * into the log instead of the document, so that they can be built on a
+ * worker thread. pdf_obj_log_replay() later numbers and writes them on
+ * the thread of the document, as if they had been made at that point,
+ * and frees the log. pdf_out_workers() tells if the current document
+ * has worker threads.
+ */
+typedef struct pdf_obj_log pdf_obj_log;
+
+extern int          pdf_out_workers    (void);
+extern pdf_obj_log *pdf_obj_log_new    (void);
+extern pdf_obj_log *pdf_obj_log_set    (pdf_obj_log *log);
+extern void         pdf_obj_log_replay (pdf_obj_log *log);
+
 extern void     texpdf_set_version   (unsigned version);
 extern unsigned texpdf_get_version   (void);
 
@@ -153,6 +194,7 @@ extern int         texpdf_add_stream_flate  (pdf_obj *stream,
 					  long stream_data_len);
 #endif
 extern int         pdf_concat_stream     (pdf_obj *dst, pdf_obj *src);
+extern pdf_obj    *pdf_join_flate_streams (pdf_obj *contents);
 extern pdf_obj    *texpdf_stream_dict       (pdf_obj *stream);
 extern long        pdf_stream_length     (pdf_obj *stream);
 #if 0
@@ -174,11 +216,34 @@ extern int         pdf_compare_reference (pdf_obj *ref1, pdf_obj *ref2);
 
 extern void      texpdf_set_compression (int level);
 
+/** Compress streams on background threads
+
+With `num_threads` greater than zero, large streams are deflated by a pool
+of worker threads while typesetting continues; the output is identical to
+serial compression. Must be called before `texpdf_open_document`. Has no
+effect if the library was built without POSIX threads.
+
+*/
+extern void      texpdf_set_compression_threads (int num_threads);
+
 extern void      texpdf_set_info     (pdf_obj *obj);
 extern void      texpdf_set_root     (pdf_obj *obj);
 extern void      texpdf_set_id       (pdf_obj *id);
 extern void      texpdf_set_encrypt  (pdf_obj *encrypt);
 
+/** Limit the memory used by objects parsed from imported PDFs
+
+Objects read from a PDF file being included are kept so that shared
+resources are parsed only once. Each open file keeps at most about
+`bytes` worth of them, dropping the least recently used first (default
+32 MiB).
+
+*/
+extern void      texpdf_set_import_cache_size (long bytes);
+
+/* Files opened by texpdf_open() belong to the current document and are
+ * closed with it; these two do nothing and are kept for old callers.
+ */
 extern void      texpdf_files_init    (void);
 extern void      texpdf_files_close   (void);
 extern int      texpdf_check_for_pdf     (FILE *file);
@@ -187,6 +252,20 @@ extern void      texpdf_close         (pdf_file *pf);
 extern pdf_obj  *pdf_file_get_trailer (pdf_file *pf);
 extern int       texpdf_file_get_version (pdf_file *pf);
 extern pdf_obj  *pdf_file_get_catalog (pdf_file *pf);
+/* Pages of an imported file, found through a flat index of its page tree.
+ * The count is the /Count of the tree, 0 if it has none. A page is
+ * returned together with the attributes it inherits (NULL if absent),
+ * each with a reference for the caller, or NULL if it cannot be reached.
+ */
+extern long      pdf_file_get_page_count (pdf_file *pf);
+extern pdf_obj  *pdf_file_get_page    (pdf_file *pf, long page_no,
+                                       pdf_obj **media_box, pdf_obj **crop_box,
+                                       pdf_obj **rotate, pdf_obj **resources);
+/* New stream with the given data, which is left in place rather than
+ * copied when it lies in the memory-mapped input file pf.
+ */
+extern pdf_obj  *pdf_file_stream      (pdf_file *pf, int flags,
+                                       const void *data, long length);
 
 extern pdf_obj *pdf_deref_obj     (pdf_obj *object);
 extern pdf_obj *pdf_import_object (pdf_obj *object);
@@ -43,7 +43,7 @@
 
 #define istokensep(c) (is_space((c)) || is_delim((c)))
 
-static struct {
+static DPX_THREAD_LOCAL struct {
   int tainted;
 } parser_state = {
   0
@@ -327,7 +327,7 @@ pn_getc (const char **pp, const char *endptr)
 #endif
 
 #define STRING_BUFFER_SIZE PDF_STRING_LEN_MAX+1
-static char sbuf[PDF_STRING_LEN_MAX+1];
+static DPX_THREAD_LOCAL char sbuf[PDF_STRING_LEN_MAX+1];
 
 
 pdf_obj *
@@ -752,7 +752,8 @@ texpdf_parse_pdf_array (const char **pp, const char *endptr, pdf_file *pf)
 }
 
 static pdf_obj *
-texpdf_parse_pdf_stream (const char **pp, const char *endptr, pdf_obj *dict)
+texpdf_parse_pdf_stream (const char **pp, const char *endptr, pdf_obj *dict,
+                         pdf_file *pf)
 {
   pdf_obj *result = NULL;
   const char *p;
@@ -815,16 +816,15 @@ texpdf_parse_pdf_stream (const char **pp, const char *endptr, pdf_obj *dict)
 
     filters = texpdf_lookup_dict(dict, "Filter");
     if (!filters && stream_length > 10) {
-      result = texpdf_new_stream(STREAM_COMPRESS);
+      result = pdf_file_stream(pf, STREAM_COMPRESS, p, stream_length);
     } else {
-      result = texpdf_new_stream(0);
+      result = pdf_file_stream(pf, 0, p, stream_length);
     }
   }
 
   stream_dict = texpdf_stream_dict(result);
   texpdf_merge_dict(stream_dict, dict);
 
-  texpdf_add_stream(result, p, stream_length);
   p += stream_length;
 
   /* Check "endsteam" */
@@ -925,7 +925,7 @@ texpdf_parse_pdf_object (const char **pp, const char *endptr, pdf_file *pf)
           *pp <= endptr - 15 &&
           !memcmp(*pp, "stream", 6)) {
         dict   = result;
-        result = texpdf_parse_pdf_stream(pp, endptr, dict);
+        result = texpdf_parse_pdf_stream(pp, endptr, dict, pf);
         texpdf_release_obj(dict);
       }
     }
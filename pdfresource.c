@@ -75,9 +75,19 @@ struct res_cache
   int      count;
   int      capacity;
   pdf_res *resources;
+  struct ht_table names; /* ident to res_id */
 };
 
-static struct res_cache resources[PDF_NUM_RESOURCE_CATEGORIES];
+/* One res_cache per category, made for each document by
+ * texpdf_init_resources() and switched with it by texpdf_doc_select().
+ */
+static DPX_THREAD_LOCAL struct res_cache *resources = NULL;
+
+static void
+hval_free (void *hval)
+{
+  RELEASE(hval);
+}
 
 static void
 texpdf_init_resource (pdf_res *res)
@@ -127,23 +137,40 @@ pdf_clean_resource (pdf_res *res)
 }
 
 void
-texpdf_init_resources (void)
+pdf_res_select (struct res_cache *cache)
+{
+  resources = cache;
+}
+
+void
+texpdf_init_resources (pdf_doc *p)
 {
   int  i;
 
+  texpdf_doc_select(p);
+  if (p->resources)
+    texpdf_close_resources(p);
+
+  p->resources = NEW(PDF_NUM_RESOURCE_CATEGORIES, struct res_cache);
+  pdf_res_select(p->resources);
   for (i = 0;
        i < PDF_NUM_RESOURCE_CATEGORIES; i++) {
     resources[i].count     = 0;
     resources[i].capacity  = 0;
     resources[i].resources = NULL;
+    texpdf_ht_init_table(&resources[i].names, hval_free);
   }
 }
 
 void
-texpdf_close_resources (void)
+texpdf_close_resources (pdf_doc *p)
 {
   int  i;
 
+  texpdf_doc_select(p);
+  if (!resources)
+    return;
+
   for (i = 0;
        i < PDF_NUM_RESOURCE_CATEGORIES; i++) {
     struct res_cache *rc;
@@ -155,11 +182,15 @@ texpdf_close_resources (void)
       pdf_clean_resource(&rc->resources[j]);
     }
     RELEASE(rc->resources);
+    texpdf_ht_clear_table(&rc->names);
 
     rc->count     = 0;
     rc->capacity  = 0;
     rc->resources = NULL;
   }
+  RELEASE(resources);
+  p->resources = NULL;
+  pdf_res_select(NULL);
 }
 
 static int
@@ -196,48 +227,48 @@ pdf_defineresource (const char *category,
 
   rc = &resources[cat_id];
   if (resname) {
-    for (res_id = 0; res_id < rc->count; res_id++) {
+    int *idp = texpdf_ht_lookup_table(&rc->names, resname, strlen(resname));
+    if (idp) {
+      res_id = *idp;
       res = &rc->resources[res_id];
-      if (!strcmp(resname, res->ident)) {
-	WARN("Resource %s (category: %s) already defined...",
-	     resname, category);
-	pdf_flush_resource(res);
-	res->flags    = flags;
-	if (flags & PDF_RES_FLUSH_IMMEDIATE) {
-	  res->reference = texpdf_ref_obj(object);
-	  texpdf_release_obj(object);
-	} else {
-	  res->object = object;
-	}
-	return (long) ((cat_id << 16)|(res_id));
+      WARN("Resource %s (category: %s) already defined...",
+	   resname, category);
+      pdf_flush_resource(res);
+      res->flags    = flags;
+      if (flags & PDF_RES_FLUSH_IMMEDIATE) {
+	res->reference = texpdf_ref_obj(object);
+	texpdf_release_obj(object);
+      } else {
+	res->object = object;
       }
+      return (long) ((cat_id << 16)|(res_id));
     }
-  } else {
-    res_id = rc->count;
   }
 
-  if (res_id == rc->count) {
-    if (rc->count >= rc->capacity) {
-      rc->capacity += CACHE_ALLOC_SIZE;
-      rc->resources = RENEW(rc->resources, rc->capacity, pdf_res);
-    }
-    res = &rc->resources[res_id];
+  res_id = rc->count;
+  if (rc->count >= rc->capacity) {
+    rc->capacity += CACHE_ALLOC_SIZE;
+    rc->resources = RENEW(rc->resources, rc->capacity, pdf_res);
+  }
+  res = &rc->resources[res_id];
 
-    texpdf_init_resource(res);
-    if (resname && resname[0] != '\0') {
-      res->ident = NEW(strlen(resname) + 1, char);
-      strcpy(res->ident, resname);
-    }
-    res->category = cat_id;
-    res->flags    = flags;
-    if (flags & PDF_RES_FLUSH_IMMEDIATE) {
-      res->reference = texpdf_ref_obj(object);
-      texpdf_release_obj(object);
-    } else {
-      res->object = object;
-    }
-    rc->count++;
+  texpdf_init_resource(res);
+  if (resname && resname[0] != '\0') {
+    int *idp = NEW(1, int);
+    res->ident = NEW(strlen(resname) + 1, char);
+    strcpy(res->ident, resname);
+    *idp = res_id;
+    texpdf_ht_append_table(&rc->names, resname, strlen(resname), idp);
+  }
+  res->category = cat_id;
+  res->flags    = flags;
+  if (flags & PDF_RES_FLUSH_IMMEDIATE) {
+    res->reference = texpdf_ref_obj(object);
+    texpdf_release_obj(object);
+  } else {
+    res->object = object;
   }
+  rc->count++;
 
   return (long) ((cat_id << 16)|(res_id));
 }
@@ -273,8 +304,7 @@ pdf_resource_exist (const char *category, const char *resname)
 long
 pdf_findresource (const char *category, const char *resname)
 {
-  pdf_res *res;
-  int      res_id, cat_id;
+  int     *res_id, cat_id;
   struct res_cache *rc;
 
   ASSERT(resname && category);
@@ -286,12 +316,9 @@ pdf_findresource (const char *category, const char *resname)
   }
 
   rc = &resources[cat_id];
-  for (res_id = 0; res_id < rc->count; res_id++) {
-    res = &rc->resources[res_id];
-    if (!strcmp(resname, res->ident)) {
-      return (long) (cat_id << 16|res_id);
-    }
-  }
+  res_id = texpdf_ht_lookup_table(&rc->names, resname, strlen(resname));
+  if (res_id)
+    return (long) (cat_id << 16|*res_id);
 
   return -1;
 }
@@ -24,11 +24,16 @@
 #define _PDF_RESOURCE_H_
 
 #include "pdfobj.h"
+#include "pdftypes.h"
 
 #define PDF_RES_FLUSH_IMMEDIATE 1
 
-extern void     texpdf_init_resources  (void);
-extern void     texpdf_close_resources (void);
+extern void     texpdf_init_resources  (pdf_doc *p);
+extern void     texpdf_close_resources (pdf_doc *p);
+/* Makes cache the resources the calling thread defines and looks up,
+ * see texpdf_doc_select()
+ */
+extern void     pdf_res_select (struct res_cache *cache);
 
 extern long     pdf_defineresource (const char *category,
 				    const char *resname,  pdf_obj *object, int flags);
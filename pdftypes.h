@@ -102,6 +102,15 @@ typedef struct pdf_article
 
 typedef struct pdf_doc
 {
+  unsigned long serial; /* see texpdf_doc_select() */
+  pdf_output *output;   /* where the objects of this document are written */
+  struct pdf_dev *dev;  /* made by texpdf_init_device() */
+  /* Resources defined for this document, made when it is opened */
+  struct res_cache  *resources;   /* texpdf_init_resources() */
+  struct cspc_cache *colorspaces; /* texpdf_init_colors() */
+  struct pdf_fonts  *fonts;       /* texpdf_init_fonts() */
+  struct ic_        *images;      /* texpdf_init_images() */
+
   struct {
     pdf_obj *dict;
 
@@ -146,7 +155,18 @@ typedef struct pdf_doc
   } opt;
 
   struct form_list_node *pending_forms;
+
+  /* Annotation broken across lines, see texpdf_doc_break_annot() */
+  struct {
+    int      dirty;
+    int      broken;
+    pdf_obj *annot_dict;
+    pdf_rect rect;
+  } breaking_state;
+
+  char *thumb_basename;
   char  manual_thumb_enabled;
+  char  incremental_contents;
   char* doccreator;
   pdf_color bgcolor;
 } pdf_doc;
@@ -95,12 +95,62 @@ struct ic_
 {
   int         count, capacity;
   pdf_ximage *ximages;
-};
 
-static struct ic_  _ic = {
-  0, 0, NULL
+  struct ht_table idents; /* ident to the last image with it */
+  struct ht_table pages;  /* ident, page_no and attr_dict to the first image */
 };
 
+/* Images of the document selected on this thread, see texpdf_init_images() */
+static DPX_THREAD_LOCAL struct ic_ *_ic = NULL;
+
+static void
+hval_free (void *hval)
+{
+  RELEASE(hval);
+}
+
+static char *
+page_key (const char *ident, long page_no, pdf_obj *dict, int *keylen)
+{
+  int   len = strlen(ident) + 1;
+  char *key;
+
+  *keylen = len + sizeof(long) + sizeof(pdf_obj *);
+  key = NEW(*keylen, char);
+  memcpy(key, ident, len);
+  memcpy(key + len, &page_no, sizeof(long));
+  memcpy(key + len + sizeof(long), &dict, sizeof(pdf_obj *));
+
+  return key;
+}
+
+static void
+index_ximage (struct ic_ *ic, int id)
+{
+  pdf_ximage *I = &ic->ximages[id];
+  int        *idp;
+  char       *key;
+  int         keylen;
+
+  if (!I->ident)
+    return;
+
+  idp = texpdf_ht_lookup_table(&ic->idents, I->ident, strlen(I->ident));
+  if (!idp) {
+    idp = NEW(1, int);
+    texpdf_ht_append_table(&ic->idents, I->ident, strlen(I->ident), idp);
+  }
+  *idp = id;
+
+  key = page_key(I->ident, I->page_no, I->attr_dict, &keylen);
+  if (!texpdf_ht_lookup_table(&ic->pages, key, keylen)) {
+    idp  = NEW(1, int);
+    *idp = id;
+    texpdf_ht_append_table(&ic->pages, key, keylen, idp);
+  }
+  RELEASE(key);
+}
+
 void
 texpdf_set_metapost_handler(metapost_handler_t handler) {
   metapost_handler = handler;
@@ -165,18 +215,39 @@ pdf_clean_ximage_struct (pdf_ximage *I)
 
 
 void
-texpdf_init_images (void)
+pdf_ximage_select (struct ic_ *images)
+{
+  _ic = images;
+}
+
+void
+texpdf_init_images (pdf_doc *p)
 {
-  struct ic_ *ic = &_ic;
+  struct ic_ *ic;
+
+  texpdf_doc_select(p);
+  if (p->images)
+    texpdf_close_images(p);
+
+  ic = p->images = NEW(1, struct ic_);
+  pdf_ximage_select(ic);
   ic->count    = 0;
   ic->capacity = 0;
   ic->ximages  = NULL;
+  texpdf_ht_init_table(&ic->idents, hval_free);
+  texpdf_ht_init_table(&ic->pages,  hval_free);
 }
 
 void
-texpdf_close_images (void)
+texpdf_close_images (pdf_doc *p)
 {
-  struct ic_ *ic = &_ic;
+  struct ic_ *ic;
+
+  texpdf_doc_select(p);
+  ic = _ic;
+  if (!ic)
+    return;
+
   if (ic->ximages) {
     int  i;
     for (i = 0; i < ic->count; i++) {
@@ -201,10 +272,11 @@ texpdf_close_images (void)
     ic->ximages = NULL;
     ic->count = ic->capacity = 0;
   }
-
-  if (_opts.cmdtmpl)
-    RELEASE(_opts.cmdtmpl);
-  _opts.cmdtmpl = NULL;
+  texpdf_ht_clear_table(&ic->idents);
+  texpdf_ht_clear_table(&ic->pages);
+  RELEASE(ic);
+  p->images = NULL;
+  pdf_ximage_select(NULL);
 }
 
 static int
@@ -252,7 +324,7 @@ static int
 load_image (const char *ident, const char *fullname, int format, FILE  *fp,
             long page_no, pdf_obj *dict)
 {
-  struct ic_ *ic = &_ic;
+  struct ic_ *ic = _ic;
   int         id = -1; /* ret */
   pdf_ximage *I;
 
@@ -335,6 +407,7 @@ load_image (const char *ident, const char *fullname, int format, FILE  *fp,
   }
 
   ic->count++;
+  index_ximage(ic, id);
 
   return  id;
 
@@ -351,22 +424,29 @@ load_image (const char *ident, const char *fullname, int format, FILE  *fp,
 int
 texpdf_ximage_findresource (pdf_doc *p, const char *ident, long page_no, pdf_obj *dict)
 {
-  struct ic_ *ic = &_ic;
+  struct ic_ *ic = _ic;
   int         id = -1;
   pdf_ximage *I;
   char       *fullname, *f = NULL;
   int         format;
   FILE       *fp;
-
-  for (id = 0; id < ic->count; id++) {
-    I = &ic->ximages[id];
-    if (I->ident && !strcmp(ident, I->ident)) {
-      f = I->filename;
-      if (I->page_no == page_no + (page_no < 0 ? I->page_count+1 : 0) &&
-          I->attr_dict == dict) {
-	return  id;
-      }
-    }
+  int        *last;
+
+  texpdf_doc_select(p);
+
+  last = texpdf_ht_lookup_table(&ic->idents, ident, strlen(ident));
+  if (last) {
+    int  *found, keylen;
+    char *key;
+
+    I = &ic->ximages[*last];
+    f = I->filename;
+    key = page_key(ident, page_no + (page_no < 0 ? I->page_count+1 : 0),
+                   dict, &keylen);
+    found = texpdf_ht_lookup_table(&ic->pages, key, keylen);
+    RELEASE(key);
+    if (found)
+      return *found;
   }
 
   if (f) {
@@ -564,7 +644,7 @@ texpdf_ximage_get_page (pdf_ximage *I)
 pdf_obj *
 texpdf_ximage_get_reference (int id)
 {
-  struct ic_ *ic = &_ic;
+  struct ic_ *ic = _ic;
   pdf_ximage *I;
 
   CHECK_ID(ic, id);
@@ -581,7 +661,7 @@ int
 texpdf_ximage_defineresource (const char *ident,
 			   int subtype, void *info, pdf_obj *resource)
 {
-  struct ic_ *ic = &_ic;
+  struct ic_ *ic = _ic;
   int         id;
   pdf_ximage *I;
 
@@ -608,6 +688,7 @@ texpdf_ximage_defineresource (const char *ident,
     ERROR("Unknown XObject subtype: %d", subtype);
   }
   ic->count++;
+  index_ximage(ic, id);
 
   return  id;
 }
@@ -616,7 +697,7 @@ texpdf_ximage_defineresource (const char *ident,
 char *
 texpdf_ximage_get_resname (int id)
 {
-  struct ic_ *ic = &_ic;
+  struct ic_ *ic = _ic;
   pdf_ximage *I;
 
   CHECK_ID(ic, id);
@@ -629,7 +710,7 @@ texpdf_ximage_get_resname (int id)
 int
 texpdf_ximage_get_subtype (int id)
 {
-  struct ic_ *ic = &_ic;
+  struct ic_ *ic = _ic;
   pdf_ximage *I;
 
   CHECK_ID(ic, id);
@@ -642,7 +723,7 @@ texpdf_ximage_get_subtype (int id)
 void
 texpdf_ximage_set_attr (int id, long width, long height, double xdensity, double ydensity, double llx, double lly, double urx, double ury)
 {
-  struct ic_ *ic = &_ic;
+  struct ic_ *ic = _ic;
   pdf_ximage *I;
 
   CHECK_ID(ic, id);
@@ -786,7 +867,7 @@ texpdf_ximage_scale_image (int            id,
                         transform_info *p  /* argument from specials */
                        )
 {
-  struct ic_ *ic = &_ic;
+  struct ic_ *ic = _ic;
   pdf_ximage *I;
 
   CHECK_ID(ic, id);
@@ -859,6 +940,9 @@ texpdf_ximage_scale_image (int            id,
 
 /* Migrated from psimage.c */
 
+/* The template is used by every document, so closing one leaves it in
+ * place; setting it to NULL releases it.
+ */
 void texpdf_set_distiller_template (char *s) 
 {
   if (_opts.cmdtmpl)
@@ -54,8 +54,12 @@ typedef int (*metapost_handler_t)(pdf_doc *, const char *i, FILE *);
 extern void     texpdf_set_metapost_handler(metapost_handler_t handler);
 extern void     texpdf_ximage_set_verbose    (void);
 
-extern void     texpdf_init_images           (void);
-extern void     texpdf_close_images          (void);
+extern void     texpdf_init_images           (pdf_doc *p);
+extern void     texpdf_close_images          (pdf_doc *p);
+/* Makes images the ones the calling thread defines and looks up,
+ * see texpdf_doc_select()
+ */
+extern void     pdf_ximage_select            (struct ic_ *images);
 
 extern char    *texpdf_ximage_get_resname    (int xobj_id);
 extern pdf_obj *texpdf_ximage_get_reference  (int xobj_id);
@@ -36,6 +36,84 @@
 #define SFNT_POSTSCRIPT 0x4f54544fUL
 #define SFNT_TTC        0x74746366UL
 
+/* Take the whole font file from the font cache so that tables are read
+ * straight from memory rather than through stdio. Leaves sfont->buffer
+ * NULL, and everything going through sfont->stream, if the file cannot
+ * be held in memory.
+ */
+static void
+sfnt_map (sfnt *sfont)
+{
+  sfont->buffer      = NULL;
+  sfont->buffer_size = 0;
+  sfont->position    = 0;
+  sfont->file        = font_cache_open(sfont->stream);
+  if (sfont->file) {
+    unsigned long length;
+
+    sfont->buffer      = font_cache_data(sfont->file, &length);
+    sfont->buffer_size = length;
+  }
+}
+
+ULONG
+sfnt_get_unsigned (sfnt *sfont, int n)
+{
+  const unsigned char *p;
+  ULONG  value = 0;
+
+  if (!sfont->buffer) {
+    switch (n) {
+    case 1:  return get_unsigned_byte(sfont->stream);
+    case 2:  return get_unsigned_pair(sfont->stream);
+    default: return get_unsigned_quad(sfont->stream);
+    }
+  }
+
+  if (sfont->position > sfont->buffer_size ||
+      n > sfont->buffer_size - sfont->position)
+    ERROR("File ended prematurely\n");
+  p = sfont->buffer + sfont->position;
+  sfont->position += n;
+  while (n-- > 0)
+    value = (value << 8) | *p++;
+
+  return value;
+}
+
+void
+sfnt_seek_set (sfnt *sfont, ULONG offset)
+{
+  if (sfont->buffer)
+    sfont->position = offset;
+  else
+    seek_absolute(sfont->stream, offset);
+}
+
+ULONG
+sfnt_tell (sfnt *sfont)
+{
+  if (sfont->buffer)
+    return sfont->position;
+  return tell_position(sfont->stream);
+}
+
+size_t
+sfnt_read (void *buf, size_t length, sfnt *sfont)
+{
+  if (!sfont->buffer)
+    return fread(buf, 1, length, sfont->stream);
+
+  if (sfont->position >= sfont->buffer_size)
+    return 0;
+  if (length > sfont->buffer_size - sfont->position)
+    length = sfont->buffer_size - sfont->position;
+  memcpy(buf, sfont->buffer + sfont->position, length);
+  sfont->position += length;
+
+  return length;
+}
+
 sfnt *
 sfnt_open (FILE *fp)
 {
@@ -49,6 +127,7 @@ sfnt_open (FILE *fp)
   sfont = NEW(1, sfnt);
 
   sfont->stream = fp;
+  sfnt_map(sfont);
 
   type = sfnt_get_ulong(sfont);
 
@@ -62,7 +141,7 @@ sfnt_open (FILE *fp)
     sfont->type = SFNT_TYPE_TTC;
   }
 
-  rewind(sfont->stream);
+  sfnt_seek_set(sfont, 0);
 
   sfont->directory = NULL;
   sfont->offset = 0UL;
@@ -84,6 +163,8 @@ dfont_open (FILE *fp, int index)
   sfont = NEW(1, sfnt);
 
   sfont->stream = fp;
+  sfont->directory = NULL;
+  sfnt_map(sfont);
 
   rdata_pos = sfnt_get_ulong(sfont);
   map_pos   = sfnt_get_ulong(sfont);
@@ -101,7 +182,7 @@ dfont_open (FILE *fp, int index)
   }
 
   if (i > tags_num) {
-    RELEASE(sfont);
+    sfnt_close(sfont);
     return NULL;
   }
 
@@ -118,7 +199,7 @@ dfont_open (FILE *fp, int index)
     if (i == index) break;
   }
 
-  rewind(sfont->stream);
+  sfnt_seek_set(sfont, 0);
 
   sfont->type = SFNT_TYPE_DFONT;
   sfont->directory = NULL;
@@ -155,6 +236,7 @@ sfnt_close (sfnt *sfont)
   if (sfont) {
     if (sfont->directory)
       release_directory(sfont->directory);
+    font_cache_release(sfont->file);
     RELEASE(sfont);
   }
 
@@ -418,7 +500,8 @@ sfnt_require_table (sfnt *sfont, const char *tag, int must_exist)
  *   then store 0xB1B0AFBA - sum.
  */
 
-static unsigned char wbuf[1024], padbytes[4] = {0, 0, 0, 0};
+static DPX_THREAD_LOCAL unsigned char wbuf[1024];
+static unsigned char padbytes[4] = {0, 0, 0, 0};
 
 pdf_obj *
 sfnt_create_FontFile_stream (sfnt *sfont)
@@ -487,6 +570,17 @@ sfnt_create_FontFile_stream (sfnt *sfont)
 	}
 
 	length = td->tables[i].length;
+	if (sfont->buffer) {
+	  /* Tables go into the stream straight from the mapped file. */
+	  if (td->tables[i].offset > sfont->buffer_size ||
+	      length > sfont->buffer_size - td->tables[i].offset) {
+	    texpdf_release_obj(stream);
+	    ERROR("Reading file failed...");
+	    return NULL;
+	  }
+	  texpdf_add_stream(stream, sfont->buffer + td->tables[i].offset, length);
+	  length = 0;
+	}
 	sfnt_seek_set(sfont, td->tables[i].offset); 
 	while (length > 0) {
 	  nb_read = sfnt_read(wbuf, MIN(length, 1024), sfont);
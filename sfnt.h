@@ -78,22 +78,32 @@ typedef struct
   struct sfnt_table_directory *directory;
   FILE  *stream;
   ULONG  offset;
+  /* Whole font file in memory, or NULL to read from stream */
+  struct font_file    *file;
+  const unsigned char *buffer;
+  ULONG  buffer_size;
+  ULONG  position;
 } sfnt;
 
 /* Convert sfnt "fixed" type to double */
 #define fixed(a) ((double)((a)%0x10000L)/(double)(0x10000L) + \
  (a)/0x10000L - (((a)/0x10000L > 0x7fffL) ? 0x10000L : 0))
 
-/* get_***_*** from numbers.h */
-#define sfnt_get_byte(s)   ((BYTE)   get_unsigned_byte((s)->stream))
-#define sfnt_get_char(s)   ((CHAR)   get_signed_byte  ((s)->stream))
-#define sfnt_get_ushort(s) ((USHORT) get_unsigned_pair((s)->stream))
-#define sfnt_get_short(s)  ((SHORT)  get_signed_pair  ((s)->stream))
-#define sfnt_get_ulong(s)  ((ULONG)  get_unsigned_quad((s)->stream))
-#define sfnt_get_long(s)   ((LONG)   get_signed_quad  ((s)->stream))
-
-#define sfnt_seek_set(s,o)   seek_absolute((s)->stream, (o))
-#define sfnt_read(b,l,s)     fread((b), 1, (l), (s)->stream)
+/* Big-endian reads from the mapped file, or get_***_*** from numbers.h
+ * when the file could not be mapped.
+ */
+extern ULONG  sfnt_get_unsigned (sfnt *sfont, int n);
+
+#define sfnt_get_byte(s)   ((BYTE)   sfnt_get_unsigned((s), 1))
+#define sfnt_get_char(s)   ((CHAR)   sfnt_get_unsigned((s), 1))
+#define sfnt_get_ushort(s) ((USHORT) sfnt_get_unsigned((s), 2))
+#define sfnt_get_short(s)  ((SHORT)  sfnt_get_unsigned((s), 2))
+#define sfnt_get_ulong(s)  ((ULONG)  sfnt_get_unsigned((s), 4))
+#define sfnt_get_long(s)   ((LONG)   (int32_t) sfnt_get_unsigned((s), 4))
+
+extern void   sfnt_seek_set (sfnt *sfont, ULONG offset);
+extern ULONG  sfnt_tell     (sfnt *sfont);
+extern size_t sfnt_read     (void *buf, size_t length, sfnt *sfont);
 
 extern  int  put_big_endian (void *s, LONG q, int n);
 
@@ -91,9 +91,12 @@ static int num_sfd_files = 0, max_sfd_files = 0;
 static struct sfd_rec_ *sfd_record = NULL;
 static int num_sfd_records = 0, max_sfd_records = 0;
 
+/* SFD files and mapping tables are shared by every document */
+static dpx_rwlock sfd_lock = DPX_RWLOCK_INITIALIZER;
 
 
-/* Another buffer...
+
+/* Another buffer, used with sfd_lock held...
  * We want buffer size at least 7 x 256 + a
  * 4096 is usually enough.
  */
@@ -330,25 +333,26 @@ find_sfd_file (const char *sfd_name)
 char **
 sfd_get_subfont_ids (const char *sfd_name, int *num_ids)
 {
-  int  sfd_id;
+  int    sfd_id;
+  char **ids = NULL;
 
   if (!sfd_name)
     return  NULL;
 
+  dpx_write_lock(&sfd_lock);
   sfd_id = find_sfd_file(sfd_name);
-  if (sfd_id < 0)
-    return  NULL;
+  if (sfd_id >= 0) {
+    if (num_ids)
+      *num_ids = sfd_files[sfd_id].num_subfonts;
+    ids = sfd_files[sfd_id].sub_id;
+  }
+  dpx_unlock(&sfd_lock);
 
-  if (num_ids)
-    *num_ids = sfd_files[sfd_id].num_subfonts;
-  return  sfd_files[sfd_id].sub_id;
+  return  ids;
 }
 
-/* Make sure that sfd_name does not have the extension '.sfd'.
- * Mapping tables are actually read here.
- */
-int
-texpdf_sfd_load_record (const char *sfd_name, const char *subfont_id)
+static int
+load_sfd_record (const char *sfd_name, const char *subfont_id)
 {
   int               rec_id = -1;
   struct sfd_file_ *sfd;
@@ -435,15 +439,37 @@ texpdf_sfd_load_record (const char *sfd_name, const char *subfont_id)
   return  rec_id;
 }
 
+/* Make sure that sfd_name does not have the extension '.sfd'.
+ * Mapping tables are actually read here.
+ */
+int
+texpdf_sfd_load_record (const char *sfd_name, const char *subfont_id)
+{
+  int  rec_id;
+
+  dpx_write_lock(&sfd_lock);
+  rec_id = load_sfd_record(sfd_name, subfont_id);
+  dpx_unlock(&sfd_lock);
+
+  return  rec_id;
+}
 
 /* Lookup mapping table */
 unsigned short
 texpdf_lookup_sfd_record (int rec_id, unsigned char c)
 {
-  if (!sfd_record ||
-       rec_id < 0 || rec_id >= num_sfd_records)
+  unsigned short code = 0;
+  int            valid;
+
+  dpx_read_lock(&sfd_lock);
+  valid = sfd_record && rec_id >= 0 && rec_id < num_sfd_records;
+  if (valid)
+    code = sfd_record[rec_id].vector[c];
+  dpx_unlock(&sfd_lock);
+  if (!valid)
     ERROR("Invalid subfont_id: %d", rec_id);
-  return sfd_record[rec_id].vector[c];
+
+  return code;
 }
 
 void
@@ -451,6 +477,7 @@ release_sfd_record (void)
 {
   int  i;
 
+  dpx_write_lock(&sfd_lock);
   if (sfd_record) {
     RELEASE(sfd_record);
   }
@@ -464,6 +491,7 @@ release_sfd_record (void)
   sfd_files  = NULL;
   num_sfd_records = max_sfd_records = 0;
   num_sfd_files = max_sfd_files = 0;
+  dpx_unlock(&sfd_lock);
 }
 
 
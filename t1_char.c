@@ -36,7 +36,7 @@
 #define CS_SUBR_RETURN   2
 #define CS_CHAR_END      3
 
-static int status = CS_PARSE_ERROR;
+static DPX_THREAD_LOCAL int status = CS_PARSE_ERROR;
 
 #define DST_NEED(a,b) {if ((a) < (b)) { status = CS_BUFFER_ERROR ; return ; }}
 #define SRC_NEED(a,b) {if ((a) < (b)) { status = CS_PARSE_ERROR  ; return ; }}
@@ -47,8 +47,8 @@ static int status = CS_PARSE_ERROR;
 #define T1_CS_PHASE_PATH 2
 #define T1_CS_PHASE_FLEX 3
 
-static int phase = -1;
-static int nest  = -1;
+static DPX_THREAD_LOCAL int phase = -1;
+static DPX_THREAD_LOCAL int nest  = -1;
 
 #ifndef CS_STEM_ZONE_MAX
 #define CS_STEM_ZONE_MAX 96
@@ -109,12 +109,12 @@ typedef struct {
   t1_cpath *lastpath;
 } t1_chardesc;
 
-static int cs_stack_top = 0;
-static int ps_stack_top = 0;
+static DPX_THREAD_LOCAL int cs_stack_top = 0;
+static DPX_THREAD_LOCAL int ps_stack_top = 0;
 
 /* [vh]stem support require one more stack size. */
-static double cs_arg_stack[CS_ARG_STACK_MAX+1];
-static double ps_arg_stack[PS_ARG_STACK_MAX];
+static DPX_THREAD_LOCAL double cs_arg_stack[CS_ARG_STACK_MAX+1];
+static DPX_THREAD_LOCAL double ps_arg_stack[PS_ARG_STACK_MAX];
 
 #define CS_HINT_DECL -1
 #define CS_FLEX_CTRL -2
@@ -1096,6 +1096,7 @@ static void
 init_cff_font (cff_font *cff)
 {
   cff->stream = NULL;
+  cff->file   = NULL;
   cff->filter = 0;
   cff->fontname = NULL;
   cff->index    = 0;
@@ -297,18 +297,36 @@ fm_clear (struct font_metric *fm)
 #define MAX_FONTS 16
 #endif
 
-struct font_metric *fms = NULL;
+/* Shared by every document. A font_metric is never changed once it is
+ * added, so it may be used without the lock; only fms itself moves.
+ */
+static struct font_metric **fms = NULL;
 static unsigned numfms = 0, max_fms = 0;
+static dpx_rwlock fms_lock = DPX_RWLOCK_INITIALIZER;
 
 static void
 fms_need (unsigned n)
 {
   if (n > max_fms) {
     max_fms = MAX(max_fms + MAX_FONTS, n);
-    fms = RENEW(fms, max_fms, struct font_metric);
+    fms = RENEW(fms, max_fms, struct font_metric *);
   }
 }
 
+/* Index of TFM_NAME in fms, or -1. Called with fms_lock held. */
+static int
+fms_find (const char *tfm_name)
+{
+  int i;
+
+  for (i = 0; i < numfms; i++) {
+    if (!strcmp(tfm_name, fms[i]->tex_name))
+      return i;
+  }
+
+  return -1;
+}
+
 void
 texpdf_tfm_set_verbose (void)
 {
@@ -817,13 +835,15 @@ int
 texpdf_tfm_open (const char *tfm_name, int must_exist)
 {
   FILE *tfm_file;
-  int i, format = TFM_FORMAT;
+  int id, format = TFM_FORMAT;
   off_t tfm_file_size;
+  struct font_metric *fm;
 
-  for (i = 0; i < numfms; i++) {
-    if (!strcmp(tfm_name, fms[i].tex_name))
-      return i;
-  }
+  dpx_read_lock(&fms_lock);
+  id = fms_find(tfm_name);
+  dpx_unlock(&fms_lock);
+  if (id >= 0)
+    return id;
 
   tfm_file = MFOPEN(tfm_name, FOPEN_RBIN_MODE);
   if (!tfm_file) {
@@ -844,27 +864,42 @@ texpdf_tfm_open (const char *tfm_name, int must_exist)
     ERROR("TFM/OFM file too small to be a valid file.");
   }
 
-  fms_need(numfms + 1);
-  fm_init(fms + numfms);
+  /* Read without the lock: another thread may load the same file */
+  fm = NEW(1, struct font_metric);
+  fm_init(fm);
 
 #ifndef WITHOUT_OMEGA
   if (format == OFM_FORMAT)
-    read_ofm(&fms[numfms], tfm_file, tfm_file_size);
+    read_ofm(fm, tfm_file, tfm_file_size);
   else
 #endif /* !WITHOUT_OMEGA */
     {
-      read_tfm(&fms[numfms], tfm_file, tfm_file_size);
+      read_tfm(fm, tfm_file, tfm_file_size);
     }
 
   MFCLOSE(tfm_file);
 
-  fms[numfms].tex_name = NEW(strlen(tfm_name)+1, char);
-  strcpy(fms[numfms].tex_name, tfm_name);
+  fm->tex_name = NEW(strlen(tfm_name)+1, char);
+  strcpy(fm->tex_name, tfm_name);
 
   if (verbose) 
     MESG(")");
 
-  return numfms++;
+  dpx_write_lock(&fms_lock);
+  id = fms_find(tfm_name);
+  if (id < 0) {
+    fms_need(numfms + 1);
+    fms[numfms] = fm;
+    id = numfms++;
+    fm = NULL;
+  }
+  dpx_unlock(&fms_lock);
+  if (fm) {
+    fm_clear(fm);
+    RELEASE(fm);
+  }
+
+  return id;
 }
 
 void
@@ -872,18 +907,33 @@ texpdf_tfm_close_all (void)
 {
   int  i;
 
+  dpx_write_lock(&fms_lock);
   if (fms) {
     for (i = 0; i < numfms; i++) {
-      fm_clear(&(fms[i]));
+      fm_clear(fms[i]);
+      RELEASE(fms[i]);
     }
     RELEASE(fms);
   }
+  fms = NULL;
+  numfms = max_fms = 0;
+  dpx_unlock(&fms_lock);
 }
 
-#define CHECK_ID(n) do {\
-  if ((n) < 0 || (n) >= numfms)\
-    ERROR("TFM: Invalid TFM ID: %d", (n));\
-} while (0)
+static struct font_metric *
+fm_get (int font_id)
+{
+  struct font_metric *fm = NULL;
+
+  dpx_read_lock(&fms_lock);
+  if (font_id >= 0 && font_id < numfms)
+    fm = fms[font_id];
+  dpx_unlock(&fms_lock);
+  if (!fm)
+    ERROR("TFM: Invalid TFM ID: %d", font_id);
+
+  return fm;
+}
 
 fixword
 texpdf_tfm_get_fw_width (int font_id, int32_t ch)
@@ -891,9 +941,7 @@ texpdf_tfm_get_fw_width (int font_id, int32_t ch)
   struct font_metric *fm;
   int idx = 0;
 
-  CHECK_ID(font_id);
-
-  fm = &(fms[font_id]);
+  fm = fm_get(font_id);
   if (ch >= fm->firstchar && ch <= fm->lastchar) {
     switch (fm->charmap.type) {
     case MAPTYPE_CHAR:
@@ -922,9 +970,7 @@ texpdf_tfm_get_fw_height (int font_id, int32_t ch)
   struct font_metric *fm;
   int idx = 0;
 
-  CHECK_ID(font_id);
-
-  fm = &(fms[font_id]);
+  fm = fm_get(font_id);
   if (ch >= fm->firstchar && ch <= fm->lastchar) {
     switch (fm->charmap.type) {
     case MAPTYPE_CHAR:
@@ -953,9 +999,7 @@ texpdf_tfm_get_fw_depth (int font_id, int32_t ch)
   struct font_metric *fm;
   int idx = 0;
 
-  CHECK_ID(font_id);
-
-  fm = &(fms[font_id]);
+  fm = fm_get(font_id);
   if (ch >= fm->firstchar && ch <= fm->lastchar) {
     switch (fm->charmap.type) {
     case MAPTYPE_CHAR:
@@ -1011,9 +1055,7 @@ tfm_string_width (int font_id, const unsigned char *s, unsigned len)
   struct font_metric *fm;
   unsigned i;
 
-  CHECK_ID(font_id);
-
-  fm = &(fms[font_id]);
+  fm = fm_get(font_id);
 #ifndef WITHOUT_ASCII_PTEX
   if (fm->source == SOURCE_TYPE_JFM) {
     for (i = 0; i < len/2; i++) {
@@ -1038,9 +1080,7 @@ tfm_string_depth (int font_id, const unsigned char *s, unsigned len)
   struct font_metric *fm;
   unsigned i;
 
-  CHECK_ID(font_id);
-
-  fm = &(fms[font_id]);
+  fm = fm_get(font_id);
 #ifndef WITHOUT_ASCII_PTEX
   if (fm->source == SOURCE_TYPE_JFM) {
     for (i = 0; i < len/2; i++) {
@@ -1065,9 +1105,7 @@ tfm_string_height (int font_id, const unsigned char *s, unsigned len)
   struct font_metric *fm;
   unsigned i;
 
-  CHECK_ID(font_id);
-
-  fm = &(fms[font_id]);
+  fm = fm_get(font_id);
 #ifndef WITHOUT_ASCII_PTEX
   if (fm->source == SOURCE_TYPE_JFM) {
     for (i = 0; i < len/2; i++) {
@@ -1088,18 +1126,14 @@ tfm_string_height (int font_id, const unsigned char *s, unsigned len)
 double
 texpdf_tfm_get_design_size (int font_id)
 {
-  CHECK_ID(font_id);
-
-  return (double) (fms[font_id].designsize)/FWBASE*(72.0/72.27);
+  return (double) (fm_get(font_id)->designsize)/FWBASE*(72.0/72.27);
 }
 
 #if 0
 char *
 texpdf_tfm_get_codingscheme (int font_id)
 {
-  CHECK_ID(font_id);
-
-  return fms[font_id].codingscheme;
+  return fm_get(font_id)->codingscheme;
 }
 
 #ifndef WITHOUT_ASCII_PTEX
@@ -1107,9 +1141,7 @@ texpdf_tfm_get_codingscheme (int font_id)
 int
 tfm_is_vert (int font_id)
 {
-  CHECK_ID(font_id);
-
-  return (fms[font_id].fontdir == FONT_DIR_VERT) ? 1 : 0;
+  return (fm_get(font_id)->fontdir == FONT_DIR_VERT) ? 1 : 0;
 }
 #else /* WITHOUT_ASCII_PTEX */
 int
@@ -0,0 +1,153 @@
+/* Stress test for documents written on several threads at once.
+
+Every thread opens a document of its own, loads the same native fonts,
+writes text and graphics on a few pages and closes the document, so
+that the fontmap, the font file cache and the other state shared
+between documents are used from all threads at the same time. Each
+document must come out complete. The program is most useful when the
+library is built with -fsanitize=thread.
+
+Built by "make check"; run it as:
+
+./thread-stress threads pages font.ttf...
+
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "libtexpdf/libtexpdf.h"
+
+#define MAX_FONTS 8
+
+static int    num_pages;
+static int    num_fonts;
+static char **font_names;
+
+struct job {
+  int       n;
+  char      filename[64];
+  pthread_t thread;
+};
+
+static void
+write_page (pdf_doc *p, const int *font_ids, int n, int page)
+{
+  char      buf[128];
+  pdf_color color;
+  int       i, len;
+
+  texpdf_doc_begin_page(p, 1.0, 72.0, 770.0);
+  for (i = 0; i < 40; i++) {
+    len = sprintf(buf, "Document %d, page %d, line %d: (The quick brown fox) \\ jumps", n, page, i);
+    texpdf_dev_set_string(p, 0, -(i * 14) * 65536, buf, len, 0,
+                          font_ids[(i + n) % num_fonts], 1);
+  }
+  texpdf_color_rgbcolor(&color, (page % 7) / 7.0, 0.5, (n % 8) / 8.0);
+  texpdf_dev_set_color(p, &color, 0x20, 0);
+  for (i = 0; i < 50; i++) {
+    texpdf_dev_moveto(p, i * 1.5, -600.0 - i);
+    texpdf_dev_lineto(p, i * 2.25, -620.0 + i * 0.125);
+  }
+  texpdf_dev_flushpath(p, 'S', 0);
+  texpdf_doc_end_page(p);
+}
+
+static void *
+run_job (void *arg)
+{
+  struct job *job = arg;
+  pdf_rect    mediabox = {0, 0, 595.0, 842.0};
+  pdf_doc    *p;
+  int         font_ids[MAX_FONTS];
+  int         i;
+
+  p = texpdf_open_document(job->filename, 0, 595.0, 842.0, 0, 0, 0);
+  texpdf_init_device(p, 1, 2, 0);
+  texpdf_doc_set_mediabox(p, 0, &mediabox);
+  for (i = 0; i < num_fonts; i++)
+    font_ids[i] = texpdf_dev_load_native_font(p, font_names[i], 0,
+                                              (10 + i + job->n) * 65536,
+                                              0, 65536, 0, 0);
+  for (i = 0; i < num_pages; i++)
+    write_page(p, font_ids, job->n, i);
+  texpdf_close_document(p);
+  texpdf_close_device(p);
+
+  return NULL;
+}
+
+/* The trailer is written last, so a document that ends with it was
+ * written all the way through.
+ */
+static int
+check_output (const char *filename)
+{
+  FILE *fp;
+  char  buf[16];
+  long  size;
+
+  fp = fopen(filename, "rb");
+  if (!fp)
+    return 0;
+  fseek(fp, 0, SEEK_END);
+  size = ftell(fp);
+  memset(buf, 0, sizeof(buf));
+  if (size >= 6) {
+    fseek(fp, size - 6, SEEK_SET);
+    fread(buf, 1, 6, fp);
+  }
+  fclose(fp);
+
+  return strstr(buf, "%%EOF") != NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct job *jobs;
+  int         num_threads, i, failed = 0;
+
+  if (argc < 4) {
+    fprintf(stderr, "Usage: %s threads pages font.ttf...\n", argv[0]);
+    return 2;
+  }
+  num_threads = atoi(argv[1]);
+  num_pages   = atoi(argv[2]);
+  font_names  = argv + 3;
+  num_fonts   = argc - 3 > MAX_FONTS ? MAX_FONTS : argc - 3;
+  if (num_threads < 1 || num_pages < 1) {
+    fprintf(stderr, "%s: threads and pages must be positive\n", argv[0]);
+    return 2;
+  }
+
+  texpdf_set_compression(9);
+  texpdf_init_fontmaps();
+
+  jobs = calloc(num_threads, sizeof(struct job));
+  for (i = 0; i < num_threads; i++) {
+    jobs[i].n = i;
+    sprintf(jobs[i].filename, "thread-stress-%d.pdf", i);
+    pthread_create(&jobs[i].thread, NULL, run_job, &jobs[i]);
+  }
+  for (i = 0; i < num_threads; i++)
+    pthread_join(jobs[i].thread, NULL);
+
+  for (i = 0; i < num_threads; i++) {
+    if (check_output(jobs[i].filename)) {
+      remove(jobs[i].filename);
+    } else {
+      fprintf(stderr, "%s: %s is incomplete\n", argv[0], jobs[i].filename);
+      failed = 1;
+    }
+  }
+  free(jobs);
+  texpdf_close_fontmaps();
+
+  printf("%d documents of %d pages on %d threads: %s\n",
+         num_threads, num_pages, num_threads, failed ? "FAILED" : "ok");
+
+  return failed;
+}
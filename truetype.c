@@ -504,17 +504,14 @@ composeuchar (long *unicodes, int n_unicodes,
               const char *feat, struct glyph_mapper *gm, USHORT *gid)
 {
   USHORT  *gids;
-  int      i, error = 0;
+  int      error = 0;
 
   if (!gm->codetogid)
     return  -1;
 
   gids = NEW(n_unicodes, USHORT);
-  for (i = 0;
-       !error && i < n_unicodes; i++) {
-    gids[i] = tt_cmap_lookup(gm->codetogid, unicodes[i]);
-    error   = (gids[i] == 0) ? -1 : 0;
-  }
+  if (tt_cmap_lookup_run(gm->codetogid, unicodes, gids, n_unicodes) < n_unicodes)
+    error = -1;
 
   if (!error)
     error = composeglyph(gids, n_unicodes, feat, gm, gid);
@@ -191,6 +191,7 @@ struct cmap4
   USHORT *idDelta;
   USHORT *idRangeOffset;
   USHORT *glyphIndexArray;
+  int     sorted; /* segments ascending and disjoint: binary search */
 };
 
 static struct cmap4 *
@@ -238,6 +239,15 @@ read_cmap4(sfnt *sfont, ULONG len)
       map->glyphIndexArray[i] = sfnt_get_ushort(sfont);
   }
 
+  map->sorted = 1;
+  for (i = 0; i < segCount; i++) {
+    if (map->startCount[i] > map->endCount[i] ||
+        (i > 0 && map->startCount[i] <= map->endCount[i-1])) {
+      map->sorted = 0;
+      break;
+    }
+  }
+
   return map;
 }
 
@@ -254,38 +264,71 @@ release_cmap4 (struct cmap4 *map)
   }
 }
 
+/* Glyph of cc in segment i, which must contain it */
 static USHORT
-lookup_cmap4 (struct cmap4 *map, USHORT cc)
+segment_cmap4 (struct cmap4 *map, USHORT i, USHORT cc)
 {
-  USHORT gid = 0;
-  USHORT i, j, segCount;
-
-  /*
-   * Segments are sorted in order of increasing endCode values.
-   * Last segment maps 0xffff to gid 0 (?)
-  */
-  i = segCount = map->segCountX2 / 2;
-  while (i-- > 0 &&  cc <= map->endCount[i]) {
-    if (cc >= map->startCount[i]) {
-      if (map->idRangeOffset[i] == 0) {
-	gid = (cc + map->idDelta[i]) & 0xffff;
-      } else if (cc == 0xffff && map->idRangeOffset[i] == 0xffff) {
-	/* this is for protection against some old broken fonts... */
-	gid = 0;
-      } else {
-	j  = map->idRangeOffset[i] - (segCount - i) * 2;
-	j  = (cc - map->startCount[i]) + (j / 2);
-	gid = map->glyphIndexArray[j];
-	if (gid != 0)
-	  gid = (gid + map->idDelta[i]) & 0xffff;
-      }
-      break;
-    }
+  USHORT gid, j, segCount = map->segCountX2 / 2;
+
+  if (map->idRangeOffset[i] == 0) {
+    gid = (cc + map->idDelta[i]) & 0xffff;
+  } else if (cc == 0xffff && map->idRangeOffset[i] == 0xffff) {
+    /* this is for protection against some old broken fonts... */
+    gid = 0;
+  } else {
+    j  = map->idRangeOffset[i] - (segCount - i) * 2;
+    j  = (cc - map->startCount[i]) + (j / 2);
+    gid = map->glyphIndexArray[j];
+    if (gid != 0)
+      gid = (gid + map->idDelta[i]) & 0xffff;
   }
 
   return gid;
 }
 
+/* seg holds the segment found by the previous call, or -1; text mostly
+ * stays within one segment, which is then not searched again.
+ */
+static USHORT
+lookup_cmap4 (struct cmap4 *map, USHORT cc, long *seg)
+{
+  USHORT i, segCount = map->segCountX2 / 2;
+  long   lo, hi;
+
+  if (*seg >= 0 &&
+      cc >= map->startCount[*seg] && cc <= map->endCount[*seg])
+    return segment_cmap4(map, *seg, cc);
+
+  if (!map->sorted) {
+    /*
+     * Segments should be sorted in order of increasing endCode values.
+     * Last segment maps 0xffff to gid 0 (?)
+     */
+    i = segCount;
+    while (i-- > 0 &&  cc <= map->endCount[i]) {
+      if (cc >= map->startCount[i])
+        return segment_cmap4(map, i, cc);
+    }
+    return 0;
+  }
+
+  /* First segment ending at or after cc */
+  lo = 0;
+  hi = segCount;
+  while (lo < hi) {
+    long mid = (lo + hi) / 2;
+    if (map->endCount[mid] < cc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == segCount || cc < map->startCount[lo])
+    return 0;
+
+  *seg = lo;
+  return segment_cmap4(map, lo, cc);
+}
+
 /* format 6: trimmed table mapping */
 struct cmap6
 {
@@ -358,6 +401,7 @@ struct cmap12
 {
   ULONG  nGroups;
   struct charGroup *groups;
+  int    sorted; /* groups ascending and disjoint: binary search */
 };
 
 /* ULONG length */
@@ -380,6 +424,16 @@ read_cmap12 (sfnt *sfont, ULONG len)
     map->groups[i].startGlyphID  = sfnt_get_ulong(sfont);
   }
 
+  map->sorted = 1;
+  for (i = 0; i < map->nGroups; i++) {
+    if (map->groups[i].startCharCode > map->groups[i].endCharCode ||
+        (i > 0 &&
+         map->groups[i].startCharCode <= map->groups[i-1].endCharCode)) {
+      map->sorted = 0;
+      break;
+    }
+  }
+
   return map;
 }
 
@@ -393,27 +447,54 @@ release_cmap12 (struct cmap12 *map)
   }
 }
 
+#define GROUP_GID(g,c) \
+  ((USHORT) (((c) - (g)->startCharCode + (g)->startGlyphID) & 0xffff))
+
+/* seg as for lookup_cmap4() */
 static USHORT
-lookup_cmap12 (struct cmap12 *map, ULONG cccc)
+lookup_cmap12 (struct cmap12 *map, ULONG cccc, long *seg)
 {
-  USHORT gid = 0;
-  int i;
-
-  i = map->nGroups;
-  while (i-- >= 0 &&
-	 cccc <= map->groups[i].endCharCode) {
-    if (cccc >= map->groups[i].startCharCode) {
-      gid = (USHORT) ((cccc -
-		       map->groups[i].startCharCode +
-		       map->groups[i].startGlyphID) & 0xffff);
-      break;
+  struct charGroup *groups = map->groups;
+  long   i, lo, hi;
+
+  if (*seg >= 0 &&
+      cccc >= groups[*seg].startCharCode && cccc <= groups[*seg].endCharCode)
+    return GROUP_GID(&groups[*seg], cccc);
+
+  if (!map->sorted) {
+    i = map->nGroups;
+    while (i-- > 0 &&
+	   cccc <= groups[i].endCharCode) {
+      if (cccc >= groups[i].startCharCode)
+        return GROUP_GID(&groups[i], cccc);
     }
+    return 0;
   }
 
-  return gid;
+  /* First group ending at or after cccc */
+  lo = 0;
+  hi = map->nGroups;
+  while (lo < hi) {
+    long mid = lo + (hi - lo) / 2;
+    if (groups[mid].endCharCode < cccc)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == map->nGroups || cccc < groups[lo].startCharCode)
+    return 0;
+
+  *seg = lo;
+  return GROUP_GID(&groups[lo], cccc);
 }
 
-/* read cmap */
+static void tt_cmap_free (void *cmap);
+
+/* read cmap
+ *
+ * Subtables parsed from a file held in the font cache are kept there
+ * and shared; tt_cmap_release() gives them back.
+ */
 tt_cmap *
 tt_cmap_read (sfnt *sfont, USHORT platform, USHORT encoding)
 {
@@ -421,6 +502,7 @@ tt_cmap_read (sfnt *sfont, USHORT platform, USHORT encoding)
   ULONG    offset, length = 0;
   USHORT   p_id, e_id;
   USHORT   i, n_subtabs;
+  unsigned long key = ((unsigned long) platform << 16) | encoding;
 
   ASSERT(sfont);
 
@@ -442,10 +524,15 @@ tt_cmap_read (sfnt *sfont, USHORT platform, USHORT encoding)
   if (i == n_subtabs)
     return NULL;
 
+  cmap = font_cache_find_table(sfont->file, "cmap", offset, key);
+  if (cmap)
+    return cmap;
+
   cmap = NEW(1, tt_cmap);
   cmap->map      = NULL;
   cmap->platform = platform;
   cmap->encoding = encoding;
+  cmap->file     = NULL;
 
   sfnt_seek_set(sfont, offset);
   cmap->format = sfnt_get_ushort(sfont);
@@ -491,7 +578,13 @@ tt_cmap_read (sfnt *sfont, USHORT platform, USHORT encoding)
 
   if (!cmap->map) {
     tt_cmap_release(cmap);
-    cmap = NULL;
+    return NULL;
+  }
+
+  if (sfont->file) {
+    cmap->file = sfont->file;
+    cmap = font_cache_add_table(sfont->file, "cmap", offset, key,
+                                cmap, length, tt_cmap_free);
   }
 
   return cmap;
@@ -500,6 +593,16 @@ tt_cmap_read (sfnt *sfont, USHORT platform, USHORT encoding)
 void
 tt_cmap_release (tt_cmap *cmap)
 {
+  if (cmap && cmap->file)
+    font_cache_release(cmap->file);
+  else
+    tt_cmap_free(cmap);
+}
+
+static void
+tt_cmap_free (void *data)
+{
+  tt_cmap *cmap = data;
 
   if (cmap) {
     if (cmap->map) {
@@ -530,13 +633,11 @@ tt_cmap_release (tt_cmap *cmap)
 }
 
 
-USHORT
-tt_cmap_lookup (tt_cmap *cmap, long cc)
+static USHORT
+cmap_lookup (tt_cmap *cmap, long cc, long *seg)
 {
   USHORT gid = 0;
 
-  ASSERT(cmap);
-
   if (cc > 0xffffL && cmap->format < 12) {
     WARN("Four bytes charcode not supported in OpenType/TrueType cmap format 0...6.");
     return 0;
@@ -550,13 +651,13 @@ tt_cmap_lookup (tt_cmap *cmap, long cc)
     gid = lookup_cmap2(cmap->map,  (USHORT) cc);
     break;
   case 4:
-    gid = lookup_cmap4(cmap->map,  (USHORT) cc);
+    gid = lookup_cmap4(cmap->map,  (USHORT) cc, seg);
     break;
   case 6:
     gid = lookup_cmap6(cmap->map,  (USHORT) cc);
     break;
   case 12:
-    gid = lookup_cmap12(cmap->map, (ULONG) cc);
+    gid = lookup_cmap12(cmap->map, (ULONG) cc, seg);
     break;
   default:
     ERROR("Unrecognized OpenType/TrueType cmap subtable format");
@@ -566,12 +667,38 @@ tt_cmap_lookup (tt_cmap *cmap, long cc)
   return gid;
 }
 
+USHORT
+tt_cmap_lookup (tt_cmap *cmap, long cc)
+{
+  long seg = -1;
+
+  ASSERT(cmap);
+
+  return cmap_lookup(cmap, cc, &seg);
+}
+
+long
+tt_cmap_lookup_run (tt_cmap *cmap, const long *codes, USHORT *gids, long n)
+{
+  long seg = -1, i, count = 0;
+
+  ASSERT(cmap);
+
+  for (i = 0; i < n; i++) {
+    gids[i] = cmap_lookup(cmap, codes[i], &seg);
+    if (gids[i] != 0)
+      count++;
+  }
+
+  return count;
+}
+
 /* Sorry for placing this here.
  * We need to rewrite TrueType font support code...
  */
 
 #define WBUF_SIZE 1024
-static unsigned char wbuf[WBUF_SIZE];
+static DPX_THREAD_LOCAL unsigned char wbuf[WBUF_SIZE];
 
 static unsigned char srange_min[2] = {0x00, 0x00};
 static unsigned char srange_max[2] = {0xff, 0xff};
@@ -33,6 +33,7 @@ typedef struct
   USHORT encoding;
   ULONG  language; /* or version, only for Mac */
   void  *map;
+  struct font_file *file; /* holding it in the font cache, or NULL */
 } tt_cmap;
 
 /* Paltform ID */
@@ -61,6 +62,11 @@ typedef struct
 extern tt_cmap *tt_cmap_read    (sfnt *sfont, USHORT platform, USHORT encoding);
 
 extern USHORT   tt_cmap_lookup  (tt_cmap *cmap, long cc);
+/* Looks up n codes at once, faster for runs of text than one call
+ * per code. Returns how many of them have a glyph.
+ */
+extern long     tt_cmap_lookup_run (tt_cmap *cmap, const long *codes,
+                                    USHORT *gids, long n);
 extern void     tt_cmap_release (tt_cmap *cmap);
 
 #include "pdfobj.h"
@@ -33,15 +33,34 @@ static USHORT
 find_empty_slot (struct tt_glyphs *g)
 {
   USHORT gid;
+  long   i;
+  unsigned char c;
 
   ASSERT(g);
 
-  for (gid = 0; gid < NUM_GLYPH_LIMIT; gid++) {
-    if (!(g->used_slot[gid/8] & (1 << (7 - (gid % 8)))))
+  /* Slots are never freed, so everything below free_slot stays in use.
+   * Skip whole words of used slots, then find the bit in the first byte
+   * that has one clear.
+   */
+  i = g->free_slot / 8;
+  while (i + 8 <= 8192) {
+    uint64_t word;
+    memcpy(&word, g->used_slot + i, 8);
+    if (word != ~(uint64_t) 0)
       break;
+    i += 8;
+  }
+  while (i < 8192 && g->used_slot[i] == 0xff)
+    i++;
+  gid = NUM_GLYPH_LIMIT;
+  if (i < 8192) {
+    c = g->used_slot[i];
+    for (gid = i * 8; c & 0x80; c <<= 1)
+      gid++;
   }
-  if (gid == NUM_GLYPH_LIMIT)
+  if (gid >= NUM_GLYPH_LIMIT)
     ERROR("No empty glyph slot available.");
+  g->free_slot = gid;
 
   return gid;
 }
@@ -49,35 +68,17 @@ find_empty_slot (struct tt_glyphs *g)
 USHORT
 tt_find_glyph (struct tt_glyphs *g, USHORT gid)
 {
-  USHORT idx, new_gid = 0;
-
   ASSERT(g);
 
-  for (idx = 0; idx < g->num_glyphs; idx++) {
-    if (gid == g->gd[idx].ogid) {
-      new_gid = g->gd[idx].gid;
-      break;
-    }
-  }
-
-  return new_gid;
+  return g->gid_map[gid];
 }
 
 USHORT
 tt_get_index (struct tt_glyphs *g, USHORT gid)
 {
-  USHORT idx;
-
   ASSERT(g);
 
-  for (idx = 0; idx < g->num_glyphs; idx++) {
-    if (gid == g->gd[idx].gid)
-      break;
-  }
-  if (idx == g->num_glyphs)
-    idx = 0;
-
-  return idx;
+  return g->gid_index[gid];
 }
 
 USHORT
@@ -100,6 +101,9 @@ tt_add_glyph (struct tt_glyphs *g, USHORT gid, USHORT new_gid)
     g->gd[g->num_glyphs].length = 0;
     g->gd[g->num_glyphs].data   = NULL;
     g->used_slot[new_gid/8] |= (1 << (7 - (new_gid % 8)));
+    if (gid != 0 && !g->gid_map[gid])
+      g->gid_map[gid] = new_gid;
+    g->gid_index[new_gid] = g->num_glyphs;
     g->num_glyphs += 1;
   }
 
@@ -129,6 +133,11 @@ tt_build_init (void)
   g->gd = NULL;
   g->used_slot = NEW(8192, unsigned char);
   memset(g->used_slot, 0, 8192);
+  g->gid_map   = NEW(65536, USHORT);
+  memset(g->gid_map, 0, 65536 * sizeof(USHORT));
+  g->gid_index = NEW(65536, USHORT);
+  memset(g->gid_index, 0, 65536 * sizeof(USHORT));
+  g->free_slot = 0;
   tt_add_glyph(g, 0, 0);
 
   return g;
@@ -148,6 +157,10 @@ tt_build_finish (struct tt_glyphs *g)
     }
     if (g->used_slot)
       RELEASE(g->used_slot);
+    if (g->gid_map)
+      RELEASE(g->gid_map);
+    if (g->gid_index)
+      RELEASE(g->gid_index);
     RELEASE(g);
   }
 }
@@ -251,17 +264,7 @@ tt_build_tables (sfnt *sfont, struct tt_glyphs *g)
     vmtx = NULL;
   }
 
-  sfnt_locate_table(sfont, "loca");
-  location = NEW(maxp->numGlyphs + 1, ULONG);
-  if (head->indexToLocFormat == 0) {
-    for (i = 0; i <= maxp->numGlyphs; i++)
-      location[i] = 2*((ULONG) sfnt_get_ushort(sfont));
-  } else if (head->indexToLocFormat == 1) {
-    for (i = 0; i <= maxp->numGlyphs; i++)
-      location[i] = sfnt_get_ulong(sfont);
-  } else {
-    ERROR("Unknown IndexToLocFormat.");
-  }
+  location = tt_read_loca_table(sfont, maxp->numGlyphs, head->indexToLocFormat);
 
   w_stat = NEW(g->emsize+2, USHORT);
   memset(w_stat, 0, sizeof(USHORT)*(g->emsize+2));
@@ -378,10 +381,9 @@ tt_build_tables (sfnt *sfont, struct tt_glyphs *g)
        */
     }
   }
-  RELEASE(location);
-  RELEASE(hmtx);
-  if (vmtx)
-    RELEASE(vmtx);
+  tt_release_table(sfont, location);
+  tt_release_table(sfont, hmtx);
+  tt_release_table(sfont, vmtx);
 
   {
     int max_count = -1;
@@ -397,6 +399,13 @@ tt_build_tables (sfnt *sfont, struct tt_glyphs *g)
   RELEASE(w_stat);
 
   qsort(g->gd, g->num_glyphs, sizeof(struct tt_glyph_desc), glyf_cmp);
+  /* The maps must follow the new order; tt_find_glyph() returned the
+   * first match in gd, so let the lowest index win.
+   */
+  for (i = g->num_glyphs - 1; i >= 0; i--) {
+    g->gid_map[g->gd[i].ogid]  = g->gd[i].gid;
+    g->gid_index[g->gd[i].gid] = i;
+  }
   {
     USHORT prev, last_advw;
     char  *p, *q;
@@ -554,17 +563,7 @@ tt_get_metrics (sfnt *sfont, struct tt_glyphs *g)
     vmtx = NULL;
   }
 
-  sfnt_locate_table(sfont, "loca");
-  location = NEW(maxp->numGlyphs + 1, ULONG);
-  if (head->indexToLocFormat == 0) {
-    for (i = 0; i <= maxp->numGlyphs; i++)
-      location[i] = 2*((ULONG) sfnt_get_ushort(sfont));
-  } else if (head->indexToLocFormat == 1) {
-    for (i = 0; i <= maxp->numGlyphs; i++)
-      location[i] = sfnt_get_ulong(sfont);
-  } else {
-    ERROR("Unknown IndexToLocFormat.");
-  }
+  location = tt_read_loca_table(sfont, maxp->numGlyphs, head->indexToLocFormat);
 
   w_stat = NEW(g->emsize+2, USHORT);
   memset(w_stat, 0, sizeof(USHORT)*(g->emsize+2));
@@ -620,15 +619,14 @@ tt_get_metrics (sfnt *sfont, struct tt_glyphs *g)
       g->gd[i].tsb = g->default_advh - g->default_tsb - g->gd[i].ury;
 #endif
   }
-  RELEASE(location);
-  RELEASE(hmtx);
+  tt_release_table(sfont, location);
+  tt_release_table(sfont, hmtx);
   RELEASE(maxp);
   RELEASE(hhea);
   RELEASE(head);
   RELEASE(os2);
 
-  if (vmtx)
-    RELEASE(vmtx);
+  tt_release_table(sfont, vmtx);
 
   {
     int max_count = -1;
@@ -43,6 +43,9 @@ struct tt_glyphs
   SHORT  default_tsb;  /* default value */
   struct tt_glyph_desc *gd;
   unsigned char *used_slot;
+  USHORT *gid_map;     /* original GID -> new GID, 0 if not added */
+  USHORT *gid_index;   /* new GID -> index in gd */
+  USHORT  free_slot;   /* no empty slot below this one */
 };
 
 extern struct tt_glyphs *tt_build_init (void);
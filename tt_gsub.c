@@ -177,6 +177,12 @@ struct clt_coverage
   struct clt_range *range; /* Array of glyph ranges
                             *  - ordered by Start GlyphID
                             */
+
+  /* Prepared by clt_read_coverage() */
+  GlyphID  first, last; /* no glyph outside is covered */
+  int      sorted;      /* ascending and disjoint: binary search */
+  USHORT  *index;       /* coverage index + 1 of first..last, 0 if
+                         * not covered; NULL unless dense enough */
 };
 
 /* GSUB - The Glyph Substitution Table */
@@ -384,6 +390,66 @@ clt_release_lookup_table (struct clt_lookup_table *tab)
     clt_release_number_list(&tab->SubTableList);
 }
 
+/* A direct index is built when it takes at most this many entries per
+ * covered glyph, to keep large sparse coverages out of memory.
+ */
+#define COVERAGE_DENSITY 8
+
+static void
+clt_prepare_coverage (struct clt_coverage *cov)
+{
+  long i, n, span, covered = 0;
+
+  cov->first  = 0xffff;
+  cov->last   = 0;
+  cov->sorted = 1;
+  cov->index  = NULL;
+
+  for (i = 0; i < cov->count; i++) {
+    GlyphID lo, hi;
+    if (cov->format == 1)
+      lo = hi = cov->list[i];
+    else {
+      lo = cov->range[i].Start;
+      hi = cov->range[i].End;
+      if (lo > hi) {
+        cov->sorted = 0;
+        continue;
+      }
+    }
+    if (i > 0 && lo <= cov->last)
+      cov->sorted = 0;
+    if (lo < cov->first) cov->first = lo;
+    if (hi > cov->last)  cov->last  = hi;
+    covered += hi - lo + 1;
+  }
+  if (covered == 0 || !cov->sorted)
+    return;
+
+  span = cov->last - cov->first + 1;
+  if (span > COVERAGE_DENSITY * covered + 64)
+    return;
+  if (cov->format == 2) {
+    for (i = 0; i < cov->count; i++) {
+      if (cov->range[i].StartCoverageIndex +
+          cov->range[i].End - cov->range[i].Start >= 0xffff)
+        return;
+    }
+  }
+
+  cov->index = NEW(span, USHORT);
+  memset(cov->index, 0, span * sizeof(USHORT));
+  for (i = 0; i < cov->count; i++) {
+    if (cov->format == 1)
+      cov->index[cov->list[i] - cov->first] = i + 1;
+    else {
+      struct clt_range *r = &cov->range[i];
+      for (n = 0; n <= r->End - r->Start; n++)
+        cov->index[r->Start - cov->first + n] = r->StartCoverageIndex + n + 1;
+    }
+  }
+}
+
 static long
 clt_read_coverage (struct clt_coverage *cov, sfnt *sfont)
 {
@@ -422,6 +488,7 @@ clt_read_coverage (struct clt_coverage *cov, sfnt *sfont)
   default:
     ERROR("Unknown coverage format");
   }
+  clt_prepare_coverage(cov);
 
   return len;
 }
@@ -444,6 +511,9 @@ clt_release_coverage (struct clt_coverage *cov)
     default:
       ERROR("Unknown coverage format");
     }
+    if (cov->index)
+      RELEASE(cov->index);
+    cov->index = NULL;
   }
   cov->count = 0;
 }
@@ -452,10 +522,44 @@ clt_release_coverage (struct clt_coverage *cov)
 static long
 clt_lookup_coverage (struct clt_coverage *cov, USHORT gid)
 {
-  long i;
+  long i, lo, hi;
 
   ASSERT(cov);
 
+  /* Most subtables do not cover most glyphs. */
+  if (gid < cov->first || gid > cov->last)
+    return -1;
+  if (cov->index)
+    return (long) cov->index[gid - cov->first] - 1;
+
+  if (cov->sorted) {
+    lo = 0;
+    hi = cov->count;
+    if (cov->format == 1) {
+      while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (cov->list[mid] < gid)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      if (lo < cov->count && cov->list[lo] == gid)
+        return lo;
+    } else {
+      while (lo < hi) {
+        long mid = (lo + hi) / 2;
+        if (cov->range[mid].End < gid)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+      if (lo < cov->count && gid >= cov->range[lo].Start)
+        return (cov->range[lo].StartCoverageIndex +
+                gid - cov->range[lo].Start);
+    }
+    return -1;
+  }
+
   switch (cov->format) {
   case 1: /* list */
     for (i = 0; i < cov->count; i++) {
@@ -492,7 +596,7 @@ otl_gsub_read_single (struct otl_gsub_subtab *subtab, sfnt *sfont)
 
   ASSERT(subtab && sfont);
 
-  offset = tell_position(sfont->stream);
+  offset = sfnt_tell(sfont);
 
   subtab->LookupType  = OTL_GSUB_TYPE_SINGLE;
   subtab->SubstFormat = sfnt_get_ushort(sfont);
@@ -551,7 +655,7 @@ otl_gsub_read_alternate (struct otl_gsub_subtab *subtab, sfnt *sfont)
 
   ASSERT(subtab && sfont);
 
-  offset = tell_position(sfont->stream);
+  offset = sfnt_tell(sfont);
 
   subtab->LookupType  = OTL_GSUB_TYPE_ALTERNATE;
   subtab->SubstFormat = sfnt_get_ushort(sfont); /* Must be 1 */
@@ -618,7 +722,7 @@ otl_gsub_read_ligature (struct otl_gsub_subtab *subtab, sfnt *sfont)
 
   ASSERT(subtab && sfont);
 
-  offset = tell_position(sfont->stream);
+  offset = sfnt_tell(sfont);
 
   subtab->LookupType  = OTL_GSUB_TYPE_LIGATURE;
   subtab->SubstFormat = sfnt_get_ushort(sfont); /* Must be 1 */
@@ -302,6 +302,12 @@ tt_read_VORG_table (sfnt *sfont)
   return vorg;
 }
 
+static void
+table_free (void *table)
+{
+  RELEASE(table);
+}
+
 /*
  * hmtx and vmtx
  *
@@ -314,6 +320,12 @@ tt_read_longMetrics (sfnt *sfont, USHORT numGlyphs, USHORT numLongMetrics, USHOR
   struct tt_longMetrics *m;
   USHORT gid, last_adv = 0;
   SHORT  last_esb = 0;
+  ULONG  offset = sfnt_tell(sfont);
+  unsigned long key = ((unsigned long) numGlyphs << 16) | numLongMetrics;
+
+  m = font_cache_find_table(sfont->file, "hmtx", offset, key);
+  if (m)
+    return m;
 
   m = NEW(numGlyphs, struct tt_longMetrics);
   for (gid = 0; gid < numGlyphs; gid++) {
@@ -324,10 +336,60 @@ tt_read_longMetrics (sfnt *sfont, USHORT numGlyphs, USHORT numLongMetrics, USHOR
     m[gid].advance     = last_adv;
     m[gid].sideBearing = last_esb;
   }
+  if (sfont->file && m)
+    m = font_cache_add_table(sfont->file, "hmtx", offset, key, m,
+                             numGlyphs * sizeof(struct tt_longMetrics),
+                             table_free);
 
   return m;
 }
 
+/* loca, as numGlyphs + 1 offsets into glyf */
+ULONG *
+tt_read_loca_table (sfnt *sfont, USHORT numGlyphs, SHORT indexToLocFormat)
+{
+  ULONG *location;
+  ULONG  offset;
+  long   i;
+  unsigned long key = ((unsigned long) numGlyphs << 1) | (indexToLocFormat & 1);
+
+  offset   = sfnt_locate_table(sfont, "loca");
+  location = font_cache_find_table(sfont->file, "loca", offset, key);
+  if (location)
+    return location;
+
+  location = NEW(numGlyphs + 1, ULONG);
+  if (indexToLocFormat == 0) {
+    for (i = 0; i <= numGlyphs; i++)
+      location[i] = 2*((ULONG) sfnt_get_ushort(sfont));
+  } else if (indexToLocFormat == 1) {
+    for (i = 0; i <= numGlyphs; i++)
+      location[i] = sfnt_get_ulong(sfont);
+  } else {
+    ERROR("Unknown IndexToLocFormat.");
+  }
+  if (sfont->file)
+    location = font_cache_add_table(sfont->file, "loca", offset, key, location,
+                                    (numGlyphs + 1) * sizeof(ULONG),
+                                    table_free);
+
+  return location;
+}
+
+/* Tables read from a file held in the font cache stay there, shared by
+ * every font using it; the others are freed.
+ */
+void
+tt_release_table (sfnt *sfont, void *table)
+{
+  if (!table)
+    return;
+  if (sfont->file)
+    font_cache_release(sfont->file);
+  else
+    RELEASE(table);
+}
+
 /* OS/2 table */
 /* this table may not exist */
 struct tt_os2__table *
@@ -185,6 +185,16 @@ extern struct tt_VORG_table *tt_read_VORG_table (sfnt *sfont);
 extern struct tt_longMetrics *tt_read_longMetrics (sfnt *sfont,
 						   USHORT numGlyphs, USHORT numLongMetrics, USHORT numExSideBearings);
 
+/* loca */
+extern ULONG *tt_read_loca_table (sfnt *sfont,
+				  USHORT numGlyphs, SHORT indexToLocFormat);
+
+/* Tables from tt_read_longMetrics() and tt_read_loca_table() may be
+ * shared through the font cache: they must not be changed, and are
+ * given back with tt_release_table().
+ */
+extern void   tt_release_table (sfnt *sfont, void *table);
+
 /* OS/2 table */
 extern struct tt_os2__table *tt_read_os2__table (sfnt *sfont);
 
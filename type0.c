@@ -286,6 +286,14 @@ Type0Font_get_wmode (Type0Font *font)
   return font->wmode;
 }
 
+void *
+Type0Font_get_cff_charsets (Type0Font *font)
+{
+  ASSERT(font);
+
+  return font->descendant ? CIDFont_get_cff_charsets(font->descendant) : NULL;
+}
+
 #if 0
 char *
 Type0Font_get_encoding (Type0Font *font)
@@ -327,28 +335,44 @@ Type0Font_get_resource (Type0Font *font)
 /******************************** CACHE ********************************/
 
 #define CHECK_ID(n) do {\
-  if ((n) < 0 || (n) >= __cache.count)\
+  if ((n) < 0 || (n) >= __cache->count)\
     ERROR("%s: Invalid ID %d", TYPE0FONT_DEBUG_STR, (n));\
 } while (0)
 
 #define CACHE_ALLOC_SIZE 16u
 
-static struct font_cache {
+struct Type0Font_cache {
   int        count;
   int        capacity;
   Type0Font *fonts;
-} __cache = {
-  0, 0, NULL
+
+  struct FontCache *cidfonts; /* their descendants */
 };
 
-void
+/* Type0 fonts of the document selected on this thread, see
+ * texpdf_init_fonts()
+ */
+static DPX_THREAD_LOCAL struct Type0Font_cache *__cache = NULL;
+
+struct Type0Font_cache *
 Type0Font_cache_init (void)
 {
-  if (__cache.fonts)
-    ERROR("%s: Already initialized.", TYPE0FONT_DEBUG_STR);
-  __cache.count    = 0;
-  __cache.capacity = 0;
-  __cache.fonts    = NULL;
+  struct Type0Font_cache *cache = NEW(1, struct Type0Font_cache);
+
+  cache->count    = 0;
+  cache->capacity = 0;
+  cache->fonts    = NULL;
+  cache->cidfonts = CIDFont_cache_init();
+  Type0Font_cache_select(cache);
+
+  return cache;
+}
+
+void
+Type0Font_cache_select (struct Type0Font_cache *cache)
+{
+  __cache = cache;
+  CIDFont_cache_select(cache ? cache->cidfonts : NULL);
 }
 
 Type0Font *
@@ -356,7 +380,7 @@ Type0Font_cache_get (int id)
 {
   CHECK_ID(id);
 
-  return &__cache.fonts[id];
+  return &__cache->fonts[id];
 }
 
 int
@@ -411,12 +435,12 @@ Type0Font_cache_find (const char *map_name, int cmap_id, fontmap_opt *fmap_opt)
    * wmode. Create new Type0 font.
    */
 
-  if (__cache.count >= __cache.capacity) {
-    __cache.capacity += CACHE_ALLOC_SIZE;
-    __cache.fonts     = RENEW(__cache.fonts, __cache.capacity, struct Type0Font);
+  if (__cache->count >= __cache->capacity) {
+    __cache->capacity += CACHE_ALLOC_SIZE;
+    __cache->fonts     = RENEW(__cache->fonts, __cache->capacity, struct Type0Font);
   }
-  font_id =  __cache.count;
-  font    = &__cache.fonts[font_id];
+  font_id =  __cache->count;
+  font    = &__cache->fonts[font_id];
 
   Type0Font_init_font_struct(font);
 
@@ -519,7 +543,7 @@ Type0Font_cache_find (const char *map_name, int cmap_id, fontmap_opt *fmap_opt)
   texpdf_add_dict(font->fontdict,
                texpdf_new_name("Encoding"), texpdf_new_name(font->encoding));
 
-  __cache.count++;
+  __cache->count++;
 
   return font_id;
 }
@@ -535,21 +559,23 @@ Type0Font_cache_close (void)
    * CIDFont_cache_close() before Type0Font_release because of used_chars.
    * ToUnicode support want descendant CIDFont's CSI and fontname.
    */
-  if (__cache.fonts) {
-    for (font_id = 0; font_id < __cache.count; font_id++)
-      Type0Font_dofont(&__cache.fonts[font_id]);
+  if (!__cache)
+    return;
+
+  if (__cache->fonts) {
+    for (font_id = 0; font_id < __cache->count; font_id++)
+      Type0Font_dofont(&__cache->fonts[font_id]);
   }
   CIDFont_cache_close();
-  if (__cache.fonts) {
-    for (font_id = 0; font_id < __cache.count; font_id++) {
-      Type0Font_flush(&__cache.fonts[font_id]);
-      Type0Font_clean(&__cache.fonts[font_id]);
+  if (__cache->fonts) {
+    for (font_id = 0; font_id < __cache->count; font_id++) {
+      Type0Font_flush(&__cache->fonts[font_id]);
+      Type0Font_clean(&__cache->fonts[font_id]);
     }
-    RELEASE(__cache.fonts);
+    RELEASE(__cache->fonts);
   }
-  __cache.fonts    = NULL;
-  __cache.count    = 0;
-  __cache.capacity = 0;
+  RELEASE(__cache);
+  Type0Font_cache_select(NULL);
 }
 
 /******************************** COMPAT ********************************/
@@ -31,6 +31,7 @@ typedef struct Type0Font Type0Font;
 extern void       Type0Font_set_verbose (void);
 
 extern int        Type0Font_get_wmode     (Type0Font *font);
+extern void      *Type0Font_get_cff_charsets (Type0Font *font);
 #if 0
 extern char      *Type0Font_get_encoding  (Type0Font *font);
 #endif
@@ -44,7 +45,8 @@ extern void       Type0Font_set_ToUnicode (Type0Font *font, pdf_obj *cmap_ref);
 
 /******************************** CACHE ********************************/
 
-extern void       Type0Font_cache_init  (void);
+extern struct Type0Font_cache *Type0Font_cache_init (void);
+extern void       Type0Font_cache_select (struct Type0Font_cache *cache);
 extern Type0Font *Type0Font_cache_get   (int id);
 extern int        Type0Font_cache_find  (const char *map_name, int cmap_id, fontmap_opt *fmap_opt);
 extern void       Type0Font_cache_close (void);